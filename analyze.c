@@ -0,0 +1,402 @@
+// 324CC Stefan CALMAC
+#define _GNU_SOURCE
+#include "analyze.h"
+#include "trace.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNELS 1
+#endif
+
+#define LANE_FLUSH (1u << 24)   /* vector iterations before int32 lanes flush */
+
+bool analyze_force_scalar = false;
+
+static int use_avx2 = -1;   /* -1 until the CPU has been probed */
+
+static bool avx2_enabled(void) {
+    if (use_avx2 < 0) {
+#ifdef HAVE_AVX2_KERNELS
+        __builtin_cpu_init();
+        use_avx2 = !analyze_force_scalar && __builtin_cpu_supports("avx2");
+#else
+        use_avx2 = 0;
+#endif
+    }
+    return use_avx2;
+}
+
+const char *analyze_engine(void) {
+    return avx2_enabled() ? "avx2" : "scalar";
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Scalar loops                                 */
+/* -------------------------------------------------------------------------- */
+
+static int rating_bin(float v) {
+    return v <= 0.0f ? 0 : v >= ANALYZE_RATING_BINS - 1
+                           ? ANALYZE_RATING_BINS - 1 : (int)v;
+}
+
+static void ratings_scalar(const float *r, size_t n, size_t from,
+                           struct rating_summary *out) {
+    for (size_t i = from; i < n; i++) {
+        float v = r[i];
+        if (isnan(v))
+            continue;
+        out->bins[rating_bin(v)]++;
+        out->rated++;
+        out->sum += v;
+    }
+}
+
+static void year_range_scalar(const int32_t *year, size_t n, size_t from,
+                              int32_t *ymin, int32_t *ymax) {
+    for (size_t i = from; i < n; i++) {
+        int32_t y = year[i];
+        if (y > 0) {
+            *ymin = y < *ymin ? y : *ymin;
+            *ymax = y > *ymax ? y : *ymax;
+        }
+    }
+}
+
+/* Orders top-N candidates: better = higher rating, then lower id */
+static bool better(const struct catalog *cat, size_t a, size_t b) {
+    float ra = cat->rating[a], rb = cat->rating[b];
+    if (ra != rb)
+        return ra > rb;
+    return cat->movie_id[a] < cat->movie_id[b];
+}
+
+/**
+ * Offer row i to a min-heap (worst kept entry at the root) of capacity k.
+ */
+static void top_offer(const struct catalog *cat, struct top_entry *heap,
+                      size_t *len, size_t k, size_t i) {
+    size_t pos;
+    if (*len < k) {
+        pos = (*len)++;
+        while (pos > 0 && better(cat, heap[(pos - 1) / 2].row, i)) {
+            heap[pos] = heap[(pos - 1) / 2];
+            pos = (pos - 1) / 2;
+        }
+    } else {
+        if (!better(cat, i, heap[0].row))
+            return;
+        pos = 0;
+        for (;;) {
+            size_t c = 2 * pos + 1;
+            if (c >= k)
+                break;
+            if (c + 1 < k && better(cat, heap[c].row, heap[c + 1].row))
+                c++;
+            if (!better(cat, i, heap[c].row))
+                break;
+            heap[pos] = heap[c];
+            pos = c;
+        }
+    }
+    heap[pos] = (struct top_entry){ i, cat->rating[i] };
+}
+
+static void top_scalar(const struct catalog *cat, struct top_entry *heap,
+                       size_t *len, size_t k, size_t from) {
+    for (size_t i = from; i < cat->n_movies; i++)
+        if (!isnan(cat->rating[i]))
+            top_offer(cat, heap, len, k, i);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                AVX2 loops                                  */
+/* -------------------------------------------------------------------------- */
+
+#ifdef HAVE_AVX2_KERNELS
+
+static uint64_t hsum_epi32(__m256i v) __attribute__((target("avx2")));
+static uint64_t hsum_epi32(__m256i v) {
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, v);
+    uint64_t s = 0;
+    for (int i = 0; i < 8; i++)
+        s += lanes[i];
+    return s;
+}
+
+/**
+ * Eight ratings per step: NaN lanes are masked out, the bin index is the
+ * clamped, truncated rating, and each bin counter subtracts the all-ones
+ * compare mask. Lane counters are int32, so they are flushed periodically.
+ */
+__attribute__((target("avx2")))
+static void ratings_avx2(const float *r, size_t n, struct rating_summary *out) {
+    const __m256 lo = _mm256_setzero_ps();
+    const __m256 hi = _mm256_set1_ps(ANALYZE_RATING_BINS - 1);
+    __m256d sum_lo = _mm256_setzero_pd(), sum_hi = _mm256_setzero_pd();
+    size_t i = 0;
+
+    while (n - i >= 8) {
+        __m256i cnt[ANALYZE_RATING_BINS];
+        __m256i rated = _mm256_setzero_si256();
+        for (int b = 0; b < ANALYZE_RATING_BINS; b++)
+            cnt[b] = _mm256_setzero_si256();
+
+        for (size_t steps = 0; n - i >= 8 && steps < LANE_FLUSH;
+             i += 8, steps++) {
+            __m256  v   = _mm256_loadu_ps(r + i);
+            __m256  ord = _mm256_cmp_ps(v, v, _CMP_ORD_Q);
+            __m256  vz  = _mm256_and_ps(v, ord);
+            __m256i ok  = _mm256_castps_si256(ord);
+
+            sum_lo = _mm256_add_pd(sum_lo,
+                        _mm256_cvtps_pd(_mm256_castps256_ps128(vz)));
+            sum_hi = _mm256_add_pd(sum_hi,
+                        _mm256_cvtps_pd(_mm256_extractf128_ps(vz, 1)));
+
+            __m256i bin = _mm256_cvttps_epi32(
+                _mm256_min_ps(_mm256_max_ps(vz, lo), hi));
+            rated = _mm256_sub_epi32(rated, ok);
+            for (int b = 0; b < ANALYZE_RATING_BINS; b++) {
+                __m256i eq = _mm256_cmpeq_epi32(bin, _mm256_set1_epi32(b));
+                cnt[b] = _mm256_sub_epi32(cnt[b], _mm256_and_si256(eq, ok));
+            }
+        }
+
+        for (int b = 0; b < ANALYZE_RATING_BINS; b++)
+            out->bins[b] += hsum_epi32(cnt[b]);
+        out->rated += hsum_epi32(rated);
+    }
+
+    double s[8];
+    _mm256_storeu_pd(s, sum_lo);
+    _mm256_storeu_pd(s + 4, sum_hi);
+    for (int k = 0; k < 8; k++)
+        out->sum += s[k];
+
+    ratings_scalar(r, n, i, out);
+}
+
+/**
+ * Running min/max over eight years per step; unknown years (<= 0) are
+ * replaced by the neutral element before each min/max.
+ */
+__attribute__((target("avx2")))
+static void year_range_avx2(const int32_t *year, size_t n,
+                            int32_t *ymin, int32_t *ymax) {
+    __m256i vmin = _mm256_set1_epi32(INT32_MAX);
+    __m256i vmax = _mm256_set1_epi32(INT32_MIN);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; n - i >= 8; i += 8) {
+        __m256i y     = _mm256_loadu_si256((const __m256i *)(year + i));
+        __m256i known = _mm256_cmpgt_epi32(y, zero);
+        vmin = _mm256_min_epi32(vmin,
+                   _mm256_blendv_epi8(_mm256_set1_epi32(INT32_MAX), y, known));
+        vmax = _mm256_max_epi32(vmax,
+                   _mm256_blendv_epi8(_mm256_set1_epi32(INT32_MIN), y, known));
+    }
+
+    int32_t a[8], b[8];
+    _mm256_storeu_si256((__m256i *)a, vmin);
+    _mm256_storeu_si256((__m256i *)b, vmax);
+    for (int k = 0; k < 8; k++) {
+        *ymin = a[k] < *ymin ? a[k] : *ymin;
+        *ymax = b[k] > *ymax ? b[k] : *ymax;
+    }
+    year_range_scalar(year, n, i, ymin, ymax);
+}
+
+/**
+ * Once the heap is full only ratings >= the worst kept one can enter it;
+ * eight ratings are tested per compare and only the survivors (usually
+ * none) go through the heap.
+ */
+__attribute__((target("avx2")))
+static void top_avx2(const struct catalog *cat, struct top_entry *heap,
+                     size_t *len, size_t k) {
+    const float *r = cat->rating;
+    size_t n = cat->n_movies, i = 0;
+
+    for (; n - i >= 8; i += 8) {
+        float floor_ = *len < k ? -INFINITY : heap[0].rating;
+        __m256 v = _mm256_loadu_ps(r + i);
+        unsigned mask = (unsigned)_mm256_movemask_ps(
+            _mm256_cmp_ps(v, _mm256_set1_ps(floor_), _CMP_GE_OQ));
+        while (mask) {
+            top_offer(cat, heap, len, k, i + (size_t)__builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    top_scalar(cat, heap, len, k, i);
+}
+
+#endif // HAVE_AVX2_KERNELS
+
+/* -------------------------------------------------------------------------- */
+/*                                Public API                                  */
+/* -------------------------------------------------------------------------- */
+
+void analyze_ratings(const float *rating, size_t n, struct rating_summary *out) {
+    memset(out, 0, sizeof(*out));
+#ifdef HAVE_AVX2_KERNELS
+    if (avx2_enabled()) {
+        ratings_avx2(rating, n, out);
+        return;
+    }
+#endif
+    ratings_scalar(rating, n, 0, out);
+}
+
+bool analyze_year_range(const int32_t *year, size_t n,
+                        int32_t *ymin, int32_t *ymax) {
+    *ymin = INT32_MAX;
+    *ymax = INT32_MIN;
+#ifdef HAVE_AVX2_KERNELS
+    if (avx2_enabled())
+        year_range_avx2(year, n, ymin, ymax);
+    else
+#endif
+        year_range_scalar(year, n, 0, ymin, ymax);
+    return *ymin <= *ymax;
+}
+
+static int cmp_year(const void *pa, const void *pb) {
+    const struct year_count *a = pa, *b = pb;
+    return (a->year > b->year) - (a->year < b->year);
+}
+
+/**
+ * When the year range is no wider than the column, four interleaved count
+ * arrays, so consecutive rows with the same year do not serialise on one
+ * counter; they are summed at the end. Otherwise (or if that allocation
+ * fails) the known years are sorted in place in out and run-length counted.
+ */
+size_t analyze_year_counts(const int32_t *year, size_t n,
+                           struct year_count *out) {
+    int32_t ymin, ymax;
+    if (!analyze_year_range(year, n, &ymin, &ymax))
+        return 0;
+
+    size_t span = (size_t)((int64_t)ymax - ymin) + 1;
+    uint64_t *part = span <= n ? calloc(4 * span, sizeof(*part)) : NULL;
+    size_t len = 0;
+    if (part) {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t off = (uint32_t)year[i] - (uint32_t)ymin;
+            if (off < span)
+                part[(i & 3) * span + off]++;
+        }
+        for (size_t y = 0; y < span; y++) {
+            uint64_t c = part[y] + part[span + y] + part[2 * span + y] +
+                         part[3 * span + y];
+            if (c)
+                out[len++] = (struct year_count){ ymin + (int32_t)y, c };
+        }
+        free(part);
+        return len;
+    }
+
+    for (size_t i = 0; i < n; i++)
+        if (year[i] > 0)
+            out[len++].year = year[i];
+    qsort(out, len, sizeof(*out), cmp_year);
+    size_t runs = 0;
+    for (size_t i = 0; i < len; ) {
+        size_t j = i;
+        while (j < len && out[j].year == out[i].year)
+            j++;
+        out[runs++] = (struct year_count){ out[i].year, j - i };
+        i = j;
+    }
+    return runs;
+}
+
+static int cmp_top(const void *pa, const void *pb, void *ctx) {
+    const struct top_entry *a = pa, *b = pb;
+    return better(ctx, a->row, b->row) ? -1 : better(ctx, b->row, a->row);
+}
+
+size_t analyze_top_rated(const struct catalog *cat, struct top_entry *top,
+                         size_t k) {
+    size_t len = 0;
+    if (k == 0)
+        return 0;
+#ifdef HAVE_AVX2_KERNELS
+    if (avx2_enabled())
+        top_avx2(cat, top, &len, k);
+    else
+#endif
+        top_scalar(cat, top, &len, k, 0);
+
+    qsort_r(top, len, sizeof(*top), cmp_top, (void *)cat);
+    return len;
+}
+
+void analyze_collection_sizes(const struct catalog *cat,
+                              uint64_t bins[ANALYZE_SIZE_BINS]) {
+    memset(bins, 0, ANALYZE_SIZE_BINS * sizeof(*bins));
+    for (size_t j = 0; j < cat->n_collections; j++) {
+        uint64_t sz = cat->coll_row[j + 1] - cat->coll_row[j];
+        int b = sz ? 64 - __builtin_clzll(sz) : 0;
+        bins[b < ANALYZE_SIZE_BINS ? b : ANALYZE_SIZE_BINS - 1]++;
+    }
+}
+
+void analyze_print(const struct catalog *cat) {
+    uint64_t t0 = trace_now_ns();
+
+    struct rating_summary rs;
+    analyze_ratings(cat->rating, cat->n_movies, &rs);
+
+    size_t nyears = 0;
+    struct year_count *years = malloc((cat->n_movies + 1) * sizeof(*years));
+    if (years)
+        nyears = analyze_year_counts(cat->year, cat->n_movies, years);
+
+    struct top_entry top[ANALYZE_TOP_N];
+    size_t ntop = analyze_top_rated(cat, top, ANALYZE_TOP_N);
+
+    uint64_t sizes[ANALYZE_SIZE_BINS];
+    analyze_collection_sizes(cat, sizes);
+    uint64_t t1 = trace_now_ns();
+
+    printf("engine: %s\n", analyze_engine());
+    printf("movies: %zu (%llu rated, mean %.2f)\n", cat->n_movies,
+           (unsigned long long)rs.rated, rs.rated ? rs.sum / rs.rated : 0.0);
+    for (int b = 0; b < ANALYZE_RATING_BINS; b++)
+        printf("rating %d-%d: %llu\n", b, b + 1,
+               (unsigned long long)rs.bins[b]);
+
+    for (size_t i = 0; i < nyears; i++)
+        printf("year %d: %llu\n", years[i].year,
+               (unsigned long long)years[i].count);
+    free(years);
+
+    for (size_t i = 0; i < ntop; i++)
+        printf("top %zu: #%d %s (%.1f)\n", i + 1, cat->movie_id[top[i].row],
+               catalog_title(cat, top[i].row), top[i].rating);
+
+    printf("collections: %zu\n", cat->n_collections);
+    for (int b = 0; b < ANALYZE_SIZE_BINS; b++) {
+        if (!sizes[b])
+            continue;
+        if (b == 0)
+            printf("collection size 0: %llu\n", (unsigned long long)sizes[b]);
+        else if (b == 1)
+            printf("collection size 1: %llu\n", (unsigned long long)sizes[b]);
+        else if (b == ANALYZE_SIZE_BINS - 1)
+            printf("collection size %llu+: %llu\n", 1ull << (b - 1),
+                   (unsigned long long)sizes[b]);
+        else
+            printf("collection size %llu-%llu: %llu\n", 1ull << (b - 1),
+                   (1ull << b) - 1, (unsigned long long)sizes[b]);
+    }
+    printf("scan: %.3f ms\n", (t1 - t0) / 1e6);
+}
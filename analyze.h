@@ -0,0 +1,95 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+// 324CC Stefan CALMAC
+
+#include "catalog.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file analyze.h
+ * @brief Aggregations over the columnar catalog for the "analyze" command.
+ *
+ * The column loops have an AVX2 version and a portable scalar version with
+ * identical results; the AVX2 one is picked at run time when the CPU
+ * supports it (and the build targets x86), unless --no-simd is given.
+ */
+
+#define ANALYZE_RATING_BINS 10   /**< [0,1) [1,2) ... [9,10] */
+#define ANALYZE_TOP_N       10   /**< Movies listed by "analyze" */
+#define ANALYZE_SIZE_BINS   16   /**< Collection sizes 0, 1, 2-3, 4-7, ... */
+
+/** Set by --no-simd to force the scalar loops. */
+extern bool analyze_force_scalar;
+
+/** Rating distribution of a column. */
+struct rating_summary {
+    uint64_t bins[ANALYZE_RATING_BINS];
+    uint64_t rated;     /**< Rows with a rating (not NaN) */
+    double   sum;       /**< Sum of the ratings */
+};
+
+/** Rows of one year. */
+struct year_count {
+    int32_t  year;
+    uint64_t count;
+};
+
+/** One entry of the top-N list (index into the catalog columns). */
+struct top_entry {
+    size_t row;
+    float  rating;
+};
+
+/**
+ * Name of the implementation in use ("avx2" or "scalar").
+ */
+const char *analyze_engine(void);
+
+/**
+ * Histogram, count and sum of a rating column; NaN means unrated.
+ */
+void analyze_ratings(const float *rating, size_t n, struct rating_summary *out);
+
+/**
+ * Smallest and largest year > 0.
+ *
+ * @return  false if no row has a known year.
+ */
+bool analyze_year_range(const int32_t *year, size_t n,
+                        int32_t *ymin, int32_t *ymax);
+
+/**
+ * Count rows per known year (> 0), in ascending year order. Only years that
+ * occur are written, so a stray year far from the others does not size any
+ * allocation.
+ *
+ * @param out  Room for n entries.
+ * @return  Number of entries written.
+ */
+size_t analyze_year_counts(const int32_t *year, size_t n,
+                           struct year_count *out);
+
+/**
+ * Best k rated rows, highest rating first (ties by lower movie id).
+ *
+ * @return  Number of entries written (at most k).
+ */
+size_t analyze_top_rated(const struct catalog *cat, struct top_entry *top,
+                         size_t k);
+
+/**
+ * Histogram of collection sizes in power-of-two buckets: bucket 0 holds
+ * empty collections, bucket b >= 1 sizes in [2^(b-1), 2^b).
+ */
+void analyze_collection_sizes(const struct catalog *cat,
+                              uint64_t bins[ANALYZE_SIZE_BINS]);
+
+/**
+ * Run every aggregation and print the report of the "analyze" command.
+ */
+void analyze_print(const struct catalog *cat);
+
+#endif // ANALYZE_H
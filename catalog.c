@@ -0,0 +1,391 @@
+// 324CC Stefan CALMAC
+#include "catalog.h"
+#include "analyze.h"
+#include "helper.h"
+#include "trace.h"
+
+#include <fcntl.h>
+#include <float.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ALIGN8(x)    (((x) + 7) & ~(uint64_t)7)
+
+const char *catalog_path = CATALOG_DEFAULT_PATH;
+
+/**
+ * Read a number that the server may send either as a JSON number or as a
+ * string ("7.5"). Returns NAN if absent.
+ */
+static double number_field(JSON_Object *obj, const char *name) {
+    JSON_Value *v = json_object_get_value(obj, name);
+    switch (json_value_get_type(v)) {
+    case JSONNumber:
+        return json_value_get_number(v);
+    case JSONString: {
+        char *end;
+        double d = strtod(json_value_get_string(v), &end);
+        return end == json_value_get_string(v) ? NAN : d;
+    }
+    default:
+        return NAN;
+    }
+}
+
+/**
+ * Convert d to an int32_t if it is a number in range (NaN is not).
+ */
+static bool to_int32(double d, int32_t *out) {
+    if (!(d >= INT32_MIN && d <= INT32_MAX))
+        return false;
+    *out = (int32_t)d;
+    return true;
+}
+
+/**
+ * The id of an entry: v itself if it is a bare number, else its "id"
+ * field. Returns false if absent, not a number or out of range.
+ */
+static bool entry_id(JSON_Value *v, int32_t *out) {
+    if (json_value_get_type(v) == JSONObject)
+        v = json_object_get_value(json_value_get_object(v), "id");
+    return json_value_get_type(v) == JSONNumber &&
+           to_int32(json_value_get_number(v), out);
+}
+
+static const char *string_field(JSON_Object *obj, const char *name) {
+    const char *s = json_object_get_string(obj, name);
+    return s ? s : "";
+}
+
+/**
+ * Copy s into the heap at *pos and return its offset.
+ */
+static uint64_t heap_put(char *heap, uint64_t *pos, const char *s) {
+    uint64_t off = *pos;
+    size_t len = strlen(s) + 1;
+    memcpy(heap + off, s, len);
+    *pos += len;
+    return off;
+}
+
+/**
+ * Entries without a usable id (absent, not a number or outside int32_t)
+ * are left out: movies, collections and collection members alike.
+ */
+int catalog_write(const char *path, JSON_Value *snapshot) {
+    JSON_Object *root   = json_value_get_object(snapshot);
+    JSON_Array  *movies = json_object_get_array(root, "movies");
+    JSON_Array  *colls  = json_object_get_array(root, "collections");
+    size_t n_in = json_array_get_count(movies);
+    size_t c_in = json_array_get_count(colls);
+    int32_t id_val;
+
+    /* First pass: sizes */
+    uint64_t heap_size = 0, members = 0, skipped = 0;
+    size_t n = 0, c = 0;
+    for (size_t i = 0; i < n_in; i++) {
+        JSON_Object *m = json_array_get_object(movies, i);
+        JSON_Object *d = json_object_get_object(m, "details");
+        if (!entry_id(json_array_get_value(movies, i), &id_val)) {
+            skipped++;
+            continue;
+        }
+        n++;
+        heap_size += strlen(string_field(m, "title")) + 1;
+        heap_size += strlen(string_field(d, "description")) + 1;
+    }
+    for (size_t j = 0; j < c_in; j++) {
+        JSON_Object *col = json_array_get_object(colls, j);
+        JSON_Array  *ms  = json_object_get_array(
+            json_object_get_object(col, "details"), "movies");
+        if (!entry_id(json_array_get_value(colls, j), &id_val)) {
+            skipped++;
+            continue;
+        }
+        c++;
+        heap_size += strlen(string_field(col, "title")) + 1;
+        for (size_t x = 0; x < json_array_get_count(ms); x++) {
+            if (entry_id(json_array_get_value(ms, x), &id_val))
+                members++;
+            else
+                skipped++;
+        }
+    }
+    if (skipped)
+        fprintf(stderr, "catalog: skipped %llu entries without a valid id\n",
+                (unsigned long long)skipped);
+
+    struct catalog_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+    h.version       = CATALOG_VERSION;
+    h.n_movies      = n;
+    h.n_collections = c;
+    h.n_members     = members;
+
+    uint64_t off = ALIGN8(sizeof(h));
+    h.off_movie_id     = off; off = ALIGN8(off + n * sizeof(int32_t));
+    h.off_year         = off; off = ALIGN8(off + n * sizeof(int32_t));
+    h.off_rating       = off; off = ALIGN8(off + n * sizeof(float));
+    h.off_title        = off; off = ALIGN8(off + (n + 1) * sizeof(uint64_t));
+    h.off_desc         = off; off = ALIGN8(off + (n + 1) * sizeof(uint64_t));
+    h.off_coll_id      = off; off = ALIGN8(off + c * sizeof(int32_t));
+    h.off_coll_title   = off; off = ALIGN8(off + (c + 1) * sizeof(uint64_t));
+    h.off_coll_row     = off; off = ALIGN8(off + (c + 1) * sizeof(uint64_t));
+    h.off_coll_members = off; off = ALIGN8(off + members * sizeof(int32_t));
+    h.off_heap         = off;
+    h.heap_size        = heap_size;
+    h.file_size        = off + heap_size;
+
+    char *buf = calloc(1, h.file_size);
+    if (!buf) {
+        fprintf(stderr, "catalog: unable to allocate %llu bytes\n",
+                (unsigned long long)h.file_size);
+        return -1;
+    }
+    memcpy(buf, &h, sizeof(h));
+
+    int32_t  *id       = (int32_t *)(buf + h.off_movie_id);
+    int32_t  *year     = (int32_t *)(buf + h.off_year);
+    float    *rating   = (float *)(buf + h.off_rating);
+    uint64_t *title    = (uint64_t *)(buf + h.off_title);
+    uint64_t *desc     = (uint64_t *)(buf + h.off_desc);
+    int32_t  *coll_id  = (int32_t *)(buf + h.off_coll_id);
+    uint64_t *ctitle   = (uint64_t *)(buf + h.off_coll_title);
+    uint64_t *row      = (uint64_t *)(buf + h.off_coll_row);
+    int32_t  *member   = (int32_t *)(buf + h.off_coll_members);
+    char     *heap     = buf + h.off_heap;
+    uint64_t  pos      = 0;
+
+    /* Second pass: columns. Each string is followed by its NUL, so the end
+     * offset of entry i is the start of entry i + 1.
+     * A year that is not a number in range is unknown (0), a rating
+     * beyond float is unrated (NaN). */
+    size_t r = 0;
+    for (size_t i = 0; i < n_in; i++) {
+        JSON_Object *m = json_array_get_object(movies, i);
+        JSON_Object *d = json_object_get_object(m, "details");
+        if (!entry_id(json_array_get_value(movies, i), &id[r]))
+            continue;
+        double rt = number_field(d, "rating");
+        if (!to_int32(number_field(d, "year"), &year[r]))
+            year[r] = 0;
+        rating[r] = fabs(rt) <= FLT_MAX ? (float)rt : NAN;
+        title[r]  = heap_put(heap, &pos, string_field(m, "title"));
+        r++;
+    }
+    title[n] = pos;
+    r = 0;
+    for (size_t i = 0; i < n_in; i++) {
+        JSON_Object *d = json_object_get_object(
+            json_array_get_object(movies, i), "details");
+        if (entry_id(json_array_get_value(movies, i), &id_val))
+            desc[r++] = heap_put(heap, &pos, string_field(d, "description"));
+    }
+    desc[n] = pos;
+
+    uint64_t k = 0;
+    r = 0;
+    for (size_t j = 0; j < c_in; j++) {
+        JSON_Object *col = json_array_get_object(colls, j);
+        JSON_Array  *ms  = json_object_get_array(
+            json_object_get_object(col, "details"), "movies");
+        if (!entry_id(json_array_get_value(colls, j), &coll_id[r]))
+            continue;
+        ctitle[r] = heap_put(heap, &pos, string_field(col, "title"));
+        row[r]    = k;
+        r++;
+        for (size_t x = 0; x < json_array_get_count(ms); x++)
+            if (entry_id(json_array_get_value(ms, x), &member[k]))
+                k++;
+    }
+    ctitle[c] = pos;
+    row[c]    = k;
+
+    int ret = write_file_atomic(path, buf, h.file_size);
+    free(buf);
+    return ret;
+}
+
+/**
+ * Check that an array of count elements of size elem fits in the file.
+ */
+static int section_ok(const struct catalog_header *h, uint64_t off,
+                      uint64_t count, size_t elem) {
+    return off % 8 == 0 && off <= h->file_size &&
+           count <= (h->file_size - off) / elem;
+}
+
+/**
+ * Check an offset array: non-decreasing, ending inside the heap.
+ */
+static int offsets_ok(const uint64_t *off, size_t count, uint64_t limit) {
+    for (size_t i = 0; i < count; i++)
+        if (off[i] > limit || (i && off[i] < off[i - 1]))
+            return 0;
+    return 1;
+}
+
+int catalog_open(const char *path, struct catalog *cat) {
+    memset(cat, 0, sizeof(*cat));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("catalog: open");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct catalog_header)) {
+        fprintf(stderr, "catalog: %s is too short\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("catalog: mmap");
+        return -1;
+    }
+
+    const struct catalog_header *h = map;
+    const char *base = map;
+    uint64_t n = h->n_movies, c = h->n_collections, m = h->n_members;
+    int ok = memcmp(h->magic, CATALOG_MAGIC, sizeof(CATALOG_MAGIC)) == 0 &&
+             h->version == CATALOG_VERSION &&
+             h->file_size == (uint64_t)st.st_size &&
+             n < UINT64_MAX / 8 && c < UINT64_MAX / 8 &&
+             section_ok(h, h->off_movie_id, n, sizeof(int32_t)) &&
+             section_ok(h, h->off_year, n, sizeof(int32_t)) &&
+             section_ok(h, h->off_rating, n, sizeof(float)) &&
+             section_ok(h, h->off_title, n + 1, sizeof(uint64_t)) &&
+             section_ok(h, h->off_desc, n + 1, sizeof(uint64_t)) &&
+             section_ok(h, h->off_coll_id, c, sizeof(int32_t)) &&
+             section_ok(h, h->off_coll_title, c + 1, sizeof(uint64_t)) &&
+             section_ok(h, h->off_coll_row, c + 1, sizeof(uint64_t)) &&
+             section_ok(h, h->off_coll_members, m, sizeof(int32_t)) &&
+             h->off_heap <= h->file_size &&
+             h->heap_size == h->file_size - h->off_heap &&
+             (h->heap_size == 0 || base[h->file_size - 1] == '\0');
+    if (ok) {
+        /* Every string must start inside the heap; the trailing NUL
+         * checked above keeps reads of the last one in bounds too */
+        uint64_t hs = h->heap_size ? h->heap_size - 1 : 0;
+        ok = offsets_ok((const uint64_t *)(base + h->off_title), n, hs) &&
+             offsets_ok((const uint64_t *)(base + h->off_desc), n, hs) &&
+             offsets_ok((const uint64_t *)(base + h->off_coll_title), c, hs) &&
+             offsets_ok((const uint64_t *)(base + h->off_coll_row), c + 1, m) &&
+             ((const uint64_t *)(base + h->off_coll_row))[c] == m;
+    }
+    if (!ok) {
+        fprintf(stderr, "catalog: %s is not a valid catalog file\n", path);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    cat->map            = map;
+    cat->size           = st.st_size;
+    cat->n_movies       = n;
+    cat->n_collections  = c;
+    cat->n_members      = m;
+    cat->movie_id       = (const int32_t *)(base + h->off_movie_id);
+    cat->year           = (const int32_t *)(base + h->off_year);
+    cat->rating         = (const float *)(base + h->off_rating);
+    cat->title_off      = (const uint64_t *)(base + h->off_title);
+    cat->desc_off       = (const uint64_t *)(base + h->off_desc);
+    cat->coll_id        = (const int32_t *)(base + h->off_coll_id);
+    cat->coll_title_off = (const uint64_t *)(base + h->off_coll_title);
+    cat->coll_row       = (const uint64_t *)(base + h->off_coll_row);
+    cat->coll_members   = (const int32_t *)(base + h->off_coll_members);
+    cat->heap           = base + h->off_heap;
+    return 0;
+}
+
+void catalog_close(struct catalog *cat) {
+    if (cat->map)
+        munmap(cat->map, cat->size);
+    memset(cat, 0, sizeof(*cat));
+}
+
+static void print_hist(const uint64_t *bins) {
+    for (int b = 0; b < ANALYZE_RATING_BINS; b++)
+        printf("%s%llu", b ? " " : "", (unsigned long long)bins[b]);
+    printf("\n");
+}
+
+static int cmp_year_count(const void *key, const void *elem) {
+    int32_t y = *(const int32_t *)key;
+    const struct year_count *e = elem;
+    return (y > e->year) - (y < e->year);
+}
+
+/**
+ * Runs on the analyze.h kernels: the overall histogram over the rating
+ * column, then the same histogram over each year's ratings, gathered into
+ * one contiguous slice per year (rows are placed by a binary search in the
+ * sorted list of years that occur).
+ */
+void catalog_print_stats(const struct catalog *cat) {
+    uint64_t t0 = trace_now_ns();
+    size_t n = cat->n_movies;
+
+    struct rating_summary all;
+    analyze_ratings(cat->rating, n, &all);
+
+    struct year_count *years = malloc((n + 1) * sizeof(*years));
+    size_t *next = malloc((n + 1) * sizeof(*next));
+    float *by_year = malloc((n + 1) * sizeof(*by_year));
+    struct rating_summary *per_year = malloc((n + 1) * sizeof(*per_year));
+    if (!years || !next || !by_year || !per_year) {
+        printf("ERROR: unable to allocate memory for statistics\n");
+        free(years); free(next); free(by_year); free(per_year);
+        return;
+    }
+
+    size_t nyears = analyze_year_counts(cat->year, n, years);
+    size_t off = 0;
+    for (size_t r = 0; r < nyears; r++) {
+        next[r] = off;
+        off += years[r].count;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (cat->year[i] <= 0)
+            continue;
+        const struct year_count *y = bsearch(&cat->year[i], years, nyears,
+                                             sizeof(*years), cmp_year_count);
+        by_year[next[y - years]++] = cat->rating[i];
+    }
+    off = 0;
+    for (size_t r = 0; r < nyears; r++) {
+        analyze_ratings(by_year + off, years[r].count, &per_year[r]);
+        off += years[r].count;
+    }
+
+    size_t largest = 0;
+    for (size_t j = 0; j < cat->n_collections; j++) {
+        size_t sz = cat->coll_row[j + 1] - cat->coll_row[j];
+        largest = sz > largest ? sz : largest;
+    }
+    uint64_t t1 = trace_now_ns();
+
+    printf("movies: %zu (%llu rated)\n", n, (unsigned long long)all.rated);
+    printf("rating histogram (0-1 .. 9-10): ");
+    print_hist(all.bins);
+    printf("mean rating: %.2f\n", all.rated ? all.sum / all.rated : 0.0);
+    for (size_t r = 0; r < nyears; r++) {
+        const struct rating_summary *ys = &per_year[r];
+        printf("year %d: %llu movies, mean %.2f, histogram ",
+               years[r].year, (unsigned long long)years[r].count,
+               ys->rated ? ys->sum / ys->rated : 0.0);
+        print_hist(ys->bins);
+    }
+    printf("collections: %zu (%zu memberships, largest %zu)\n",
+           cat->n_collections, cat->n_members, largest);
+    printf("scan: %.3f ms\n", (t1 - t0) / 1e6);
+
+    free(years);
+    free(next);
+    free(by_year);
+    free(per_year);
+}
@@ -0,0 +1,130 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+// 324CC Stefan CALMAC
+
+#include "parson.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file catalog.h
+ * @brief Binary, column-oriented catalog file that is used in place through
+ *        mmap, without deserialisation.
+ *
+ * Layout (native endianness, every section 8-byte aligned):
+ *
+ *   header             struct catalog_header
+ *   movie_id[n]        int32    movie ids
+ *   year[n]            int32    release year (0 if unknown)
+ *   rating[n]          float    rating (NaN if unknown)
+ *   title_off[n + 1]   uint64   title i is heap[title_off[i] .. title_off[i+1])
+ *   desc_off[n + 1]    uint64   same for descriptions
+ *   coll_id[c]         int32    collection ids
+ *   coll_title_off[c+1] uint64  collection titles in the heap
+ *   coll_row[c + 1]    uint64   CSR row pointers: members of collection j are
+ *   coll_members[m]    int32    coll_members[coll_row[j] .. coll_row[j+1])
+ *   heap               bytes    strings, each followed by a NUL
+ *
+ * The file is written by "sync" next to the JSON snapshot and read by the
+ * local "catalog_stats" command.
+ */
+
+#define CATALOG_MAGIC        "MCATLG1"
+#define CATALOG_VERSION      1
+#define CATALOG_DEFAULT_PATH "catalog.bin"
+
+/** File header; offsets are bytes from the start of the file. */
+struct catalog_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t n_movies;
+    uint64_t n_collections;
+    uint64_t n_members;
+    uint64_t off_movie_id;
+    uint64_t off_year;
+    uint64_t off_rating;
+    uint64_t off_title;
+    uint64_t off_desc;
+    uint64_t off_coll_id;
+    uint64_t off_coll_title;
+    uint64_t off_coll_row;
+    uint64_t off_coll_members;
+    uint64_t off_heap;
+    uint64_t heap_size;
+    uint64_t file_size;
+};
+
+/** An opened (mapped) catalog; the arrays point into the mapping. */
+struct catalog {
+    void           *map;
+    size_t          size;
+    size_t          n_movies;
+    size_t          n_collections;
+    size_t          n_members;
+    const int32_t  *movie_id;
+    const int32_t  *year;
+    const float    *rating;
+    const uint64_t *title_off;
+    const uint64_t *desc_off;
+    const int32_t  *coll_id;
+    const uint64_t *coll_title_off;
+    const uint64_t *coll_row;
+    const int32_t  *coll_members;
+    const char     *heap;
+};
+
+/** Path used by "sync" and "catalog_stats" (set with --catalog=PATH). */
+extern const char *catalog_path;
+
+/**
+ * Convert a library snapshot (see sync.h) to the columnar format and
+ * replace path atomically.
+ *
+ * @param path      Destination file.
+ * @param snapshot  Snapshot root value.
+ * @return          0 on success, -1 on error.
+ */
+int catalog_write(const char *path, JSON_Value *snapshot);
+
+/**
+ * Map a catalog file read-only and validate its header and offsets.
+ *
+ * @param path  Catalog file.
+ * @param cat   Out: the opened catalog.
+ * @return      0 on success, -1 if the file is missing or malformed.
+ */
+int catalog_open(const char *path, struct catalog *cat);
+
+/**
+ * Unmap a catalog opened with catalog_open().
+ */
+void catalog_close(struct catalog *cat);
+
+/** Title of movie i (NUL-terminated, inside the mapping). */
+static inline const char *catalog_title(const struct catalog *cat, size_t i) {
+    return cat->heap + cat->title_off[i];
+}
+
+/** Description of movie i (NUL-terminated, inside the mapping). */
+static inline const char *catalog_desc(const struct catalog *cat, size_t i) {
+    return cat->heap + cat->desc_off[i];
+}
+
+/** Title of collection j (NUL-terminated, inside the mapping). */
+static inline const char *catalog_coll_title(const struct catalog *cat,
+                                             size_t j) {
+    return cat->heap + cat->coll_title_off[j];
+}
+
+/**
+ * Print the catalog summary used by "catalog_stats": overall rating
+ * histogram, then per year the movie count, mean rating and histogram,
+ * then collection counts.
+ *
+ * @param cat  Opened catalog.
+ */
+void catalog_print_stats(const struct catalog *cat);
+
+#endif // CATALOG_H
@@ -0,0 +1,39 @@
+// 324CC Stefan CALMAC
+#include "unit.h"
+#include "analyze.h"
+
+/* Year counts as "year:count" joined with ',' */
+static const char *years(const int32_t *year, size_t n) {
+    static char text[256];
+    struct year_count out[16];
+    size_t len = analyze_year_counts(year, n, out);
+    text[0] = '\0';
+    for (size_t i = 0; i < len; i++)
+        snprintf(text + strlen(text), sizeof(text) - strlen(text),
+                 "%s%d:%llu", i ? "," : "", out[i].year,
+                 (unsigned long long)out[i].count);
+    return text;
+}
+
+static void test_year_counts(void) {
+    /* Narrow range: the counter arrays */
+    static const int32_t dense[] = { 1999, 2001, 1999, 0, 2001, 1999, -5 };
+    CHECK_STR(years(dense, 7), "1999:3,2001:2");
+
+    /* Range far wider than the column: sorted, not one bucket per year */
+    static const int32_t sparse[] = {
+        2000000000, 1, 1994, INT32_MIN, 1, 2000000000, INT32_MAX, 0, 1994,
+    };
+    CHECK_STR(years(sparse, 9), "1:2,1994:2,2000000000:2,2147483647:1");
+
+    static const int32_t unknown[] = { 0, -1, INT32_MIN };
+    CHECK_STR(years(unknown, 3), "");
+    CHECK_STR(years(NULL, 0), "");
+}
+
+int main(void) {
+    test_year_counts();
+    analyze_force_scalar = true;
+    test_year_counts();
+    return unit_done("analyze");
+}
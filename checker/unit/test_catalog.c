@@ -0,0 +1,62 @@
+// 324CC Stefan CALMAC
+#include "unit.h"
+#include "catalog.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void test_write(void) {
+    char path[] = "/tmp/test_catalog_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    /* Ids that are absent, not numbers, NaN-like or beyond int32_t are
+     * dropped; so are bad years and ratings, but not their movies */
+    JSON_Value *snap = json_parse_string(
+        "{\"movies\": ["
+        " {\"id\": 1, \"title\": \"One\", \"details\": {\"year\": 1999,"
+        "  \"rating\": \"7.5\", \"description\": \"d1\"}},"
+        " {\"title\": \"No id\"},"
+        " {\"id\": \"2\", \"title\": \"String id\"},"
+        " {\"id\": 1e300, \"title\": \"Huge id\"},"
+        " {\"id\": -2147483648, \"title\": \"Min\", \"details\": {"
+        "  \"year\": 1e12, \"rating\": 1e300}},"
+        " {\"id\": 3, \"title\": \"Three\", \"details\": {\"year\": \"x\"}}"
+        "], \"collections\": ["
+        " {\"id\": 9, \"title\": \"C\", \"details\": {\"movies\": "
+        "  [1, {\"id\": 3}, {\"id\": 5e9}, \"3\", {}, -2147483648]}},"
+        " {\"id\": 4294967296, \"title\": \"Bad\", \"details\": {\"movies\": [1]}}"
+        "]}");
+    CHECK(catalog_write(path, snap) == 0);
+    json_value_free(snap);
+
+    struct catalog cat;
+    CHECK(catalog_open(path, &cat) == 0);
+    CHECK(cat.n_movies == 3);
+    if (cat.n_movies == 3) {
+        CHECK(cat.movie_id[0] == 1 && cat.movie_id[1] == INT32_MIN &&
+              cat.movie_id[2] == 3);
+        CHECK_STR(catalog_title(&cat, 1), "Min");
+        CHECK_STR(catalog_title(&cat, 2), "Three");
+        CHECK_STR(catalog_desc(&cat, 0), "d1");
+        CHECK(cat.year[0] == 1999 && cat.year[1] == 0 && cat.year[2] == 0);
+        CHECK(cat.rating[0] == 7.5f && isnan(cat.rating[1]) &&
+              isnan(cat.rating[2]));
+    }
+    CHECK(cat.n_collections == 1 && cat.n_members == 3);
+    if (cat.n_collections == 1 && cat.n_members == 3) {
+        CHECK(cat.coll_id[0] == 9);
+        CHECK_STR(catalog_coll_title(&cat, 0), "C");
+        CHECK(cat.coll_members[0] == 1 && cat.coll_members[1] == 3 &&
+              cat.coll_members[2] == INT32_MIN);
+    }
+    catalog_close(&cat);
+    unlink(path);
+}
+
+int main(void) {
+    test_write();
+    return unit_done("catalog");
+}
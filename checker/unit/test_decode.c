@@ -0,0 +1,105 @@
+// 324CC Stefan CALMAC
+#include "unit.h"
+#include "decode.h"
+
+static void test_movies(void) {
+    struct decoded d;
+    const char *json =
+        "{ \"extra\": {\"a\": [1, {\"b\": null}]}, \"movies\": ["
+        "{\"id\": 3, \"title\": \"Heat\", \"year\": 1995,"
+        " \"rating\": 8.3, \"description\": \"LA\"},"
+        "{\"title\": \"A\\\"B\\\\C\\n\\u00e9\\ud83d\\ude00\", \"id\": -7,"
+        " \"unknown\": [true, false], \"year\": 2.9e3}"
+        "] }";
+
+    CHECK(decode_movies(json, &d) == 0);
+    CHECK(d.count == 2);
+    const movie_t *m = d.items;
+    CHECK(m[0].id == 3);
+    CHECK_STR(m[0].title, "Heat");
+    CHECK(m[0].year == 1995);
+    CHECK_STR(m[0].rating, "8.3");
+    CHECK_STR(m[0].description, "LA");
+    CHECK(m[1].id == -7);
+    CHECK_STR(m[1].title, "A\"B\\C\n\xc3\xa9\xf0\x9f\x98\x80");
+    CHECK(m[1].year == 2900);
+    CHECK(m[1].rating == NULL);
+    CHECK(m[1].description == NULL);
+    decode_free(&d);
+
+    CHECK(decode_movies("{\"movies\": []}", &d) == 0);
+    CHECK(d.count == 0);
+    decode_free(&d);
+}
+
+static void test_users(void) {
+    struct decoded d;
+    CHECK(decode_users("{\"users\":[{\"id\":1,\"username\":\"ana\","
+                       "\"password\":\"p\\/w\"}]}", &d) == 0);
+    CHECK(d.count == 1);
+    const user_t *u = d.items;
+    CHECK(u->id == 1);
+    CHECK_STR(u->username, "ana");
+    CHECK_STR(u->password, "p/w");
+    decode_free(&d);
+}
+
+static void test_collections(void) {
+    struct decoded d;
+    CHECK(decode_collection("{\"id\": 4, \"title\": \"T\", \"owner\": \"o\","
+                            " \"movies\": [{\"id\": 1, \"title\": \"x\"},"
+                            " {\"id\": 2, \"title\": \"y\"}]}", &d) == 0);
+    const collection_t *c = d.items;
+    CHECK(d.count == 1);
+    CHECK(c->id == 4);
+    CHECK_STR(c->owner, "o");
+    CHECK(c->movies.count == 2);
+    CHECK(c->movies.items[1].id == 2);
+    CHECK_STR(c->movies.items[1].title, "y");
+    decode_free(&d);
+
+    /* Members given as plain ids */
+    CHECK(decode_collections("{\"collections\": [{\"id\": 1, \"title\": \"a\","
+                             " \"movies\": [5, 6, -1]}, {\"id\": 2,"
+                             " \"movies\": []}]}", &d) == 0);
+    c = d.items;
+    CHECK(d.count == 2);
+    if (d.count == 2) {
+        CHECK(c[0].movies.count == 3);
+        CHECK(c[0].movies.count == 3 && c[0].movies.items[0].id == 5 &&
+              c[0].movies.items[2].id == -1);
+        CHECK(c[0].movies.count == 3 && c[0].movies.items[0].title == NULL);
+        CHECK(c[1].movies.count == 0);
+    }
+    decode_free(&d);
+}
+
+static void test_malformed(void) {
+    struct decoded d;
+    const char *bad[] = {
+        "",
+        "[]",
+        "{\"users\": []}",
+        "{\"movies\": {}}",
+        "{\"movies\": [{\"id\": 1}",
+        "{\"movies\": [{\"id\" 1}]}",
+        "{\"movies\": [{\"title\": \"unterminated}]}",
+        "{\"movies\": [{\"title\": \"\\x\"}]}",
+        "{\"movies\": [{\"title\": \"\\ud800\"}]}",
+        "{\"movies\": [\"1\"]}",
+        "{\"movies\": [{\"id\": 1},]}",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        CHECK(decode_movies(bad[i], &d) == -1);
+        CHECK(d.items == NULL && d.count == 0);
+    }
+    CHECK(decode_movie("{\"id\": tru}", &d) == -1);
+}
+
+int main(void) {
+    test_movies();
+    test_users();
+    test_collections();
+    test_malformed();
+    return unit_done("decode");
+}
@@ -0,0 +1,80 @@
+// 324CC Stefan CALMAC
+#include "unit.h"
+#include "helper.h"
+
+/* The list joined with ',' ("" for NULL) */
+static const char *joined(char **list, size_t count) {
+    static char text[4096];
+    text[0] = '\0';
+    for (size_t i = 0; list && i < count; i++)
+        snprintf(text + strlen(text), sizeof(text) - strlen(text), "%s%s",
+                 i ? "," : "", list[i]);
+    return text;
+}
+
+static const char *ids(const char *spec, size_t max) {
+    size_t count = 99;
+    char **list = parse_id_list(spec, max, &count);
+    const char *text = joined(list, count);
+    if (!list)
+        CHECK(count == 0);
+    free_string_list(list, count);
+    return text;
+}
+
+static void test_parse_id_list(void) {
+    CHECK_STR(ids("7", 100), "7");
+    CHECK_STR(ids("1,2, 5-9", 100), "1,2,5,6,7,8,9");
+    CHECK_STR(ids(" 3 - 5 ,, 1 ,", 100), "3,4,5,1");
+    CHECK_STR(ids("4-4", 100), "4");
+    CHECK_STR(ids("0", 100), "0");
+    CHECK_STR(ids("1-10", 10), "1,2,3,4,5,6,7,8,9,10");
+
+    /* Malformed, empty or too many ids */
+    static const char *bad[] = {
+        "", " , ", "a", "1,a", "-3", "1-", "1-x", "5-3", "1 2", "1.5",
+        "1-11", "1-5,6-11",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        size_t count = 99;
+        char **list = parse_id_list(bad[i], 10, &count);
+        CHECK(list == NULL && count == 0);
+        if (list)
+            fprintf(stderr, "  accepted: \"%s\"\n", bad[i]);
+        free_string_list(list, count);
+    }
+}
+
+/* "all": the keys of a listing */
+static void test_extract_list_field(void) {
+    size_t count;
+    char **list = extract_list_field(
+        "{\"movies\":[{\"id\":3,\"title\":\"a\"},{\"id\":12},{\"title\":\"b\"},"
+        "{\"id\":4.0}]}", "movies", "id", &count);
+    CHECK_STR(joined(list, count), "3,12,4");
+    free_string_list(list, count);
+
+    list = extract_list_field("{\"users\":[{\"username\":\"ana\"},"
+                              "{\"username\":\"bo b\"}]}",
+                              "users", "username", &count);
+    CHECK_STR(joined(list, count), "ana,bo b");
+    free_string_list(list, count);
+
+    /* Elements without the field: a list, but an empty one */
+    list = extract_list_field("{\"users\":[{\"id\":1}]}", "users", "username",
+                              &count);
+    CHECK(count == 0);
+    free_string_list(list, count);
+
+    list = extract_list_field("{\"movies\":[]}", "movies", "id", &count);
+    CHECK(list == NULL && count == 0);
+    list = extract_list_field("{\"other\":[{\"id\":1}]}", "movies", "id",
+                              &count);
+    CHECK(list == NULL && count == 0);
+}
+
+int main(void) {
+    test_parse_id_list();
+    test_extract_list_field();
+    return unit_done("ids");
+}
@@ -0,0 +1,80 @@
+// 324CC Stefan CALMAC
+#include "unit.h"
+#include "compress.h"
+#include "jsonw.h"
+#include "parson.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+/* A one-string document, as written by jw_string() */
+static const char *quoted(const char *s) {
+    struct json_writer w;
+    jw_start(&w, NULL);
+    jw_string(&w, s);
+    return jw_finish(&w);
+}
+
+static void test_escaping(void) {
+    CHECK_STR(quoted(""), "\"\"");
+    CHECK_STR(quoted("plain text"), "\"plain text\"");
+    CHECK_STR(quoted("a\"b\\c/d"), "\"a\\\"b\\\\c/d\"");
+    CHECK_STR(quoted("\b\f\n\r\t"), "\"\\b\\f\\n\\r\\t\"");
+    CHECK_STR(quoted("\x01\x1f x\x7f"), "\"\\u0001\\u001f x\x7f\"");
+    CHECK_STR(quoted("\xc3\xa9t\xc3\xa9 \xf0\x9f\x8e\xac"),
+              "\"\xc3\xa9t\xc3\xa9 \xf0\x9f\x8e\xac\"");
+    CHECK_STR(quoted(NULL), "null");
+
+    /* Every control byte reads back unchanged through parson */
+    char all[32];
+    for (int i = 1; i < 32; i++)
+        all[i - 1] = (char)i;
+    all[31] = '\0';
+    JSON_Value *v = json_parse_string(quoted(all));
+    CHECK_STR(json_value_get_string(v), all);
+    json_value_free(v);
+}
+
+static void test_document(void) {
+    struct dbuf buf = { 0 };
+    struct json_writer w;
+    jw_start(&w, &buf);
+    jw_object_begin(&w);
+    jw_field_string(&w, "ti\"tle", "T");
+    jw_field_int(&w, "year", 1999);
+    jw_field_number(&w, "rating", 6.5);
+    jw_key(&w, "ids");
+    jw_array_begin(&w);
+    jw_int(&w, LONG_MIN);
+    jw_int(&w, 0);
+    jw_array_begin(&w);
+    jw_array_end(&w);
+    jw_object_begin(&w);
+    jw_object_end(&w);
+    jw_number(&w, 0.1);
+    jw_array_end(&w);
+    jw_field_string(&w, "none", NULL);
+    jw_object_end(&w);
+    CHECK_STR(jw_finish(&w),
+              "{\"ti\\\"tle\":\"T\",\"year\":1999,\"rating\":6.5,"
+              "\"ids\":[-9223372036854775808,0,[],{},0.1],\"none\":null}");
+
+    /* Starting again empties the buffer */
+    jw_start(&w, &buf);
+    jw_array_begin(&w);
+    jw_array_end(&w);
+    CHECK_STR(jw_finish(&w), "[]");
+    free(buf.data);
+
+    /* The thread's body buffer is reused, not appended to */
+    const char *first = quoted("first");
+    const char *second = quoted("2");
+    CHECK(first == second);
+    CHECK_STR(second, "\"2\"");
+}
+
+int main(void) {
+    test_escaping();
+    test_document();
+    return unit_done("jsonw");
+}
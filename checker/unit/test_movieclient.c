@@ -0,0 +1,174 @@
+// 324CC Stefan CALMAC
+#define _GNU_SOURCE
+#include "unit.h"
+#include "movieclient.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * A keep-alive server on a loopback port that serves connections one at a
+ * time and closes each after a set number of answers, without saying so:
+ * the client parks the connection and finds it dead on its next call.
+ */
+#define NCONNS 3
+
+static const int answers_per_conn[NCONNS] = { 2, 1, 1 };
+
+static const char answer[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 52\r\n"
+    "\r\n"
+    "{\"id\":5,\"title\":\"B\",\"movies\":[{\"id\":1,\"title\":\"A\"}]}";
+
+struct server {
+    int lfd;
+    int port;
+    int conns;      /* accepted so far */
+    int requests;   /* answered so far */
+    int closed;     /* connections closed so far */
+};
+
+/* Read one request, body included; 0 on EOF */
+static int read_request(int fd) {
+    char buf[4096];
+    size_t len = 0;
+    for (;;) {
+        ssize_t n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (n <= 0)
+            return 0;
+        len += (size_t)n;
+        buf[len] = '\0';
+        char *end = strstr(buf, "\r\n\r\n");
+        if (!end)
+            continue;
+        char *cl = strcasestr(buf, "Content-Length:");
+        size_t body = cl && cl < end ? strtoul(cl + 15, NULL, 10) : 0;
+        if (len >= (size_t)(end + 4 - buf) + body)
+            return 1;
+    }
+}
+
+static void *serve(void *arg) {
+    struct server *s = arg;
+    for (int c = 0; c < NCONNS; c++) {
+        int fd = accept(s->lfd, NULL, NULL);
+        if (fd < 0)
+            break;
+        __atomic_add_fetch(&s->conns, 1, __ATOMIC_SEQ_CST);
+        for (int k = 0; k < answers_per_conn[c] && read_request(fd); k++) {
+            if (send(fd, answer, sizeof(answer) - 1, MSG_NOSIGNAL) < 0)
+                break;
+            __atomic_add_fetch(&s->requests, 1, __ATOMIC_SEQ_CST);
+        }
+        close(fd);
+        __atomic_add_fetch(&s->closed, 1, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+static int server_start(struct server *s) {
+    struct sockaddr_in a = { .sin_family = AF_INET };
+    socklen_t alen = sizeof(a);
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    memset(s, 0, sizeof(*s));
+    s->lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s->lfd < 0 || bind(s->lfd, (struct sockaddr *)&a, sizeof(a)) < 0 ||
+        listen(s->lfd, 8) < 0 ||
+        getsockname(s->lfd, (struct sockaddr *)&a, &alen) < 0)
+        return -1;
+    s->port = ntohs(a.sin_port);
+    return 0;
+}
+
+static int get(int *v) {
+    return __atomic_load_n(v, __ATOMIC_SEQ_CST);
+}
+
+/* Until the server has closed n connections (the FIN reaches the client) */
+static void wait_closed(struct server *s, int n) {
+    for (int i = 0; i < 2000 && get(&s->closed) < n; i++)
+        usleep(1000);
+    usleep(10000);
+}
+
+/* Outcome of the last call */
+static mc_result last;
+static int       last_id;
+static size_t    last_count;
+
+static void on_movies(mc_ctx *ctx, const mc_result *res,
+                      const mc_movie *movies, size_t count, void *user) {
+    last = *res;
+    last_count = count;
+    last_id = count ? movies[0].id : 0;
+}
+
+static void on_done(mc_ctx *ctx, const mc_result *res, void *user) {
+    last = *res;
+}
+
+int main(void) {
+    struct server s;
+    pthread_t tid;
+    if (server_start(&s) < 0 || pthread_create(&tid, NULL, serve, &s) != 0) {
+        perror("server");
+        return 1;
+    }
+
+    mc_ctx *ctx = mc_new("127.0.0.1", s.port);
+    CHECK(ctx != NULL);
+    if (!ctx)
+        return unit_done("movieclient");
+    mc_set_max_conns(ctx, 1);
+    mc_set_timeout(ctx, 5000);
+
+    /* Connect */
+    CHECK(mc_get_movies(ctx, on_movies, NULL) == 0);
+    CHECK(mc_run(ctx) == 0);
+    CHECK(MC_OK(&last) && last.error == 0);
+    CHECK(last_count == 1 && last_id == 1);
+    CHECK(get(&s.conns) == 1);
+
+    /* Reuse: same connection, which the server then drops */
+    CHECK(mc_get_movie(ctx, 5, on_movies, NULL) == 0);
+    CHECK(mc_run(ctx) == 0);
+    CHECK(MC_OK(&last));
+    CHECK(last_count == 1 && last_id == 5);
+    CHECK(get(&s.conns) == 1);
+    wait_closed(&s, 1);
+
+    /* Replay: a GET on the dead connection is sent again on a new one */
+    CHECK(mc_get_movies(ctx, on_movies, NULL) == 0);
+    CHECK(mc_run(ctx) == 0);
+    CHECK(MC_OK(&last) && last.error == 0);
+    CHECK(get(&s.conns) == 2);
+    CHECK(get(&s.requests) == 3);
+    wait_closed(&s, 2);
+
+    /* No replay: a POST sent on a dead connection fails */
+    mc_movie m = { .title = "C", .year = 2001, .rating = 6.5 };
+    CHECK(mc_add_movie(ctx, &m, on_done, NULL) == 0);
+    CHECK(mc_run(ctx) == 0);
+    CHECK(last.status == 0 && last.error != 0);
+    CHECK(get(&s.conns) == 2);
+    CHECK(get(&s.requests) == 3);
+
+    /* The failed connection was not kept: the next call connects again */
+    CHECK(mc_get_movies(ctx, on_movies, NULL) == 0);
+    CHECK(mc_run(ctx) == 0);
+    CHECK(MC_OK(&last));
+    CHECK(get(&s.conns) == 3);
+
+    mc_free(ctx);
+    pthread_join(tid, NULL);
+    close(s.lfd);
+    return unit_done("movieclient");
+}
@@ -0,0 +1,103 @@
+// 324CC Stefan CALMAC
+#define _GNU_SOURCE
+#include "unit.h"
+#include "output.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+/* out_*() output between begin() and end() */
+static FILE  *stream;
+static char  *text;
+static size_t text_len;
+
+static void begin(void) {
+    free(text);
+    text = NULL;
+    stream = open_memstream(&text, &text_len);
+    out_capture(stream);
+}
+
+static const char *end(void) {
+    out_capture(NULL);
+    fclose(stream);
+    return text;
+}
+
+static const char *tsv(const char *s) {
+    begin();
+    out_tsv(s);
+    return end();
+}
+
+static void test_tsv(void) {
+    CHECK_STR(tsv("plain"), "plain");
+    CHECK_STR(tsv("a\tb\nc\rd\\e"), "a\\tb\\nc\\rd\\\\e");
+    CHECK_STR(tsv("\\t"), "\\\\t");
+    CHECK_STR(tsv("\xc8\x98tefan \"q\""), "\xc8\x98tefan \"q\"");
+    CHECK_STR(tsv(""), "");
+    CHECK_STR(tsv(NULL), "");
+
+    begin();
+    out_long(0);
+    out_char(' ');
+    out_long(-42);
+    out_char(' ');
+    out_long(LONG_MIN);
+    out_char(' ');
+    out_long(LONG_MAX);
+    CHECK_STR(end(), "0 -42 -9223372036854775808 9223372036854775807");
+}
+
+static void test_json_line(void) {
+    begin();
+    CHECK(out_json_line(" {\n  \"a\" : [ 1 , 2 ],\n  \"s\" : \"x  y\\\" }\"\n}\n")
+          == 0);
+    CHECK_STR(end(), "{\"a\":[1,2],\"s\":\"x  y\\\" }\"}\n");
+
+    begin();
+    CHECK(out_json_line("{\"a\": [1, 2}") == -1);
+    end();
+}
+
+static const char *elements(const char *json, const char *key, long *n) {
+    begin();
+    *n = out_json_elements(json, key);
+    return end();
+}
+
+static void test_json_elements(void) {
+    long n;
+    CHECK_STR(elements("{\"count\": 2, \"movies2\": [9],\n"
+                       " \"movies\": [ {\"id\": 1, \"t\": \"a, b\"},\n"
+                       "  {\"id\": 2, \"tags\": [\"x\", {\"y\": null}]} ],"
+                       " \"after\": true}", "movies", &n),
+              "{\"id\":1,\"t\":\"a, b\"}\n"
+              "{\"id\":2,\"tags\":[\"x\",{\"y\":null}]}\n");
+    CHECK(n == 2);
+
+    CHECK_STR(elements("{\"ids\": [1, -2.5e3, \"3\", null, [] ]}", "ids", &n),
+              "1\n-2.5e3\n\"3\"\nnull\n[]\n");
+    CHECK(n == 5);
+
+    elements("{\"movies\": []}", "movies", &n);
+    CHECK(n == 0);
+    elements("{\"movies\": {}}", "movies", &n);
+    CHECK(n == -1);
+    elements("{\"other\": [1]}", "movies", &n);
+    CHECK(n == -1);
+    elements("[{\"movies\": [1]}]", "movies", &n);
+    CHECK(n == -1);
+    elements("{\"movies\": [1, 2", "movies", &n);
+    CHECK(n == -1);
+    elements("{\"movies\": [1 2]}", "movies", &n);
+    CHECK(n == -1);
+}
+
+int main(void) {
+    test_tsv();
+    test_json_line();
+    test_json_elements();
+    free(text);
+    return unit_done("output");
+}
@@ -0,0 +1,123 @@
+// 324CC Stefan CALMAC
+#include "unit.h"
+#include "parson.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* xorshift64, so every run checks the same values */
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t next(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static int same(double a, double b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static double parse(const char *text) {
+    JSON_Value *v = json_parse_string(text);
+    double d = json_value_get_type(v) == JSONNumber ? json_value_get_number(v)
+                                                    : NAN;
+    json_value_free(v);
+    return d;
+}
+
+static void test_serialize(void) {
+    static const struct { double v; const char *text; } cases[] = {
+        { 6.5,                     "6.5" },
+        { 0.1,                     "0.1" },
+        { 0.3,                     "0.3" },
+        { -0.5,                    "-0.5" },
+        { 2020,                    "2020" },
+        { 100,                     "100" },
+        { -0.0,                    "-0" },
+        { 123456.789,              "123456.789" },
+        { 1e21,                    "1e+21" },
+        { 1e-7,                    "1e-7" },
+        { 5e-324,                  "5e-324" },
+        { 1.7976931348623157e308,  "1.7976931348623157e+308" },
+        /* Grisu2 round-trips but is one digit longer than needed here */
+        { 1e23,                    "9.999999999999999e+22" },
+    };
+    char buf[64];
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        CHECK(json_serialize_number(cases[i].v, buf) == (int)strlen(buf));
+        CHECK_STR(buf, cases[i].text);
+    }
+    json_serialize_number(NAN, buf);
+    CHECK_STR(buf, "null");
+    json_serialize_number(INFINITY, buf);
+    CHECK_STR(buf, "null");
+}
+
+/* Every finite double written by Grisu2 reads back to the same bits */
+static void test_round_trip(void) {
+    char buf[64];
+    int bad = 0, tried = 0;
+    for (int i = 0; i < 200000; i++) {
+        uint64_t bits = next();
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        if (!isfinite(v))
+            continue;
+        tried++;
+        json_serialize_number(v, buf);
+        if (!same(strtod(buf, NULL), v) || !same(parse(buf), v))
+            bad++;
+    }
+    CHECK(tried > 190000);
+    CHECK(bad == 0);
+}
+
+/* The integer and Clinger fast paths agree with strtod() */
+static void test_parse(void) {
+    static const char *exact[] = {
+        "0", "-0", "7", "2020", "9007199254740992", "9007199254740993",
+        "18446744073709551615", "123456789012345678901234567890",
+        "0.1", "3.14159", "-2.5e-3", "1e22", "1e23", "1E-22", "4.9e-324",
+        "2.2250738585072014e-308", "1.7976931348623157e308", "8.3",
+    };
+    for (size_t i = 0; i < sizeof(exact) / sizeof(exact[0]); i++)
+        CHECK(same(parse(exact[i]), strtod(exact[i], NULL)));
+
+    char text[64];
+    int bad = 0;
+    for (int i = 0; i < 200000; i++) {
+        uint64_t r = next();
+        int digits = 1 + (int)(r % 19);
+        int point = (int)((r >> 8) % (uint64_t)(digits + 1));
+        int exp = (int)((r >> 16) % 61) - 30;
+        char *p = text;
+        if (r >> 63)
+            *p++ = '-';
+        for (int d = 0; d < digits; d++) {
+            if (d == point && d > 0)
+                *p++ = '.';
+            *p++ = (char)('0' + (d == 0 ? 1 + next() % 9 : next() % 10));
+        }
+        sprintf(p, (r >> 62) & 1 ? "e%d" : "", exp);
+        if (!same(parse(text), strtod(text, NULL)))
+            bad++;
+    }
+    CHECK(bad == 0);
+
+    static const char *malformed[] = { "01", "1.", ".5", "1e", "+1", "-", "1e+" };
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        JSON_Value *v = json_parse_string(malformed[i]);
+        CHECK(v == NULL);
+        json_value_free(v);
+    }
+}
+
+int main(void) {
+    test_serialize();
+    test_round_trip();
+    test_parse();
+    return unit_done("parson");
+}
@@ -0,0 +1,94 @@
+// 324CC Stefan CALMAC
+#include "unit.h"
+#include "search.h"
+
+static struct search_hit hits[SEARCH_MAX_HITS];
+
+/* Ids of the hits, best first, joined with ',' */
+static const char *query(const char *q) {
+    static char text[256];
+    size_t n = search_query(q, hits, SEARCH_MAX_HITS);
+    text[0] = '\0';
+    for (size_t i = 0; i < n; i++)
+        snprintf(text + strlen(text), sizeof(text) - strlen(text), "%s%d",
+                 i ? "," : "", hits[i].id);
+    return text;
+}
+
+static void test_tokens(void) {
+    search_index_movie(1, "Spider-Man: Homecoming", NULL);
+    search_index_movie(2, "Ștefan cel Mare", "A ȘTEFAN biopic, from Moldova.");
+    search_index_movie(3, "ΑΘΗΝΑ", NULL);
+    search_index_movie(4, "Mare Nostrum", NULL);
+    CHECK(search_doc_count() == 4);
+
+    CHECK_STR(query("spider-man"), "1");
+    CHECK_STR(query("SPIDER"), "1");
+    CHECK_STR(query("homecoming!"), "1");
+    CHECK_STR(query("stefan"), "2");
+    CHECK_STR(query("Ştefan"), "2");        /* cedilla, not comma below */
+    CHECK_STR(query("moldova"), "2");
+    CHECK_STR(query("αθηνα"), "3");
+    CHECK_STR(query("hom*"), "1");
+    CHECK_STR(query("m*"), "2,1,4");        /* mare+moldova, rare man, mare */
+    CHECK_STR(query("ideR"), "1");          /* substring of a word */
+    CHECK_STR(query("id"), "");             /* too short for a substring */
+    CHECK_STR(query("zebra"), "");
+    CHECK_STR(query(""), "");
+}
+
+static void test_ranking(void) {
+    /* More matched terms first, whatever the scores */
+    search_index_movie(10, "Red Heat", NULL);
+    search_index_movie(11, "Heat", NULL);
+    search_index_movie(12, "Red", NULL);
+    CHECK_STR(query("red heat"), "10,11,12");
+
+    /* A title hit beats a description hit */
+    search_index_movie(20, "Quiet place", "nothing about volcanoes");
+    search_index_movie(21, "Volcano", "a quiet film");
+    CHECK_STR(query("volcano"), "21");
+    CHECK_STR(query("quiet"), "20,21");
+
+    /* Same hits: the shorter field ranks higher (length normalization) */
+    search_index_movie(30, "Lighthouse and the long voyage of the ship", NULL);
+    search_index_movie(31, "Lighthouse", NULL);
+    CHECK_STR(query("lighthouse"), "31,30");
+    CHECK(hits[0].score > hits[1].score);
+    CHECK(hits[0].matched == 1);
+
+    /* A rare term outweighs a common one */
+    search_index_movie(40, "Common common", NULL);
+    search_index_movie(41, "Common rare", NULL);
+    search_index_movie(42, "Common", NULL);
+    query("common rare");
+    CHECK(hits[0].id == 41 && hits[0].matched == 2);
+}
+
+static void test_updates(void) {
+    search_index_movie(50, "Old title", NULL);
+    CHECK_STR(query("old"), "50");
+    search_index_movie(50, "New title", NULL);
+    CHECK_STR(query("old"), "");
+    CHECK_STR(query("new"), "50");
+
+    /* A listing entry keeps the description the details brought */
+    search_index_details(50, "{\"title\":\"New title\","
+                             "\"description\":\"glacier\"}");
+    search_index_listing("{\"movies\":[{\"id\":50,\"title\":\"New title\"},"
+                         "{\"id\":51,\"title\":\"Glacier\"}]}");
+    CHECK_STR(query("glacier"), "51,50");
+
+    size_t before = search_doc_count();
+    search_remove_movie(51);
+    search_remove_movie(999);
+    CHECK(search_doc_count() == before - 1);
+    CHECK_STR(query("glacier"), "50");
+}
+
+int main(void) {
+    test_tokens();
+    test_ranking();
+    test_updates();
+    return unit_done("search");
+}
@@ -0,0 +1,44 @@
+#ifndef UNIT_H
+#define UNIT_H
+// 324CC Stefan CALMAC
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @file unit.h
+ * @brief Minimal checks for the unit tests: a failed check is reported
+ *        with its location and the test goes on; unit_done() gives the
+ *        exit status.
+ */
+
+static int unit_checks, unit_failures;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        unit_checks++;                                                     \
+        if (!(cond)) {                                                     \
+            unit_failures++;                                               \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n",                   \
+                    __FILE__, __LINE__, #cond);                            \
+        }                                                                  \
+    } while (0)
+
+#define CHECK_STR(got, want)                                               \
+    do {                                                                   \
+        const char *g_ = (got), *w_ = (want);                              \
+        unit_checks++;                                                     \
+        if (!g_ || strcmp(g_, w_) != 0) {                                  \
+            unit_failures++;                                               \
+            fprintf(stderr, "%s:%d: %s is \"%s\", expected \"%s\"\n",      \
+                    __FILE__, __LINE__, #got, g_ ? g_ : "(null)", w_);     \
+        }                                                                  \
+    } while (0)
+
+/** Print the summary line; returns the process exit status. */
+static inline int unit_done(const char *name) {
+    printf("%-12s %4d checks, %d failed\n", name, unit_checks, unit_failures);
+    return unit_failures ? 1 : 0;
+}
+
+#endif // UNIT_H
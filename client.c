@@ -1,35 +1,74 @@
 // 324CC Stefan CALMAC
+#include "client.h"
+#include "daemon.h"
 #include "helper.h"
 #include "requests.h"
 #include "commands.h"
+#include "trace.h"
+#include "fanout.h"
+#include "retry.h"
+#include "timeout.h"
+#include "compress.h"
+#include "shmcache.h"
+#include "sync.h"
+#include "catalog.h"
+#include "analyze.h"
+#include "output.h"
+#include "uring.h"
+#include "tcpopt.h"
+#include "h2.h"
+
+#include <errno.h>
+#include <limits.h>
 
 /* Global state for the client process */
 int   client_socket = -1;   /**< Active socket descriptor, or -1 if closed */
 char *cookie        = NULL; /**< Session cookie string (malloc’d), or NULL if not set */
 char *token         = NULL; /**< JWT access token string (malloc’d), or NULL if not set */
+bool  client_prewarm = false;
+
+static int warm_socket = -1;   /**< Connection opened ahead of the next command */
 
 /**
- * Dispatch a single text command by name.
+ * Connection for the next command: the one opened while waiting for it if
+ * the server has not closed it meanwhile, otherwise a fresh one.
+ */
+static int take_conn(void) {
+    int fd = warm_socket;
+    warm_socket = -1;
+    if (fd >= 0) {
+        if (conn_alive(fd))
+            return fd;
+        close(fd);
+    }
+    return setup_conn();
+}
+
+/**
+ * Match a command string against the known commands and run its handler.
  * - Closes and reopens the TCP connection on every command to ensure freshness.
- * - Matches the input command string against known commands.
  * - Calls the appropriate handler function, passing pointers to cookie/token and socket.
  *
- * @param cmd  Null-terminated command string (e.g. "login", "get_movies", "exit").
- * @return     Handler-specific return code, or EXIT to signal program termination.
- *             Returns 0 for unrecognized commands.
+ * @param cmd  Null-terminated command string (e.g. "login", "get_movies").
+ * @return     Handler-specific return code; 0 for unrecognized commands.
  */
-int commands_dispatch(char *cmd) {
-    if (!cmd) return -1;
-
-    /* Special built-in: exit command */
-    if (strcmp(cmd, "exit") == 0) {
-        return EXIT;
-    }
+static int run_command(char *cmd) {
+    /* Local commands never touch the network */
+    if (strcmp(cmd, "stats") == 0)
+        return handle_stats();
+    if (strcmp(cmd, "catalog_stats") == 0)
+        return handle_catalog_stats();
+    if (strcmp(cmd, "analyze") == 0)
+        return handle_analyze();
 
-    /* Re-establish the connection for each command */
+    /* Use a fresh (or freshly pre-opened) connection for each command */
     close(client_socket);
     client_socket = -1;
-    client_socket = setup_conn();
+    client_socket = take_conn();
+    if (client_socket < 0) {
+        printf("ERROR: unable to reach the server\n");
+        return -1;
+    }
 
     /* Match and invoke the corresponding handler */
     if (strcmp(cmd, "login_admin") == 0) {
@@ -40,6 +79,8 @@ int commands_dispatch(char *cmd) {
         return handle_get_users(&cookie, client_socket);
     } else if (strcmp(cmd, "delete_user") == 0) {
         return handle_delete_user(&cookie, client_socket);
+    } else if (strcmp(cmd, "delete_users") == 0) {
+        return handle_delete_users(&cookie, client_socket);
     } else if (strcmp(cmd, "login") == 0) {
         return handle_login(&cookie, client_socket);
     } else if (strcmp(cmd, "logout_admin") == 0) {
@@ -56,21 +97,32 @@ int commands_dispatch(char *cmd) {
         return handle_add_movie(&token, client_socket);
     } else if (strcmp(cmd, "delete_movie") == 0) {
         return handle_delete_movie(&token, client_socket);
+    } else if (strcmp(cmd, "delete_movies") == 0) {
+        return handle_delete_movies(&token, client_socket);
     } else if (strcmp(cmd, "update_movie") == 0) {
         return handle_update_movie(&token, client_socket);
     } else if (strcmp(cmd, "get_collections") == 0) {
         return handle_get_collections(&token, client_socket);
     } else if (strcmp(cmd, "get_collection") == 0) {
-        return handle_get_collection(&token, client_socket);
+        return handle_get_collection(&token, client_socket, false);
+    } else if (strcmp(cmd, "get_collection --expand") == 0) {
+        /* 'true' also fetches every movie of the collection in parallel */
+        return handle_get_collection(&token, client_socket, true);
     } else if (strcmp(cmd, "add_collection") == 0) {
         return handle_add_collection(&token, client_socket);
     } else if (strcmp(cmd, "delete_collection") == 0) {
         /* 'false' indicates user will be prompted for the collection ID */
         return handle_delete_collection(&token, client_socket, false, NULL);
+    } else if (strcmp(cmd, "delete_collections") == 0) {
+        return handle_delete_collections(&token, client_socket);
     } else if (strcmp(cmd, "add_movie_to_collection") == 0) {
         return handle_add_movie_to_collection(&token, client_socket);
     } else if (strcmp(cmd, "delete_movie_from_collection") == 0) {
         return handle_delete_movie_from_collection(&token, client_socket);
+    } else if (strcmp(cmd, "search_movies") == 0) {
+        return handle_search_movies(&token, client_socket);
+    } else if (strcmp(cmd, "sync") == 0) {
+        return handle_sync(&token, client_socket);
     } else {
         /* Unknown commands are simply echoed back */
         printf("Unknown command: %s\n", cmd);
@@ -78,15 +130,58 @@ int commands_dispatch(char *cmd) {
     }
 }
 
+/**
+ * Dispatch a single text command by name.
+ * - Handles the built-in exit command.
+ * - Runs the matching handler under the per-command deadline, which all
+ *   of its sub-requests share, and, when tracing is enabled, records a
+ *   span covering the whole command.
+ * - Flushes the command's output once it has finished.
+ *
+ * @param cmd  Null-terminated command string (e.g. "login", "get_movies", "exit").
+ * @return     Handler-specific return code, or EXIT to signal program termination.
+ *             Returns 0 for unrecognized commands.
+ */
+int commands_dispatch(char *cmd) {
+    if (!cmd) return -1;
+
+    /* Special built-in: exit command */
+    if (strcmp(cmd, "exit") == 0) {
+        return EXIT;
+    }
+
+    uint64_t start = trace_active ? trace_now_ns() : 0;
+    deadline_start(timeout_policy.command_ms);
+    int ret = run_command(cmd);
+    deadline_clear();
+    trace_command(cmd, start, ret);
+    out_flush();
+    return ret;
+}
+
 /**
  * Main client loop: read commands from stdin until EOF or 'exit' is entered.
+ * - Refills the retry budget for this batch of commands.
+ * - In daemon mode, opens the next connection before waiting for input.
  * - Uses helper_readline() to get each command string.
  * - Frees the command buffer after dispatch.
  * - Breaks out of the loop when commands_dispatch returns EXIT.
  */
 void client_run(void) {
     char *cmd = NULL;
-    while ((cmd = helper_readline()) != NULL) {
+
+    /* The whole stdin session is one batch for the retry budget */
+    retry_budget_reset();
+    for (;;) {
+        /* Daemon mode: connect while waiting for the next command */
+        if (client_prewarm && warm_socket < 0) {
+            close(client_socket);
+            client_socket = -1;
+            warm_socket = try_conn();
+        }
+        if ((cmd = helper_readline()) == NULL)
+            break;
+
         int r = commands_dispatch(cmd);
         free(cmd);
         if (r == EXIT)
@@ -96,27 +191,253 @@ void client_run(void) {
 
 /**
  * Clean up global client state before exiting:
- * - Close any open socket.
+ * - Close any open sockets.
  * - Free malloc’d cookie and token strings if set.
+ * - Flush and close the trace file if tracing was enabled.
+ * - Unmap the shared response cache.
  */
 void client_cleanup(void) {
+    trace_shutdown();
+    shm_cache_close();
+    close(warm_socket);
     close(client_socket);
     free(cookie);
     free(token);
 }
 
+#define MODE_LOCAL  0
+#define MODE_DAEMON 1
+#define MODE_REMOTE 2
+
+static int  run_mode = MODE_LOCAL;      /**< MODE_LOCAL, MODE_DAEMON or MODE_REMOTE */
+static char sock_path[DAEMON_PATH_SZ];  /**< Daemon socket for --daemon/--remote */
+
+/**
+ * Parse a decimal option value: digits with an optional '-', nothing else.
+ *
+ * @return  0, or -1 if arg is not such a number or is outside [min, max].
+ */
+static int parse_long(const char *arg, long min, long max, long *out) {
+    char *end;
+    if (*arg != '-' && !isdigit((unsigned char)*arg))
+        return -1;
+    errno = 0;
+    long n = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno == ERANGE || n < min || n > max)
+        return -1;
+    *out = n;
+    return 0;
+}
+
+/**
+ * Parse the value of a --*-timeout option: milliseconds, 0 meaning none.
+ *
+ * @return  0, or -1 (with a message) if it is not a non-negative number.
+ */
+static int parse_timeout(const char *opt, const char *arg, int *ms) {
+    long n;
+    if (parse_long(arg, 0, INT_MAX, &n) < 0) {
+        fprintf(stderr, "%s must be a non-negative number of milliseconds\n",
+                opt);
+        return -1;
+    }
+    *ms = (int)n;
+    return 0;
+}
+
+/**
+ * Parse command-line options:
+ *   --trace=FILE                  record command/request spans to FILE
+ *   --trace-format=chrome|jsonl   trace output format (default: chrome)
+ *   --max-inflight=N              concurrent requests for parallel commands
+ *   --retries=N                   retries per connect / idempotent request
+ *   --retry-budget=N              total retries allowed per batch
+ *   --connect-timeout=MS          connect timeout (0 = none)
+ *   --io-timeout=MS               read/write inactivity timeout (0 = none)
+ *   --command-timeout=MS          deadline for a whole command (0 = none)
+ *   --no-compression              do not ask for gzip/deflate responses
+ *   --gzip-requests=BYTES         gzip POST/PUT bodies of at least BYTES
+ *   --snapshot=PATH               library snapshot used by "sync"
+ *   --catalog=PATH                columnar catalog written by "sync"
+ *   --no-simd                     use the scalar loops in "analyze"
+ *   --io-uring                    do socket I/O through io_uring if available
+ *   --h2c[=upgrade]               run fan-out batches over HTTP/2 cleartext,
+ *                                 with prior knowledge or via Upgrade: h2c
+ *   --no-nodelay                  leave Nagle's algorithm on
+ *   --tcp-fastopen                send the first request in the SYN (TFO)
+ *   --tcp-quickack                ACK every read right away
+ *   --sndbuf=BYTES / --rcvbuf=BYTES  socket buffer sizes
+ *   --keepalive=IDLE[,INTVL[,CNT]]   TCP keepalive probes (seconds)
+ *   --output=text|jsonl|tsv       format of listings and details
+ *   --shared-cache[=TTL_MS]       cache library GETs in /dev/shm across processes
+ *   --daemon[=SOCKET]             serve sessions on a Unix domain socket
+ *   --remote[=SOCKET]             forward stdin/stdout to a running daemon
+ *
+ * @return  0 on success, -1 on an unknown or malformed option.
+ */
+static int parse_options(int argc, char *argv[]) {
+    const char *trace_path = NULL;
+    int trace_format = TRACE_FMT_CHROME;
+    int cache_ttl = 0;
+    long n;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_path = argv[i] + 8;
+        } else if (strncmp(argv[i], "--max-inflight=", 15) == 0) {
+            if (parse_long(argv[i] + 15, 1, FANOUT_MAX_CONNS, &n) < 0) {
+                fprintf(stderr, "--max-inflight must be between 1 and %d\n",
+                        FANOUT_MAX_CONNS);
+                return -1;
+            }
+            fanout_limit = (int)n;
+        } else if (strncmp(argv[i], "--retries=", 10) == 0) {
+            if (parse_long(argv[i] + 10, 0, INT_MAX, &n) < 0) {
+                fprintf(stderr, "--retries must be a non-negative number\n");
+                return -1;
+            }
+            retry_policy.retries = (int)n;
+        } else if (strncmp(argv[i], "--retry-budget=", 15) == 0) {
+            if (parse_long(argv[i] + 15, 0, INT_MAX, &n) < 0) {
+                fprintf(stderr, "--retry-budget must be a non-negative "
+                                "number\n");
+                return -1;
+            }
+            retry_policy.budget = (int)n;
+        } else if (strncmp(argv[i], "--connect-timeout=", 18) == 0) {
+            if (parse_timeout("--connect-timeout", argv[i] + 18,
+                              &timeout_policy.connect_ms) < 0)
+                return -1;
+        } else if (strncmp(argv[i], "--io-timeout=", 13) == 0) {
+            if (parse_timeout("--io-timeout", argv[i] + 13,
+                              &timeout_policy.io_ms) < 0)
+                return -1;
+        } else if (strncmp(argv[i], "--command-timeout=", 18) == 0) {
+            if (parse_timeout("--command-timeout", argv[i] + 18,
+                              &timeout_policy.command_ms) < 0)
+                return -1;
+        } else if (strcmp(argv[i], "--no-compression") == 0) {
+            compress_accept = false;
+        } else if (strncmp(argv[i], "--gzip-requests=", 16) == 0) {
+            if (parse_long(argv[i] + 16, 1, LONG_MAX, &n) < 0) {
+                fprintf(stderr, "--gzip-requests must be a number of bytes, "
+                                "at least 1\n");
+                return -1;
+            }
+            compress_request_min = (size_t)n;
+        } else if (strncmp(argv[i], "--snapshot=", 11) == 0) {
+            sync_snapshot_path = argv[i] + 11;
+        } else if (strncmp(argv[i], "--catalog=", 10) == 0) {
+            catalog_path = argv[i] + 10;
+        } else if (strcmp(argv[i], "--output=text") == 0) {
+            output_format = OUT_TEXT;
+        } else if (strcmp(argv[i], "--output=jsonl") == 0) {
+            output_format = OUT_JSONL;
+        } else if (strcmp(argv[i], "--output=tsv") == 0) {
+            output_format = OUT_TSV;
+        } else if (strcmp(argv[i], "--no-simd") == 0) {
+            analyze_force_scalar = true;
+        } else if (strcmp(argv[i], "--io-uring") == 0) {
+            uring_enabled = true;
+        } else if (strcmp(argv[i], "--h2c") == 0) {
+            h2_mode = H2_PRIOR;
+        } else if (strcmp(argv[i], "--h2c=upgrade") == 0) {
+            h2_mode = H2_UPGRADE;
+        } else if (strcmp(argv[i], "--no-nodelay") == 0) {
+            tcp_options.nodelay = false;
+        } else if (strcmp(argv[i], "--tcp-fastopen") == 0) {
+            tcp_options.fastopen = true;
+        } else if (strcmp(argv[i], "--tcp-quickack") == 0) {
+            tcp_options.quickack = true;
+        } else if (strncmp(argv[i], "--sndbuf=", 9) == 0 ||
+                   strncmp(argv[i], "--rcvbuf=", 9) == 0) {
+            if (parse_long(argv[i] + 9, 1, INT_MAX / 2, &n) < 0) {
+                fprintf(stderr, "%.8s must be between 1 and %d bytes\n",
+                        argv[i], INT_MAX / 2);
+                return -1;
+            }
+            if (argv[i][2] == 's')
+                tcp_options.sndbuf = (int)n;
+            else
+                tcp_options.rcvbuf = (int)n;
+        } else if (strncmp(argv[i], "--keepalive=", 12) == 0) {
+            if (tcp_parse_keepalive(argv[i] + 12) < 0) {
+                fprintf(stderr, "--keepalive expects IDLE[,INTVL[,CNT]] "
+                                "(seconds, count)\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--shared-cache") == 0) {
+            cache_ttl = SHM_CACHE_DEFAULT_TTL_MS;
+        } else if (strncmp(argv[i], "--shared-cache=", 15) == 0) {
+            if (parse_long(argv[i] + 15, 1, INT_MAX, &n) < 0) {
+                fprintf(stderr, "--shared-cache TTL must be between 1 and %d "
+                                "ms\n", INT_MAX);
+                return -1;
+            }
+            cache_ttl = (int)n;
+        } else if (strncmp(argv[i], "--daemon", 8) == 0 ||
+                   strncmp(argv[i], "--remote", 8) == 0) {
+            const char *path = argv[i] + 8;
+            if (*path != '\0' && *path++ != '=') {
+                fprintf(stderr, "Unknown option: %s\n", argv[i]);
+                return -1;
+            }
+            run_mode = argv[i][2] == 'd' ? MODE_DAEMON : MODE_REMOTE;
+            if (*path == '\0')
+                daemon_default_path(sock_path, sizeof(sock_path));
+            else
+                snprintf(sock_path, sizeof(sock_path), "%s", path);
+        } else if (strcmp(argv[i], "--trace-format=chrome") == 0) {
+            trace_format = TRACE_FMT_CHROME;
+        } else if (strcmp(argv[i], "--trace-format=jsonl") == 0) {
+            trace_format = TRACE_FMT_JSONL;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    /* Sessions share the connection for stdout and stderr */
+    if (run_mode != MODE_LOCAL && output_format != OUT_TEXT) {
+        fprintf(stderr, "--output=jsonl|tsv cannot be used with --daemon "
+                        "or --remote\n");
+        return -1;
+    }
+
+    if (trace_path && trace_init(trace_path, trace_format) < 0)
+        return -1;
+    if (cache_ttl && shm_cache_open(cache_ttl) < 0)
+        return -1;
+    return 0;
+}
+
 /**
  * Program entry point:
- * - Disable stdout buffering for immediate feedback.
- * - Enter the client command loop.
+ * - Parse command-line options.
+ * - In remote mode, just relay to the daemon.
+ * - Switch stdout to block buffering (flushed on prompts and per command).
+ * - Enter the client command loop, or serve daemon sessions.
  * - Perform cleanup on exit.
  */
 int main(int argc, char *argv[]) {
-    /* Ensure prompt output appears immediately */
-    setvbuf(stdout, NULL, _IONBF, 0);
+    if (parse_options(argc, argv) < 0)
+        return 1;
+
+    if (run_mode == MODE_REMOTE)
+        return remote_run(sock_path) < 0 ? 1 : 0;
 
-    client_run();
+    /* Output is flushed before reading input and after each command */
+    if (out_init() < 0)
+        return 1;
+
+    int ret = 0;
+    if (run_mode == MODE_DAEMON) {
+        client_prewarm = true;
+        ret = daemon_serve(sock_path) < 0 ? 1 : 0;
+    } else {
+        client_run();
+    }
     client_cleanup();
 
-    return 0;
+    return ret;
 }
@@ -0,0 +1,44 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+
+/**
+ * @file client.h
+ * @brief Client session state and the command loop.
+ *
+ * The session (socket, cookie, JWT) lives in globals owned by client.c, so
+ * the same loop can serve one stdin session or, in daemon mode, many
+ * consecutive sessions that share the login state.
+ */
+
+extern int   client_socket;  /**< Active socket descriptor, or -1 if closed */
+extern char *cookie;         /**< Session cookie (malloc’d), or NULL */
+extern char *token;          /**< JWT access token (malloc’d), or NULL */
+
+/**
+ * When set, open the connection for the next command while waiting for it
+ * (daemon mode), instead of connecting after the command has been read.
+ */
+extern bool client_prewarm;
+
+/**
+ * Dispatch a single command string.
+ *
+ * @param cmd  Command text (without newline).
+ * @return     Handler return code, or EXIT for the "exit" command.
+ */
+int commands_dispatch(char *cmd);
+
+/**
+ * Read and dispatch commands from stdin until EOF or "exit".
+ */
+void client_run(void);
+
+/**
+ * Release the session state and shut down tracing.
+ */
+void client_cleanup(void);
+
+#endif // CLIENT_H
@@ -4,12 +4,27 @@
 #include "parson.h"
 #include "helper.h"
 #include "routes.h"
+#include "fanout.h"
+#include "timeout.h"
+#include "stats.h"
+#include "search.h"
+#include "sync.h"
+#include "catalog.h"
+#include "analyze.h"
+#include "jsonw.h"
+#include "output.h"
+#include "decode.h"
+#include "coro.h"
+
+#include <errno.h>
 
 /* Sends a POST request to add the specified movie to the given collection.
- * Re-establishes the connection if necessary and attaches the JWT token header.
- * Returns 0 on success, -1 on no response, -2 for HTTP errors.
+ * Replaces *sockfd with a new connection (the request closes it). The body
+ * is built in its own buffer, so this may run in a coroutine.
+ * Returns the response, or NULL if none arrived.
  */
-int add_movie_to_collection(char **token, int *sockfd, int collection_id, int movie_id)
+static char *post_collection_movie(const char *token, int *sockfd,
+								   int collection_id, int movie_id)
 {
 	close(*sockfd);
 	*sockfd = -1;
@@ -22,40 +37,59 @@ int add_movie_to_collection(char **token, int *sockfd, int collection_id, int mo
 	}
 
 	snprintf(hdr_token, HDR_COOKIE_SZ,
-			 "Authorization: Bearer %s\r\n", *token);
-
-	JSON_Value *root = json_value_init_object();
-	JSON_Object *o = json_value_get_object(root);
-	json_object_set_number(o, "id", movie_id);
-	char *body = json_serialize_to_string(root);
+			 "Authorization: Bearer %s\r\n", token);
+
+	struct dbuf buf = { 0 };
+	struct json_writer w;
+	jw_start(&w, &buf);
+	jw_object_begin(&w);
+	jw_field_int(&w, "id", movie_id);
+	jw_object_end(&w);
+	const char *body = jw_finish(&w);
+	if (!body) {
+		printf("ERROR: unable to allocate memory for the request body\n");
+		free(buf.data);
+		free(hdr_token);
+		return NULL;
+	}
 
 	char path[512];
 	snprintf(path, sizeof(path), "%s/%d/movies",
 			 ROUTE_MANAGE_COLLECTIONS, collection_id);
 
 	char *resp = request_post(path, body, PAYLOAD_APP_JSON, *sockfd, hdr_token);
+	free(buf.data);
+	free(hdr_token);
+	return resp;
+}
+
+/* Reports the outcome of adding a movie to a collection and frees resp.
+ * Returns 0 on success, -1 on no response, -2 for HTTP errors.
+ */
+static int collection_add_result(char *resp)
+{
 	if (!resp) {
 		fprintf(stderr, "Error: no response\n");
-		free(resp);
-		free(hdr_token);
-		json_free_serialized_string(body);
-		json_value_free(root);
 		return -1;
-	} else {
-		int status = get_status(resp);
-		char str[CODE_SZ];
-		sprintf(str, "%d", status);
-		if (str[0] != '2') {
-			print_http_error(status, resp);
-			free(resp);
-			return -2;
-		}
-		free(hdr_token);
-		free(resp);
-		json_free_serialized_string(body);
-		json_value_free(root);
-		return 0;
 	}
+
+	int res = 0;
+	int status = get_status(resp);
+	if (status / 100 != 2) {
+		print_http_error(status, resp);
+		res = -2;
+	}
+	free(resp);
+	return res;
+}
+
+/* Adds the specified movie to the given collection, attaching the JWT
+ * token header. Returns 0 on success, -1 on no response, -2 for HTTP errors.
+ */
+int add_movie_to_collection(char **token, int *sockfd, int collection_id, int movie_id)
+{
+	return collection_add_result(
+		post_collection_movie(*token, sockfd, collection_id, movie_id));
 }
 
 /* Prompts for collection and movie IDs, checks authorization,
@@ -235,6 +269,80 @@ int handle_delete_collection(char **token, int sockfd,
 	return 0;
 }
 
+/* Movies being added to a new collection by collection_add_worker() */
+struct collection_adds {
+	const char *token;
+	int id;
+	const int *ids;
+	int count;
+	int next;		/* next movie to hand out */
+	bool failed;	/* an add failed: hand out no more */
+	char **resps;	/* response of each add sent, NULL if none arrived */
+	bool *sent;
+};
+
+/* Coroutine: takes the next pending movie until none is left or an add
+ * failed. */
+static void collection_add_worker(void *arg)
+{
+	struct collection_adds *a = arg;
+	int sockfd = -1;
+
+	while (!a->failed && a->next < a->count) {
+		int i = a->next++;
+		char *resp = post_collection_movie(a->token, &sockfd, a->id,
+										   a->ids[i]);
+		a->resps[i] = resp;
+		a->sent[i] = true;
+		if (!resp || get_status(resp) / 100 != 2)
+			a->failed = true;
+	}
+	close(sockfd);
+}
+
+/* Adds the movies to a new collection. The adds run as up to
+ * --max-inflight coroutines on this thread, each on its own connection.
+ * As with one add after the other, only the first failing add (in input
+ * order) is reported, and none is started after a failure.
+ * Returns 0 on success, -1 on no response, -2 for HTTP errors.
+ */
+static int add_collection_movies(const char *token, int id, const int *ids,
+								 int count)
+{
+	struct collection_adds a = {
+		.token = token, .id = id, .ids = ids, .count = count,
+		.resps = calloc(count ? count : 1, sizeof(char *)),
+		.sent = calloc(count ? count : 1, sizeof(bool)),
+	};
+	if (!a.resps || !a.sent) {
+		printf("ERROR: unable to allocate memory\n");
+		exit(-1);
+	}
+
+	int workers = count < fanout_limit ? count : fanout_limit;
+	int spawned = 0;
+	for (int i = 0; i < workers; i++)
+		if (coro_spawn(collection_add_worker, &a) == 0)
+			spawned++;
+	if (spawned > 0)
+		coro_run();
+	else
+		collection_add_worker(&a);
+
+	int res = 0;
+	for (int i = 0; i < count; i++) {
+		if (!a.sent[i])
+			continue;
+		if (res == 0)
+			res = collection_add_result(a.resps[i]);
+		else
+			free(a.resps[i]);
+	}
+	free(a.resps);
+	free(a.sent);
+	return res;
+}
+
 /* Creates a new collection with the given title and initial movies.
  * Validates all inputs. On successful creation, adds each movie and rolls
  * back if any addition fails.
@@ -293,10 +401,18 @@ int handle_add_collection(char **token, int sockfd)
 	snprintf(hdr_token, HDR_COOKIE_SZ,
 			 "Authorization: Bearer %s\r\n", *token);
 
-	JSON_Value *root = json_value_init_object();
-	JSON_Object *o = json_value_get_object(root);
-	json_object_set_string(o, "title", title);
-	char *body = json_serialize_to_string(root);
+	struct json_writer w;
+	jw_start(&w, NULL);
+	jw_object_begin(&w);
+	jw_field_string(&w, "title", title);
+	jw_object_end(&w);
+	const char *body = jw_finish(&w);
+	if (!body) {
+		printf("ERROR: unable to allocate memory for the request body\n");
+		free(ids);
+		free(hdr_token);
+		return -1;
+	}
 
 	char *resp = request_post(ROUTE_MANAGE_COLLECTIONS, body,
 							  PAYLOAD_APP_JSON, sockfd, hdr_token);
@@ -304,26 +420,22 @@ int handle_add_collection(char **token, int sockfd)
 		fprintf(stderr, "Error: no response\n");
 		free(resp);
 		free(hdr_token);
-		json_free_serialized_string(body);
-		json_value_free(root);
 		return -1;
 	} else {
 		int res = 0;
 		int status = get_status(resp);
 		if (status / 100 == 2) {
 			int id = extract_id(resp);
-			for (int i = 0; i < num_movies; i++) {
-				res = add_movie_to_collection(token, &sockfd, id, ids[i]);
-				if (res < 0) {
-					break;
-				}
-			}
+			res = add_collection_movies(*token, id, ids, num_movies);
 
 			if (res >= 0) {
 				printf("SUCCESS: Colectie creata\n");
 			} else {
 				char str[24];
 				sprintf(str, "%d", id);
+				/* The rollback must not be skipped because the adds used
+				 * up the command deadline: give it one I/O timeout */
+				deadline_start(timeout_policy.io_ms);
 				close(sockfd);
 				sockfd = -1;
 				sockfd = setup_conn();
@@ -337,15 +449,109 @@ int handle_add_collection(char **token, int sockfd)
 
 	free(ids);
 	free(hdr_token);
-	json_free_serialized_string(body);
-	json_value_free(root);
 	return 0;
 }
 
+/* A movie fetched by --expand, decoded and formatted on a pool worker */
+struct expand_item {
+	char *body;
+	struct decoded d;
+	bool parsed;
+};
+
+/* Worker side of --expand: decode the details and format them into the
+ * job's own buffer, so that only the ordered write is left to the caller.
+ */
+static void expand_post(struct fanout_job *job, void *arg)
+{
+	(void)arg;
+	if (!job->resp || get_status(job->resp) / 100 != 2)
+		return;
+	struct expand_item *item = calloc(1, sizeof(*item));
+	if (!item)
+		return;
+	job->data = item;
+	item->body = strip_headers(job->resp);
+	if (!item->body || decode_movie(item->body, &item->d) < 0)
+		return;
+	item->parsed = true;
+
+	FILE *f = open_memstream(&job->out, &job->out_len);
+	if (!f)
+		return;
+	out_capture(f);
+	print_movie(item->body, item->d.items);
+	out_capture(NULL);
+	fclose(f);
+}
+
+/* Caller side of --expand, in collection order: print and index */
+static void expand_merge(struct fanout_job *job, size_t i, void *arg)
+{
+	(void)i;
+	(void)arg;
+	struct expand_item *item = job->data;
+
+	printf("movie #%s\n", job->id);
+	if (!job->resp) {
+		printf("ERROR: no response\n");
+	} else if (get_status(job->resp) / 100 != 2) {
+		print_http_error(get_status(job->resp), job->resp);
+	} else if (item && item->parsed) {
+		const movie_t *m = item->d.items;
+		if (job->out)
+			out_mem(job->out, job->out_len);
+		search_index_movie(atoi(job->id), m->title, m->description);
+	} else if (item && item->body) {
+		fprintf(stderr, "ERROR: Failed to parse JSON\n");
+	}
+
+	if (item) {
+		if (item->parsed)
+			decode_free(&item->d);
+		free(item->body);
+		free(item);
+	}
+	free(job->out);
+	free(job->resp);
+}
+
+/* Fetches the details of every movie listed in a collection response,
+ * in parallel over keep-alive connections; the workers also decode and
+ * format them, and the results are printed in collection order.
+ */
+static void print_collection_movies(const char *body, const char *hdr_token)
+{
+	size_t count = 0;
+	int *ids = extract_collection_movie_ids(body, &count);
+	if (!ids)
+		return;
+
+	struct fanout_job *jobs = calloc(count, sizeof(*jobs));
+	if (jobs == NULL) {
+		printf("ERROR: unable to allocate memory for requests\n");
+		free(ids);
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		jobs[i].method = "GET";
+		jobs[i].route = ROUTE_MANAGE_MOVIE;
+		snprintf(jobs[i].id, sizeof(jobs[i].id), "%d", ids[i]);
+	}
+
+	const struct fanout_hooks hooks = { expand_post, expand_merge, NULL };
+	fanout_run_ordered(jobs, count, hdr_token, fanout_limit, &hooks);
+
+	free(jobs);
+	free(ids);
+}
+
 /* Retrieves details for a single collection and prints them.
- * Validates input and prompts for collection ID.
+ * Validates input and prompts for collection ID. With expand set,
+ * also prints the details of every movie in the collection.
  */
-int handle_get_collection(char **token, int sockfd)
+int handle_get_collection(char **token, int sockfd, bool expand)
 {
 	if (!*token) {
 		printf("ERROR: no access.\n");
@@ -387,6 +593,8 @@ int handle_get_collection(char **token, int sockfd)
 			char *body = strip_headers(resp);
 			if (body) {
 				print_collection_details(body);
+				if (expand)
+					print_collection_movies(body, hdr_token);
 				free(body);
 			}
 		} else {
@@ -514,15 +722,21 @@ int handle_update_movie(char **token, int sockfd)
 	        }
 	    }
 	}
-	float rating = atof(temp);
-
-	JSON_Value *root = json_value_init_object();
-	JSON_Object *o = json_value_get_object(root);
-	json_object_set_string(o, "title", title);
-	json_object_set_number(o, "year", year);
-	json_object_set_string(o, "description", description);
-	json_object_set_number(o, "rating", rating);
-	char *body = json_serialize_to_string(root);
+	double rating = atof(temp);
+
+	struct json_writer w;
+	jw_start(&w, NULL);
+	jw_object_begin(&w);
+	jw_field_string(&w, "title", title);
+	jw_field_int(&w, "year", year);
+	jw_field_string(&w, "description", description);
+	jw_field_number(&w, "rating", rating);
+	jw_object_end(&w);
+	const char *body = jw_finish(&w);
+	if (!body) {
+		printf("ERROR: unable to allocate memory for the request body\n");
+		return -1;
+	}
 
 	char *hdr_token = malloc(HDR_COOKIE_SZ);
 	if (hdr_token == NULL) {
@@ -538,13 +752,12 @@ int handle_update_movie(char **token, int sockfd)
 		fprintf(stderr, "Error: no response\n");
 		free(resp);
 		free(hdr_token);
-		json_free_serialized_string(body);
-		json_value_free(root);
 		return -1;
 	} else {
 		int status = get_status(resp);
 		if (status / 100 == 2) {
 			printf("SUCCESS: Film actualizat\n");
+			search_index_movie(atoi(id), title, description);
 		} else {
 			print_http_error(status, resp);
 		}
@@ -552,8 +765,6 @@ int handle_update_movie(char **token, int sockfd)
 	}
 
 	free(hdr_token);
-	json_free_serialized_string(body);
-	json_value_free(root);
 	return 0;
 }
 
@@ -598,6 +809,7 @@ int handle_delete_movie(char **token, int sockfd)
 		int status = get_status(resp);
 		if (status / 100 == 2) {
 			printf("SUCCESS: Film șters cu succes\n");
+			search_remove_movie(atoi(id));
 		} else {
 			print_http_error(status, resp);
 		}
@@ -665,7 +877,7 @@ int handle_add_movie(char **token, int sockfd)
 	        }
 	    }
 	}
-	float rating = atof(temp);
+	double rating = atof(temp);
 
 	if (rating >= 10.0) {
 		printf("ERROR: Rating must be between 0.0 and 10.0\n");
@@ -680,13 +892,20 @@ int handle_add_movie(char **token, int sockfd)
 	snprintf(hdr_token, HDR_COOKIE_SZ,
 			 "Authorization: Bearer %s\r\n", *token);
 
-	JSON_Value *root = json_value_init_object();
-	JSON_Object *o = json_value_get_object(root);
-	json_object_set_string(o, "title", title);
-	json_object_set_number(o, "year", year);
-	json_object_set_string(o, "description", description);
-	json_object_set_number(o, "rating", rating);
-	char *body = json_serialize_to_string(root);
+	struct json_writer w;
+	jw_start(&w, NULL);
+	jw_object_begin(&w);
+	jw_field_string(&w, "title", title);
+	jw_field_int(&w, "year", year);
+	jw_field_string(&w, "description", description);
+	jw_field_number(&w, "rating", rating);
+	jw_object_end(&w);
+	const char *body = jw_finish(&w);
+	if (!body) {
+		printf("ERROR: unable to allocate memory for the request body\n");
+		free(hdr_token);
+		return -1;
+	}
 
 	char *resp = request_post(ROUTE_MANAGE_MOVIE, body, PAYLOAD_APP_JSON,
 							  sockfd, hdr_token);
@@ -694,8 +913,6 @@ int handle_add_movie(char **token, int sockfd)
 		fprintf(stderr, "Error: no response\n");
 		free(resp);
 		free(hdr_token);
-		json_free_serialized_string(body);
-		json_value_free(root);
 		return -1;
 	} else {
 		int status = get_status(resp);
@@ -708,8 +925,6 @@ int handle_add_movie(char **token, int sockfd)
 	}
 
 	free(hdr_token);
-	json_free_serialized_string(body);
-	json_value_free(root);
 	return 0;
 }
 
@@ -757,6 +972,7 @@ int handle_get_movie(char **token, int sockfd)
 			char *body = strip_headers(resp);
 			if (body) {
 				print_movie_details(body);
+				search_index_details(atoi(movie_id), body);
 				free(body);
 			}
 		} else {
@@ -800,6 +1016,7 @@ int handle_get_movies(char **token, int sockfd)
 			char *body = strip_headers(resp);
 			if (body) {
 				print_movies(body);
+				search_index_listing(body);
 				free(body);
 			}
 		} else {
@@ -960,20 +1177,24 @@ int handle_login(char **cookie, int sockfd)
 		return -1;
 	}
 
-	JSON_Value *root = json_value_init_object();
-	JSON_Object *o = json_value_get_object(root);
-	json_object_set_string(o, "admin_username", admin_username);
-	json_object_set_string(o, "username", username);
-	json_object_set_string(o, "password", password);
-	char *body = json_serialize_to_string(root);
+	struct json_writer w;
+	jw_start(&w, NULL);
+	jw_object_begin(&w);
+	jw_field_string(&w, "admin_username", admin_username);
+	jw_field_string(&w, "username", username);
+	jw_field_string(&w, "password", password);
+	jw_object_end(&w);
+	const char *body = jw_finish(&w);
+	if (!body) {
+		printf("ERROR: unable to allocate memory for the request body\n");
+		return -1;
+	}
 
 	char *resp = request_post(ROUTE_USER_LOGIN, body, PAYLOAD_APP_JSON,
 							  sockfd, NULL);
 	if (!resp) {
 		fprintf(stderr, "Error: no response\n");
 		free(resp);
-		json_free_serialized_string(body);
-		json_value_free(root);
 		return -1;
 	} else {
 		int status = get_status(resp);
@@ -1105,11 +1326,17 @@ int handle_add_user(char **cookie, int sockfd)
 		return -1;
 	}
 
-	JSON_Value *root = json_value_init_object();
-	JSON_Object *o = json_value_get_object(root);
-	json_object_set_string(o, "username", username);
-	json_object_set_string(o, "password", password);
-	char *body = json_serialize_to_string(root);
+	struct json_writer w;
+	jw_start(&w, NULL);
+	jw_object_begin(&w);
+	jw_field_string(&w, "username", username);
+	jw_field_string(&w, "password", password);
+	jw_object_end(&w);
+	const char *body = jw_finish(&w);
+	if (!body) {
+		printf("ERROR: unable to allocate memory for the request body\n");
+		return -1;
+	}
 
 	char *hdr_cookie = malloc(HDR_COOKIE_SZ);
 	if (hdr_cookie == NULL) {
@@ -1125,8 +1352,6 @@ int handle_add_user(char **cookie, int sockfd)
 		fprintf(stderr, "Error: no response\n");
 		free(resp);
 		free(hdr_cookie);
-		json_free_serialized_string(body);
-		json_value_free(root);
 		return -1;
 	} else {
 		int status = get_status(resp);
@@ -1139,8 +1364,6 @@ int handle_add_user(char **cookie, int sockfd)
 	}
 
 	free(hdr_cookie);
-	json_free_serialized_string(body);
-	json_value_free(root);
 	return 0;
 }
 
@@ -1168,19 +1391,23 @@ int handle_login_admin(char **cookie, int sockfd)
 		return -1;
 	}
 
-	JSON_Value *root = json_value_init_object();
-	JSON_Object *o = json_value_get_object(root);
-	json_object_set_string(o, "username", username);
-	json_object_set_string(o, "password", password);
-	char *body = json_serialize_to_string(root);
+	struct json_writer w;
+	jw_start(&w, NULL);
+	jw_object_begin(&w);
+	jw_field_string(&w, "username", username);
+	jw_field_string(&w, "password", password);
+	jw_object_end(&w);
+	const char *body = jw_finish(&w);
+	if (!body) {
+		printf("ERROR: unable to allocate memory for the request body\n");
+		return -1;
+	}
 
 	char *resp = request_post(ROUTE_ADMIN_LOGIN, body, PAYLOAD_APP_JSON,
 							  sockfd, NULL);
 	if (!resp) {
 		fprintf(stderr, "Error: no response\n");
 		free(resp);
-		json_free_serialized_string(body);
-		json_value_free(root);
 		return -1;
 	} else {
 		int status = get_status(resp);
@@ -1193,7 +1420,387 @@ int handle_login_admin(char **cookie, int sockfd)
 		free(resp);
 	}
 
-	json_free_serialized_string(body);
-	json_value_free(root);
+	return 0;
+}
+
+/* Deletes every id in ids concurrently (bounded by fanout_limit) and
+ * reports the outcome for each id, in input order, followed by a summary.
+ */
+static int bulk_delete(const char *route, const char *hdr, char **ids,
+					   size_t count, const char *what)
+{
+	struct fanout_job *jobs = calloc(count, sizeof(*jobs));
+	if (jobs == NULL) {
+		printf("ERROR: unable to allocate memory for requests\n");
+		return -1;
+	}
+
+	/* Ids that do not fit a job's path segment are never sent */
+	size_t njobs = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (strlen(ids[i]) >= sizeof(jobs[0].id))
+			continue;
+		jobs[njobs].method = "DELETE";
+		jobs[njobs].route = route;
+		strcpy(jobs[njobs].id, ids[i]);
+		njobs++;
+	}
+
+	fanout_run(jobs, njobs, hdr, fanout_limit);
+
+	size_t failed = 0;
+	struct fanout_job *job = jobs;
+	for (size_t i = 0; i < count; i++) {
+		if (strlen(ids[i]) >= sizeof(jobs[0].id)) {
+			printf("ERROR: %.20s... is longer than %d characters\n", ids[i],
+				   FANOUT_ID_SZ - 1);
+			failed++;
+			continue;
+		}
+		char *resp = job->resp;
+		if (!resp) {
+			printf("ERROR: %s no response\n", job->id);
+			failed++;
+			job++;
+			continue;
+		}
+		int status = get_status(resp);
+		if (status / 100 == 2) {
+			printf("SUCCESS: %s deleted\n", job->id);
+			if (strcmp(route, ROUTE_MANAGE_MOVIE) == 0)
+				search_remove_movie(atoi(job->id));
+		} else {
+			char msg[256];
+			if (extract_http_error(resp, msg, sizeof(msg)) < 0)
+				msg[0] = '\0';
+			printf("ERROR: %s %d %s\n", job->id, status, msg);
+			failed++;
+		}
+		free(resp);
+		job++;
+	}
+
+	if (failed)
+		printf("ERROR: %zu of %zu %s could not be deleted\n",
+			   failed, count, what);
+	else
+		printf("SUCCESS: %zu %s deleted\n", count, what);
+
+	free(jobs);
+	return failed ? -2 : 0;
+}
+
+/* Prompts for the ids to delete: "all" lists the resource first and
+ * collects every key; otherwise numeric lists and ranges ("1,4,7-9")
+ * are expanded, or, for non-numeric keys, a plain comma-separated list
+ * is used. Returns the malloc’d list, or NULL after printing an error.
+ */
+static char **read_bulk_ids(const char *prompt, const char *route,
+							const char *hdr, int sockfd, const char *array,
+							const char *field, bool numeric, size_t *count)
+{
+	printf("%s=", prompt);
+	char *spec = helper_readline();
+	if (!spec || strlen(spec) == 0) {
+		printf("ERROR: %s is required\n", prompt);
+		free(spec);
+		return NULL;
+	}
+
+	char **ids = NULL;
+	*count = 0;
+	if (strcmp(spec, "all") == 0) {
+		char *resp = request_get(route, sockfd, hdr, NULL);
+		if (!resp) {
+			fprintf(stderr, "Error: no response\n");
+		} else {
+			int status = get_status(resp);
+			if (status / 100 == 2) {
+				char *body = strip_headers(resp);
+				errno = 0;
+				if (body) {
+					ids = extract_list_field(body, array, field, count);
+					free(body);
+				}
+				if (ids && *count == 0) {
+					free(ids);
+					ids = NULL;
+				}
+				if (!ids && errno == ENOMEM)
+					printf("ERROR: unable to allocate memory for %s\n", prompt);
+				else if (!ids)
+					printf("SUCCESS: nothing to delete\n");
+			} else {
+				print_http_error(status, resp);
+			}
+			free(resp);
+		}
+	} else if (numeric) {
+		ids = parse_id_list(spec, BULK_MAX_IDS, count);
+		if (!ids)
+			printf("ERROR: %s must be a list of numbers or ranges\n", prompt);
+	} else {
+		size_t cap = 16;
+		ids = malloc(cap * sizeof(char *));
+		bool oom = !ids;
+		for (char *tok = strtok(spec, ", "); !oom && tok;
+			 tok = strtok(NULL, ", ")) {
+			if (*count == cap) {
+				char **tmp = realloc(ids, 2 * cap * sizeof(char *));
+				if (!tmp) {
+					oom = true;
+					break;
+				}
+				ids = tmp;
+				cap *= 2;
+			}
+			if (!(ids[*count] = strdup(tok)))
+				oom = true;
+			else
+				(*count)++;
+		}
+		if (oom) {
+			free_string_list(ids, *count);
+			ids = NULL;
+			*count = 0;
+			printf("ERROR: unable to allocate memory for %s\n", prompt);
+		} else if (*count == 0) {
+			free(ids);
+			ids = NULL;
+			printf("ERROR: %s is required\n", prompt);
+		}
+	}
+
+	free(spec);
+	return ids;
+}
+
+/* Deletes several movies at once. Prompts for ids ("all", a list
+ * or ranges) and deletes them concurrently.
+ */
+int handle_delete_movies(char **token, int sockfd)
+{
+	if (!*token) {
+		printf("ERROR: no access.\n");
+		return -1;
+	}
+
+	char *hdr_token = malloc(HDR_COOKIE_SZ);
+	if (hdr_token == NULL) {
+		printf("ERROR: unable to allocate memory for cookie\n");
+		exit(-1);
+	}
+	snprintf(hdr_token, HDR_COOKIE_SZ,
+			 "Authorization: Bearer %s\r\n", *token);
+
+	size_t count = 0;
+	char **ids = read_bulk_ids("ids", ROUTE_MANAGE_MOVIE, hdr_token, sockfd,
+							   "movies", "id", true, &count);
+	int res = 0;
+	if (ids)
+		res = bulk_delete(ROUTE_MANAGE_MOVIE, hdr_token, ids, count, "movies");
+
+	free_string_list(ids, count);
+	free(hdr_token);
+	return res;
+}
+
+/* Deletes several collections at once. Prompts for ids ("all", a list
+ * or ranges) and deletes them concurrently.
+ */
+int handle_delete_collections(char **token, int sockfd)
+{
+	if (!*token) {
+		printf("ERROR: no access.\n");
+		return -1;
+	}
+
+	char *hdr_token = malloc(HDR_COOKIE_SZ);
+	if (hdr_token == NULL) {
+		printf("ERROR: unable to allocate memory for cookie\n");
+		exit(-1);
+	}
+	snprintf(hdr_token, HDR_COOKIE_SZ,
+			 "Authorization: Bearer %s\r\n", *token);
+
+	size_t count = 0;
+	char **ids = read_bulk_ids("ids", ROUTE_MANAGE_COLLECTIONS, hdr_token,
+							   sockfd, "collections", "id", true, &count);
+	int res = 0;
+	if (ids)
+		res = bulk_delete(ROUTE_MANAGE_COLLECTIONS, hdr_token, ids, count,
+						  "collections");
+
+	free_string_list(ids, count);
+	free(hdr_token);
+	return res;
+}
+
+/* Deletes several users at once. Prompts for usernames ("all" or a
+ * comma-separated list) and deletes them concurrently.
+ */
+int handle_delete_users(char **cookie, int sockfd)
+{
+	if (!*cookie) {
+		printf("Error: login first.\n");
+		return -1;
+	}
+
+	char *hdr_cookie = malloc(HDR_COOKIE_SZ);
+	if (hdr_cookie == NULL) {
+		printf("ERROR: unable to allocate memory for cookie\n");
+		exit(-1);
+	}
+	snprintf(hdr_cookie, HDR_COOKIE_SZ,
+			 "Cookie: %s\r\n", *cookie);
+
+	size_t count = 0;
+	char **names = read_bulk_ids("usernames", ROUTE_MANAGE_USER, hdr_cookie,
+								 sockfd, "users", "username", false, &count);
+	int res = 0;
+	if (names)
+		res = bulk_delete(ROUTE_MANAGE_USER, hdr_cookie, names, count, "users");
+
+	free_string_list(names, count);
+	free(hdr_cookie);
+	return res;
+}
+
+/* Searches movie titles and descriptions in the local index.
+ * Prompts for the query; fetches the movie list once if nothing is indexed.
+ */
+int handle_search_movies(char **token, int sockfd)
+{
+	if (!*token) {
+		printf("ERROR: no access.\n");
+		return -1;
+	}
+
+	printf("query=");
+	char *query = helper_readline();
+	if (!query || strlen(query) == 0) {
+		printf("ERROR: query is required\n");
+		free(query);
+		return -1;
+	}
+
+	if (search_doc_count() == 0) {
+		char hdr_token[HDR_COOKIE_SZ];
+		snprintf(hdr_token, sizeof(hdr_token),
+				 "Authorization: Bearer %s\r\n", *token);
+
+		char *resp = request_get(ROUTE_MANAGE_MOVIE, sockfd, hdr_token, NULL);
+		if (!resp) {
+			fprintf(stderr, "Error: no response\n");
+			free(query);
+			return -1;
+		}
+		int status = get_status(resp);
+		if (status / 100 != 2) {
+			print_http_error(status, resp);
+			free(resp);
+			free(query);
+			return -1;
+		}
+		char *body = strip_headers(resp);
+		if (body) {
+			search_index_listing(body);
+			free(body);
+		}
+		free(resp);
+	}
+
+	struct search_hit hits[SEARCH_MAX_HITS];
+	size_t n = search_query(query, hits, SEARCH_MAX_HITS);
+	printf("SUCCESS: Rezultatele căutării (%zu din %zu filme)\n",
+		   n, search_doc_count());
+	for (size_t i = 0; i < n; i++)
+		printf("#%d %s\n", hits[i].id, hits[i].title);
+
+	free(query);
+	return 0;
+}
+
+/* Synchronizes the local snapshot with the server library.
+ * Only added or renamed entries cost a detail request.
+ */
+int handle_sync(char **token, int sockfd)
+{
+	(void)sockfd;
+	if (!*token) {
+		printf("ERROR: no access.\n");
+		return -1;
+	}
+
+	char hdr_token[HDR_COOKIE_SZ];
+	snprintf(hdr_token, sizeof(hdr_token),
+			 "Authorization: Bearer %s\r\n", *token);
+
+	struct sync_report rep;
+	int ret = sync_library(hdr_token, &rep);
+	if (ret == -1)
+		return -1;
+	if (ret == -2) {
+		printf("ERROR: unable to write %s or %s\n",
+			   sync_snapshot_path, catalog_path);
+		return -2;
+	}
+
+	if (rep.failed)
+		printf("ERROR: Sincronizare incompletă (%zu cereri eșuate)\n",
+			   rep.failed);
+	else
+		printf("SUCCESS: Sincronizare completă\n");
+	printf("movies: %zu added, %zu changed, %zu removed, %zu unchanged\n",
+		   rep.movies.added, rep.movies.changed, rep.movies.removed,
+		   rep.movies.unchanged);
+	printf("collections: %zu added, %zu changed, %zu removed, %zu unchanged\n",
+		   rep.collections.added, rep.collections.changed,
+		   rep.collections.removed, rep.collections.unchanged);
+	printf("details fetched: %zu\n", rep.fetched);
+	return rep.failed ? -2 : 0;
+}
+
+/* Prints the transfer counters collected since the client started
+ * (requests, bytes on the wire, compression ratio). No network access.
+ */
+int handle_stats(void)
+{
+	printf("SUCCESS: Statistici\n");
+	stats_print();
+	return 0;
+}
+
+/* Prints rating and year statistics computed over the columnar catalog
+ * written by the last sync. No network access.
+ */
+int handle_catalog_stats(void)
+{
+	struct catalog cat;
+	if (catalog_open(catalog_path, &cat) < 0) {
+		printf("ERROR: no catalog at %s (run sync first)\n", catalog_path);
+		return -1;
+	}
+
+	printf("SUCCESS: Statistici catalog\n");
+	catalog_print_stats(&cat);
+	catalog_close(&cat);
+	return 0;
+}
+
+/* Aggregations over the catalog columns: rating distribution, movies per
+ * year, best rated movies and collection sizes. No network access.
+ */
+int handle_analyze(void)
+{
+	struct catalog cat;
+	if (catalog_open(catalog_path, &cat) < 0) {
+		printf("ERROR: no catalog at %s (run sync first)\n", catalog_path);
+		return -1;
+	}
+
+	printf("SUCCESS: Analiza catalogului\n");
+	analyze_print(&cat);
+	catalog_close(&cat);
 	return 0;
 }
@@ -6,6 +6,7 @@
 
 #define HDR_COOKIE_SZ 256   // Maximum size for HTTP header strings
 #define CODE_SZ 4           // Size for HTTP status code string
+#define BULK_MAX_IDS 100000 // Maximum number of ids in one bulk command
 
 /* -------------------------------------------------------------------------- */
 /*                        Movie Collection Handlers                           */
@@ -45,12 +46,15 @@ int handle_add_collection(char **token, int sockfd);
 /**
  * Prompt the user for a collection ID and retrieve its details
  * via GET request, then print them.
+ * If expand is true, the full details of every movie in the collection
+ * are then fetched in parallel and printed in collection order.
  *
  * @param token   Pointer to the JWT access token string.
  * @param sockfd  Active socket descriptor for HTTP communication.
+ * @param expand  Whether to also fetch and print each movie's details.
  * @return        0 on success, negative on error.
  */
-int handle_get_collection(char **token, int sockfd);
+int handle_get_collection(char **token, int sockfd, bool expand);
 
 /**
  * Retrieve and print the list of all collections via GET request.
@@ -217,4 +221,100 @@ int handle_get_users(char **cookie, int sockfd);
  */
 int handle_delete_user(char **cookie, int sockfd);
 
+
+/* -------------------------------------------------------------------------- */
+/*                             Bulk Deletion                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Prompt for movie ids ("all", a list or ranges such as "1,4,7-9") and
+ * delete them concurrently, reporting the result for each id.
+ *
+ * @param token   Pointer to the JWT access token string.
+ * @param sockfd  Active socket descriptor for HTTP communication.
+ * @return        0 if every deletion succeeded, negative otherwise.
+ */
+int handle_delete_movies(char **token, int sockfd);
+
+/**
+ * Prompt for collection ids ("all", a list or ranges) and delete them
+ * concurrently, reporting the result for each id.
+ *
+ * @param token   Pointer to the JWT access token string.
+ * @param sockfd  Active socket descriptor for HTTP communication.
+ * @return        0 if every deletion succeeded, negative otherwise.
+ */
+int handle_delete_collections(char **token, int sockfd);
+
+/**
+ * Prompt for usernames ("all" or a comma-separated list) and delete
+ * them concurrently, reporting the result for each user.
+ *
+ * @param cookie  Pointer to the admin session cookie string.
+ * @param sockfd  Active socket descriptor for HTTP communication.
+ * @return        0 if every deletion succeeded, negative otherwise.
+ */
+int handle_delete_users(char **cookie, int sockfd);
+
+
+/* -------------------------------------------------------------------------- */
+/*                               Search                                       */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Prompt for a query and print the best matching movies from the local
+ * search index. The index is filled from earlier movie responses; if it is
+ * still empty, the movie list is fetched first.
+ *
+ * @param token   Pointer to the JWT access token string.
+ * @param sockfd  Active socket descriptor for HTTP communication.
+ * @return        0 on success, -1 on missing access or a failed fetch.
+ */
+int handle_search_movies(char **token, int sockfd);
+
+
+/* -------------------------------------------------------------------------- */
+/*                            Synchronization                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Bring the local library snapshot up to date, fetching details only for
+ * movies and collections that were added or renamed, and print a summary.
+ *
+ * @param token   Pointer to the JWT access token string.
+ * @param sockfd  Active socket descriptor (unused: requests go through the
+ *                fan-out pool).
+ * @return        0 on success, negative on failure.
+ */
+int handle_sync(char **token, int sockfd);
+
+
+/* -------------------------------------------------------------------------- */
+/*                            Local Commands                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Print the transfer statistics collected so far (requests, bytes in/out,
+ * compressed vs. decompressed body sizes and the compression ratio).
+ *
+ * @return  Always 0.
+ */
+int handle_stats(void);
+
+/**
+ * Print statistics over the columnar catalog written by "sync": rating
+ * histogram overall and per year, mean ratings and collection sizes.
+ *
+ * @return  0 on success, -1 if the catalog is missing or invalid.
+ */
+int handle_catalog_stats(void);
+
+/**
+ * Run the "analyze" aggregations over the columnar catalog: rating
+ * distribution, per-year counts, top rated movies and collection sizes.
+ *
+ * @return  0 on success, -1 if the catalog is missing or invalid.
+ */
+int handle_analyze(void);
+
 #endif // COMMANDS_H
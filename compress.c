@@ -0,0 +1,181 @@
+// 324CC Stefan CALMAC
+#include "compress.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+
+#define INFLATE_CHUNK 16384   /* minimum free space before each inflate() */
+
+bool   compress_accept      = true;
+size_t compress_request_min = 0;
+
+static atomic_bool gzip_refused = false;
+
+/**
+ * Header line advertising the supported encodings, or "" when disabled.
+ */
+const char *compress_accept_hdr(void) {
+    return compress_accept ? "Accept-Encoding: gzip, deflate\r\n" : "";
+}
+
+/**
+ * Map a Content-Encoding value to an ENCODING_* constant.
+ */
+int compress_parse_encoding(const char *value) {
+    while (*value == ' ' || *value == '\t')
+        value++;
+    if (strncasecmp(value, "gzip", 4) == 0 ||
+        strncasecmp(value, "x-gzip", 6) == 0)
+        return ENCODING_GZIP;
+    if (strncasecmp(value, "deflate", 7) == 0)
+        return ENCODING_DEFLATE;
+    if (strncasecmp(value, "identity", 8) == 0 || *value == '\r')
+        return ENCODING_IDENTITY;
+    return -1;
+}
+
+/**
+ * Append raw bytes to a dbuf, growing it geometrically.
+ */
+int dbuf_append(struct dbuf *b, const char *data, size_t len) {
+    if (b->cap - b->len < len + 1) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap - b->len < len + 1)
+            cap *= 2;
+        char *tmp = realloc(b->data, cap);
+        if (!tmp)
+            return -1;
+        b->data = tmp;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+    return 0;
+}
+
+/**
+ * Prepare a decoder. gzip uses the gzip wrapper; deflate starts with the
+ * zlib wrapper (RFC 9110) and falls back to raw deflate on the first error,
+ * since some servers send it unwrapped.
+ */
+int inflater_init(struct inflater *inf, int encoding) {
+    memset(inf, 0, sizeof(*inf));
+    inf->encoding = encoding;
+    int bits = encoding == ENCODING_GZIP ? 15 + 16 : 15;
+    return inflateInit2(&inf->zs, bits) == Z_OK ? 0 : -1;
+}
+
+/**
+ * Decode one piece of input, appending everything produced to out.
+ */
+int inflater_feed(struct inflater *inf, const char *data, size_t len,
+                  struct dbuf *out) {
+    if (inf->done || len == 0)
+        return 0;
+
+    inf->zs.next_in  = (Bytef *)data;
+    inf->zs.avail_in = (uInt)len;
+
+    while (inf->zs.avail_in > 0 && !inf->done) {
+        if (out->cap - out->len < INFLATE_CHUNK + 1) {
+            size_t cap = out->cap ? out->cap * 2 : 4 * INFLATE_CHUNK;
+            char *tmp = realloc(out->data, cap);
+            if (!tmp)
+                return -1;
+            out->data = tmp;
+            out->cap = cap;
+        }
+
+        inf->zs.next_out  = (Bytef *)(out->data + out->len);
+        inf->zs.avail_out = (uInt)(out->cap - out->len - 1);
+        size_t before = inf->zs.avail_out;
+
+        int r = inflate(&inf->zs, Z_NO_FLUSH);
+        if (r == Z_DATA_ERROR && inf->encoding == ENCODING_DEFLATE &&
+            !inf->raw && !inf->started) {
+            /* Retry the same input as raw deflate */
+            inflateEnd(&inf->zs);
+            if (inflateInit2(&inf->zs, -15) != Z_OK)
+                return -1;
+            inf->raw = true;
+            inf->zs.next_in  = (Bytef *)data;
+            inf->zs.avail_in = (uInt)len;
+            continue;
+        }
+        if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR)
+            return -1;
+
+        size_t produced = before - inf->zs.avail_out;
+        out->len += produced;
+        out->data[out->len] = '\0';
+        if (produced)
+            inf->started = true;
+        if (r == Z_STREAM_END)
+            inf->done = true;
+        else if (r == Z_BUF_ERROR && produced == 0)
+            break;
+    }
+    return 0;
+}
+
+/**
+ * Release the decoder.
+ */
+void inflater_end(struct inflater *inf) {
+    inflateEnd(&inf->zs);
+}
+
+/**
+ * Whether a request body should be sent gzip-compressed.
+ */
+bool compress_should_gzip(size_t body_len) {
+    return compress_request_min > 0 && body_len >= compress_request_min &&
+           !atomic_load(&gzip_refused);
+}
+
+/**
+ * Remember that the server does not accept compressed bodies.
+ */
+void compress_gzip_refused(void) {
+    atomic_store(&gzip_refused, true);
+}
+
+/**
+ * gzip-compress data in one pass into a buffer sized by deflateBound().
+ */
+int gzip_compress(const char *data, size_t len, struct dbuf *out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    memset(out, 0, sizeof(*out));
+
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+
+    size_t cap = deflateBound(&zs, (uLong)len);
+    out->data = malloc(cap);
+    if (!out->data) {
+        deflateEnd(&zs);
+        return -1;
+    }
+
+    zs.next_in   = (Bytef *)data;
+    zs.avail_in  = (uInt)len;
+    zs.next_out  = (Bytef *)out->data;
+    zs.avail_out = (uInt)cap;
+
+    int r = deflate(&zs, Z_FINISH);
+    out->len = cap - zs.avail_out;
+    out->cap = cap;
+    deflateEnd(&zs);
+
+    if (r != Z_STREAM_END) {
+        free(out->data);
+        memset(out, 0, sizeof(*out));
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <zlib.h>
+
+/**
+ * @file compress.h
+ * @brief HTTP content-coding support (gzip / deflate) built on zlib.
+ */
+
+#define ENCODING_IDENTITY 0
+#define ENCODING_GZIP     1
+#define ENCODING_DEFLATE  2
+
+/** Whether requests advertise "Accept-Encoding: gzip, deflate". */
+extern bool compress_accept;
+
+/** Minimum POST/PUT body size sent gzip-compressed (0 = never compress). */
+extern size_t compress_request_min;
+
+/** Growable byte buffer receiving decoded data. */
+struct dbuf {
+    char  *data;
+    size_t len;
+    size_t cap;
+};
+
+/** Streaming decoder for one response body. */
+struct inflater {
+    z_stream zs;
+    int      encoding;   /**< ENCODING_GZIP or ENCODING_DEFLATE */
+    bool     raw;        /**< "deflate" sent without the zlib wrapper */
+    bool     started;    /**< Some output was already produced */
+    bool     done;       /**< End of the compressed stream was reached */
+};
+
+/**
+ * Header line advertising the supported encodings, or "" when disabled.
+ */
+const char *compress_accept_hdr(void);
+
+/**
+ * Map a Content-Encoding header value to an ENCODING_* constant.
+ *
+ * @param value  Header value (leading spaces allowed).
+ * @return       ENCODING_GZIP, ENCODING_DEFLATE, ENCODING_IDENTITY,
+ *               or -1 for an unsupported coding.
+ */
+int compress_parse_encoding(const char *value);
+
+/**
+ * Prepare a decoder for the given encoding.
+ *
+ * @return  0 on success, -1 on zlib failure.
+ */
+int inflater_init(struct inflater *inf, int encoding);
+
+/**
+ * Decode the next piece of the compressed body, appending the output to out.
+ * May be called with arbitrarily small pieces as they arrive.
+ *
+ * @return  0 on success, -1 on corrupt input or allocation failure.
+ */
+int inflater_feed(struct inflater *inf, const char *data, size_t len,
+                  struct dbuf *out);
+
+/**
+ * Release the decoder.
+ */
+void inflater_end(struct inflater *inf);
+
+/**
+ * Whether a request body of body_len bytes should be sent gzip-compressed:
+ * request compression is enabled, the body reaches the threshold and the
+ * server has not refused compressed bodies before.
+ */
+bool compress_should_gzip(size_t body_len);
+
+/**
+ * Remember that the server answered 415 to a compressed body, so later
+ * requests are sent uncompressed.
+ */
+void compress_gzip_refused(void);
+
+/**
+ * gzip-compress data in one pass into out (sized with deflateBound, so the
+ * buffer is allocated once and can be sent directly as an iovec segment).
+ *
+ * @return  0 on success, -1 on failure (out is left empty).
+ */
+int gzip_compress(const char *data, size_t len, struct dbuf *out);
+
+/**
+ * Append raw bytes to a dbuf, growing it as needed.
+ *
+ * @return  0 on success, -1 on allocation failure.
+ */
+int dbuf_append(struct dbuf *b, const char *data, size_t len);
+
+#endif // COMPRESS_H
@@ -0,0 +1,220 @@
+// 324CC Stefan CALMAC
+#include "coro.h"
+#include "stats.h"
+#include "timeout.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+enum coro_state { CORO_READY, CORO_WAITING, CORO_DONE };
+
+struct coro {
+    ucontext_t      ctx;
+    void           *stack;      /* mapping, guard page first */
+    size_t          map_len;
+    void          (*fn)(void *);
+    void           *arg;
+    enum coro_state state;
+    uint64_t        deadline;   /* command deadline while switched out */
+    int             fd;         /* waited descriptor, -1 for a sleep */
+    short           events;
+    uint64_t        wake_ns;    /* end of the wait, 0 for none */
+    int             result;     /* what coro_poll() returns */
+    int             err;
+    struct coro    *next;
+};
+
+/* Scheduler of the calling thread */
+static __thread struct {
+    ucontext_t   main;
+    struct coro *head, *tail;   /* every live coroutine, spawn order */
+    struct coro *current;
+    int          waiting;
+} sched;
+
+/* Entry point of every coroutine; returning resumes sched.main (uc_link) */
+static void trampoline(void) {
+    struct coro *co = sched.current;
+    co->fn(co->arg);
+    co->state = CORO_DONE;
+}
+
+int coro_spawn(void (*fn)(void *), void *arg) {
+    struct coro *co = calloc(1, sizeof(*co));
+    if (!co)
+        return -1;
+
+    long page = sysconf(_SC_PAGESIZE);
+    co->map_len = CORO_STACK_SZ + (size_t)page;
+    co->stack = mmap(NULL, co->map_len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (co->stack == MAP_FAILED) {
+        free(co);
+        return -1;
+    }
+    /* Overflowing the stack faults instead of corrupting memory */
+    mprotect(co->stack, (size_t)page, PROT_NONE);
+
+    getcontext(&co->ctx);
+    co->ctx.uc_stack.ss_sp   = (char *)co->stack + page;
+    co->ctx.uc_stack.ss_size = CORO_STACK_SZ;
+    co->ctx.uc_link          = &sched.main;
+    makecontext(&co->ctx, trampoline, 0);
+
+    co->fn = fn;
+    co->arg = arg;
+    co->state = CORO_READY;
+    co->deadline = deadline_get();
+    if (sched.tail)
+        sched.tail->next = co;
+    else
+        sched.head = co;
+    sched.tail = co;
+    return 0;
+}
+
+bool coro_active(void) {
+    return sched.current != NULL;
+}
+
+/* Run co until it waits or returns, with its own deadline installed */
+static void resume(struct coro *co) {
+    uint64_t saved = deadline_get();
+    deadline_set(co->deadline);
+    sched.current = co;
+    STATS_ADD(coro_switches, 1);
+    swapcontext(&sched.main, &co->ctx);
+    sched.current = NULL;
+    co->deadline = deadline_get();
+    deadline_set(saved);
+}
+
+int coro_poll(int fd, short events, int ms) {
+    struct coro *co = sched.current;
+    if (ms == 0 && fd >= 0) {
+        struct pollfd pfd = { .fd = fd, .events = events };
+        return poll(&pfd, 1, 0);
+    }
+
+    co->fd = fd;
+    co->events = events;
+    co->wake_ns = ms >= 0 ? trace_now_ns() + (uint64_t)ms * 1000000ull : 0;
+    co->state = CORO_WAITING;
+    sched.waiting++;
+    swapcontext(&co->ctx, &sched.main);
+
+    if (co->result < 0)
+        errno = co->err;
+    return co->result;
+}
+
+static void wake(struct coro *co, int result, int err) {
+    co->state = CORO_READY;
+    co->result = result;
+    co->err = err;
+    sched.waiting--;
+}
+
+/**
+ * One poll() over the descriptors of all waiting coroutines, bounded by
+ * the earliest wake-up time; wakes those that are ready or timed out.
+ */
+static int wait_round(void) {
+    struct pollfd stack_pfd[64];
+    struct coro *stack_co[64];
+    struct pollfd *pfd = stack_pfd;
+    struct coro **who = stack_co;
+    if (sched.waiting > 64) {
+        pfd = malloc((size_t)sched.waiting * sizeof(*pfd));
+        who = malloc((size_t)sched.waiting * sizeof(*who));
+        if (!pfd || !who) {
+            free(pfd);
+            free(who);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    uint64_t first = 0;
+    int n = 0;
+    for (struct coro *co = sched.head; co; co = co->next) {
+        if (co->state != CORO_WAITING)
+            continue;
+        if (co->wake_ns && (!first || co->wake_ns < first))
+            first = co->wake_ns;
+        if (co->fd >= 0) {
+            pfd[n] = (struct pollfd){ .fd = co->fd, .events = co->events };
+            who[n++] = co;
+        }
+    }
+
+    int ms = -1;
+    if (first) {
+        uint64_t now = trace_now_ns();
+        ms = now >= first ? 0 : (int)((first - now + 999999) / 1000000);
+    }
+
+    int r = poll(pfd, (nfds_t)n, ms);
+    int err = errno;
+    if (r < 0 && err != EINTR) {
+        /* Fail every wait rather than spin */
+        for (struct coro *co = sched.head; co; co = co->next)
+            if (co->state == CORO_WAITING)
+                wake(co, -1, err);
+    } else {
+        for (int i = 0; r > 0 && i < n; i++)
+            if (pfd[i].revents)
+                wake(who[i], 1, 0);
+        uint64_t now = trace_now_ns();
+        for (struct coro *co = sched.head; co; co = co->next)
+            if (co->state == CORO_WAITING && co->wake_ns && now >= co->wake_ns)
+                wake(co, 0, 0);
+    }
+
+    if (pfd != stack_pfd) {
+        free(pfd);
+        free(who);
+    }
+    if (r < 0 && err != EINTR) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int coro_run(void) {
+    int ret = 0;
+    while (sched.head) {
+        /* Resume every ready coroutine once, in spawn order, and reap the
+         * finished ones; coroutines spawned meanwhile join at the tail */
+        struct coro *prev = NULL, *co = sched.head;
+        while (co) {
+            if (co->state == CORO_READY)
+                resume(co);
+            struct coro *next = co->next;
+            if (co->state == CORO_DONE) {
+                if (prev)
+                    prev->next = next;
+                else
+                    sched.head = next;
+                if (sched.tail == co)
+                    sched.tail = prev;
+                munmap(co->stack, co->map_len);
+                free(co);
+            } else {
+                prev = co;
+            }
+            co = next;
+        }
+
+        if (sched.waiting > 0 && wait_round() < 0)
+            ret = -1;
+    }
+    return ret;
+}
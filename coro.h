@@ -0,0 +1,59 @@
+#ifndef CORO_H
+#define CORO_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+
+/**
+ * @file coro.h
+ * @brief Stackful coroutines (ucontext) for multi-step commands.
+ *
+ * A flow of several requests is written as ordinary sequential code and
+ * run as a coroutine: whenever it would block in wait_fd() (connect, send,
+ * read) or in a retry backoff, it yields to a scheduler on the same thread,
+ * which polls the descriptors of all waiting coroutines at once. Many flows
+ * thus progress concurrently without threads or callbacks.
+ *
+ * Each coroutine carries its own command deadline (inherited from the code
+ * that spawned it). I/O inside a coroutine always takes the poll() path;
+ * io_uring submissions block and are not used there. Code running in
+ * coroutines must not keep data in thread-local scratch buffers across a
+ * call that may yield (e.g. pass its own dbuf to jw_start()).
+ */
+
+#define CORO_STACK_SZ (256 * 1024)   /**< Stack per coroutine (plus a guard page) */
+
+/**
+ * Create a coroutine running fn(arg) on the calling thread. It starts at
+ * the next coro_run() (or, when spawned from a coroutine, in the running
+ * scheduler).
+ *
+ * @return  0 on success, -1 with errno set.
+ */
+int coro_spawn(void (*fn)(void *), void *arg);
+
+/**
+ * Run the scheduler until every coroutine of this thread has returned.
+ * Not to be called from a coroutine.
+ *
+ * @return  0, or -1 with errno set if polling failed (the remaining
+ *          coroutines are then resumed with their waits reported as errors).
+ */
+int coro_run(void);
+
+/**
+ * Whether the caller is running inside a coroutine.
+ */
+bool coro_active(void);
+
+/**
+ * Yield until fd is ready for the given poll events or ms have passed.
+ * With fd < 0 this is a sleep. Only valid inside a coroutine.
+ *
+ * @param ms  Timeout in milliseconds, -1 for none.
+ * @return    1 when ready, 0 on timeout, -1 with errno set on error:
+ *            the same as poll() on a single descriptor.
+ */
+int coro_poll(int fd, short events, int ms);
+
+#endif // CORO_H
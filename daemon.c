@@ -0,0 +1,213 @@
+// 324CC Stefan CALMAC
+#define _GNU_SOURCE
+#include "daemon.h"
+#include "client.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define RELAY_BUF_SZ 8192
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void on_stop(int sig) {
+    (void)sig;
+    daemon_stop = 1;
+}
+
+/**
+ * Default socket path for the current user.
+ */
+void daemon_default_path(char *buf, size_t size) {
+    snprintf(buf, size, "/tmp/client-%u.sock", (unsigned)getuid());
+}
+
+/**
+ * Fill a sockaddr_un, rejecting paths that do not fit.
+ */
+static int make_addr(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+ * Create the listening socket. The umask keeps the socket file private
+ * from the moment it is created.
+ */
+static int listen_unix(const char *path) {
+    struct sockaddr_un addr;
+    if (make_addr(&addr, path) < 0)
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("daemon: socket");
+        return -1;
+    }
+
+    unlink(path);
+    mode_t old = umask(0077);
+    int r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old);
+    if (r < 0 || listen(fd, 16) < 0) {
+        perror("daemon: bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Serve one session: the connection temporarily becomes stdin, stdout and
+ * stderr, so the command loop and every handler work unchanged.
+ */
+static void serve_session(int conn) {
+    int saved[3];
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++) {
+        saved[i] = dup(i);
+        dup2(conn, i);
+    }
+    clearerr(stdin);
+
+    client_run();
+
+    fflush(stdout);
+    fflush(stderr);
+    /* Drop input the session sent after "exit" so it cannot leak into
+     * the next one */
+    __fpurge(stdin);
+    clearerr(stdin);
+    for (int i = 0; i < 3; i++) {
+        dup2(saved[i], i);
+        close(saved[i]);
+    }
+}
+
+/**
+ * Accept sessions until SIGINT/SIGTERM.
+ */
+int daemon_serve(const char *path) {
+    int lfd = listen_unix(path);
+    if (lfd < 0)
+        return -1;
+
+    /* No SA_RESTART: a stop signal must interrupt accept() */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    /* A remote that goes away mid-output must not kill the daemon */
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "daemon: listening on %s\n", path);
+    while (!daemon_stop) {
+        int conn = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno != EINTR)
+                perror("daemon: accept");
+            continue;
+        }
+
+        struct ucred cred;
+        socklen_t len = sizeof(cred);
+        if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 ||
+            cred.uid != getuid()) {
+            fprintf(stderr, "daemon: rejected connection from another user\n");
+            close(conn);
+            continue;
+        }
+
+        serve_session(conn);
+        close(conn);
+    }
+
+    close(lfd);
+    unlink(path);
+    return 0;
+}
+
+/**
+ * Write all of buf to a socket or file descriptor.
+ */
+static int write_all(int fd, const char *buf, size_t len, int is_sock) {
+    while (len > 0) {
+        ssize_t n = is_sock ? send(fd, buf, len, MSG_NOSIGNAL)
+                            : write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Relay stdin -> daemon and daemon -> stdout until the daemon closes.
+ */
+int remote_run(const char *path) {
+    struct sockaddr_un addr;
+    if (make_addr(&addr, path) < 0)
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "ERROR: no daemon listening on %s (%s)\n",
+                path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    char buf[RELAY_BUF_SZ];
+    struct pollfd pfd[2] = {
+        { .fd = STDIN_FILENO, .events = POLLIN },
+        { .fd = fd,           .events = POLLIN },
+    };
+
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfd[0].revents) {
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n <= 0 || write_all(fd, buf, (size_t)n, 1) < 0) {
+                /* End of input: let the daemon see EOF, keep reading */
+                shutdown(fd, SHUT_WR);
+                pfd[0].fd = -1;
+            }
+        }
+
+        if (pfd[1].revents) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0 || write_all(STDOUT_FILENO, buf, (size_t)n, 0) < 0)
+                break;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+// 324CC Stefan CALMAC
+
+#include <stddef.h>
+
+/**
+ * @file daemon.h
+ * @brief Long-lived client daemon on a Unix domain socket, and the thin
+ *        front-end that talks to it.
+ *
+ * `client --daemon` keeps the session (cookie, JWT, statistics, a connection
+ * opened ahead of the next command) across invocations and serves one
+ * `client --remote` session at a time: the remote forwards its stdin to the
+ * daemon and copies everything the daemon prints back to its stdout.
+ */
+
+#define DAEMON_PATH_SZ 108   /**< sizeof(sockaddr_un.sun_path) */
+
+/**
+ * Default socket path for the current user (/tmp/client-<uid>.sock).
+ *
+ * @param buf   Output buffer.
+ * @param size  Size of buf.
+ */
+void daemon_default_path(char *buf, size_t size);
+
+/**
+ * Listen on path and run one command session per accepted connection,
+ * until SIGINT/SIGTERM. Only connections from the same user are served.
+ *
+ * @param path  Socket path (an existing socket file is replaced).
+ * @return      0 on a clean shutdown, -1 if the socket could not be set up.
+ */
+int daemon_serve(const char *path);
+
+/**
+ * Connect to a daemon and relay stdin to it and its output to stdout until
+ * the daemon ends the session.
+ *
+ * @param path  Socket path.
+ * @return      0 on success, -1 if no daemon is listening on path.
+ */
+int remote_run(const char *path);
+
+#endif // DAEMON_H
@@ -0,0 +1,542 @@
+// 324CC Stefan CALMAC
+#include "decode.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DECODE_MAX_DEPTH 512          /* nesting limit while skipping */
+#define ARENA_CHUNK_SZ   (64 * 1024)  /* minimum arena chunk */
+
+struct decode_chunk {
+    struct decode_chunk *next;
+    size_t               used;
+    size_t               cap;
+    char                 data[];
+};
+
+/** One member of a record: JSON name, how to decode it and where to. */
+struct field {
+    const char *name;
+    uint8_t     len;
+    uint8_t     type;
+    uint16_t    offset;
+};
+
+struct schema {
+    const struct field *fields;
+    size_t              n_fields;
+    size_t              size;
+};
+
+#define FIELD_ENTRY(type, name, ft) \
+    { #name, sizeof(#name) - 1, ft, offsetof(type, name) },
+
+static const struct field movie_fields[]      = { MOVIE_FIELDS(FIELD_ENTRY) };
+static const struct field user_fields[]       = { USER_FIELDS(FIELD_ENTRY) };
+static const struct field collection_fields[] = { COLLECTION_FIELDS(FIELD_ENTRY) };
+
+#define SCHEMA(fields, type) \
+    { fields, sizeof(fields) / sizeof(fields[0]), sizeof(type) }
+
+static const struct schema movie_schema      = SCHEMA(movie_fields, movie_t);
+static const struct schema user_schema       = SCHEMA(user_fields, user_t);
+static const struct schema collection_schema = SCHEMA(collection_fields,
+                                                      collection_t);
+
+struct parser {
+    const char           *p;
+    struct decode_chunk **arena;
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                   Arena                                    */
+/* -------------------------------------------------------------------------- */
+
+/* Room for n bytes at the end of the current chunk (not yet committed) */
+static char *arena_reserve(struct decode_chunk **arena, size_t n) {
+    struct decode_chunk *c = *arena;
+    if (!c || c->cap - c->used < n) {
+        size_t cap = n > ARENA_CHUNK_SZ ? n : ARENA_CHUNK_SZ;
+        c = malloc(sizeof(*c) + cap);
+        if (!c)
+            return NULL;
+        c->next = *arena;
+        c->used = 0;
+        c->cap = cap;
+        *arena = c;
+    }
+    return c->data + c->used;
+}
+
+/* Keep n bytes of the last reservation, rounded up to keep alignment */
+static void arena_commit(struct decode_chunk **arena, size_t n) {
+    struct decode_chunk *c = *arena;
+    c->used += (n + 7) & ~(size_t)7;
+    if (c->used > c->cap)
+        c->used = c->cap;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Scanning                                  */
+/* -------------------------------------------------------------------------- */
+
+static void skip_ws(struct parser *ps) {
+    while (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n' || *ps->p == '\r')
+        ps->p++;
+}
+
+/* Past a string starting at the opening quote; -1 if unterminated */
+static int skip_string(struct parser *ps) {
+    const char *p = ps->p + 1;
+    for (;;) {
+        p += strcspn(p, "\"\\");
+        if (*p == '"')
+            break;
+        if (*p == '\0' || p[1] == '\0')
+            return -1;
+        p += 2;
+    }
+    ps->p = p + 1;
+    return 0;
+}
+
+/* Span of a number token; -1 if there is none */
+static int number_span(const char *p, size_t *len) {
+    const char *s = p;
+    if (*p == '-')
+        p++;
+    if (*p < '0' || *p > '9')
+        return -1;
+    p += strspn(p, "0123456789.eE+-");
+    *len = (size_t)(p - s);
+    return 0;
+}
+
+static int skip_value(struct parser *ps, int depth) {
+    size_t len;
+
+    if (depth > DECODE_MAX_DEPTH)
+        return -1;
+    skip_ws(ps);
+    switch (*ps->p) {
+    case '"':
+        return skip_string(ps);
+    case '{':
+    case '[': {
+        char close = *ps->p == '{' ? '}' : ']';
+        ps->p++;
+        skip_ws(ps);
+        if (*ps->p == close) {
+            ps->p++;
+            return 0;
+        }
+        for (;;) {
+            if (close == '}') {
+                skip_ws(ps);
+                if (*ps->p != '"' || skip_string(ps) < 0)
+                    return -1;
+                skip_ws(ps);
+                if (*ps->p++ != ':')
+                    return -1;
+            }
+            if (skip_value(ps, depth + 1) < 0)
+                return -1;
+            skip_ws(ps);
+            if (*ps->p == close) {
+                ps->p++;
+                return 0;
+            }
+            if (*ps->p++ != ',')
+                return -1;
+        }
+    }
+    case 't':
+        return strncmp(ps->p, "true", 4) == 0 ? (ps->p += 4, 0) : -1;
+    case 'f':
+        return strncmp(ps->p, "false", 5) == 0 ? (ps->p += 5, 0) : -1;
+    case 'n':
+        return strncmp(ps->p, "null", 4) == 0 ? (ps->p += 4, 0) : -1;
+    default:
+        if (number_span(ps->p, &len) < 0)
+            return -1;
+        ps->p += len;
+        return 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Values                                    */
+/* -------------------------------------------------------------------------- */
+
+static int hex4(const char *p, unsigned *out) {
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')      v |= (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f') v |= (unsigned)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v |= (unsigned)(c - 'A' + 10);
+        else return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+static char *put_utf8(char *d, unsigned cp) {
+    if (cp < 0x80) {
+        *d++ = (char)cp;
+    } else if (cp < 0x800) {
+        *d++ = (char)(0xC0 | (cp >> 6));
+        *d++ = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *d++ = (char)(0xE0 | (cp >> 12));
+        *d++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *d++ = (char)(0x80 | (cp & 0x3F));
+    } else {
+        *d++ = (char)(0xF0 | (cp >> 18));
+        *d++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+        *d++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *d++ = (char)(0x80 | (cp & 0x3F));
+    }
+    return d;
+}
+
+/**
+ * Unescape the string at ps->p into the arena. The result is never longer
+ * than the escaped text, so that much is reserved up front.
+ */
+static int decode_string(struct parser *ps, char **out) {
+    const char *start = ps->p;
+    if (skip_string(ps) < 0)
+        return -1;
+
+    const char *s = start + 1, *end = ps->p - 1;
+    char *dst = arena_reserve(ps->arena, (size_t)(end - s) + 1);
+    if (!dst)
+        return -1;
+
+    char *d = dst;
+    while (s < end) {
+        size_t run = strcspn(s, "\\\"");
+        if (s + run > end)
+            run = (size_t)(end - s);
+        memcpy(d, s, run);
+        d += run;
+        s += run;
+        if (s >= end)
+            break;
+
+        s++;   /* backslash */
+        switch (*s++) {
+        case '"':  *d++ = '"';  break;
+        case '\\': *d++ = '\\'; break;
+        case '/':  *d++ = '/';  break;
+        case 'b':  *d++ = '\b'; break;
+        case 'f':  *d++ = '\f'; break;
+        case 'n':  *d++ = '\n'; break;
+        case 'r':  *d++ = '\r'; break;
+        case 't':  *d++ = '\t'; break;
+        case 'u': {
+            unsigned cp, lo;
+            if (end - s < 4 || hex4(s, &cp) < 0)
+                return -1;
+            s += 4;
+            if (cp >= 0xD800 && cp < 0xDC00) {
+                if (end - s < 6 || s[0] != '\\' || s[1] != 'u' ||
+                    hex4(s + 2, &lo) < 0 || lo < 0xDC00 || lo > 0xDFFF)
+                    return -1;
+                s += 6;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                return -1;
+            }
+            d = put_utf8(d, cp);
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+    *d++ = '\0';
+    arena_commit(ps->arena, (size_t)(d - dst));
+    *out = dst;
+    return 0;
+}
+
+/* Integer fast path; anything with a fraction or exponent goes to strtod */
+static int decode_int(struct parser *ps, int *out) {
+    size_t len;
+    if (number_span(ps->p, &len) < 0)
+        return skip_value(ps, 0);
+
+    const char *p = ps->p;
+    int neg = *p == '-';
+    long v = 0;
+    p += neg;
+    while (*p >= '0' && *p <= '9' && v < 1000000000000L)
+        v = v * 10 + (*p++ - '0');
+    if (p == ps->p + len)
+        *out = (int)(neg ? -v : v);
+    else
+        *out = (int)strtod(ps->p, NULL);
+    ps->p += len;
+    return 0;
+}
+
+static int decode_text(struct parser *ps, char **out) {
+    size_t len;
+    if (*ps->p == '"')
+        return decode_string(ps, out);
+    if (number_span(ps->p, &len) < 0)
+        return skip_value(ps, 0);
+
+    char *dst = arena_reserve(ps->arena, len + 1);
+    if (!dst)
+        return -1;
+    memcpy(dst, ps->p, len);
+    dst[len] = '\0';
+    arena_commit(ps->arena, len + 1);
+    ps->p += len;
+    *out = dst;
+    return 0;
+}
+
+static int decode_array(struct parser *ps, const struct schema *sc,
+                        void **items, size_t *count);
+
+/**
+ * Fill one record. Fields usually arrive in table order, so the search
+ * for a member name starts after the previously matched field.
+ */
+static int decode_object(struct parser *ps, const struct schema *sc,
+                         char *dst) {
+    size_t next = 0;
+
+    skip_ws(ps);
+    if (*ps->p != '{')
+        return -1;
+    ps->p++;
+    skip_ws(ps);
+    if (*ps->p == '}') {
+        ps->p++;
+        return 0;
+    }
+
+    for (;;) {
+        skip_ws(ps);
+        const char *name = ps->p + 1;
+        if (*ps->p != '"' || skip_string(ps) < 0)
+            return -1;
+        size_t len = (size_t)(ps->p - 1 - name);
+
+        const struct field *f = NULL;
+        for (size_t k = 0; k < sc->n_fields; k++) {
+            const struct field *c = &sc->fields[(next + k) % sc->n_fields];
+            if (c->len == len && memcmp(c->name, name, len) == 0) {
+                f = c;
+                next = (size_t)(c - sc->fields) + 1;
+                break;
+            }
+        }
+
+        skip_ws(ps);
+        if (*ps->p++ != ':')
+            return -1;
+        skip_ws(ps);
+
+        int rc;
+        if (!f) {
+            rc = skip_value(ps, 1);
+        } else if (f->type == FT_INT) {
+            rc = decode_int(ps, (int *)(dst + f->offset));
+        } else if (f->type == FT_TEXT) {
+            rc = decode_text(ps, (char **)(dst + f->offset));
+        } else if (*ps->p != '[') {
+            rc = skip_value(ps, 1);
+        } else {
+            /* Nested records end up in the arena with the strings */
+            struct movie_array *arr = (struct movie_array *)(dst + f->offset);
+            void *tmp = NULL;
+            size_t n = 0;
+            rc = decode_array(ps, &movie_schema, &tmp, &n);
+            if (rc == 0 && n > 0) {
+                size_t sz = n * sizeof(movie_t);
+                arr->items = (movie_t *)arena_reserve(ps->arena, sz);
+                if (arr->items) {
+                    memcpy(arr->items, tmp, sz);
+                    arena_commit(ps->arena, sz);
+                    arr->count = n;
+                } else {
+                    rc = -1;
+                }
+            }
+            free(tmp);
+        }
+        if (rc < 0)
+            return -1;
+
+        skip_ws(ps);
+        if (*ps->p == '}') {
+            ps->p++;
+            return 0;
+        }
+        if (*ps->p++ != ',')
+            return -1;
+    }
+}
+
+/*
+ * One array element: an object, or a bare number standing for the record's
+ * id (a collection may list its movies as [1, 2, 3]).
+ */
+static int decode_element(struct parser *ps, const struct schema *sc,
+                          char *dst) {
+    if (*ps->p != '-' && (*ps->p < '0' || *ps->p > '9'))
+        return decode_object(ps, sc, dst);
+    for (size_t k = 0; k < sc->n_fields; k++) {
+        const struct field *f = &sc->fields[k];
+        if (f->type == FT_INT && f->len == 2 && memcmp(f->name, "id", 2) == 0)
+            return decode_int(ps, (int *)(dst + f->offset));
+    }
+    return -1;
+}
+
+/* Decode an array of records into a malloc'd, zero-initialised array */
+static int decode_array(struct parser *ps, const struct schema *sc,
+                        void **items, size_t *count) {
+    size_t cap = 0, n = 0;
+    char *arr = NULL;
+
+    ps->p++;   /* '[' */
+    skip_ws(ps);
+    if (*ps->p == ']') {
+        ps->p++;
+        goto done;
+    }
+
+    for (;;) {
+        if (n == cap) {
+            size_t ncap = cap ? cap * 2 : 16;
+            char *grown = realloc(arr, ncap * sc->size);
+            if (!grown)
+                goto fail;
+            arr = grown;
+            cap = ncap;
+        }
+        memset(arr + n * sc->size, 0, sc->size);
+        if (decode_element(ps, sc, arr + n * sc->size) < 0)
+            goto fail;
+        n++;
+
+        skip_ws(ps);
+        if (*ps->p == ']') {
+            ps->p++;
+            break;
+        }
+        if (*ps->p++ != ',')
+            goto fail;
+        skip_ws(ps);
+    }
+
+done:
+    *items = arr;
+    *count = n;
+    return 0;
+
+fail:
+    free(arr);
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Public API                                 */
+/* -------------------------------------------------------------------------- */
+
+/* Decode the array stored under key in the top-level object */
+static int decode_list(const char *json, const char *key,
+                       const struct schema *sc, struct decoded *out) {
+    struct parser ps = { json, &out->arena };
+    size_t klen = strlen(key);
+
+    memset(out, 0, sizeof(*out));
+    skip_ws(&ps);
+    if (*ps.p != '{')
+        return -1;
+    ps.p++;
+    skip_ws(&ps);
+
+    while (*ps.p == '"') {
+        const char *name = ps.p + 1;
+        if (skip_string(&ps) < 0)
+            goto fail;
+        int match = (size_t)(ps.p - 1 - name) == klen &&
+                    memcmp(name, key, klen) == 0;
+
+        skip_ws(&ps);
+        if (*ps.p++ != ':')
+            goto fail;
+        skip_ws(&ps);
+
+        if (match) {
+            if (*ps.p != '[' ||
+                decode_array(&ps, sc, &out->items, &out->count) < 0)
+                goto fail;
+            return 0;
+        }
+        if (skip_value(&ps, 1) < 0)
+            goto fail;
+        skip_ws(&ps);
+        if (*ps.p++ != ',')
+            goto fail;
+        skip_ws(&ps);
+    }
+
+fail:
+    decode_free(out);
+    return -1;
+}
+
+static int decode_one(const char *json, const struct schema *sc,
+                      struct decoded *out) {
+    struct parser ps = { json, &out->arena };
+
+    memset(out, 0, sizeof(*out));
+    out->items = calloc(1, sc->size);
+    if (!out->items || decode_object(&ps, sc, out->items) < 0) {
+        decode_free(out);
+        return -1;
+    }
+    out->count = 1;
+    return 0;
+}
+
+int decode_movies(const char *json, struct decoded *out) {
+    return decode_list(json, "movies", &movie_schema, out);
+}
+
+int decode_users(const char *json, struct decoded *out) {
+    return decode_list(json, "users", &user_schema, out);
+}
+
+int decode_collections(const char *json, struct decoded *out) {
+    return decode_list(json, "collections", &collection_schema, out);
+}
+
+int decode_movie(const char *json, struct decoded *out) {
+    return decode_one(json, &movie_schema, out);
+}
+
+int decode_collection(const char *json, struct decoded *out) {
+    return decode_one(json, &collection_schema, out);
+}
+
+void decode_free(struct decoded *out) {
+    struct decode_chunk *c = out->arena;
+    while (c) {
+        struct decode_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    free(out->items);
+    memset(out, 0, sizeof(*out));
+}
@@ -0,0 +1,98 @@
+#ifndef DECODE_H
+#define DECODE_H
+// 324CC Stefan CALMAC
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file decode.h
+ * @brief Schema-driven decoding of server responses into C structs.
+ *
+ * The record types are generated from the field tables below, and so are
+ * the schemas the decoder walks: one pass over the JSON text fills the
+ * structs directly, without a DOM. Members that are not in the table are
+ * skipped without allocating. Missing members are left zero / NULL, as
+ * parson's getters would return.
+ *
+ * Strings are unescaped into an arena owned by the result, so a whole
+ * listing is released with one decode_free().
+ *
+ * Field types:
+ *   FT_INT     JSON number, truncated to int
+ *   FT_TEXT    JSON string (unescaped) or the text of a number; else NULL
+ *   FT_MOVIES  array of movie objects, or of bare movie ids
+ */
+
+enum field_type { FT_INT, FT_TEXT, FT_MOVIES };
+
+#define FT_INT_CTYPE    int
+#define FT_TEXT_CTYPE   char *
+#define FT_MOVIES_CTYPE struct movie_array
+
+#define MOVIE_FIELDS(X)                          \
+    X(movie_t,      id,          FT_INT)         \
+    X(movie_t,      title,       FT_TEXT)        \
+    X(movie_t,      year,        FT_INT)         \
+    X(movie_t,      description, FT_TEXT)        \
+    X(movie_t,      rating,      FT_TEXT)
+
+#define USER_FIELDS(X)                           \
+    X(user_t,       id,          FT_INT)         \
+    X(user_t,       username,    FT_TEXT)        \
+    X(user_t,       password,    FT_TEXT)
+
+#define COLLECTION_FIELDS(X)                     \
+    X(collection_t, id,          FT_INT)         \
+    X(collection_t, title,       FT_TEXT)        \
+    X(collection_t, owner,       FT_TEXT)        \
+    X(collection_t, movies,      FT_MOVIES)
+
+#define DECODE_MEMBER(type, name, ft) ft##_CTYPE name;
+
+typedef struct movie { MOVIE_FIELDS(DECODE_MEMBER) } movie_t;
+
+/** Nested array of movies (members of a collection). */
+struct movie_array {
+    movie_t *items;
+    size_t   count;
+};
+
+typedef struct user { USER_FIELDS(DECODE_MEMBER) } user_t;
+
+typedef struct collection { COLLECTION_FIELDS(DECODE_MEMBER) } collection_t;
+
+struct decode_chunk;
+
+/** Decoded records and the storage behind their strings. */
+struct decoded {
+    void                *items;   /**< movie_t[], user_t[] or collection_t[] */
+    size_t               count;
+    struct decode_chunk *arena;   /**< Strings and nested arrays */
+};
+
+/**
+ * Decode {"movies":[...]} into movie_t records.
+ *
+ * @return  0 on success, -1 if the text is malformed or the array missing.
+ */
+int decode_movies(const char *json, struct decoded *out);
+
+/** Decode {"users":[...]} into user_t records. */
+int decode_users(const char *json, struct decoded *out);
+
+/** Decode {"collections":[...]} into collection_t records. */
+int decode_collections(const char *json, struct decoded *out);
+
+/** Decode one movie object (out->count is 1). */
+int decode_movie(const char *json, struct decoded *out);
+
+/** Decode one collection object, members included (out->count is 1). */
+int decode_collection(const char *json, struct decoded *out);
+
+/**
+ * Release the records and their strings; out may be reused afterwards.
+ */
+void decode_free(struct decoded *out);
+
+#endif // DECODE_H
@@ -0,0 +1,289 @@
+// 324CC Stefan CALMAC
+#include "fanout.h"
+#include "h2.h"
+#include "helper.h"
+#include "pool.h"
+#include "requests.h"
+#include "retry.h"
+#include "stats.h"
+#include "timeout.h"
+
+#include <errno.h>
+
+#include <stdatomic.h>
+
+int fanout_limit = FANOUT_DEFAULT_CONNS;
+
+/* Connection owned by one pool worker */
+struct fanout_conn {
+    int  sockfd;
+    bool reused;
+};
+
+/* Progress of a job when the batch goes over h2c first */
+enum job_state { JOB_PENDING, JOB_RERUN, JOB_DONE };
+
+/* State shared by all workers of one fanout_run_ordered() call */
+struct fanout_ctx {
+    struct fanout_job         *jobs;
+    size_t                     count;
+    const char                *extra_hdr;
+    const struct fanout_hooks *hooks;
+    uint64_t                   deadline;  /* deadline of the command that fanned out */
+    struct fanout_conn         conns[FANOUT_MAX_CONNS];
+    atomic_size_t              done;      /* jobs that received a response */
+    /* h2c: */
+    struct h2_request         *h2;
+    unsigned char             *state;     /* enum job_state per job */
+    size_t                    *map;       /* pool task -> job, for the reruns */
+    size_t                     merged;    /* jobs merged so far */
+};
+
+/**
+ * Pool task: run one job on the worker's connection, reconnecting only
+ * when the server closes it, then post-process the response.
+ */
+static void fanout_task(size_t i, int worker, void *arg)
+{
+    struct fanout_ctx *ctx = arg;
+    struct fanout_conn *conn = &ctx->conns[worker];
+    struct fanout_job *job = &ctx->jobs[ctx->map ? ctx->map[i] : i];
+
+    /* Sub-requests share the deadline of the command that spawned them */
+    deadline_set(ctx->deadline);
+
+    /* A reused connection may have been closed by the server while
+     * idle; that is retried once right away on a fresh connection.
+     * Other transient failures follow the retry policy. */
+    bool stale_retried = false;
+    for (int attempt = 0; ; ) {
+        if (conn->sockfd < 0) {
+            conn->sockfd = setup_conn();
+            conn->reused = false;
+            if (conn->sockfd < 0)
+                break;
+        }
+
+        bool was_reused = conn->reused;
+        bool keep = false;
+        char *resp = request_keepalive(job->method, job->route,
+                                       job->id[0] ? job->id : NULL,
+                                       conn->sockfd, ctx->extra_hdr,
+                                       conn->reused, &keep);
+        int err = errno;
+        if (!resp || !keep) {
+            close(conn->sockfd);
+            conn->sockfd = -1;
+        } else {
+            conn->reused = true;
+        }
+
+        if (!resp && was_reused && !stale_retried) {
+            stale_retried = true;
+            continue;
+        }
+
+        if (resp) {
+            free(job->resp);
+            job->resp = resp;
+        }
+
+        bool transient = resp ? retry_status_retryable(get_status(resp))
+                              : retry_errno_retryable(err);
+        if (!transient || ++attempt > retry_policy.retries ||
+            !retry_budget_take() || !retry_backoff(attempt))
+            break;
+    }
+
+    if (job->resp)
+        atomic_fetch_add(&ctx->done, 1);
+    if (ctx->hooks && ctx->hooks->post)
+        ctx->hooks->post(job, ctx->hooks->arg);
+}
+
+static void fanout_merge(size_t i, void *arg)
+{
+    struct fanout_ctx *ctx = arg;
+    ctx->hooks->merge(&ctx->jobs[i], i, ctx->hooks->arg);
+}
+
+/* Merge, in order, every job that is done and not merged yet */
+static void merge_ready(struct fanout_ctx *ctx)
+{
+    while (ctx->merged < ctx->count && ctx->state[ctx->merged] == JOB_DONE) {
+        if (ctx->hooks && ctx->hooks->merge)
+            fanout_merge(ctx->merged, ctx);
+        ctx->merged++;
+    }
+}
+
+/* A job's outcome is final: post-process it, then merge what is ready */
+static void finish_job(struct fanout_ctx *ctx, size_t i)
+{
+    struct fanout_job *job = &ctx->jobs[i];
+    if (job->resp)
+        atomic_fetch_add(&ctx->done, 1);
+    if (ctx->hooks && ctx->hooks->post)
+        ctx->hooks->post(job, ctx->hooks->arg);
+    ctx->state[i] = JOB_DONE;
+    merge_ready(ctx);
+}
+
+/* h2c stream completed. Transient statuses are left to the HTTP/1.1
+ * path, which applies the retry policy. */
+static void fanout_h2_done(size_t i, void *arg)
+{
+    struct fanout_ctx *ctx = arg;
+    struct fanout_job *job = &ctx->jobs[i];
+    job->resp = ctx->h2[i].resp;
+    ctx->h2[i].resp = NULL;
+
+    if (retry_policy.retries > 0 &&
+        retry_status_retryable(get_status(job->resp))) {
+        free(job->resp);
+        job->resp = NULL;
+        ctx->state[i] = JOB_RERUN;
+        return;
+    }
+    finish_job(ctx, i);
+}
+
+/* An HTTP/1.1 rerun finished (called in task order) */
+static void fanout_rerun_done(size_t task, void *arg)
+{
+    struct fanout_ctx *ctx = arg;
+    ctx->state[ctx->map[task]] = JOB_DONE;
+    merge_ready(ctx);
+}
+
+/**
+ * Run the batch as streams of one h2c connection. Requests the server
+ * certainly did not process, failed GETs (safe to repeat), and other
+ * failures and transient statuses when retries are allowed are then run
+ * again on the HTTP/1.1 pool, as are all of them if h2c turns out to be
+ * unavailable. Jobs are merged in order throughout.
+ *
+ * @return  0, or -1 if memory ran out before anything was sent.
+ */
+static int fanout_h2(struct fanout_ctx *ctx, int max_conns)
+{
+    size_t count = ctx->count;
+    ctx->h2    = calloc(count, sizeof(*ctx->h2));
+    ctx->state = calloc(count, sizeof(*ctx->state));
+    ctx->map   = malloc(count * sizeof(*ctx->map));
+    int ret = -1;
+    if (!ctx->h2 || !ctx->state || !ctx->map)
+        goto out;
+
+    for (size_t i = 0; i < count; i++) {
+        const struct fanout_job *job = &ctx->jobs[i];
+        size_t len = strlen(job->route) + strlen(job->id) + 2;
+        char *path = malloc(len);
+        if (!path)
+            goto out;
+        snprintf(path, len, job->id[0] ? "%s/%s" : "%s%s",
+                 job->route, job->id);
+        ctx->h2[i].method = job->method;
+        ctx->h2[i].path   = path;
+    }
+    ret = 0;
+
+    h2_exchange(ctx->h2, count, ctx->extra_hdr, max_conns,
+                fanout_h2_done, ctx);
+
+    size_t reruns = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (ctx->state[i] == JOB_PENDING &&
+            (ctx->h2[i].unprocessed || retry_policy.retries > 0 ||
+             strcmp(ctx->jobs[i].method, "GET") == 0))
+            ctx->state[i] = JOB_RERUN;
+        if (ctx->state[i] == JOB_RERUN)
+            ctx->map[reruns++] = i;
+        else if (ctx->state[i] == JOB_PENDING)
+            finish_job(ctx, i);   /* failed, and no retries allowed */
+    }
+
+    if (reruns > 0) {
+        STATS_ADD(h2_fallbacks, reruns);
+        if (pool_run(reruns, max_conns, fanout_task, fanout_rerun_done,
+                     ctx) < 0) {
+            for (size_t i = 0; i < count; i++)
+                if (ctx->state[i] == JOB_RERUN)
+                    ctx->state[i] = JOB_DONE;
+        }
+        merge_ready(ctx);
+    }
+
+out:
+    for (size_t i = 0; ctx->h2 && i < count; i++)
+        free((char *)ctx->h2[i].path);
+    free(ctx->h2);
+    free(ctx->state);
+    free(ctx->map);
+    ctx->h2    = NULL;
+    ctx->state = NULL;
+    ctx->map   = NULL;
+    return ret;
+}
+
+/**
+ * Execute all jobs on at most max_conns pool workers, one connection each,
+ * or on one h2c connection with --h2c.
+ */
+size_t fanout_run_ordered(struct fanout_job *jobs, size_t count,
+                          const char *extra_hdr, int max_conns,
+                          const struct fanout_hooks *hooks)
+{
+    if (count == 0)
+        return 0;
+
+    if (max_conns > FANOUT_MAX_CONNS)
+        max_conns = FANOUT_MAX_CONNS;
+
+    struct fanout_ctx *ctx = malloc(sizeof(*ctx));
+    if (!ctx) {
+        perror("malloc");
+        return 0;
+    }
+    ctx->jobs      = jobs;
+    ctx->count     = count;
+    ctx->extra_hdr = extra_hdr;
+    ctx->hooks     = hooks;
+    ctx->deadline  = deadline_get();
+    ctx->h2        = NULL;
+    ctx->state     = NULL;
+    ctx->map       = NULL;
+    ctx->merged    = 0;
+    atomic_init(&ctx->done, 0);
+    for (size_t i = 0; i < FANOUT_MAX_CONNS; i++)
+        ctx->conns[i] = (struct fanout_conn){ -1, false };
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].resp    = NULL;
+        jobs[i].out     = NULL;
+        jobs[i].out_len = 0;
+        jobs[i].data    = NULL;
+    }
+
+    bool merge = hooks && hooks->merge;
+    int ran = h2_usable() ? fanout_h2(ctx, max_conns) : -1;
+    if (ran < 0 && pool_run(count, max_conns, fanout_task,
+                            merge ? fanout_merge : NULL, ctx) < 0 && merge) {
+        /* Nothing ran: every job is reported as failed */
+        for (size_t i = 0; i < count; i++)
+            fanout_merge(i, ctx);
+    }
+
+    for (size_t i = 0; i < FANOUT_MAX_CONNS; i++)
+        if (ctx->conns[i].sockfd >= 0)
+            close(ctx->conns[i].sockfd);
+
+    size_t done = atomic_load(&ctx->done);
+    free(ctx);
+    return done;
+}
+
+size_t fanout_run(struct fanout_job *jobs, size_t count,
+                  const char *extra_hdr, int max_conns)
+{
+    return fanout_run_ordered(jobs, count, extra_hdr, max_conns, NULL);
+}
@@ -0,0 +1,72 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+// 324CC Stefan CALMAC
+
+#include <stddef.h>
+
+/**
+ * @file fanout.h
+ * @brief Run many independent body-less requests concurrently over a
+ *        bounded set of keep-alive connections.
+ *
+ * The requests run as tasks of a work-stealing pool (pool.h); each worker
+ * owns one connection. An optional post hook processes a response on the
+ * worker that fetched it (parsing, formatting), and an optional merge hook
+ * consumes the results on the calling thread in job order, each as soon as
+ * the jobs before it are done.
+ */
+
+#define FANOUT_DEFAULT_CONNS 8   /**< Default number of parallel connections */
+#define FANOUT_MAX_CONNS     64  /**< Hard cap, to stay gentle with the server */
+#define FANOUT_ID_SZ         64
+
+/** One request in a fan-out batch. */
+struct fanout_job {
+    const char *method;              /**< "GET" or "DELETE" */
+    const char *route;               /**< Base route (e.g. ROUTE_MANAGE_MOVIE) */
+    char        id[FANOUT_ID_SZ];    /**< Path segment appended to route ("" for none) */
+    char       *resp;                /**< Out: malloc’d response, or NULL on failure */
+    char       *out;                 /**< Post hook: malloc’d formatted output, or NULL */
+    size_t      out_len;             /**< Post hook: length of out */
+    void       *data;                /**< Post hook: anything else kept for the merge */
+};
+
+/** Per-job callbacks for fanout_run_ordered(). */
+struct fanout_hooks {
+    /** On a worker thread, after the job's request (resp may be NULL). */
+    void (*post)(struct fanout_job *job, void *arg);
+    /** On the calling thread, for job 0, 1, 2... in order. */
+    void (*merge)(struct fanout_job *job, size_t i, void *arg);
+    void  *arg;   /**< Passed to both hooks */
+};
+
+/** In-flight request limit used by commands (set with --max-inflight=N). */
+extern int fanout_limit;
+
+/**
+ * Execute every job, using at most max_conns pool workers, each owning
+ * one persistent connection. Results are stored in jobs[i].resp, so the
+ * caller can consume them in the original order.
+ *
+ * @param jobs       Array of jobs to execute.
+ * @param count      Number of jobs.
+ * @param extra_hdr  Extra header sent with every request (e.g. Authorization), or NULL.
+ * @param max_conns  Upper bound on concurrent connections (>= 1).
+ * @return           Number of jobs that received a response.
+ */
+size_t fanout_run(struct fanout_job *jobs, size_t count,
+                  const char *extra_hdr, int max_conns);
+
+/**
+ * Like fanout_run(), with post-processing on the workers and an ordered
+ * merge on the calling thread. The post hook must only touch its own job
+ * (and thread-safe state); the merge hook owns what the job holds.
+ *
+ * @param hooks  Callbacks, or NULL for plain fanout_run().
+ * @return       Number of jobs that received a response.
+ */
+size_t fanout_run_ordered(struct fanout_job *jobs, size_t count,
+                          const char *extra_hdr, int max_conns,
+                          const struct fanout_hooks *hooks);
+
+#endif // FANOUT_H
@@ -0,0 +1,901 @@
+// 324CC Stefan CALMAC
+#include "h2.h"
+#include "compress.h"
+#include "helper.h"
+#include "hpack.h"
+#include "requests.h"
+#include "shmcache.h"
+#include "stats.h"
+#include "timeout.h"
+#include "trace.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define H2_PREFACE        "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_FRAME_HDR      9
+#define H2_MAX_FRAME      16384          /* largest frame we accept (default) */
+#define H2_WINDOW         (1 << 24)      /* our receive window, stream and connection */
+#define H2_DEFAULT_WINDOW 65535
+#define H2_MAX_BLOCK      (256 * 1024)   /* HEADERS + CONTINUATION limit */
+#define H2_READ_CHUNK     65536
+
+enum {
+    F_DATA, F_HEADERS, F_PRIORITY, F_RST_STREAM, F_SETTINGS,
+    F_PUSH_PROMISE, F_PING, F_GOAWAY, F_WINDOW_UPDATE, F_CONTINUATION,
+};
+
+#define FL_END_STREAM  0x01
+#define FL_ACK         0x01
+#define FL_END_HEADERS 0x04
+#define FL_PADDED      0x08
+#define FL_PRIORITY    0x20
+
+enum {
+    S_HEADER_TABLE_SIZE = 1, S_ENABLE_PUSH, S_MAX_CONCURRENT_STREAMS,
+    S_INITIAL_WINDOW_SIZE, S_MAX_FRAME_SIZE,
+};
+
+#define E_NO_ERROR       0
+#define E_REFUSED_STREAM 7
+
+enum h2_mode h2_mode = H2_OFF;
+
+/* 0 = not tried yet, 1 = works, -1 = the server does not speak h2c */
+static atomic_int h2_state;
+
+struct h2_stream {
+    uint32_t    id;
+    size_t      req;       /* index in the batch */
+    int         status;    /* final status, 0 until the response headers */
+    struct dbuf hdrs;      /* header lines, HTTP/1.1 style */
+    struct dbuf body;
+    size_t      unacked;   /* DATA bytes not yet given back by WINDOW_UPDATE */
+    /* For the trace span: */
+    uint64_t    start_ns;
+    uint64_t    first_ns;  /* response headers received */
+    size_t      bytes_out;
+    size_t      bytes_in;
+};
+
+struct h2_conn {
+    int                   fd;
+    struct hpack_encoder  enc;
+    struct hpack_decoder  dec;
+    struct dbuf           out;            /* frames waiting to be sent */
+    struct dbuf           in;             /* bytes read, not parsed yet */
+    struct dbuf           req_block;      /* header block being sent */
+    struct dbuf           block;          /* header block being received */
+    uint32_t              cont_id;        /* stream of that block, 0 if none */
+    bool                  cont_end;       /* ... and whether it ends the stream */
+    uint32_t              next_id;        /* next stream to open */
+    uint32_t              peer_streams;   /* server's MAX_CONCURRENT_STREAMS */
+    uint32_t              peer_frame;     /* server's MAX_FRAME_SIZE */
+    size_t                unacked;        /* connection-level, as in h2_stream */
+    bool                  settings;       /* server's SETTINGS seen: h2c works */
+    bool                  goaway;
+    uint32_t              last_id;        /* from GOAWAY */
+
+    struct h2_stream     *streams;        /* open streams */
+    size_t                nstreams;
+    size_t                max_streams;
+
+    struct h2_request    *reqs;
+    size_t                count;
+    size_t               *queue;          /* requests to send, a ring */
+    size_t                qhead, qlen;
+    bool                 *refused;        /* already refused once */
+    const char           *extra_hdr;
+    h2_done_fn            done;
+    void                 *arg;
+};
+
+bool h2_usable(void) {
+    return h2_mode != H2_OFF && atomic_load(&h2_state) >= 0;
+}
+
+static void unavailable(const char *why) {
+    if (atomic_exchange(&h2_state, -1) >= 0)
+        fprintf(stderr, "h2c unavailable (%s), using HTTP/1.1\n", why);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Frames                                      */
+/* -------------------------------------------------------------------------- */
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+           (uint32_t)p[2] << 8 | p[3];
+}
+
+static int put_frame(struct h2_conn *c, int type, int flags, uint32_t id,
+                     const void *payload, size_t len) {
+    unsigned char h[H2_FRAME_HDR] = {
+        (unsigned char)(len >> 16), (unsigned char)(len >> 8),
+        (unsigned char)len, (unsigned char)type, (unsigned char)flags,
+    };
+    put_u32(h + 5, id & 0x7fffffff);
+    if (dbuf_append(&c->out, (const char *)h, sizeof(h)) < 0)
+        return -1;
+    return len ? dbuf_append(&c->out, payload, len) : 0;
+}
+
+static int put_window_update(struct h2_conn *c, uint32_t id, size_t inc) {
+    unsigned char p[4];
+    put_u32(p, (uint32_t)inc);
+    return put_frame(c, F_WINDOW_UPDATE, 0, id, p, sizeof(p));
+}
+
+/* Our SETTINGS payload: no server push, large receive windows */
+static size_t settings_payload(unsigned char *p) {
+    p[0] = 0; p[1] = S_ENABLE_PUSH;         put_u32(p + 2, 0);
+    p[6] = 0; p[7] = S_INITIAL_WINDOW_SIZE; put_u32(p + 8, H2_WINDOW);
+    return 12;
+}
+
+static int flush(struct h2_conn *c) {
+    size_t off = 0;
+    while (off < c->out.len) {
+        if (wait_fd(c->fd, POLLOUT, timeout_policy.io_ms) < 0)
+            return -1;
+        ssize_t n = send(c->fd, c->out.data + off, c->out.len - off,
+                         MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    STATS_ADD(bytes_out, c->out.len);
+    c->out.len = 0;
+    return 0;
+}
+
+/* Read more bytes into c->in (kept NUL-terminated) */
+static int fill(struct h2_conn *c) {
+    if (c->in.cap - c->in.len < H2_READ_CHUNK + 1) {
+        size_t cap = c->in.cap ? c->in.cap * 2 : 2 * H2_READ_CHUNK;
+        char *tmp = realloc(c->in.data, cap);
+        if (!tmp)
+            return -1;
+        c->in.data = tmp;
+        c->in.cap = cap;
+    }
+    if (wait_fd(c->fd, POLLIN, timeout_policy.io_ms) < 0)
+        return -1;
+    ssize_t n = read(c->fd, c->in.data + c->in.len,
+                     c->in.cap - c->in.len - 1);
+    if (n < 0)
+        return -1;
+    if (n == 0) {
+        errno = ECONNRESET;
+        return -1;
+    }
+    c->in.len += (size_t)n;
+    c->in.data[c->in.len] = '\0';
+    STATS_ADD(bytes_in, (size_t)n);
+    return 0;
+}
+
+static void consume(struct h2_conn *c, size_t n) {
+    memmove(c->in.data, c->in.data + n, c->in.len - n);
+    c->in.len -= n;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Streams                                     */
+/* -------------------------------------------------------------------------- */
+
+static struct h2_stream *find_stream(struct h2_conn *c, uint32_t id) {
+    for (size_t i = 0; i < c->nstreams; i++)
+        if (c->streams[i].id == id)
+            return &c->streams[i];
+    return NULL;
+}
+
+static struct h2_stream *open_stream(struct h2_conn *c, uint32_t id,
+                                     size_t req) {
+    struct h2_stream *s = &c->streams[c->nstreams++];
+    memset(s, 0, sizeof(*s));
+    s->id = id;
+    s->req = req;
+    s->start_ns = trace_active ? trace_now_ns() : 0;
+    STATS_ADD(h2_streams, 1);
+    return s;
+}
+
+/* As in exchange(): once the server may have seen a mutation (even if its
+ * answer got lost), nothing cached across processes may be served any more */
+static void request_ended(const struct h2_request *r) {
+    if (shm_cache_active && strcmp(r->method, "GET") != 0)
+        shm_cache_invalidate(r->path);
+}
+
+static void record_span(const struct h2_request *r, int status,
+                        uint64_t start_ns, uint64_t first_ns,
+                        size_t bytes_out, size_t bytes_in, bool reused) {
+    uint64_t now = trace_now_ns();
+    if (!first_ns)
+        first_ns = now;
+    struct trace_span sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.kind      = TRACE_KIND_REQ;
+    sp.start_ns  = start_ns;
+    sp.dur_ns    = now - start_ns;
+    sp.status    = status;
+    sp.bytes_out = bytes_out;
+    sp.bytes_in  = bytes_in;
+    sp.wait_ns   = first_ns - start_ns;   /* streams are written together */
+    sp.read_ns   = now - first_ns;
+    sp.reused    = reused;
+    snprintf(sp.name, sizeof(sp.name), "%s", r->method);
+    snprintf(sp.route, sizeof(sp.route), "%s", r->path);
+    trace_record(&sp);
+}
+
+static void close_stream(struct h2_conn *c, struct h2_stream *s,
+                         bool unprocessed) {
+    if (!unprocessed)
+        request_ended(&c->reqs[s->req]);
+    free(s->hdrs.data);
+    free(s->body.data);
+    *s = c->streams[--c->nstreams];
+}
+
+/* A stream that ended without a usable response */
+static void fail_stream(struct h2_conn *c, struct h2_stream *s,
+                        bool unprocessed) {
+    c->reqs[s->req].unprocessed = unprocessed;
+    close_stream(c, s, unprocessed);
+}
+
+static void queue_push(struct h2_conn *c, size_t req) {
+    c->queue[(c->qhead + c->qlen++) % c->count] = req;
+}
+
+static size_t queue_pop(struct h2_conn *c) {
+    size_t req = c->queue[c->qhead];
+    c->qhead = (c->qhead + 1) % c->count;
+    c->qlen--;
+    return req;
+}
+
+/* Hand a complete response over in HTTP/1.1 form */
+static void complete_stream(struct h2_conn *c, struct h2_stream *s) {
+    if (s->status == 0) {
+        fail_stream(c, s, false);
+        return;
+    }
+
+    struct dbuf r = { 0 };
+    char line[32];
+    int n = snprintf(line, sizeof(line), "HTTP/1.1 %d \r\n", s->status);
+    if (dbuf_append(&r, line, (size_t)n) < 0 ||
+        dbuf_append(&r, s->hdrs.data ? s->hdrs.data : "", s->hdrs.len) < 0 ||
+        dbuf_append(&r, "\r\n", 2) < 0 ||
+        dbuf_append(&r, s->body.data ? s->body.data : "", s->body.len) < 0 ||
+        dbuf_append(&r, "", 1) < 0) {
+        free(r.data);
+        fail_stream(c, s, false);
+        return;
+    }
+
+    size_t req = s->req;
+    c->reqs[req].resp = r.data;
+    c->reqs[req].unprocessed = false;
+    STATS_ADD(requests, 1);
+    if (trace_active)
+        record_span(&c->reqs[req], s->status, s->start_ns, s->first_ns,
+                    s->bytes_out, s->bytes_in, s->id > 1);
+    close_stream(c, s, false);
+    if (c->done)
+        c->done(req, c->arg);
+}
+
+/* Headers that only make sense for one HTTP/1.1 hop (RFC 9113 8.2.2) */
+static bool connection_specific(const char *name) {
+    static const char *const skip[] = {
+        "connection", "keep-alive", "proxy-connection", "transfer-encoding",
+        "upgrade", "host", "te",
+    };
+    for (size_t i = 0; i < sizeof(skip) / sizeof(*skip); i++)
+        if (strcmp(name, skip[i]) == 0)
+            return true;
+    return false;
+}
+
+/* Encode the header lines of extra_hdr, names lowercased */
+static int encode_extra(struct h2_conn *c) {
+    const char *p = c->extra_hdr;
+    while (p && *p) {
+        const char *eol = strstr(p, "\r\n");
+        const char *colon = memchr(p, ':', eol ? (size_t)(eol - p) : strlen(p));
+        if (!eol || !colon)
+            break;
+
+        char name[128], value[1024];
+        size_t nlen = (size_t)(colon - p);
+        const char *v = colon + 1;
+        while (v < eol && (*v == ' ' || *v == '\t'))
+            v++;
+        size_t vlen = (size_t)(eol - v);
+        if (nlen >= sizeof(name) || vlen >= sizeof(value))
+            return -1;
+        for (size_t i = 0; i < nlen; i++)
+            name[i] = (char)tolower((unsigned char)p[i]);
+        name[nlen] = '\0';
+        memcpy(value, v, vlen);
+        value[vlen] = '\0';
+
+        if (!connection_specific(name) &&
+            hpack_encode(&c->enc, &c->req_block, name, value) < 0)
+            return -1;
+        p = eol + 2;
+    }
+    return 0;
+}
+
+/**
+ * Open a stream for request req: one HEADERS frame (plus CONTINUATION
+ * frames if the block exceeds the server's frame size) with END_STREAM.
+ */
+static int send_request(struct h2_conn *c, size_t req) {
+    const struct h2_request *r = &c->reqs[req];
+    char authority[64];
+    snprintf(authority, sizeof(authority), "%s:%d", HOST, PORT);
+
+    c->req_block.len = 0;
+    if (hpack_encode_begin(&c->enc, &c->req_block) < 0 ||
+        hpack_encode(&c->enc, &c->req_block, ":method", r->method) < 0 ||
+        hpack_encode(&c->enc, &c->req_block, ":scheme", "http") < 0 ||
+        hpack_encode(&c->enc, &c->req_block, ":authority", authority) < 0 ||
+        hpack_encode(&c->enc, &c->req_block, ":path", r->path) < 0 ||
+        encode_extra(c) < 0)
+        return -1;
+
+    /* What the same headers cost in HTTP/1.1 */
+    size_t raw = strlen(r->method) + strlen(r->path) + strlen(" HTTP/1.1\r\n")
+               + strlen("Host: \r\n") + strlen(HOST) + 1
+               + (c->extra_hdr ? strlen(c->extra_hdr) : 0);
+    STATS_ADD(h2_header_raw_bytes, raw);
+    STATS_ADD(h2_header_bytes, c->req_block.len);
+
+    uint32_t id = c->next_id;
+    c->next_id += 2;
+    struct h2_stream *s = open_stream(c, id, req);
+    s->bytes_out = c->req_block.len + H2_FRAME_HDR;
+
+    size_t off = 0;
+    int type = F_HEADERS, flags = FL_END_STREAM;
+    do {
+        size_t n = c->req_block.len - off;
+        if (n > c->peer_frame)
+            n = c->peer_frame;
+        if (off + n == c->req_block.len)
+            flags |= FL_END_HEADERS;
+        if (put_frame(c, type, flags, id, c->req_block.data + off, n) < 0)
+            return -1;
+        off += n;
+        type = F_CONTINUATION;
+        flags = 0;
+    } while (off < c->req_block.len);
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                             Frame handling                                 */
+/* -------------------------------------------------------------------------- */
+
+struct header_ctx {
+    int         status;
+    struct dbuf lines;
+};
+
+static int collect_header(const char *name, size_t name_len,
+                          const char *value, size_t value_len, void *arg) {
+    struct header_ctx *h = arg;
+    if (name[0] == ':') {
+        if (strcmp(name, ":status") == 0)
+            h->status = atoi(value);
+        return 0;
+    }
+    if (dbuf_append(&h->lines, name, name_len) < 0 ||
+        dbuf_append(&h->lines, ": ", 2) < 0 ||
+        dbuf_append(&h->lines, value, value_len) < 0 ||
+        dbuf_append(&h->lines, "\r\n", 2) < 0)
+        return -1;
+    return 0;
+}
+
+/**
+ * A complete header block arrived. It is decoded even for streams we no
+ * longer track, to keep the HPACK tables in step.
+ */
+static int finish_headers(struct h2_conn *c, uint32_t id, bool end_stream) {
+    struct header_ctx h = { 0 };
+    size_t len = c->block.len;
+    int r = hpack_decode(&c->dec, (const unsigned char *)c->block.data,
+                         len, collect_header, &h);
+    c->block.len = 0;
+    c->cont_id = 0;
+    if (r < 0) {
+        free(h.lines.data);
+        return -1;
+    }
+
+    struct h2_stream *s = find_stream(c, id);
+    if (s) {
+        s->bytes_in += len + H2_FRAME_HDR;
+        if (!s->first_ns && trace_active)
+            s->first_ns = trace_now_ns();
+    }
+    if (s && s->status == 0 && h.status >= 200) {
+        s->status = h.status;
+        s->hdrs = h.lines;
+        h.lines.data = NULL;
+    }
+    /* Otherwise: 1xx informational headers, or trailers, both ignored */
+    free(h.lines.data);
+
+    if (s && end_stream)
+        complete_stream(c, s);
+    return 0;
+}
+
+/* Drop padding (and the priority fields) from a DATA/HEADERS payload */
+static int strip(int flags, bool priority, const unsigned char **p,
+                 size_t *len) {
+    size_t pad = 0;
+    if (flags & FL_PADDED) {
+        if (*len < 1)
+            return -1;
+        pad = **p;
+        (*p)++;
+        (*len)--;
+    }
+    if (priority && (flags & FL_PRIORITY)) {
+        if (*len < 5)
+            return -1;
+        *p += 5;
+        *len -= 5;
+    }
+    if (pad > *len)
+        return -1;
+    *len -= pad;
+    return 0;
+}
+
+static int on_data(struct h2_conn *c, int flags, uint32_t id,
+                   const unsigned char *p, size_t len) {
+    if (id == 0)
+        return -1;
+    size_t flow = len;   /* padding counts against the windows too */
+    if (strip(flags, false, &p, &len) < 0)
+        return -1;
+
+    c->unacked += flow;
+    if (c->unacked >= H2_WINDOW / 2) {
+        if (put_window_update(c, 0, c->unacked) < 0)
+            return -1;
+        c->unacked = 0;
+    }
+
+    struct h2_stream *s = find_stream(c, id);
+    if (!s)
+        return 0;
+    s->bytes_in += flow + H2_FRAME_HDR;
+    if (dbuf_append(&s->body, (const char *)p, len) < 0)
+        return -1;
+    if (flags & FL_END_STREAM) {
+        complete_stream(c, s);
+        return 0;
+    }
+    s->unacked += flow;
+    if (s->unacked >= H2_WINDOW / 2) {
+        if (put_window_update(c, id, s->unacked) < 0)
+            return -1;
+        s->unacked = 0;
+    }
+    return 0;
+}
+
+static int on_headers(struct h2_conn *c, int type, int flags, uint32_t id,
+                      const unsigned char *p, size_t len) {
+    if (id == 0)
+        return -1;
+    if (type == F_HEADERS) {
+        if (strip(flags, true, &p, &len) < 0)
+            return -1;
+        c->cont_id = id;
+        c->cont_end = flags & FL_END_STREAM;
+    }
+    if (c->block.len + len > H2_MAX_BLOCK ||
+        dbuf_append(&c->block, (const char *)p, len) < 0)
+        return -1;
+    if (flags & FL_END_HEADERS)
+        return finish_headers(c, id, c->cont_end);
+    return 0;
+}
+
+static int on_settings(struct h2_conn *c, int flags, uint32_t id,
+                       const unsigned char *p, size_t len) {
+    if (id != 0)
+        return -1;
+    if (flags & FL_ACK)
+        return len == 0 ? 0 : -1;
+    if (len % 6)
+        return -1;
+
+    for (size_t off = 0; off < len; off += 6) {
+        int key = p[off] << 8 | p[off + 1];
+        uint32_t v = get_u32(p + off + 2);
+        switch (key) {
+        case S_HEADER_TABLE_SIZE:
+            hpack_encoder_set_limit(&c->enc, v);
+            break;
+        case S_MAX_CONCURRENT_STREAMS:
+            c->peer_streams = v;
+            break;
+        case S_INITIAL_WINDOW_SIZE:
+            /* We send no DATA, so only the range matters */
+            if (v > 0x7fffffff)
+                return -1;
+            break;
+        case S_MAX_FRAME_SIZE:
+            if (v < H2_MAX_FRAME || v > 0xffffff)
+                return -1;
+            c->peer_frame = v;
+            break;
+        }
+    }
+    c->settings = true;
+    return put_frame(c, F_SETTINGS, FL_ACK, 0, NULL, 0);
+}
+
+static int on_rst_stream(struct h2_conn *c, uint32_t id,
+                         const unsigned char *p, size_t len) {
+    if (id == 0 || len != 4)
+        return -1;
+    struct h2_stream *s = find_stream(c, id);
+    if (!s)
+        return 0;
+
+    /* A refused stream was not processed: try it once more */
+    if (get_u32(p) == E_REFUSED_STREAM) {
+        size_t req = s->req;
+        bool again = !c->refused[req] && !c->goaway;
+        c->refused[req] = true;
+        fail_stream(c, s, true);
+        if (again)
+            queue_push(c, req);
+        return 0;
+    }
+    fail_stream(c, s, false);
+    return 0;
+}
+
+static int on_goaway(struct h2_conn *c, uint32_t id,
+                     const unsigned char *p, size_t len) {
+    if (id != 0 || len < 8)
+        return -1;
+    c->goaway = true;
+    c->last_id = get_u32(p) & 0x7fffffff;
+
+    /* Streams above last_id were never processed */
+    for (size_t i = 0; i < c->nstreams; ) {
+        if (c->streams[i].id > c->last_id)
+            fail_stream(c, &c->streams[i], true);
+        else
+            i++;
+    }
+    return 0;
+}
+
+static int handle_frame(struct h2_conn *c, int type, int flags, uint32_t id,
+                        const unsigned char *p, size_t len) {
+    /* A header block must not be interleaved with other frames */
+    if (c->cont_id && (type != F_CONTINUATION || id != c->cont_id))
+        return -1;
+
+    switch (type) {
+    case F_DATA:
+        return on_data(c, flags, id, p, len);
+    case F_HEADERS:
+        return on_headers(c, type, flags, id, p, len);
+    case F_CONTINUATION:
+        return c->cont_id ? on_headers(c, type, flags, id, p, len) : -1;
+    case F_RST_STREAM:
+        return on_rst_stream(c, id, p, len);
+    case F_SETTINGS:
+        return on_settings(c, flags, id, p, len);
+    case F_PING:
+        if (id != 0 || len != 8)
+            return -1;
+        return (flags & FL_ACK) ? 0 : put_frame(c, F_PING, FL_ACK, 0, p, len);
+    case F_GOAWAY:
+        return on_goaway(c, id, p, len);
+    case F_WINDOW_UPDATE:
+        return len == 4 ? 0 : -1;
+    case F_PUSH_PROMISE:
+        return -1;   /* disabled in our SETTINGS */
+    default:
+        return 0;    /* PRIORITY and unknown types are ignored */
+    }
+}
+
+/**
+ * Handle every complete frame in c->in.
+ *
+ * @return  0, or -1 on a connection error (errno EPROTO), or -2 if the
+ *          server's first frame is not SETTINGS: it does not speak h2c.
+ */
+static int parse_frames(struct h2_conn *c) {
+    while (c->in.len >= H2_FRAME_HDR) {
+        const unsigned char *h = (const unsigned char *)c->in.data;
+        size_t len = (size_t)h[0] << 16 | (size_t)h[1] << 8 | h[2];
+        int type = h[3], flags = h[4];
+        uint32_t id = get_u32(h + 5) & 0x7fffffff;
+
+        if (!c->settings && (type != F_SETTINGS || (flags & FL_ACK)))
+            return -2;
+        if (len > H2_MAX_FRAME) {
+            errno = EPROTO;
+            return -1;
+        }
+        if (c->in.len < H2_FRAME_HDR + len)
+            break;
+        if (handle_frame(c, type, flags, id, h + H2_FRAME_HDR, len) < 0) {
+            errno = EPROTO;
+            return -1;
+        }
+        consume(c, H2_FRAME_HDR + len);
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Connection                                   */
+/* -------------------------------------------------------------------------- */
+
+static void base64url(const unsigned char *in, size_t len, char *out) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        out[o++] = alphabet[(v >> 18) & 63];
+        out[o++] = alphabet[(v >> 12) & 63];
+        if (i + 1 < len) out[o++] = alphabet[(v >> 6) & 63];
+        if (i + 2 < len) out[o++] = alphabet[v & 63];
+    }
+    out[o] = '\0';
+}
+
+/* Read the HTTP/1.1 answer to an upgrade request the server declined */
+static int upgrade_answer(struct h2_conn *c, size_t req) {
+    struct h2_request *r = &c->reqs[req];
+    struct http_frame f;
+    memset(&f, 0, sizeof(f));
+    bool eof = false;
+    int done;
+    while ((done = http_frame_scan(c->in.data, c->in.len, &f, eof)) == 0) {
+        if (fill(c) < 0) {
+            if (errno != ECONNRESET)
+                return -1;
+            eof = true;
+        }
+    }
+    if (done < 0) {
+        errno = EPROTO;
+        return -1;
+    }
+    http_frame_finish(c->in.data, &f);
+    r->resp = strdup(c->in.data);
+    return r->resp ? 0 : -1;
+}
+
+/**
+ * Send the first request as an HTTP/1.1 Upgrade to h2c.
+ *
+ * @return  1 if the server switched protocols (the request continues as
+ *          stream 1), 0 if it answered in HTTP/1.1 (then the response is
+ *          stored), -1 on a transport error.
+ */
+static int upgrade(struct h2_conn *c) {
+    size_t req = queue_pop(c);
+    struct h2_request *r = &c->reqs[req];
+    uint64_t start_ns = trace_active ? trace_now_ns() : 0;
+
+    unsigned char settings[12];
+    char encoded[32];
+    base64url(settings, settings_payload(settings), encoded);
+
+    char head[4096];
+    int n = snprintf(head, sizeof(head),
+                     "%s %s HTTP/1.1\r\n"
+                     "Host: %s\r\n"
+                     "%s"
+                     "Connection: Upgrade, HTTP2-Settings\r\n"
+                     "Upgrade: h2c\r\n"
+                     "HTTP2-Settings: %s\r\n"
+                     "\r\n",
+                     r->method, r->path, HOST,
+                     c->extra_hdr ? c->extra_hdr : "", encoded);
+    if (n < 0 || n >= (int)sizeof(head) ||
+        dbuf_append(&c->out, head, (size_t)n) < 0 || flush(c) < 0)
+        return -1;
+    r->unprocessed = false;
+
+    char *end = NULL;
+    while (!(c->in.data && (end = strstr(c->in.data, "\r\n\r\n"))))
+        if (fill(c) < 0)
+            break;
+
+    if (end && strncmp(c->in.data, "HTTP/1.1 101", 12) == 0) {
+        consume(c, (size_t)(end + 4 - c->in.data));
+        c->next_id = 3;
+        struct h2_stream *s = open_stream(c, 1, req);
+        s->start_ns = start_ns;
+        s->bytes_out = (size_t)n;
+        return 1;
+    }
+
+    /* An ordinary HTTP/1.1 response: read it to the end */
+    int ret = end ? upgrade_answer(c, req) : -1;
+    request_ended(r);
+    if (ret < 0)
+        return -1;
+    STATS_ADD(requests, 1);
+    if (trace_active)
+        record_span(r, get_status(r->resp), start_ns, 0, (size_t)n,
+                    strlen(r->resp), false);
+    if (c->done)
+        c->done(req, c->arg);
+    return 0;
+}
+
+static void conn_free(struct h2_conn *c) {
+    for (size_t i = 0; i < c->nstreams; i++) {
+        free(c->streams[i].hdrs.data);
+        free(c->streams[i].body.data);
+    }
+    if (c->fd >= 0)
+        close(c->fd);
+    hpack_encoder_free(&c->enc);
+    hpack_decoder_free(&c->dec);
+    free(c->out.data);
+    free(c->in.data);
+    free(c->req_block.data);
+    free(c->block.data);
+    free(c->streams);
+    free(c->queue);
+    free(c->refused);
+    free(c);
+}
+
+/**
+ * Send requests while streams are available, then read and handle frames,
+ * until every request has an outcome.
+ *
+ * @return  0, -1 on a connection error, -2 if the server is not h2c.
+ */
+static int run(struct h2_conn *c) {
+    for (;;) {
+        size_t limit = c->max_streams < c->peer_streams ? c->max_streams
+                                                        : c->peer_streams;
+        while (!c->goaway && c->qlen > 0 && c->nstreams < limit)
+            if (send_request(c, queue_pop(c)) < 0)
+                return -1;
+        if (flush(c) < 0)
+            return -1;
+        if (c->nstreams == 0 && (c->qlen == 0 || c->goaway || limit == 0))
+            return 0;
+
+        if (fill(c) < 0)
+            return -1;
+        int r = parse_frames(c);
+        if (r < 0)
+            return r;
+    }
+}
+
+int h2_exchange(struct h2_request *reqs, size_t count, const char *extra_hdr,
+                int max_streams, h2_done_fn done, void *arg) {
+    for (size_t i = 0; i < count; i++) {
+        reqs[i].resp = NULL;
+        reqs[i].unprocessed = true;
+    }
+    if (!h2_usable() || count == 0)
+        return -1;
+
+    struct h2_conn *c = calloc(1, sizeof(*c));
+    if (!c)
+        return -1;
+    c->fd = -1;
+    c->reqs = reqs;
+    c->count = count;
+    c->extra_hdr = extra_hdr;
+    c->done = done;
+    c->arg = arg;
+    c->next_id = 1;
+    c->peer_streams = UINT32_MAX;
+    c->peer_frame = H2_MAX_FRAME;
+    c->max_streams = max_streams > 0 ? (size_t)max_streams : 1;
+    hpack_encoder_init(&c->enc);
+    hpack_decoder_init(&c->dec);
+    c->streams = calloc(c->max_streams, sizeof(*c->streams));
+    c->queue = malloc(count * sizeof(*c->queue));
+    c->refused = calloc(count, sizeof(*c->refused));
+    if (!c->streams || !c->queue || !c->refused) {
+        conn_free(c);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++)
+        queue_push(c, i);
+
+    c->fd = setup_conn();
+    if (c->fd < 0) {
+        conn_free(c);
+        return -1;
+    }
+
+    if (h2_mode == H2_UPGRADE) {
+        int r = upgrade(c);
+        if (r <= 0) {
+            if (r == 0)
+                unavailable("no upgrade");
+            conn_free(c);
+            return -1;
+        }
+    }
+
+    /* Connection preface: the magic string, our SETTINGS and a bigger
+     * connection window */
+    unsigned char settings[12];
+    size_t slen = settings_payload(settings);
+    int r = dbuf_append(&c->out, H2_PREFACE, strlen(H2_PREFACE));
+    if (r == 0)
+        r = put_frame(c, F_SETTINGS, 0, 0, settings, slen);
+    if (r == 0)
+        r = put_window_update(c, 0, H2_WINDOW - H2_DEFAULT_WINDOW);
+    if (r == 0)
+        r = run(c);
+
+    bool negotiated = c->settings;
+    /* With prior knowledge, a server closing the connection without a
+     * single frame does not speak h2c either */
+    if (r == -2 || (r == -1 && !negotiated && h2_mode == H2_PRIOR &&
+                    errno == ECONNRESET))
+        unavailable("no h2c preface from server");
+    else if (negotiated)
+        atomic_store(&h2_state, 1);
+    if (negotiated)
+        STATS_ADD(h2_connections, 1);
+
+    /* Streams still open have an unknown outcome */
+    while (c->nstreams > 0)
+        fail_stream(c, &c->streams[0], !negotiated && h2_mode == H2_PRIOR);
+
+    if (negotiated && r == 0) {
+        unsigned char goaway[8];
+        put_u32(goaway, 0);
+        put_u32(goaway + 4, E_NO_ERROR);
+        put_frame(c, F_GOAWAY, 0, 0, goaway, sizeof(goaway));
+        flush(c);
+    }
+    conn_free(c);
+    return negotiated ? 0 : -1;
+}
@@ -0,0 +1,68 @@
+#ifndef H2_H
+#define H2_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @file h2.h
+ * @brief HTTP/2 over cleartext TCP (h2c) for batches of body-less requests.
+ *
+ * h2_exchange() opens one connection and runs a whole batch on it as
+ * concurrent streams, with HPACK-compressed headers (hpack.h). The
+ * connection is set up either with prior knowledge (the client preface
+ * right away) or by upgrading the first request (Upgrade: h2c).
+ *
+ * Responses are handed back in HTTP/1.1 form ("HTTP/1.1 <status>", the
+ * header lines, a blank line, the body), so callers parse them exactly
+ * like responses read by requests.c.
+ *
+ * When the server does not speak h2c, a note is printed once and every
+ * later call returns -1 at once, so the caller can fall back to HTTP/1.1.
+ * Socket I/O uses wait_fd() and read()/send(), never io_uring.
+ */
+
+/** How --h2c reaches HTTP/2. */
+enum h2_mode {
+    H2_OFF,        /**< HTTP/1.1 only (default) */
+    H2_PRIOR,      /**< --h2c: send the connection preface right away */
+    H2_UPGRADE,    /**< --h2c=upgrade: HTTP/1.1 Upgrade on the first request */
+};
+
+extern enum h2_mode h2_mode;
+
+/** One request of a batch. */
+struct h2_request {
+    const char *method;       /**< "GET" or "DELETE" */
+    const char *path;         /**< Request path */
+    char       *resp;         /**< Out: malloc'd response in HTTP/1.1 form, or NULL */
+    bool        unprocessed;  /**< Out: the server certainly did not act on
+                                   it (never sent, refused, or beyond GOAWAY) */
+};
+
+/** Called on the calling thread as soon as reqs[i].resp is set. */
+typedef void (*h2_done_fn)(size_t i, void *arg);
+
+/**
+ * Whether h2c is enabled and not known to be unsupported by the server.
+ */
+bool h2_usable(void);
+
+/**
+ * Run every request as a stream of one h2c connection, at most
+ * max_streams at a time (fewer if the server says so).
+ *
+ * @param extra_hdr    Header lines sent with every request, "Name: value\r\n"
+ *                     each, or NULL.
+ * @param max_streams  Concurrent stream limit (>= 1).
+ * @param done         Optional completion callback.
+ * @return             0 if the batch ran over HTTP/2 (single requests may
+ *                     still have failed), -1 if it could not: then only
+ *                     requests with a response were processed, and the
+ *                     others are marked unprocessed.
+ */
+int h2_exchange(struct h2_request *reqs, size_t count, const char *extra_hdr,
+                int max_streams, h2_done_fn done, void *arg);
+
+#endif // H2_H
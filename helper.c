@@ -1,6 +1,18 @@
 // 324CC Stefan CALMAC
 #include "helper.h"
+#include "output.h"
+#include "decode.h"
 #include "parson.h"
+#include "retry.h"
+#include "tcpopt.h"
+#include "timeout.h"
+#include "trace.h"
+#include "uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 
 /**
  * Remove HTTP headers from the response and return a newly allocated string
@@ -97,36 +109,211 @@ char *extract_token(const char *resp) {
     return token_copy;
 }
 
+/**
+ * Collect the movie ids listed in a collection details response.
+ *
+ * @param resp   JSON string containing an array "movies"
+ * @param count  Out: number of ids returned
+ * @return       Malloc’d array of ids in collection order, or NULL if
+ *               parsing failed or the collection has no movies
+ */
+int *extract_collection_movie_ids(const char *resp, size_t *count) {
+    *count = 0;
+
+    struct decoded d;
+    if (decode_collection(resp, &d) < 0) {
+        fprintf(stderr, "Error: failed to parse JSON\n");
+        return NULL;
+    }
+
+    const collection_t *c = d.items;
+    size_t n = c->movies.count;
+    int *ids = n ? malloc(n * sizeof(int)) : NULL;
+    if (ids) {
+        for (size_t i = 0; i < n; i++)
+            ids[i] = c->movies.items[i].id;
+        *count = n;
+    }
+
+    decode_free(&d);
+    return ids;
+}
+
+/**
+ * Collect one field of every element of a JSON list response as strings.
+ *
+ * @param resp   JSON text containing an array named by `array`
+ * @param array  Name of the array member (e.g. "movies", "users")
+ * @param field  Member to collect from each element (e.g. "id", "username");
+ *               numbers are formatted as integers
+ * @param count  Out: number of strings returned
+ * @return       Malloc’d array of malloc’d strings (free with free_string_list),
+ *               or NULL if parsing failed or the list is empty (errno is
+ *               ENOMEM when memory ran out); non-NULL with *count 0 when no
+ *               element has the field
+ */
+char **extract_list_field(const char *resp, const char *array,
+                          const char *field, size_t *count) {
+    *count = 0;
+
+    JSON_Value *root_val = json_parse_string(resp);
+    if (!root_val) {
+        fprintf(stderr, "Error: failed to parse JSON\n");
+        return NULL;
+    }
+
+    JSON_Array *arr = json_object_get_array(json_value_get_object(root_val),
+                                            array);
+    size_t n = json_array_get_count(arr);
+    char **out = n ? calloc(n, sizeof(char *)) : NULL;
+    size_t k = 0;
+    for (size_t i = 0; out && i < n; i++) {
+        JSON_Object *elem = json_array_get_object(arr, i);
+        JSON_Value  *val  = json_object_get_value(elem, field);
+        char num[32];
+        const char *s = NULL;
+        if (json_value_get_type(val) == JSONNumber) {
+            snprintf(num, sizeof(num), "%ld", (long)json_value_get_number(val));
+            s = num;
+        } else {
+            s = json_value_get_string(val);
+        }
+        if (s && !(out[k++] = strdup(s))) {
+            free_string_list(out, k - 1);
+            out = NULL;
+            k = 0;
+            errno = ENOMEM;
+        }
+    }
+    *count = k;
+
+    json_value_free(root_val);
+    return out;
+}
+
+/**
+ * Free a string list returned by extract_list_field() or parse_id_list().
+ *
+ * @param list   Array of malloc’d strings (may be NULL)
+ * @param count  Number of entries
+ */
+void free_string_list(char **list, size_t count) {
+    if (!list) return;
+    for (size_t i = 0; i < count; i++)
+        free(list[i]);
+    free(list);
+}
+
+/**
+ * Parse an id specification such as "1,2, 5-9" into a list of id strings.
+ *
+ * @param spec   Comma-separated ids and inclusive ranges "a-b"
+ * @param max    Maximum number of ids accepted
+ * @param count  Out: number of ids returned
+ * @return       Malloc’d array of malloc’d id strings, or NULL if the
+ *               specification is empty, malformed or too large
+ */
+char **parse_id_list(const char *spec, size_t max, size_t *count) {
+    size_t cap = 16, n = 0;
+    char **out = malloc(cap * sizeof(char *));
+    *count = 0;
+    if (!out) return NULL;
+
+    const char *p = spec;
+    while (*p) {
+        while (isspace((unsigned char)*p) || *p == ',') p++;
+        if (!*p) break;
+        if (!isdigit((unsigned char)*p)) goto bad;
+
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        p = end;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '-') {
+            p++;
+            while (isspace((unsigned char)*p)) p++;
+            if (!isdigit((unsigned char)*p)) goto bad;
+            hi = strtol(p, &end, 10);
+            p = end;
+        }
+        while (isspace((unsigned char)*p)) p++;
+        if (*p && *p != ',') goto bad;
+        if (hi < lo || (size_t)(hi - lo) >= max - n) goto bad;
+
+        for (long id = lo; id <= hi; id++) {
+            if (n == cap) {
+                char **tmp = realloc(out, 2 * cap * sizeof(char *));
+                if (!tmp) goto bad;
+                out = tmp;
+                cap *= 2;
+            }
+            char num[32];
+            snprintf(num, sizeof(num), "%ld", id);
+            if (!(out[n] = strdup(num))) goto bad;
+            n++;
+        }
+    }
+
+    if (n == 0) goto bad;
+    *count = n;
+    return out;
+
+bad:
+    free_string_list(out, n);
+    return NULL;
+}
+
 /**
  * Print details of a movie collection from its JSON representation.
- * Outputs title, owner, and a numbered list of movies (id + title).
+ * Outputs title, owner, and a numbered list of movies (id + title); in
+ * TSV one row per movie, in JSONL the collection object on one line.
  *
  * @param resp  JSON string containing "title", "owner", and array "movies"
  */
 void print_collection_details(const char *resp) {
-    JSON_Value *root_val = json_parse_string(resp);
-    if (!root_val) {
+    if (output_format == OUT_JSONL) {
+        if (out_json_line(resp) < 0)
+            fprintf(stderr, "Error: failed to parse JSON\n");
+        return;
+    }
+
+    struct decoded d;
+    if (decode_collection(resp, &d) < 0) {
         fprintf(stderr, "Error: failed to parse JSON\n");
         return;
     }
 
-    JSON_Object *root_obj = json_value_get_object(root_val);
-    const char *title = json_object_get_string(root_obj, "title");
-    const char *owner = json_object_get_string(root_obj, "owner");
+    const collection_t *c = d.items;
+    const movie_t *m = c->movies.items;
+
+    if (output_format == OUT_TSV) {
+        out_str("title\towner\tmovie_id\tmovie_title\n");
+        for (size_t i = 0; i < c->movies.count; i++) {
+            out_tsv(c->title);
+            out_char('\t');
+            out_tsv(c->owner);
+            out_char('\t');
+            out_long(m[i].id);
+            out_char('\t');
+            out_tsv(m[i].title);
+            out_char('\n');
+        }
+        decode_free(&d);
+        return;
+    }
 
-    printf("title: %s\n", title ? title : "");
-    printf("owner: %s\n", owner ? owner : "");
+    printf("title: %s\n", c->title ? c->title : "");
+    printf("owner: %s\n", c->owner ? c->owner : "");
 
-    JSON_Array *movies = json_object_get_array(root_obj, "movies");
-    size_t count = json_array_get_count(movies);
-    for (size_t i = 0; i < count; i++) {
-        JSON_Object *movie = json_array_get_object(movies, i);
-        int id = (int)json_object_get_number(movie, "id");
-        const char *m_title = json_object_get_string(movie, "title");
-        printf("#%d: %s\n", id, m_title ? m_title : "");
+    for (size_t i = 0; i < c->movies.count; i++) {
+        out_char('#');
+        out_long(m[i].id);
+        out_mem(": ", 2);
+        out_str(m[i].title ? m[i].title : "");
+        out_char('\n');
     }
 
-    json_value_free(root_val);
+    decode_free(&d);
 }
 
 /**
@@ -135,31 +322,37 @@ void print_collection_details(const char *resp) {
  * @param resp  JSON text containing an array "collections"
  */
 void print_collections(const char *resp) {
-    JSON_Value *root_value = json_parse_string(resp);
-    if (!root_value) {
-        fprintf(stderr, "ERROR: Invalid JSON\n");
+    if (output_format == OUT_JSONL) {
+        if (out_json_elements(resp, "collections") < 0)
+            fprintf(stderr, "ERROR: No \"collections\" array found\n");
         return;
     }
 
-    JSON_Object *root_object = json_value_get_object(root_value);
-    JSON_Array *arr = json_object_get_array(root_object, "collections");
-    if (!arr) {
+    struct decoded d;
+    if (decode_collections(resp, &d) < 0) {
         fprintf(stderr, "ERROR: No \"collections\" array found\n");
-        json_value_free(root_value);
         return;
     }
 
-    size_t count = json_array_get_count(arr);
-    for (size_t i = 0; i < count; ++i) {
-        JSON_Object *coll = json_array_get_object(arr, i);
-        long id = (long)json_object_get_number(coll, "id");
-        const char *title = json_object_get_string(coll, "title");
-        if (title) {
-            printf("#%ld: %s\n", id, title);
+    const collection_t *c = d.items;
+    if (output_format == OUT_TSV)
+        out_str("id\ttitle\n");
+    for (size_t i = 0; i < d.count; ++i) {
+        if (output_format == OUT_TSV) {
+            out_long(c[i].id);
+            out_char('\t');
+            out_tsv(c[i].title);
+            out_char('\n');
+        } else if (c[i].title) {
+            out_char('#');
+            out_long(c[i].id);
+            out_mem(": ", 2);
+            out_str(c[i].title);
+            out_char('\n');
         }
     }
 
-    json_value_free(root_value);
+    decode_free(&d);
 }
 
 /**
@@ -169,30 +362,56 @@ void print_collections(const char *resp) {
  * @param resp  JSON string containing movie fields
  */
 void print_movie_details(const char *resp) {
-    JSON_Value *root_value = json_parse_string(resp);
-    if (!root_value) {
-        fprintf(stderr, "ERROR: Failed to parse JSON\n");
+    if (output_format == OUT_JSONL) {
+        if (out_json_line(resp) < 0)
+            fprintf(stderr, "ERROR: Failed to parse JSON\n");
         return;
     }
 
-    JSON_Object *movie = json_value_get_object(root_value);
-    if (!movie) {
-        fprintf(stderr, "ERROR: JSON is not an object\n");
-        json_value_free(root_value);
+    struct decoded d;
+    if (decode_movie(resp, &d) < 0) {
+        fprintf(stderr, "ERROR: Failed to parse JSON\n");
         return;
     }
 
-    const char *title       = json_object_get_string(movie, "title");
-    double      year_num    = json_object_get_number(movie, "year");
-    const char *description = json_object_get_string(movie, "description");
-    const char *rating      = json_object_get_string(movie, "rating");
+    print_movie(resp, d.items);
+    decode_free(&d);
+}
+
+/**
+ * Print a decoded movie in the selected format.
+ *
+ * @param json  JSON text of the movie (JSONL copies it)
+ * @param m     Decoded movie
+ */
+void print_movie(const char *json, const movie_t *m) {
+    if (output_format == OUT_JSONL) {
+        out_json_line(json);
+        return;
+    }
 
-    printf("title: %s\n",       title       ? title       : "(no title)");
-    printf("year: %.0f\n",      year_num    );
-    printf("description: %s\n", description ? description : "(no description)");
-    printf("rating: %s\n",      rating      ? rating      : "(no rating)");
+    if (output_format == OUT_TSV) {
+        out_str("title\tyear\tdescription\trating\n");
+        out_tsv(m->title);
+        out_char('\t');
+        out_long(m->year);
+        out_char('\t');
+        out_tsv(m->description);
+        out_char('\t');
+        out_tsv(m->rating);
+        out_char('\n');
+        return;
+    }
 
-    json_value_free(root_value);
+    out_str("title: ");
+    out_str(m->title ? m->title : "(no title)");
+    out_str("\nyear: ");
+    out_long(m->year);
+    out_str("\ndescription: ");
+    out_str(m->description ? m->description : "(no description)");
+    out_str("\nrating: ");
+    out_str(m->rating ? m->rating : "(no rating)");
+    out_char('\n');
 }
 
 /**
@@ -201,29 +420,37 @@ void print_movie_details(const char *resp) {
  * @param resp  JSON text containing an array "movies"
  */
 void print_movies(const char *resp) {
-    JSON_Value *root_value = json_parse_string(resp);
-    if (!root_value) {
-        fprintf(stderr, "ERROR: Failed to parse JSON\n");
+    if (output_format == OUT_JSONL) {
+        if (out_json_elements(resp, "movies") < 0)
+            fprintf(stderr, "ERROR: No \"movies\" array in JSON\n");
         return;
     }
 
-    JSON_Object *root_object = json_value_get_object(root_value);
-    JSON_Array  *movies      = json_object_get_array(root_object, "movies");
-    if (!movies) {
+    struct decoded d;
+    if (decode_movies(resp, &d) < 0) {
         fprintf(stderr, "ERROR: No \"movies\" array in JSON\n");
-        json_value_free(root_value);
         return;
     }
 
-    size_t count = json_array_get_count(movies);
-    for (size_t i = 0; i < count; i++) {
-        JSON_Object *movie = json_array_get_object(movies, i);
-        int id = (int)json_object_get_number(movie, "id");
-        const char *title = json_object_get_string(movie, "title");
-        printf("#%d %s\n", id, title ? title : "(no title)");
+    const movie_t *m = d.items;
+    if (output_format == OUT_TSV)
+        out_str("id\ttitle\n");
+    for (size_t i = 0; i < d.count; i++) {
+        if (output_format == OUT_TSV) {
+            out_long(m[i].id);
+            out_char('\t');
+            out_tsv(m[i].title);
+            out_char('\n');
+            continue;
+        }
+        out_char('#');
+        out_long(m[i].id);
+        out_char(' ');
+        out_str(m[i].title ? m[i].title : "(no title)");
+        out_char('\n');
     }
 
-    json_value_free(root_value);
+    decode_free(&d);
 }
 
 /**
@@ -232,33 +459,41 @@ void print_movies(const char *resp) {
  * @param resp  JSON text containing an array "users"
  */
 void print_users(const char *resp) {
-    JSON_Value *root_val = json_parse_string(resp);
-    if (!root_val) {
-        fprintf(stderr, "Invalid JSON\n");
+    if (output_format == OUT_JSONL) {
+        if (out_json_elements(resp, "users") < 0)
+            fprintf(stderr, "No \"users\" array found\n");
         return;
     }
 
-    JSON_Object *root_obj = json_value_get_object(root_val);
-    JSON_Array  *users    = json_object_get_array(root_obj, "users");
-    if (!users) {
+    struct decoded d;
+    if (decode_users(resp, &d) < 0) {
         fprintf(stderr, "No \"users\" array found\n");
-        json_value_free(root_val);
         return;
     }
 
-    size_t count = json_array_get_count(users);
-    for (size_t i = 0; i < count; i++) {
-        JSON_Object *user = json_array_get_object(users, i);
-		int id = (int)json_object_get_number(user, "id");
-        const char *username = json_object_get_string(user, "username");
-        const char *password = json_object_get_string(user, "password");
-        printf("#%d %s:%s\n",
-               id,
-               username ? username : "(null)",
-               password ? password : "(null)");
+    const user_t *u = d.items;
+    if (output_format == OUT_TSV)
+        out_str("id\tusername\tpassword\n");
+    for (size_t i = 0; i < d.count; i++) {
+        if (output_format == OUT_TSV) {
+            out_long(u[i].id);
+            out_char('\t');
+            out_tsv(u[i].username);
+            out_char('\t');
+            out_tsv(u[i].password);
+            out_char('\n');
+            continue;
+        }
+        out_char('#');
+        out_long(u[i].id);
+        out_char(' ');
+        out_str(u[i].username ? u[i].username : "(null)");
+        out_char(':');
+        out_str(u[i].password ? u[i].password : "(null)");
+        out_char('\n');
     }
 
-    json_value_free(root_val);
+    decode_free(&d);
 }
 
 /**
@@ -275,48 +510,62 @@ int get_status(char *resp) {
 }
 
 /**
- * Parse a JSON error message from the response and print it along with
- * the HTTP status code.
+ * Copy the "error" message of a JSON error response into msg.
  *
- * @param status_code  HTTP status code to display
- * @param resp         Full HTTP response containing a JSON "error" field
+ * @param resp  Full HTTP response containing a JSON "error" field
+ * @param msg   Destination buffer
+ * @param size  Size of the destination buffer
+ * @return      0 on success, -1 (after reporting why on stderr) otherwise
  */
-void print_http_error(int status_code, const char *resp) {
+int extract_http_error(const char *resp, char *msg, size_t size) {
     const char *body = strchr(resp, '{');
     if (!body) {
         fprintf(stderr, "ERROR: no JSON body found\n");
-        return;
+        return -1;
     }
 
     const char *key = strstr(body, "\"error\"");
     if (!key) {
         fprintf(stderr, "ERROR: no \"error\" key in JSON\n");
-        return;
+        return -1;
     }
 
     const char *colon = strchr(key, ':');
     if (!colon) {
         fprintf(stderr, "ERROR: malformed JSON (no colon after \"error\")\n");
-        return;
+        return -1;
     }
     colon++;
     while (*colon == ' ' || *colon == '\t') colon++;
     if (*colon != '"') {
         fprintf(stderr, "ERROR: malformed JSON (\"error\" value not quoted)\n");
-        return;
+        return -1;
     }
 
     const char *msg_start = colon + 1;
     const char *msg_end   = strchr(msg_start, '"');
     if (!msg_end) {
         fprintf(stderr, "ERROR: malformed JSON (unterminated string)\n");
-        return;
+        return -1;
     }
     size_t msg_len = msg_end - msg_start;
+    if (msg_len >= size) msg_len = size - 1;
+    memcpy(msg, msg_start, msg_len);
+    msg[msg_len] = '\0';
+    return 0;
+}
+
+/**
+ * Parse a JSON error message from the response and print it along with
+ * the HTTP status code.
+ *
+ * @param status_code  HTTP status code to display
+ * @param resp         Full HTTP response containing a JSON "error" field
+ */
+void print_http_error(int status_code, const char *resp) {
     char message[256];
-    if (msg_len >= sizeof(message)) msg_len = sizeof(message) - 1;
-    memcpy(message, msg_start, msg_len);
-    message[msg_len] = '\0';
+    if (extract_http_error(resp, message, sizeof(message)) < 0)
+        return;
 
     printf("ERROR: %d %s\n", status_code, message);
 }
@@ -347,44 +596,143 @@ char *extract_cookie(char *resp) {
     return cookie;
 }
 
+/**
+ * Connect sockfd to servaddr without blocking longer than the connect
+ * timeout (and the current command deadline).
+ *
+ * @return  0 on success, -1 with errno set on failure
+ */
+static int connect_timed(int sockfd, const struct sockaddr_in *servaddr) {
+    if (uring_active())
+        return uring_connect(sockfd, (const SA*)servaddr, sizeof(*servaddr),
+                             timeout_policy.connect_ms);
+
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+
+    int r = connect(sockfd, (const SA*)servaddr, sizeof(*servaddr));
+    if (r != 0 && errno == EINPROGRESS) {
+        r = wait_fd(sockfd, POLLOUT, timeout_policy.connect_ms);
+        if (r == 0) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err) {
+                errno = err;
+                r = -1;
+            }
+        }
+    }
+
+    /* Reads and writes poll explicitly, so go back to blocking mode */
+    fcntl(sockfd, F_SETFL, flags);
+    return r;
+}
+
 /**
  * Create and return a connected TCP socket to the server defined by
- * HOST and PORT. Exits on failure.
+ * HOST and PORT. Transient failures (connection refused/reset, network
+ * unreachable, timeouts) are retried with exponential backoff and jitter.
  *
- * @return  Socket file descriptor for the established connection
+ * @return  Socket file descriptor for the established connection,
+ *          or -1 if the server could not be reached
  */
 int setup_conn(void) {
     int sockfd;
     struct sockaddr_in servaddr;
 
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd == -1) {
-        printf("socket creation failed...\n");
-        exit(0);
-    }
     bzero(&servaddr, sizeof(servaddr));
-
     servaddr.sin_family = AF_INET;
     servaddr.sin_addr.s_addr = inet_addr(HOST);
     servaddr.sin_port = htons(PORT);
 
-    if (connect(sockfd, (SA*)&servaddr, sizeof(servaddr)) != 0) {
-        printf("connection with the server failed...\n");
-        exit(0);
+    for (int attempt = 0; ; attempt++) {
+        sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd == -1) {
+            printf("socket creation failed...\n");
+            return -1;
+        }
+        tcp_configure(sockfd);
+
+        if (connect_timed(sockfd, &servaddr) == 0)
+            return sockfd;
+
+        int err = errno;
+        close(sockfd);
+        if (attempt >= retry_policy.retries || !retry_errno_retryable(err) ||
+            !retry_budget_take() || !retry_backoff(attempt + 1)) {
+            printf("connection with the server failed... (%s)\n",
+                   strerror(err));
+            errno = err;
+            return -1;
+        }
+        fprintf(stderr, "retry: connect (%s), attempt %d\n",
+                strerror(err), attempt + 2);
     }
+}
 
+/**
+ * Single quiet connection attempt: no retries and no messages. Used to open
+ * a connection ahead of time, where a failure simply means "connect later".
+ *
+ * @return  Connected socket file descriptor, or -1 on failure.
+ */
+int try_conn(void) {
+    struct sockaddr_in servaddr;
+
+    bzero(&servaddr, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = inet_addr(HOST);
+    servaddr.sin_port = htons(PORT);
+
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd == -1)
+        return -1;
+    tcp_configure(sockfd);
+    if (connect_timed(sockfd, &servaddr) != 0) {
+        close(sockfd);
+        return -1;
+    }
     return sockfd;
 }
 
+/**
+ * Check, without blocking, that an idle connection is still usable. The
+ * server never sends unsolicited data, so a readable socket means it was
+ * closed (EOF) or reset.
+ *
+ * @param sockfd  Idle connected socket.
+ * @return        true if the connection can still carry a request.
+ */
+bool conn_alive(int sockfd) {
+    struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+    if (poll(&pfd, 1, 0) == 0)
+        return true;
+
+    char c;
+    ssize_t n = recv(sockfd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n > 0;
+}
+
 /**
  * Read a line from stdin, strip the trailing newline, and return it.
+ * The wait is excluded from the current command deadline.
  *
  * @return  Malloc’d string without the newline, or NULL on EOF/error
  */
 char *helper_readline(void) {
     size_t cap = 0;
     char *line = NULL;
+
+    /* Show the prompt (and anything else pending) before blocking */
+    out_flush();
+
+    /* Time spent waiting for the user does not count against the
+     * deadline of the command being executed */
+    uint64_t start = trace_now_ns();
     ssize_t len = getline(&line, &cap, stdin);
+    deadline_extend(trace_now_ns() - start);
+
     if (len <= 0) {
         free(line);
         return NULL;
@@ -392,3 +740,50 @@ char *helper_readline(void) {
     if (line[len-1] == '\n') line[len-1] = '\0';
     return line;
 }
+
+/**
+ * Replace a file so that readers see either the old or the new contents:
+ * write a temporary file in the same directory, fsync it, rename it over
+ * path and fsync the directory.
+ *
+ * @param path  Destination file.
+ * @param data  New contents.
+ * @param len   Length of data.
+ * @return      0 on success, -1 on error (path is left untouched).
+ */
+int write_file_atomic(const char *path, const void *data, size_t len) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        perror("fopen");
+        return -1;
+    }
+    if (fwrite(data, 1, len, f) != len || fflush(f) != 0 ||
+        fsync(fileno(f)) != 0) {
+        perror("write");
+        fclose(f);
+        unlink(tmp);
+        return -1;
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        perror("rename");
+        unlink(tmp);
+        return -1;
+    }
+
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash)
+        *(slash == dir ? slash + 1 : slash) = '\0';
+    else
+        strcpy(dir, ".");
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    return 0;
+}
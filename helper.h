@@ -12,6 +12,8 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "decode.h"
+
 /* Socket address shorthand */
 #define SA      struct sockaddr
 
@@ -60,6 +62,47 @@ int extract_id(const char *resp);
  */
 char *extract_token(const char *resp);
 
+/**
+ * Parse a collection details response and collect the ids of its movies.
+ *
+ * @param resp   JSON string containing an array "movies" of {id, title}.
+ * @param count  Out: number of ids returned.
+ * @return       Malloc’d array of movie ids in collection order, or NULL
+ *               on parse error or when the collection is empty.
+ */
+int *extract_collection_movie_ids(const char *resp, size_t *count);
+
+/**
+ * Collect one field of every element of a JSON list response as strings.
+ *
+ * @param resp   JSON text containing the array named by `array`.
+ * @param array  Array member name (e.g. "movies", "collections", "users").
+ * @param field  Element member to collect (e.g. "id", "username").
+ * @param count  Out: number of strings returned.
+ * @return       Malloc’d array of malloc’d strings, or NULL on error/empty
+ *               list (errno is ENOMEM when memory ran out).
+ */
+char **extract_list_field(const char *resp, const char *array,
+                          const char *field, size_t *count);
+
+/**
+ * Parse a list of ids and inclusive ranges (e.g. "1,2,5-9").
+ *
+ * @param spec   Id specification entered by the user.
+ * @param max    Maximum number of ids accepted.
+ * @param count  Out: number of ids returned.
+ * @return       Malloc’d array of malloc’d id strings, or NULL if malformed.
+ */
+char **parse_id_list(const char *spec, size_t max, size_t *count);
+
+/**
+ * Free a list returned by extract_list_field() or parse_id_list().
+ *
+ * @param list   Array of malloc’d strings (may be NULL).
+ * @param count  Number of entries.
+ */
+void free_string_list(char **list, size_t count);
+
 /* -------------------------------------------------------------------------- */
 /*                         JSON Response Printers                             */
 /* -------------------------------------------------------------------------- */
@@ -92,6 +135,15 @@ void print_collections(const char *resp);
  */
 void print_movie_details(const char *resp);
 
+/**
+ * Print an already decoded movie the way print_movie_details() does,
+ * through the out_*() helpers only (so out_capture() collects all of it).
+ *
+ * @param json  JSON text m was decoded from (copied as is for JSONL).
+ * @param m     Decoded movie.
+ */
+void print_movie(const char *json, const movie_t *m);
+
 /**
  * Print a list of movies (id and title).
  *
@@ -128,6 +180,16 @@ int get_status(char *resp);
  */
 void print_http_error(int status_code, const char *resp);
 
+/**
+ * Copy the "error" message of a JSON error response into msg.
+ *
+ * @param resp  Full HTTP response containing a JSON "error" field.
+ * @param msg   Destination buffer.
+ * @param size  Size of the destination buffer.
+ * @return      0 on success, -1 if no message could be extracted.
+ */
+int extract_http_error(const char *resp, char *msg, size_t size);
+
 /* -------------------------------------------------------------------------- */
 /*                               Cookie Helper                                */
 /* -------------------------------------------------------------------------- */
@@ -145,13 +207,39 @@ char *extract_cookie(char *resp);
 /* -------------------------------------------------------------------------- */
 
 /**
- * Open a TCP socket and connect to HOST:PORT.
- * Exits the application if creation or connection fails.
+ * Open a TCP socket and connect to HOST:PORT, retrying transient
+ * failures according to the retry policy.
  *
- * @return  Connected socket file descriptor.
+ * @return  Connected socket file descriptor, or -1 on failure.
  */
 int setup_conn(void);
 
+/**
+ * Make a single connection attempt to HOST:PORT, without retries or
+ * error messages.
+ *
+ * @return  Connected socket file descriptor, or -1 on failure.
+ */
+int try_conn(void);
+
+/**
+ * Check without blocking whether an idle connection is still open.
+ *
+ * @param sockfd  Idle connected socket.
+ * @return        true if the peer has not closed or reset it.
+ */
+bool conn_alive(int sockfd);
+
+/**
+ * Atomically replace a file (temporary file, fsync, rename).
+ *
+ * @param path  Destination file.
+ * @param data  New contents.
+ * @param len   Length of data.
+ * @return      0 on success, -1 on error (path is left untouched).
+ */
+int write_file_atomic(const char *path, const void *data, size_t len);
+
 /**
  * Read a line from stdin, allocate buffer with malloc, strip trailing newline.
  *
@@ -0,0 +1,557 @@
+// 324CC Stefan CALMAC
+#include "hpack.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HPACK_STATIC_COUNT 61
+#define ENTRY_OVERHEAD     32   /* per-field size overhead (RFC 7541 4.1) */
+#define HUFF_EOS           256
+
+struct static_entry {
+    const char *name;
+    const char *value;
+};
+
+/* RFC 7541, Appendix A */
+static const struct static_entry static_table[HPACK_STATIC_COUNT] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+/* Huffman code of every byte, then EOS (RFC 7541, Appendix B) */
+static const uint32_t huff_codes[257] = {
+    0x00001ff8, 0x007fffd8, 0x0fffffe2, 0x0fffffe3, 0x0fffffe4, 0x0fffffe5,
+    0x0fffffe6, 0x0fffffe7, 0x0fffffe8, 0x00ffffea, 0x3ffffffc, 0x0fffffe9,
+    0x0fffffea, 0x3ffffffd, 0x0fffffeb, 0x0fffffec, 0x0fffffed, 0x0fffffee,
+    0x0fffffef, 0x0ffffff0, 0x0ffffff1, 0x0ffffff2, 0x3ffffffe, 0x0ffffff3,
+    0x0ffffff4, 0x0ffffff5, 0x0ffffff6, 0x0ffffff7, 0x0ffffff8, 0x0ffffff9,
+    0x0ffffffa, 0x0ffffffb, 0x00000014, 0x000003f8, 0x000003f9, 0x00000ffa,
+    0x00001ff9, 0x00000015, 0x000000f8, 0x000007fa, 0x000003fa, 0x000003fb,
+    0x000000f9, 0x000007fb, 0x000000fa, 0x00000016, 0x00000017, 0x00000018,
+    0x00000000, 0x00000001, 0x00000002, 0x00000019, 0x0000001a, 0x0000001b,
+    0x0000001c, 0x0000001d, 0x0000001e, 0x0000001f, 0x0000005c, 0x000000fb,
+    0x00007ffc, 0x00000020, 0x00000ffb, 0x000003fc, 0x00001ffa, 0x00000021,
+    0x0000005d, 0x0000005e, 0x0000005f, 0x00000060, 0x00000061, 0x00000062,
+    0x00000063, 0x00000064, 0x00000065, 0x00000066, 0x00000067, 0x00000068,
+    0x00000069, 0x0000006a, 0x0000006b, 0x0000006c, 0x0000006d, 0x0000006e,
+    0x0000006f, 0x00000070, 0x00000071, 0x00000072, 0x000000fc, 0x00000073,
+    0x000000fd, 0x00001ffb, 0x0007fff0, 0x00001ffc, 0x00003ffc, 0x00000022,
+    0x00007ffd, 0x00000003, 0x00000023, 0x00000004, 0x00000024, 0x00000005,
+    0x00000025, 0x00000026, 0x00000027, 0x00000006, 0x00000074, 0x00000075,
+    0x00000028, 0x00000029, 0x0000002a, 0x00000007, 0x0000002b, 0x00000076,
+    0x0000002c, 0x00000008, 0x00000009, 0x0000002d, 0x00000077, 0x00000078,
+    0x00000079, 0x0000007a, 0x0000007b, 0x00007ffe, 0x000007fc, 0x00003ffd,
+    0x00001ffd, 0x0ffffffc, 0x000fffe6, 0x003fffd2, 0x000fffe7, 0x000fffe8,
+    0x003fffd3, 0x003fffd4, 0x003fffd5, 0x007fffd9, 0x003fffd6, 0x007fffda,
+    0x007fffdb, 0x007fffdc, 0x007fffdd, 0x007fffde, 0x00ffffeb, 0x007fffdf,
+    0x00ffffec, 0x00ffffed, 0x003fffd7, 0x007fffe0, 0x00ffffee, 0x007fffe1,
+    0x007fffe2, 0x007fffe3, 0x007fffe4, 0x001fffdc, 0x003fffd8, 0x007fffe5,
+    0x003fffd9, 0x007fffe6, 0x007fffe7, 0x00ffffef, 0x003fffda, 0x001fffdd,
+    0x000fffe9, 0x003fffdb, 0x003fffdc, 0x007fffe8, 0x007fffe9, 0x001fffde,
+    0x007fffea, 0x003fffdd, 0x003fffde, 0x00fffff0, 0x001fffdf, 0x003fffdf,
+    0x007fffeb, 0x007fffec, 0x001fffe0, 0x001fffe1, 0x003fffe0, 0x001fffe2,
+    0x007fffed, 0x003fffe1, 0x007fffee, 0x007fffef, 0x000fffea, 0x003fffe2,
+    0x003fffe3, 0x003fffe4, 0x007ffff0, 0x003fffe5, 0x003fffe6, 0x007ffff1,
+    0x03ffffe0, 0x03ffffe1, 0x000fffeb, 0x0007fff1, 0x003fffe7, 0x007ffff2,
+    0x003fffe8, 0x01ffffec, 0x03ffffe2, 0x03ffffe3, 0x03ffffe4, 0x07ffffde,
+    0x07ffffdf, 0x03ffffe5, 0x00fffff1, 0x01ffffed, 0x0007fff2, 0x001fffe3,
+    0x03ffffe6, 0x07ffffe0, 0x07ffffe1, 0x03ffffe7, 0x07ffffe2, 0x00fffff2,
+    0x001fffe4, 0x001fffe5, 0x03ffffe8, 0x03ffffe9, 0x0ffffffd, 0x07ffffe3,
+    0x07ffffe4, 0x07ffffe5, 0x000fffec, 0x00fffff3, 0x000fffed, 0x001fffe6,
+    0x003fffe9, 0x001fffe7, 0x001fffe8, 0x007ffff3, 0x003fffea, 0x003fffeb,
+    0x01ffffee, 0x01ffffef, 0x00fffff4, 0x00fffff5, 0x03ffffea, 0x007ffff4,
+    0x03ffffeb, 0x07ffffe6, 0x03ffffec, 0x03ffffed, 0x07ffffe7, 0x07ffffe8,
+    0x07ffffe9, 0x07ffffea, 0x07ffffeb, 0x0ffffffe, 0x07ffffec, 0x07ffffed,
+    0x07ffffee, 0x07ffffef, 0x07fffff0, 0x03ffffee,
+    0x3fffffff,   /* EOS */
+};
+
+static const uint8_t huff_lens[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+     6, 10, 10, 12, 13,  6,  8, 11, 10, 10,  8, 11,  8,  6,  6,  6,
+     5,  5,  5,  6,  6,  6,  6,  6,  6,  6,  7,  8, 15,  6, 12, 10,
+    13,  6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,
+     7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8, 13, 19, 13, 14,  6,
+    15,  5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,
+     6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+/* -------------------------------------------------------------------------- */
+/*                             Dynamic table                                  */
+/* -------------------------------------------------------------------------- */
+
+static void table_init(struct hpack_table *t, size_t max) {
+    memset(t, 0, sizeof(*t));
+    t->max = max;
+}
+
+static void table_free(struct hpack_table *t) {
+    for (size_t i = 0; i < t->count; i++)
+        free(t->ring[(t->first + i) % t->cap].name);
+    free(t->ring);
+    memset(t, 0, sizeof(*t));
+}
+
+/* Field k of the table, 1 being the newest */
+static struct hpack_field *table_get(const struct hpack_table *t, size_t k) {
+    return &t->ring[(t->first + t->count - k) % t->cap];
+}
+
+static void table_evict(struct hpack_table *t) {
+    struct hpack_field *f = &t->ring[t->first];
+    t->size -= f->name_len + f->value_len + ENTRY_OVERHEAD;
+    free(f->name);
+    t->first = (t->first + 1) % t->cap;
+    t->count--;
+}
+
+static void table_resize(struct hpack_table *t, size_t max) {
+    t->max = max;
+    while (t->size > max)
+        table_evict(t);
+}
+
+/**
+ * Insert a field, evicting the oldest ones to make room. A field larger
+ * than the whole table just empties it.
+ */
+static int table_add(struct hpack_table *t, const char *name, size_t nlen,
+                     const char *value, size_t vlen) {
+    size_t sz = nlen + vlen + ENTRY_OVERHEAD;
+    while (t->count > 0 && t->size + sz > t->max)
+        table_evict(t);
+    if (sz > t->max)
+        return 0;
+
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 16;
+        struct hpack_field *ring = malloc(cap * sizeof(*ring));
+        if (!ring)
+            return -1;
+        for (size_t i = 0; i < t->count; i++)
+            ring[i] = t->ring[(t->first + i) % t->cap];
+        free(t->ring);
+        t->ring = ring;
+        t->cap = cap;
+        t->first = 0;
+    }
+
+    char *s = malloc(nlen + vlen + 2);
+    if (!s)
+        return -1;
+    memcpy(s, name, nlen);
+    s[nlen] = '\0';
+    memcpy(s + nlen + 1, value, vlen);
+    s[nlen + 1 + vlen] = '\0';
+
+    struct hpack_field *f = &t->ring[(t->first + t->count) % t->cap];
+    f->name = s;
+    f->value = s + nlen + 1;
+    f->name_len = nlen;
+    f->value_len = vlen;
+    t->count++;
+    t->size += sz;
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                        Integers and Huffman strings                        */
+/* -------------------------------------------------------------------------- */
+
+/* Integer with an N-bit prefix, the high bits of the first byte in `first` */
+static int put_int(struct dbuf *out, unsigned char first, int prefix,
+                   size_t v) {
+    unsigned char buf[16];
+    size_t n = 0;
+    size_t max = ((size_t)1 << prefix) - 1;
+    if (v < max) {
+        buf[n++] = first | (unsigned char)v;
+    } else {
+        buf[n++] = first | (unsigned char)max;
+        for (v -= max; v >= 128; v >>= 7)
+            buf[n++] = (unsigned char)((v & 0x7f) | 0x80);
+        buf[n++] = (unsigned char)v;
+    }
+    return dbuf_append(out, (const char *)buf, n);
+}
+
+static int get_int(const unsigned char **p, const unsigned char *end,
+                   int prefix, size_t *v) {
+    if (*p >= end)
+        return -1;
+    size_t max = ((size_t)1 << prefix) - 1;
+    size_t x = *(*p)++ & max;
+    if (x == max) {
+        for (int shift = 0; ; shift += 7) {
+            if (*p >= end || shift > 28)
+                return -1;
+            unsigned char b = *(*p)++;
+            x += (size_t)(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                break;
+        }
+    }
+    *v = x;
+    return 0;
+}
+
+static size_t huff_len(const char *s, size_t len) {
+    size_t bits = 0;
+    for (size_t i = 0; i < len; i++)
+        bits += huff_lens[(unsigned char)s[i]];
+    return (bits + 7) / 8;
+}
+
+static int huff_encode(struct dbuf *out, const char *s, size_t len) {
+    char buf[256];
+    size_t n = 0;
+    uint64_t acc = 0;
+    int nbits = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        acc = (acc << huff_lens[c]) | huff_codes[c];
+        nbits += huff_lens[c];
+        while (nbits >= 8) {
+            nbits -= 8;
+            buf[n++] = (char)(acc >> nbits);
+            if (n == sizeof(buf)) {
+                if (dbuf_append(out, buf, n) < 0)
+                    return -1;
+                n = 0;
+            }
+        }
+        acc &= ((uint64_t)1 << nbits) - 1;
+    }
+    /* Pad with the most significant bits of EOS (all ones) */
+    if (nbits > 0)
+        buf[n++] = (char)((acc << (8 - nbits)) | (0xffu >> nbits));
+    return dbuf_append(out, buf, n);
+}
+
+/* Decoding tree of the Huffman code: 257 leaves, 256 inner nodes */
+struct huff_node {
+    int16_t child[2];   /* 0 = none (the root is never a child) */
+    int16_t sym;        /* -1 for inner nodes */
+};
+
+static struct huff_node huff_tree[2 * 257];
+static pthread_once_t huff_once = PTHREAD_ONCE_INIT;
+
+static void huff_build(void) {
+    int nodes = 1;
+    huff_tree[0] = (struct huff_node){ { 0, 0 }, -1 };
+    for (int sym = 0; sym <= HUFF_EOS; sym++) {
+        int node = 0;
+        for (int bit = huff_lens[sym] - 1; bit >= 0; bit--) {
+            int b = (huff_codes[sym] >> bit) & 1;
+            if (!huff_tree[node].child[b]) {
+                huff_tree[nodes] = (struct huff_node){ { 0, 0 }, -1 };
+                huff_tree[node].child[b] = (int16_t)nodes++;
+            }
+            node = huff_tree[node].child[b];
+        }
+        huff_tree[node].sym = (int16_t)sym;
+    }
+}
+
+static int huff_decode(struct dbuf *out, const unsigned char *s, size_t len) {
+    pthread_once(&huff_once, huff_build);
+
+    char buf[256];
+    size_t n = 0;
+    int node = 0, depth = 0;
+    bool ones = true;
+
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int b = (s[i] >> bit) & 1;
+            node = huff_tree[node].child[b];
+            depth++;
+            ones = ones && b;
+            if (huff_tree[node].sym < 0)
+                continue;
+            if (huff_tree[node].sym == HUFF_EOS)
+                return -1;
+            buf[n++] = (char)huff_tree[node].sym;
+            if (n == sizeof(buf)) {
+                if (dbuf_append(out, buf, n) < 0)
+                    return -1;
+                n = 0;
+            }
+            node = 0;
+            depth = 0;
+            ones = true;
+        }
+    }
+    /* Padding: at most 7 bits, all ones */
+    if (depth > 7 || !ones)
+        return -1;
+    return dbuf_append(out, buf, n);
+}
+
+static int put_string(struct dbuf *out, const char *s, size_t len) {
+    size_t h = huff_len(s, len);
+    if (h < len)
+        return put_int(out, 0x80, 7, h) < 0 ? -1 : huff_encode(out, s, len);
+    return put_int(out, 0x00, 7, len) < 0 ? -1 : dbuf_append(out, s, len);
+}
+
+/* String literal into out (replacing its contents), NUL-terminated */
+static int get_string(const unsigned char **p, const unsigned char *end,
+                      struct dbuf *out) {
+    if (*p >= end)
+        return -1;
+    bool huffman = **p & 0x80;
+    size_t len;
+    if (get_int(p, end, 7, &len) < 0 || len > (size_t)(end - *p))
+        return -1;
+
+    out->len = 0;
+    int r = huffman ? huff_decode(out, *p, len)
+                    : dbuf_append(out, (const char *)*p, len);
+    if (r < 0 || dbuf_append(out, "", 1) < 0)
+        return -1;
+    out->len--;
+    *p += len;
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Encoder                                    */
+/* -------------------------------------------------------------------------- */
+
+void hpack_encoder_init(struct hpack_encoder *e) {
+    table_init(&e->table, HPACK_TABLE_SZ);
+    e->update = false;
+    e->update_min = HPACK_TABLE_SZ;
+}
+
+void hpack_encoder_free(struct hpack_encoder *e) {
+    table_free(&e->table);
+}
+
+void hpack_encoder_set_limit(struct hpack_encoder *e, size_t limit) {
+    size_t max = limit < HPACK_TABLE_SZ ? limit : HPACK_TABLE_SZ;
+    if (max == e->table.max)
+        return;
+    if (!e->update || max < e->update_min)
+        e->update_min = max;
+    e->update = true;
+    table_resize(&e->table, max);
+}
+
+int hpack_encode_begin(struct hpack_encoder *e, struct dbuf *out) {
+    if (!e->update)
+        return 0;
+    e->update = false;
+    /* The smallest size since the last block goes first (RFC 7541 4.2) */
+    if (e->update_min < e->table.max &&
+        put_int(out, 0x20, 5, e->update_min) < 0)
+        return -1;
+    return put_int(out, 0x20, 5, e->table.max);
+}
+
+int hpack_encode(struct hpack_encoder *e, struct dbuf *out,
+                 const char *name, const char *value) {
+    size_t nlen = strlen(name), vlen = strlen(value);
+    size_t name_idx = 0;
+
+    for (size_t i = 0; i < HPACK_STATIC_COUNT; i++) {
+        if (strcmp(static_table[i].name, name) != 0)
+            continue;
+        if (strcmp(static_table[i].value, value) == 0)
+            return put_int(out, 0x80, 7, i + 1);
+        if (!name_idx)
+            name_idx = i + 1;
+    }
+    for (size_t k = 1; k <= e->table.count; k++) {
+        const struct hpack_field *f = table_get(&e->table, k);
+        if (f->name_len != nlen || memcmp(f->name, name, nlen) != 0)
+            continue;
+        if (f->value_len == vlen && memcmp(f->value, value, vlen) == 0)
+            return put_int(out, 0x80, 7, HPACK_STATIC_COUNT + k);
+        if (!name_idx)
+            name_idx = HPACK_STATIC_COUNT + k;
+    }
+
+    /* Paths differ from request to request: indexing them would only
+     * evict the headers that do repeat */
+    bool index = strcmp(name, ":path") != 0;
+    if (put_int(out, index ? 0x40 : 0x00, index ? 6 : 4, name_idx) < 0)
+        return -1;
+    if (!name_idx && put_string(out, name, nlen) < 0)
+        return -1;
+    if (put_string(out, value, vlen) < 0)
+        return -1;
+    return index ? table_add(&e->table, name, nlen, value, vlen) : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Decoder                                    */
+/* -------------------------------------------------------------------------- */
+
+void hpack_decoder_init(struct hpack_decoder *d) {
+    table_init(&d->table, HPACK_TABLE_SZ);
+    d->limit = HPACK_TABLE_SZ;
+}
+
+void hpack_decoder_free(struct hpack_decoder *d) {
+    table_free(&d->table);
+}
+
+/* Name and value at a (static or dynamic) index */
+static int lookup(const struct hpack_decoder *d, size_t idx,
+                  const char **name, size_t *nlen,
+                  const char **value, size_t *vlen) {
+    if (idx == 0 || idx > HPACK_STATIC_COUNT + d->table.count)
+        return -1;
+    if (idx <= HPACK_STATIC_COUNT) {
+        *name = static_table[idx - 1].name;
+        *value = static_table[idx - 1].value;
+        *nlen = strlen(*name);
+        *vlen = strlen(*value);
+    } else {
+        const struct hpack_field *f =
+            table_get(&d->table, idx - HPACK_STATIC_COUNT);
+        *name = f->name;
+        *value = f->value;
+        *nlen = f->name_len;
+        *vlen = f->value_len;
+    }
+    return 0;
+}
+
+int hpack_decode(struct hpack_decoder *d, const unsigned char *block,
+                 size_t len, hpack_field_fn fn, void *arg) {
+    const unsigned char *p = block, *end = block + len;
+    struct dbuf name = { 0 }, value = { 0 };
+    bool fields = false;
+    int ret = -1;
+
+    while (p < end) {
+        const char *n, *v;
+        size_t nlen, vlen, idx;
+
+        if (*p & 0x80) {
+            /* Indexed field */
+            if (get_int(&p, end, 7, &idx) < 0 ||
+                lookup(d, idx, &n, &nlen, &v, &vlen) < 0 ||
+                fn(n, nlen, v, vlen, arg) < 0)
+                goto out;
+            fields = true;
+            continue;
+        }
+
+        if ((*p & 0xe0) == 0x20) {
+            /* Table size update, only before the first field */
+            if (fields || get_int(&p, end, 5, &idx) < 0 || idx > d->limit)
+                goto out;
+            table_resize(&d->table, idx);
+            continue;
+        }
+
+        /* Literal: with incremental indexing (01), without (0000) or
+         * never indexed (0001) */
+        bool index = *p & 0x40;
+        if (get_int(&p, end, index ? 6 : 4, &idx) < 0)
+            goto out;
+        if (idx) {
+            if (lookup(d, idx, &n, &nlen, &v, &vlen) < 0)
+                goto out;
+            name.len = 0;
+            if (dbuf_append(&name, n, nlen) < 0 ||
+                dbuf_append(&name, "", 1) < 0)
+                goto out;
+            name.len--;
+        } else if (get_string(&p, end, &name) < 0) {
+            goto out;
+        }
+        if (get_string(&p, end, &value) < 0)
+            goto out;
+        if (index && table_add(&d->table, name.data, name.len,
+                               value.data, value.len) < 0)
+            goto out;
+        if (fn(name.data, name.len, value.data, value.len, arg) < 0)
+            goto out;
+        fields = true;
+    }
+    ret = 0;
+
+out:
+    free(name.data);
+    free(value.data);
+    return ret;
+}
@@ -0,0 +1,99 @@
+#ifndef HPACK_H
+#define HPACK_H
+// 324CC Stefan CALMAC
+
+#include "compress.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @file hpack.h
+ * @brief HPACK header compression for HTTP/2 (RFC 7541).
+ *
+ * The encoder indexes every header except :path into the dynamic table,
+ * so after the first request of a connection a repeated header such as
+ * Authorization costs one byte. Strings are Huffman-coded when that is
+ * shorter. The decoder implements the whole format: indexed fields, the
+ * three literal forms, dynamic table size updates and Huffman strings.
+ *
+ * One encoder and one decoder belong to each connection and must see
+ * the header blocks in the order they go over the wire.
+ */
+
+#define HPACK_TABLE_SZ 4096   /**< Default dynamic table size (SETTINGS) */
+
+/** One field of a dynamic table. */
+struct hpack_field {
+    char  *name;     /**< "name" NUL "value" NUL, one allocation */
+    char  *value;
+    size_t name_len;
+    size_t value_len;
+};
+
+/** Dynamic table: a ring of fields, newest at index 1. */
+struct hpack_table {
+    struct hpack_field *ring;
+    size_t              cap;
+    size_t              first;   /**< Slot of the oldest field */
+    size_t              count;
+    size_t              size;    /**< Sum of name + value + 32 per field */
+    size_t              max;     /**< Current size limit */
+};
+
+struct hpack_encoder {
+    struct hpack_table table;
+    bool               update;      /**< A size update opens the next block */
+    size_t             update_min;  /**< Smallest size since the last block */
+};
+
+struct hpack_decoder {
+    struct hpack_table table;
+    size_t             limit;    /**< Largest size the peer may ask for */
+};
+
+void hpack_encoder_init(struct hpack_encoder *e);
+void hpack_encoder_free(struct hpack_encoder *e);
+
+/**
+ * Apply the peer's SETTINGS_HEADER_TABLE_SIZE. The encoder uses at most
+ * HPACK_TABLE_SZ; a change is announced at the start of the next block.
+ */
+void hpack_encoder_set_limit(struct hpack_encoder *e, size_t limit);
+
+/**
+ * Start a header block (emits a pending table size update).
+ *
+ * @return  0, or -1 if memory ran out.
+ */
+int hpack_encode_begin(struct hpack_encoder *e, struct dbuf *out);
+
+/**
+ * Append one header field (name in lower case) to the block.
+ *
+ * @return  0, or -1 if memory ran out.
+ */
+int hpack_encode(struct hpack_encoder *e, struct dbuf *out,
+                 const char *name, const char *value);
+
+void hpack_decoder_init(struct hpack_decoder *d);
+void hpack_decoder_free(struct hpack_decoder *d);
+
+/**
+ * Called for each decoded field; name and value are NUL-terminated.
+ *
+ * @return  0 to go on, -1 to stop decoding with an error.
+ */
+typedef int (*hpack_field_fn)(const char *name, size_t name_len,
+                              const char *value, size_t value_len,
+                              void *arg);
+
+/**
+ * Decode a complete header block.
+ *
+ * @return  0, or -1 if the block is malformed (a connection error).
+ */
+int hpack_decode(struct hpack_decoder *d, const unsigned char *block,
+                 size_t len, hpack_field_fn fn, void *arg);
+
+#endif // HPACK_H
@@ -0,0 +1,121 @@
+// 324CC Stefan CALMAC
+#include "jsonw.h"
+#include "output.h"
+#include "parson.h"
+
+#include <string.h>
+
+/* Request bodies of this thread; reset by jw_start(), never freed */
+static __thread struct dbuf body_buf;
+
+static void put(struct json_writer *w, const char *s, size_t len) {
+    if (!w->failed && dbuf_append(w->out, s, len) < 0)
+        w->failed = true;
+}
+
+/* Separator before a value or member at the current level */
+static void sep(struct json_writer *w) {
+    if (w->need_comma)
+        put(w, ",", 1);
+}
+
+void jw_start(struct json_writer *w, struct dbuf *out) {
+    w->out = out ? out : &body_buf;
+    w->out->len = 0;
+    w->need_comma = false;
+    w->failed = false;
+}
+
+void jw_object_begin(struct json_writer *w) {
+    sep(w);
+    put(w, "{", 1);
+    w->need_comma = false;
+}
+
+void jw_object_end(struct json_writer *w) {
+    put(w, "}", 1);
+    w->need_comma = true;
+}
+
+void jw_array_begin(struct json_writer *w) {
+    sep(w);
+    put(w, "[", 1);
+    w->need_comma = false;
+}
+
+void jw_array_end(struct json_writer *w) {
+    put(w, "]", 1);
+    w->need_comma = true;
+}
+
+/* Quoted, escaped string; runs without special bytes are copied at once */
+static void put_quoted(struct json_writer *w, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+
+    put(w, "\"", 1);
+    for (;;) {
+        const char *run = s;
+        while ((unsigned char)*s >= 0x20 && *s != '"' && *s != '\\')
+            s++;
+        put(w, run, (size_t)(s - run));
+        if (*s == '\0')
+            break;
+
+        char esc[6] = { '\\', 0 };
+        size_t n = 2;
+        switch (*s) {
+        case '"':  esc[1] = '"';  break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b';  break;
+        case '\f': esc[1] = 'f';  break;
+        case '\n': esc[1] = 'n';  break;
+        case '\r': esc[1] = 'r';  break;
+        case '\t': esc[1] = 't';  break;
+        default:
+            memcpy(esc + 1, "u00", 3);
+            esc[4] = hex[(unsigned char)*s >> 4];
+            esc[5] = hex[*s & 0xF];
+            n = 6;
+        }
+        put(w, esc, n);
+        s++;
+    }
+    put(w, "\"", 1);
+}
+
+void jw_key(struct json_writer *w, const char *key) {
+    sep(w);
+    put_quoted(w, key);
+    put(w, ":", 1);
+    w->need_comma = false;
+}
+
+void jw_string(struct json_writer *w, const char *s) {
+    sep(w);
+    if (s)
+        put_quoted(w, s);
+    else
+        put(w, "null", 4);
+    w->need_comma = true;
+}
+
+void jw_number(struct json_writer *w, double v) {
+    char num[32];
+    sep(w);
+    put(w, num, (size_t)json_serialize_number(v, num));
+    w->need_comma = true;
+}
+
+void jw_int(struct json_writer *w, long v) {
+    char num[24];
+    char *p = out_itoa(v, num + sizeof(num));
+    sep(w);
+    put(w, p, (size_t)(num + sizeof(num) - p));
+    w->need_comma = true;
+}
+
+const char *jw_finish(struct json_writer *w) {
+    if (w->failed || !w->out->data)
+        return NULL;
+    return w->out->data;
+}
@@ -0,0 +1,85 @@
+#ifndef JSONW_H
+#define JSONW_H
+// 324CC Stefan CALMAC
+
+#include "compress.h"
+
+#include <stdbool.h>
+
+/**
+ * @file jsonw.h
+ * @brief Streaming JSON writer for request bodies.
+ *
+ * Values are appended to a dbuf as they are written: no DOM, no sizing
+ * pass and no intermediate string. Without an explicit buffer the writer
+ * uses a per-thread body buffer that is reset, not freed, for each body,
+ * so building a request body normally allocates nothing. The body stays
+ * valid until the next jw_start() on the same thread.
+ *
+ *   struct json_writer w;
+ *   jw_start(&w, NULL);
+ *   jw_object_begin(&w);
+ *   jw_field_string(&w, "title", title);
+ *   jw_field_number(&w, "rating", rating);
+ *   jw_object_end(&w);
+ *   const char *body = jw_finish(&w);
+ */
+
+struct json_writer {
+    struct dbuf *out;
+    bool         need_comma;   /**< A value was written at this level */
+    bool         failed;       /**< An append ran out of memory */
+};
+
+/**
+ * Start a document.
+ *
+ * @param out  Buffer to write to (emptied first), or NULL for the
+ *             thread's reusable body buffer.
+ */
+void jw_start(struct json_writer *w, struct dbuf *out);
+
+void jw_object_begin(struct json_writer *w);
+void jw_object_end(struct json_writer *w);
+void jw_array_begin(struct json_writer *w);
+void jw_array_end(struct json_writer *w);
+
+/** Member name; the next value written is its value. */
+void jw_key(struct json_writer *w, const char *key);
+
+/** String value, escaped as JSON requires; NULL writes null. */
+void jw_string(struct json_writer *w, const char *s);
+
+/** Number as json_serialize_number() writes it (reads back exactly). */
+void jw_number(struct json_writer *w, double v);
+
+/** Integer value. */
+void jw_int(struct json_writer *w, long v);
+
+static inline void jw_field_string(struct json_writer *w, const char *key,
+                                   const char *s) {
+    jw_key(w, key);
+    jw_string(w, s);
+}
+
+static inline void jw_field_number(struct json_writer *w, const char *key,
+                                   double v) {
+    jw_key(w, key);
+    jw_number(w, v);
+}
+
+static inline void jw_field_int(struct json_writer *w, const char *key,
+                                long v) {
+    jw_key(w, key);
+    jw_int(w, v);
+}
+
+/**
+ * End the document.
+ *
+ * @return  The NUL-terminated JSON text (owned by the buffer), or NULL if
+ *          memory ran out while writing.
+ */
+const char *jw_finish(struct json_writer *w);
+
+#endif // JSONW_H
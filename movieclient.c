@@ -0,0 +1,809 @@
+// 324CC Stefan CALMAC
+#define _GNU_SOURCE
+#include "movieclient.h"
+#include "compress.h"
+#include "decode.h"
+#include "helper.h"
+#include "jsonw.h"
+#include "parson.h"
+#include "requests.h"
+#include "routes.h"
+#include "tcpopt.h"
+#include "timeout.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <time.h>
+
+#define MC_DEFAULT_CONNS 8
+#define MC_MAX_IDLE      16      /* keep-alive connections kept for reuse */
+#define MC_RECV_CHUNK    16384
+
+enum mc_state { ST_QUEUED, ST_CONNECTING, ST_SENDING, ST_RECEIVING };
+
+/* How a completed response is turned into a callback */
+enum mc_kind {
+    K_DONE, K_CREATE, K_LOGIN, K_ACCESS, K_LOGOUT,
+    K_MOVIES, K_MOVIE, K_COLLECTIONS, K_COLLECTION,
+};
+
+enum mc_auth { AUTH_NONE, AUTH_COOKIE, AUTH_TOKEN };
+
+struct mc_req {
+    struct mc_req    *prev, *next;   /* queue or active list */
+    enum mc_state     state;
+    enum mc_kind      kind;
+    int               fd;
+    bool              reused;        /* fd carried an earlier request */
+    bool              retried;       /* already replayed after a stale fd */
+    bool              idempotent;    /* GET, PUT or DELETE */
+    struct dbuf       out;           /* serialized request */
+    size_t            sent;
+    struct dbuf       in;            /* response received so far */
+    struct http_frame frame;
+    uint64_t          deadline;      /* CLOCK_MONOTONIC ns, 0 for none */
+    int               id;            /* resource asked for by a single read */
+    union {
+        mc_done_cb        done;
+        mc_movies_cb      movies;
+        mc_collections_cb collections;
+    } cb;
+    void             *user;
+};
+
+struct req_list {
+    struct mc_req *head, *tail;
+    int            count;
+};
+
+struct mc_ctx {
+    struct sockaddr_in addr;
+    char               host[64];
+    int                epfd;
+    struct req_list    queued;      /* not started yet, FIFO */
+    struct req_list    active;      /* holding a connection */
+    int                max_conns;
+    int                timeout_ms;
+    int                idle[MC_MAX_IDLE];
+    int                nidle;
+    char              *cookie;
+    char              *token;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void list_push(struct req_list *l, struct mc_req *r) {
+    r->next = NULL;
+    r->prev = l->tail;
+    if (l->tail)
+        l->tail->next = r;
+    else
+        l->head = r;
+    l->tail = r;
+    l->count++;
+}
+
+static void list_remove(struct req_list *l, struct mc_req *r) {
+    if (r->prev)
+        r->prev->next = r->next;
+    else
+        l->head = r->next;
+    if (r->next)
+        r->next->prev = r->prev;
+    else
+        l->tail = r->prev;
+    l->count--;
+}
+
+static void req_free(struct mc_req *r) {
+    free(r->out.data);
+    free(r->in.data);
+    free(r);
+}
+
+/* Append printf-formatted text to a dbuf */
+static int dbuf_printf(struct dbuf *b, const char *fmt, ...) {
+    char small[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(small, sizeof(small), fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return -1;
+    if ((size_t)n < sizeof(small))
+        return dbuf_append(b, small, (size_t)n);
+
+    char *big = malloc((size_t)n + 1);
+    if (!big)
+        return -1;
+    va_start(ap, fmt);
+    vsnprintf(big, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    int r = dbuf_append(b, big, (size_t)n);
+    free(big);
+    return r;
+}
+
+mc_ctx *mc_new(const char *host, int port) {
+    mc_ctx *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+        return NULL;
+
+    ctx->addr.sin_family = AF_INET;
+    ctx->addr.sin_port   = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &ctx->addr.sin_addr) != 1) {
+        free(ctx);
+        errno = EINVAL;
+        return NULL;
+    }
+    snprintf(ctx->host, sizeof(ctx->host), "%s", host);
+    ctx->max_conns  = MC_DEFAULT_CONNS;
+    ctx->timeout_ms = TIMEOUT_COMMAND_MS;
+    ctx->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (ctx->epfd < 0) {
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void mc_free(mc_ctx *ctx) {
+    if (!ctx)
+        return;
+    struct mc_req *r, *next;
+    for (r = ctx->active.head; r; r = next) {
+        next = r->next;
+        close(r->fd);
+        req_free(r);
+    }
+    for (r = ctx->queued.head; r; r = next) {
+        next = r->next;
+        req_free(r);
+    }
+    for (int i = 0; i < ctx->nidle; i++)
+        close(ctx->idle[i]);
+    close(ctx->epfd);
+    free(ctx->cookie);
+    free(ctx->token);
+    free(ctx);
+}
+
+void mc_set_timeout(mc_ctx *ctx, int ms) {
+    ctx->timeout_ms = ms > 0 ? ms : 0;
+}
+
+void mc_set_max_conns(mc_ctx *ctx, int n) {
+    ctx->max_conns = n > 0 ? n : 1;
+}
+
+int mc_fd(const mc_ctx *ctx) {
+    return ctx->epfd;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Completion                                    */
+/* -------------------------------------------------------------------------- */
+
+/* Copy the server's "error" member into msg */
+static const char *error_message(const char *body, char *msg, size_t size) {
+    if (!strstr(body, "\"error\""))
+        return NULL;
+    JSON_Value *v = json_parse_string(body);
+    const char *e = json_object_get_string(json_value_get_object(v), "error");
+    if (e)
+        snprintf(msg, size, "%s", e);
+    json_value_free(v);
+    return e ? msg : NULL;
+}
+
+/* Rating text as kept by the decoder (a JSON number) */
+static double rating_value(const char *text) {
+    if (!text)
+        return 0;
+    JSON_Value *v = json_parse_string(text);
+    double r = json_value_get_number(v);
+    json_value_free(v);
+    return r;
+}
+
+static void to_mc_movie(const movie_t *m, mc_movie *out) {
+    out->id          = m->id;
+    out->title       = m->title;
+    out->year        = m->year;
+    out->description = m->description;
+    out->rating      = rating_value(m->rating);
+}
+
+static void deliver_movies(mc_ctx *ctx, struct mc_req *r, mc_result *res,
+                           const char *body) {
+    struct decoded d = { 0 };
+    mc_movie *movies = NULL;
+    size_t count = 0;
+
+    if (MC_OK(res)) {
+        int ok = r->kind == K_MOVIES ? decode_movies(body, &d)
+                                     : decode_movie(body, &d);
+        movies = ok == 0 ? calloc(d.count ? d.count : 1, sizeof(*movies))
+                         : NULL;
+        if (movies) {
+            const movie_t *m = d.items;
+            for (size_t i = 0; i < d.count; i++)
+                to_mc_movie(&m[i], &movies[i]);
+            if (d.count == 1 && !movies[0].id)
+                movies[0].id = r->id;
+            count = d.count;
+        } else {
+            res->error = ok == 0 ? ENOMEM : EPROTO;
+        }
+    }
+    if (r->cb.movies)
+        r->cb.movies(ctx, res, movies, count, r->user);
+    free(movies);
+    decode_free(&d);
+}
+
+static void deliver_collections(mc_ctx *ctx, struct mc_req *r,
+                                mc_result *res, const char *body) {
+    struct decoded d = { 0 };
+    mc_collection *colls = NULL;
+    mc_movie *members = NULL;
+    size_t count = 0;
+
+    if (MC_OK(res)) {
+        int ok = r->kind == K_COLLECTIONS ? decode_collections(body, &d)
+                                          : decode_collection(body, &d);
+        const collection_t *c = d.items;
+        size_t nmembers = 0;
+        for (size_t i = 0; ok == 0 && i < d.count; i++)
+            nmembers += c[i].movies.count;
+        if (ok == 0) {
+            colls   = calloc(d.count ? d.count : 1, sizeof(*colls));
+            members = calloc(nmembers ? nmembers : 1, sizeof(*members));
+        }
+        if (colls && members) {
+            mc_movie *m = members;
+            for (size_t i = 0; i < d.count; i++) {
+                colls[i].id          = c[i].id;
+                colls[i].title       = c[i].title;
+                colls[i].owner       = c[i].owner;
+                colls[i].movies      = m;
+                colls[i].movie_count = c[i].movies.count;
+                for (size_t j = 0; j < c[i].movies.count; j++)
+                    to_mc_movie(&c[i].movies.items[j], m++);
+            }
+            if (d.count == 1 && !colls[0].id)
+                colls[0].id = r->id;
+            count = d.count;
+        } else {
+            res->error = ok == 0 ? ENOMEM : EPROTO;
+        }
+    }
+    if (r->cb.collections)
+        r->cb.collections(ctx, res, colls, count, r->user);
+    free(members);
+    free(colls);
+    decode_free(&d);
+}
+
+/**
+ * Hand a finished call to its callback. resp is the whole response
+ * (headers and plain body), or NULL when res->error says why there is none.
+ */
+static void deliver(mc_ctx *ctx, struct mc_req *r, char *resp,
+                    mc_result *res) {
+    char msg[256];
+    const char *body = "";
+
+    if (resp) {
+        res->status = strncmp(resp, "HTTP/", 5) == 0 ? atoi(resp + 9) : 0;
+        body = resp + r->frame.hdr_len;
+        if (!MC_OK(res))
+            res->message = error_message(body, msg, sizeof(msg));
+    }
+
+    if (MC_OK(res)) {
+        switch (r->kind) {
+        case K_LOGIN:
+            free(ctx->cookie);
+            ctx->cookie = extract_cookie(resp);
+            break;
+        case K_ACCESS: {
+            JSON_Value *v = json_parse_string(body);
+            const char *t = json_object_get_string(json_value_get_object(v),
+                                                   "token");
+            free(ctx->token);
+            ctx->token = t ? strdup(t) : NULL;
+            json_value_free(v);
+            break;
+        }
+        case K_LOGOUT:
+            free(ctx->cookie);
+            free(ctx->token);
+            ctx->cookie = ctx->token = NULL;
+            break;
+        case K_CREATE: {
+            int id = extract_id(body);
+            res->id = id > 0 ? id : 0;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    switch (r->kind) {
+    case K_MOVIES:
+    case K_MOVIE:
+        deliver_movies(ctx, r, res, body);
+        break;
+    case K_COLLECTIONS:
+    case K_COLLECTION:
+        deliver_collections(ctx, r, res, body);
+        break;
+    default:
+        if (r->cb.done)
+            r->cb.done(ctx, res, r->user);
+        break;
+    }
+}
+
+/* Give up the connection of an active call: park it or close it */
+static void release_conn(mc_ctx *ctx, struct mc_req *r, bool keep) {
+    epoll_ctl(ctx->epfd, EPOLL_CTL_DEL, r->fd, NULL);
+    if (keep && ctx->nidle < MC_MAX_IDLE)
+        ctx->idle[ctx->nidle++] = r->fd;
+    else
+        close(r->fd);
+    r->fd = -1;
+    list_remove(&ctx->active, r);
+}
+
+static void fail(mc_ctx *ctx, struct mc_req *r, int err) {
+    if (r->state == ST_QUEUED)
+        list_remove(&ctx->queued, r);
+    else
+        release_conn(ctx, r, false);
+
+    mc_result res = { .error = err };
+    deliver(ctx, r, NULL, &res);
+    req_free(r);
+}
+
+static void complete(mc_ctx *ctx, struct mc_req *r) {
+    http_frame_finish(r->in.data, &r->frame);
+    release_conn(ctx, r, r->frame.keep_alive);
+
+    mc_result res = { 0 };
+    deliver(ctx, r, r->in.data, &res);
+    req_free(r);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  I/O                                       */
+/* -------------------------------------------------------------------------- */
+
+static int watch(mc_ctx *ctx, struct mc_req *r, int op, uint32_t events) {
+    struct epoll_event ev = { .events = events, .data.ptr = r };
+    return epoll_ctl(ctx->epfd, op, r->fd, &ev);
+}
+
+/**
+ * Give a queued call a connection: an idle keep-alive one if there is
+ * one (unless the call is being replayed), a new non-blocking one otherwise.
+ */
+static void start(mc_ctx *ctx, struct mc_req *r) {
+    list_remove(&ctx->queued, r);
+    list_push(&ctx->active, r);
+
+    if (ctx->nidle > 0 && !r->retried) {
+        r->fd = ctx->idle[--ctx->nidle];
+        r->reused = true;
+        r->state = ST_SENDING;
+    } else {
+        r->reused = false;
+        r->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (r->fd < 0) {
+            list_remove(&ctx->active, r);
+            list_push(&ctx->queued, r);
+            fail(ctx, r, errno);
+            return;
+        }
+        tcp_configure(r->fd);
+        if (connect(r->fd, (struct sockaddr *)&ctx->addr,
+                    sizeof(ctx->addr)) == 0)
+            r->state = ST_SENDING;
+        else if (errno == EINPROGRESS)
+            r->state = ST_CONNECTING;
+        else {
+            int err = errno;
+            close(r->fd);
+            r->fd = -1;
+            list_remove(&ctx->active, r);
+            list_push(&ctx->queued, r);
+            fail(ctx, r, err);
+            return;
+        }
+    }
+
+    if (watch(ctx, r, EPOLL_CTL_ADD, EPOLLOUT) < 0)
+        fail(ctx, r, errno);
+}
+
+static void start_queued(mc_ctx *ctx) {
+    while (ctx->queued.head && ctx->active.count < ctx->max_conns)
+        start(ctx, ctx->queued.head);
+}
+
+/**
+ * A socket error. A reused connection that fails before any byte of the
+ * answer arrived was most likely closed by the server while idle: the call
+ * is replayed once on a new connection. A POST is replayed only if none of
+ * it was sent, since the server may already have acted on it.
+ */
+static void io_error(mc_ctx *ctx, struct mc_req *r, int err) {
+    if (!r->reused || r->retried || r->in.len > 0 ||
+        (!r->idempotent && r->sent > 0)) {
+        fail(ctx, r, err);
+        return;
+    }
+    release_conn(ctx, r, false);
+    r->retried = true;
+    r->sent = 0;
+    r->state = ST_QUEUED;
+    memset(&r->frame, 0, sizeof(r->frame));
+    /* Replay ahead of the calls queued after it */
+    r->prev = NULL;
+    r->next = ctx->queued.head;
+    if (ctx->queued.head)
+        ctx->queued.head->prev = r;
+    else
+        ctx->queued.tail = r;
+    ctx->queued.head = r;
+    ctx->queued.count++;
+}
+
+static void advance(mc_ctx *ctx, struct mc_req *r) {
+    if (r->state == ST_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(r->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+            fail(ctx, r, err);
+            return;
+        }
+        r->state = ST_SENDING;
+    }
+
+    if (r->state == ST_SENDING) {
+        while (r->sent < r->out.len) {
+            ssize_t n = send(r->fd, r->out.data + r->sent,
+                             r->out.len - r->sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN)
+                    io_error(ctx, r, errno);
+                return;
+            }
+            r->sent += (size_t)n;
+        }
+        r->state = ST_RECEIVING;
+        if (watch(ctx, r, EPOLL_CTL_MOD, EPOLLIN) < 0)
+            fail(ctx, r, errno);
+        return;
+    }
+
+    for (;;) {
+        if (r->in.cap - r->in.len < MC_RECV_CHUNK + 1) {
+            size_t cap = r->in.cap ? r->in.cap * 2 : 2 * MC_RECV_CHUNK;
+            char *tmp = realloc(r->in.data, cap);
+            if (!tmp) {
+                fail(ctx, r, ENOMEM);
+                return;
+            }
+            r->in.data = tmp;
+            r->in.cap = cap;
+        }
+
+        ssize_t n = recv(r->fd, r->in.data + r->in.len,
+                         r->in.cap - r->in.len - 1, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                io_error(ctx, r, errno);
+            return;
+        }
+        if (n == 0 && r->in.len == 0) {
+            io_error(ctx, r, ECONNRESET);
+            return;
+        }
+        r->in.len += (size_t)n;
+        r->in.data[r->in.len] = '\0';
+
+        int done = http_frame_scan(r->in.data, r->in.len, &r->frame, n == 0);
+        if (done < 0) {
+            fail(ctx, r, EPROTO);
+            return;
+        }
+        if (done) {
+            complete(ctx, r);
+            return;
+        }
+    }
+}
+
+static void expire(mc_ctx *ctx, struct req_list *l, uint64_t now) {
+    struct mc_req *r = l->head;
+    while (r) {
+        struct mc_req *next = r->next;
+        if (r->deadline && now >= r->deadline)
+            fail(ctx, r, ETIMEDOUT);
+        r = next;
+    }
+}
+
+int mc_process(mc_ctx *ctx) {
+    start_queued(ctx);
+
+    struct epoll_event ev[64];
+    int n = epoll_wait(ctx->epfd, ev, 64, 0);
+    for (int i = 0; i < n; i++)
+        advance(ctx, ev[i].data.ptr);
+
+    uint64_t now = now_ns();
+    expire(ctx, &ctx->active, now);
+    expire(ctx, &ctx->queued, now);
+
+    start_queued(ctx);
+    return ctx->active.count + ctx->queued.count;
+}
+
+int mc_timeout(const mc_ctx *ctx) {
+    if (ctx->queued.head && ctx->active.count < ctx->max_conns)
+        return 0;
+
+    uint64_t first = 0;
+    const struct req_list *lists[] = { &ctx->active, &ctx->queued };
+    for (int k = 0; k < 2; k++)
+        for (const struct mc_req *r = lists[k]->head; r; r = r->next)
+            if (r->deadline && (!first || r->deadline < first))
+                first = r->deadline;
+    if (!first)
+        return -1;
+
+    uint64_t now = now_ns();
+    return now >= first ? 0 : (int)((first - now + 999999) / 1000000);
+}
+
+int mc_run(mc_ctx *ctx) {
+    while (mc_process(ctx) > 0) {
+        struct pollfd pfd = { .fd = ctx->epfd, .events = POLLIN };
+        if (poll(&pfd, 1, mc_timeout(ctx)) < 0 && errno != EINTR)
+            return -1;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Calls                                      */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Serialize a request and queue it.
+ *
+ * @param body  JSON body, or NULL for none.
+ */
+static struct mc_req *queue(mc_ctx *ctx, enum mc_kind kind,
+                            const char *method, const char *path,
+                            const char *body, enum mc_auth auth,
+                            void *user) {
+    struct mc_req *r = calloc(1, sizeof(*r));
+    if (!r)
+        return NULL;
+    r->kind = kind;
+    r->fd = -1;
+    r->user = user;
+    r->idempotent = !strcmp(method, "GET") || !strcmp(method, "PUT") ||
+                    !strcmp(method, "DELETE");
+    if (ctx->timeout_ms)
+        r->deadline = now_ns() + (uint64_t)ctx->timeout_ms * 1000000ull;
+
+    const char *cred = auth == AUTH_COOKIE ? ctx->cookie
+                     : auth == AUTH_TOKEN  ? ctx->token : NULL;
+    int bad = dbuf_printf(&r->out, "%s %s HTTP/1.1\r\nHost: %s\r\n",
+                          method, path, ctx->host);
+    if (cred)
+        bad |= dbuf_printf(&r->out, auth == AUTH_COOKIE
+                               ? "Cookie: %s\r\n"
+                               : "Authorization: Bearer %s\r\n", cred);
+    if (body)
+        bad |= dbuf_printf(&r->out, "Content-Type: %s\r\n"
+                                    "Content-Length: %zu\r\n",
+                           PAYLOAD_APP_JSON, strlen(body));
+    bad |= dbuf_printf(&r->out, "Connection: keep-alive\r\n\r\n");
+    if (body)
+        bad |= dbuf_append(&r->out, body, strlen(body));
+    if (bad) {
+        req_free(r);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    list_push(&ctx->queued, r);
+    return r;
+}
+
+static int call_done(mc_ctx *ctx, enum mc_kind kind, const char *method,
+                     const char *path, const char *body, enum mc_auth auth,
+                     mc_done_cb cb, void *user) {
+    struct mc_req *r = queue(ctx, kind, method, path, body, auth, user);
+    if (!r)
+        return -1;
+    r->cb.done = cb;
+    return 0;
+}
+
+/* Body of the add/update movie calls */
+static const char *movie_body(struct dbuf *buf, const mc_movie *m) {
+    struct json_writer w;
+    jw_start(&w, buf);
+    jw_object_begin(&w);
+    jw_field_string(&w, "title", m->title ? m->title : "");
+    jw_field_int(&w, "year", m->year);
+    jw_field_string(&w, "description", m->description ? m->description : "");
+    jw_field_number(&w, "rating", m->rating);
+    jw_object_end(&w);
+    return jw_finish(&w);
+}
+
+int mc_login(mc_ctx *ctx, const char *admin_username, const char *username,
+             const char *password, mc_done_cb cb, void *user) {
+    struct dbuf buf = { 0 };
+    struct json_writer w;
+    jw_start(&w, &buf);
+    jw_object_begin(&w);
+    jw_field_string(&w, "admin_username", admin_username);
+    jw_field_string(&w, "username", username);
+    jw_field_string(&w, "password", password);
+    jw_object_end(&w);
+    const char *body = jw_finish(&w);
+
+    int r = body ? call_done(ctx, K_LOGIN, "POST", ROUTE_USER_LOGIN, body,
+                             AUTH_NONE, cb, user)
+                 : (errno = ENOMEM, -1);
+    free(buf.data);
+    return r;
+}
+
+int mc_logout(mc_ctx *ctx, mc_done_cb cb, void *user) {
+    return call_done(ctx, K_LOGOUT, "GET", ROUTE_USER_LOGOUT, NULL,
+                     AUTH_COOKIE, cb, user);
+}
+
+int mc_get_access(mc_ctx *ctx, mc_done_cb cb, void *user) {
+    return call_done(ctx, K_ACCESS, "GET", ROUTE_GET_ACCESS, NULL,
+                     AUTH_COOKIE, cb, user);
+}
+
+int mc_get_movies(mc_ctx *ctx, mc_movies_cb cb, void *user) {
+    struct mc_req *r = queue(ctx, K_MOVIES, "GET", ROUTE_MANAGE_MOVIE, NULL,
+                             AUTH_TOKEN, user);
+    if (!r)
+        return -1;
+    r->cb.movies = cb;
+    return 0;
+}
+
+int mc_get_movie(mc_ctx *ctx, int id, mc_movies_cb cb, void *user) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%d", ROUTE_MANAGE_MOVIE, id);
+    struct mc_req *r = queue(ctx, K_MOVIE, "GET", path, NULL, AUTH_TOKEN,
+                             user);
+    if (!r)
+        return -1;
+    r->id = id;
+    r->cb.movies = cb;
+    return 0;
+}
+
+int mc_add_movie(mc_ctx *ctx, const mc_movie *movie, mc_done_cb cb,
+                 void *user) {
+    struct dbuf buf = { 0 };
+    const char *body = movie_body(&buf, movie);
+    int r = body ? call_done(ctx, K_CREATE, "POST", ROUTE_MANAGE_MOVIE, body,
+                             AUTH_TOKEN, cb, user)
+                 : (errno = ENOMEM, -1);
+    free(buf.data);
+    return r;
+}
+
+int mc_update_movie(mc_ctx *ctx, const mc_movie *movie, mc_done_cb cb,
+                    void *user) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%d", ROUTE_MANAGE_MOVIE, movie->id);
+    struct dbuf buf = { 0 };
+    const char *body = movie_body(&buf, movie);
+    int r = body ? call_done(ctx, K_DONE, "PUT", path, body, AUTH_TOKEN,
+                             cb, user)
+                 : (errno = ENOMEM, -1);
+    free(buf.data);
+    return r;
+}
+
+int mc_delete_movie(mc_ctx *ctx, int id, mc_done_cb cb, void *user) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%d", ROUTE_MANAGE_MOVIE, id);
+    return call_done(ctx, K_DONE, "DELETE", path, NULL, AUTH_TOKEN, cb, user);
+}
+
+int mc_get_collections(mc_ctx *ctx, mc_collections_cb cb, void *user) {
+    struct mc_req *r = queue(ctx, K_COLLECTIONS, "GET",
+                             ROUTE_MANAGE_COLLECTIONS, NULL, AUTH_TOKEN, user);
+    if (!r)
+        return -1;
+    r->cb.collections = cb;
+    return 0;
+}
+
+int mc_get_collection(mc_ctx *ctx, int id, mc_collections_cb cb, void *user) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%d", ROUTE_MANAGE_COLLECTIONS, id);
+    struct mc_req *r = queue(ctx, K_COLLECTION, "GET", path, NULL,
+                             AUTH_TOKEN, user);
+    if (!r)
+        return -1;
+    r->id = id;
+    r->cb.collections = cb;
+    return 0;
+}
+
+int mc_add_collection(mc_ctx *ctx, const char *title, mc_done_cb cb,
+                      void *user) {
+    struct dbuf buf = { 0 };
+    struct json_writer w;
+    jw_start(&w, &buf);
+    jw_object_begin(&w);
+    jw_field_string(&w, "title", title);
+    jw_object_end(&w);
+    const char *body = jw_finish(&w);
+
+    int r = body ? call_done(ctx, K_CREATE, "POST", ROUTE_MANAGE_COLLECTIONS,
+                             body, AUTH_TOKEN, cb, user)
+                 : (errno = ENOMEM, -1);
+    free(buf.data);
+    return r;
+}
+
+int mc_delete_collection(mc_ctx *ctx, int id, mc_done_cb cb, void *user) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%d", ROUTE_MANAGE_COLLECTIONS, id);
+    return call_done(ctx, K_DONE, "DELETE", path, NULL, AUTH_TOKEN, cb, user);
+}
+
+int mc_add_movie_to_collection(mc_ctx *ctx, int collection_id, int movie_id,
+                               mc_done_cb cb, void *user) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%d/movies", ROUTE_MANAGE_COLLECTIONS,
+             collection_id);
+    struct dbuf buf = { 0 };
+    struct json_writer w;
+    jw_start(&w, &buf);
+    jw_object_begin(&w);
+    jw_field_int(&w, "id", movie_id);
+    jw_object_end(&w);
+    const char *body = jw_finish(&w);
+
+    int r = body ? call_done(ctx, K_DONE, "POST", path, body, AUTH_TOKEN,
+                             cb, user)
+                 : (errno = ENOMEM, -1);
+    free(buf.data);
+    return r;
+}
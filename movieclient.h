@@ -0,0 +1,135 @@
+#ifndef MOVIECLIENT_H
+#define MOVIECLIENT_H
+// 324CC Stefan CALMAC
+
+#include <stddef.h>
+
+/**
+ * @file movieclient.h
+ * @brief Asynchronous C API to the movie library (libmovieclient).
+ *
+ * The library talks to the server without prompting or printing: each
+ * mc_*() call queues a request and returns at once, and its callback gets
+ * the outcome and, for reads, typed records. Nothing blocks; the caller
+ * drives the I/O from its own event loop:
+ *
+ *   int fd = mc_fd(ctx);             // poll for POLLIN (an epoll fd)
+ *   int ms = mc_timeout(ctx);        // longest wait, -1 for none
+ *   ... poll(fd, ms) ...
+ *   mc_process(ctx);                 // does the I/O, runs the callbacks
+ *
+ * or simply calls mc_run() to block until every call has completed.
+ *
+ * Requests run in parallel on up to mc_set_max_conns() non-blocking
+ * keep-alive connections; more are queued. The session cookie from
+ * mc_login() and the token from mc_get_access() are kept by the context
+ * and sent with the calls that need them, so a callback may start the
+ * next step of a flow (login, then access, then reads).
+ *
+ * Strings and arrays handed to a callback are only valid during it. A
+ * context is not thread-safe; use one per thread.
+ */
+
+typedef struct mc_ctx mc_ctx;
+
+/** Outcome of a call, passed to every callback. */
+typedef struct mc_result {
+    int         status;   /**< HTTP status, or 0 if no response arrived */
+    int         error;    /**< errno for transport failures, else 0 */
+    const char *message;  /**< Server's "error" text, or NULL */
+    int         id;       /**< Id of the resource a create call made, else 0 */
+} mc_result;
+
+/** Whether a call succeeded (2xx). */
+#define MC_OK(res) ((res)->status / 100 == 2)
+
+typedef struct mc_movie {
+    int         id;
+    const char *title;
+    int         year;         /**< 0 if absent (listings) */
+    const char *description;  /**< NULL if absent (listings) */
+    double      rating;       /**< 0 if absent (listings) */
+} mc_movie;
+
+typedef struct mc_collection {
+    int             id;
+    const char     *title;
+    const char     *owner;         /**< NULL in listings */
+    const mc_movie *movies;        /**< id and title of each member */
+    size_t          movie_count;
+} mc_collection;
+
+typedef void (*mc_done_cb)(mc_ctx *ctx, const mc_result *res, void *user);
+typedef void (*mc_movies_cb)(mc_ctx *ctx, const mc_result *res,
+                             const mc_movie *movies, size_t count,
+                             void *user);
+typedef void (*mc_collections_cb)(mc_ctx *ctx, const mc_result *res,
+                                  const mc_collection *collections,
+                                  size_t count, void *user);
+
+/**
+ * Create a context for the server at host (IPv4 address) and port.
+ *
+ * @return  The context, or NULL with errno set.
+ */
+mc_ctx *mc_new(const char *host, int port);
+
+/**
+ * Close every connection and free the context. Calls still pending are
+ * dropped without their callbacks. Not to be called from a callback.
+ */
+void mc_free(mc_ctx *ctx);
+
+/** Per-call timeout in ms, from queueing to completion (0 = none). */
+void mc_set_timeout(mc_ctx *ctx, int ms);
+
+/** Maximum number of parallel connections (default 8). */
+void mc_set_max_conns(mc_ctx *ctx, int n);
+
+/* Event loop ---------------------------------------------------------------*/
+
+/** Descriptor that becomes readable when mc_process() has I/O to do. */
+int mc_fd(const mc_ctx *ctx);
+
+/** Milliseconds until mc_process() must run for a timeout, -1 for none. */
+int mc_timeout(const mc_ctx *ctx);
+
+/**
+ * Do whatever I/O is possible without blocking, expire timed-out calls and
+ * run the callbacks of completed ones.
+ *
+ * @return  Number of calls still pending.
+ */
+int mc_process(mc_ctx *ctx);
+
+/**
+ * Process until no call is pending (including calls started by callbacks).
+ *
+ * @return  0, or -1 with errno set if waiting failed.
+ */
+int mc_run(mc_ctx *ctx);
+
+/* Calls: each returns 0 once queued, -1 with errno set otherwise ---------*/
+
+int mc_login(mc_ctx *ctx, const char *admin_username, const char *username,
+             const char *password, mc_done_cb cb, void *user);
+int mc_logout(mc_ctx *ctx, mc_done_cb cb, void *user);
+int mc_get_access(mc_ctx *ctx, mc_done_cb cb, void *user);
+
+int mc_get_movies(mc_ctx *ctx, mc_movies_cb cb, void *user);
+int mc_get_movie(mc_ctx *ctx, int id, mc_movies_cb cb, void *user);
+int mc_add_movie(mc_ctx *ctx, const mc_movie *movie, mc_done_cb cb,
+                 void *user);
+int mc_update_movie(mc_ctx *ctx, const mc_movie *movie, mc_done_cb cb,
+                    void *user);
+int mc_delete_movie(mc_ctx *ctx, int id, mc_done_cb cb, void *user);
+
+int mc_get_collections(mc_ctx *ctx, mc_collections_cb cb, void *user);
+int mc_get_collection(mc_ctx *ctx, int id, mc_collections_cb cb, void *user);
+int mc_add_collection(mc_ctx *ctx, const char *title, mc_done_cb cb,
+                      void *user);
+int mc_delete_collection(mc_ctx *ctx, int id, mc_done_cb cb, void *user);
+int mc_add_movie_to_collection(mc_ctx *ctx, int collection_id, int movie_id,
+                               mc_done_cb cb, void *user);
+
+#endif // MOVIECLIENT_H
@@ -0,0 +1,249 @@
+// 324CC Stefan CALMAC
+#define _GNU_SOURCE
+#include "output.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+int output_format = OUT_TEXT;
+
+static char out_buf[OUT_BUF_SZ];
+static FILE *out_data;   /* stdout, or the saved descriptor 1 for data formats */
+static __thread FILE *out_local;   /* set by out_capture() */
+
+/* Stream the out_*() helpers of the calling thread write to */
+static inline FILE *out_file(void) {
+    return out_local ? out_local : out_data;
+}
+
+/* "00" "01" ... "99": two digits per division */
+static const char digit_pairs[201] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+int out_init(void) {
+    out_data = stdout;
+    if (output_format == OUT_TEXT) {
+        setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+        return 0;
+    }
+
+    int fd = dup(STDOUT_FILENO);
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "w");
+    if (!f) {
+        perror("output");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    setvbuf(f, out_buf, _IOFBF, sizeof(out_buf));
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        perror("output");
+        fclose(f);
+        return -1;
+    }
+    out_data = f;
+    return 0;
+}
+
+void out_flush(void) {
+    fflush(stdout);
+    if (out_data && out_data != stdout)
+        fflush(out_data);
+}
+
+void out_capture(FILE *f) {
+    out_local = f;
+}
+
+void out_mem(const char *s, size_t len) {
+    fwrite_unlocked(s, 1, len, out_file());
+}
+
+void out_str(const char *s) {
+    fputs_unlocked(s, out_file());
+}
+
+void out_char(char c) {
+    putc_unlocked(c, out_file());
+}
+
+char *out_itoa(long v, char *end) {
+    /* Work on the magnitude as unsigned so LONG_MIN does not overflow */
+    unsigned long u = v < 0 ? 0UL - (unsigned long)v : (unsigned long)v;
+    char *p = end;
+
+    while (u >= 100) {
+        unsigned d = (unsigned)(u % 100) * 2;
+        u /= 100;
+        *--p = digit_pairs[d + 1];
+        *--p = digit_pairs[d];
+    }
+    if (u >= 10) {
+        *--p = digit_pairs[u * 2 + 1];
+        *--p = digit_pairs[u * 2];
+    } else {
+        *--p = (char)('0' + u);
+    }
+    if (v < 0)
+        *--p = '-';
+    return p;
+}
+
+void out_long(long v) {
+    char buf[24];
+    char *p = out_itoa(v, buf + sizeof(buf));
+    out_mem(p, (size_t)(buf + sizeof(buf) - p));
+}
+
+void out_tsv(const char *s) {
+    if (!s)
+        return;
+    for (;;) {
+        size_t run = strcspn(s, "\\\t\n\r");
+        out_mem(s, run);
+        s += run;
+        if (*s == '\0')
+            return;
+        out_char('\\');
+        out_char(*s == '\t' ? 't' : *s == '\n' ? 'n' : *s == '\r' ? 'r' : '\\');
+        s++;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                         JSON pass-through scanning                         */
+/* -------------------------------------------------------------------------- */
+
+static int is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static const char *skip_ws(const char *p) {
+    while (is_ws(*p))
+        p++;
+    return p;
+}
+
+/**
+ * End of the JSON value starting at p: strings and nested containers are
+ * matched (escapes included), scalars run to the next delimiter. The value
+ * itself is not validated; the server's JSON is trusted to be well formed.
+ *
+ * @return  One past the value, or NULL if the text ends inside it.
+ */
+static const char *value_end(const char *p) {
+    if (*p == '"') {
+        for (p++; *p && *p != '"'; p++)
+            if (*p == '\\' && p[1])
+                p++;
+        return *p ? p + 1 : NULL;
+    }
+
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (*p) {
+            if (*p == '"') {
+                p = value_end(p);
+                if (!p)
+                    return NULL;
+                continue;
+            }
+            if (*p == '{' || *p == '[') {
+                depth++;
+            } else if (*p == '}' || *p == ']') {
+                if (--depth == 0)
+                    return p + 1;
+            }
+            p++;
+        }
+        return NULL;
+    }
+
+    const char *start = p;
+    while (*p && *p != ',' && *p != '}' && *p != ']' && !is_ws(*p))
+        p++;
+    return p > start ? p : NULL;
+}
+
+/* Copy [p, end) dropping whitespace outside strings, then a newline */
+static void out_compact(const char *p, const char *end) {
+    const char *run = p;
+    while (p < end) {
+        if (*p == '"') {
+            p = value_end(p);
+        } else if (is_ws(*p)) {
+            out_mem(run, (size_t)(p - run));
+            run = ++p;
+        } else {
+            p++;
+        }
+    }
+    out_mem(run, (size_t)(end - run));
+    out_char('\n');
+}
+
+int out_json_line(const char *json) {
+    const char *p = skip_ws(json);
+    const char *end = value_end(p);
+    if (!end)
+        return -1;
+    out_compact(p, end);
+    return 0;
+}
+
+long out_json_elements(const char *json, const char *key) {
+    size_t klen = strlen(key);
+    const char *p = skip_ws(json);
+    if (*p != '{')
+        return -1;
+    p = skip_ws(p + 1);
+
+    while (*p == '"') {
+        const char *kend = value_end(p);
+        if (!kend)
+            return -1;
+        int match = (size_t)(kend - p) == klen + 2 &&
+                    memcmp(p + 1, key, klen) == 0;
+
+        p = skip_ws(kend);
+        if (*p != ':')
+            return -1;
+        p = skip_ws(p + 1);
+
+        if (match) {
+            if (*p != '[')
+                return -1;
+            long n = 0;
+            p = skip_ws(p + 1);
+            if (*p == ']')
+                return 0;
+            for (;;) {
+                const char *e = value_end(p);
+                if (!e)
+                    return -1;
+                out_compact(p, e);
+                n++;
+                p = skip_ws(e);
+                if (*p == ']')
+                    return n;
+                if (*p != ',')
+                    return -1;
+                p = skip_ws(p + 1);
+            }
+        }
+
+        const char *vend = value_end(p);
+        if (!vend)
+            return -1;
+        p = skip_ws(vend);
+        if (*p != ',')
+            return -1;
+        p = skip_ws(p + 1);
+    }
+    return -1;
+}
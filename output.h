@@ -0,0 +1,101 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+// 324CC Stefan CALMAC
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @file output.h
+ * @brief Block-buffered standard output and the listing formats.
+ *
+ * stdout is given a large, fully buffered stdio buffer, so printf() and the
+ * out_*() helpers below share one buffer and keep their relative order.
+ * The buffer is written out when it fills up, before reading input (so a
+ * prompt is visible while the client waits, see helper_readline()) and at
+ * the end of every command. The helpers append directly to the buffer and
+ * format integers without printf.
+ *
+ * With --output=jsonl or --output=tsv, listings and details (the data) are
+ * the only thing written to stdout; prompts and SUCCESS/ERROR lines go to
+ * stderr. out_init() does this by keeping the original stdout descriptor
+ * for the out_*() helpers and pointing descriptor 1 (printf) at stderr.
+ */
+
+#define OUT_BUF_SZ (256 * 1024)   /**< Flush threshold, in bytes */
+
+#define OUT_TEXT  0   /**< Human-readable lines (the default) */
+#define OUT_JSONL 1   /**< One JSON value per line */
+#define OUT_TSV   2   /**< Header row, then tab-separated rows */
+
+/** Format selected with --output=text|jsonl|tsv. */
+extern int output_format;
+
+/**
+ * Install the output buffer and, for the data formats, split data from
+ * the rest of the output. Call once, before any output.
+ *
+ * @return  0 on success, -1 if the descriptors could not be set up.
+ */
+int out_init(void);
+
+/**
+ * Write everything buffered so far.
+ */
+void out_flush(void);
+
+/**
+ * Send the out_*() output of the calling thread to f instead (e.g. an
+ * open_memstream() buffer filled on a worker and written out later in
+ * order); NULL restores the normal output. printf() is not affected.
+ */
+void out_capture(FILE *f);
+
+/** Append len bytes. */
+void out_mem(const char *s, size_t len);
+
+/** Append a NUL-terminated string. */
+void out_str(const char *s);
+
+/** Append one character. */
+void out_char(char c);
+
+/** Append a signed integer in decimal. */
+void out_long(long v);
+
+/**
+ * Format v in decimal right-aligned against end (not NUL-terminated).
+ *
+ * @param v    Value to format.
+ * @param end  One past the last byte of a buffer of at least 20 bytes.
+ * @return     First digit (or the '-' sign).
+ */
+char *out_itoa(long v, char *end);
+
+/**
+ * Append a TSV field: backslash, tab, newline and carriage return are
+ * written as \\, \t, \n and \r; NULL is an empty field.
+ */
+void out_tsv(const char *s);
+
+/**
+ * Write a JSON value on one line, as is apart from the whitespace between
+ * tokens, without building a DOM.
+ *
+ * @param json  JSON text.
+ * @return      0 on success, -1 if the text is not a complete value.
+ */
+int out_json_line(const char *json);
+
+/**
+ * Write each element of the array stored under key in a JSON object on
+ * its own line (JSON Lines), copied from the input without building a DOM.
+ *
+ * @param json  JSON text of an object.
+ * @param key   Top-level member holding the array (no escapes).
+ * @return      Number of elements written, or -1 if the member is missing,
+ *              not an array or the text is malformed.
+ */
+long out_json_elements(const char *json, const char *key);
+
+#endif // OUTPUT_H
@@ -47,6 +47,8 @@
 #include <ctype.h>
 #include <math.h>
 #include <errno.h>
+#include <locale.h>
+#include <stdint.h>
 
 /* Apparently sscanf is not implemented in some "standard" libraries, so don't use it, if you
  * don't have to. */
@@ -64,9 +66,9 @@
 #define STARTING_CAPACITY 16
 #define MAX_NESTING       2048
 
-#ifndef PARSON_DEFAULT_FLOAT_FORMAT
-#define PARSON_DEFAULT_FLOAT_FORMAT "%1.17g" /* do not increase precision without incresing NUM_BUF_SIZE */
-#endif
+/* Numbers are written in a short form that reads back exactly (see
+   serialize_number) unless PARSON_DEFAULT_FLOAT_FORMAT or
+   json_set_float_serialization_format() selects a printf format. */
 
 #ifndef PARSON_NUM_BUF_SIZE
 #define PARSON_NUM_BUF_SIZE 64 /* double printed with "%1.17g" shouldn't be longer than 25 bytes so let's be paranoid and use 64 */
@@ -1096,15 +1098,411 @@ static JSON_Value * parse_boolean_value(const char **string) {
     return NULL;
 }
 
-static JSON_Value * parse_number_value(const char **string) {
-    char *end;
+/* Number formatting and parsing
+ *
+ * Doubles are written with a digit string that reads back as the same value
+ * (Grisu2, F. Loitsch, "Printing Floating-Point Numbers Quickly and
+ * Accurately with Integers", 2010), so 6.5 is written as 6.5 rather than
+ * 6.5000000000000000. Grisu2 always round-trips but is not always shortest:
+ * in rare cases it gives one digit more (1e23 becomes 9.999999999999999e+22).
+ * Integral values below 2^53 (ids, years) skip Grisu.
+ * Parsing has an integer path and Clinger's exact path (mantissa <= 2^53,
+ * |exponent| <= 22); other numbers go through strtod() under the "C"
+ * locale. Neither direction depends on the current locale. */
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_HIDDEN_BIT       0x0010000000000000ULL
+#define DP_EXPONENT_BIAS    1075      /* 0x3FF + 52 */
+#define EXACT_INT_LIMIT     9007199254740992.0  /* 2^53 */
+
+/* 10^k for k = -348, -340, ..., 340, as normalized 64-bit significands */
+static const unsigned long long cached_powers_f[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const short cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007,  -980,
+     -954,  -927,  -901,  -874,  -847,  -821,  -794,  -768,  -741,  -715,
+     -688,  -661,  -635,  -608,  -582,  -555,  -529,  -502,  -475,  -449,
+     -422,  -396,  -369,  -343,  -316,  -289,  -263,  -236,  -210,  -183,
+     -157,  -130,  -103,   -77,   -50,   -24,     3,    30,    56,    83,
+      109,   136,   162,   189,   216,   242,   269,   295,   322,   348,
+      375,   402,   428,   455,   481,   508,   534,   561,   588,   614,
+      641,   667,   694,   720,   747,   774,   800,   827,   853,   880,
+      907,   933,   960,   986,  1013,  1039,  1066
+};
+
+typedef struct {
+    uint64_t f;
+    int      e;
+} diy_fp;
+
+static diy_fp diy_fp_make(uint64_t f, int e) {
+    diy_fp r;
+    r.f = f;
+    r.e = e;
+    return r;
+}
+
+/* High 64 bits of x * y, with the low half rounded into them */
+#if defined(__SIZEOF_INT128__)
+static uint64_t mul_hi_rounded(uint64_t x, uint64_t y) {
+    unsigned __int128 p = (unsigned __int128)x * y;
+    return (uint64_t)(p >> 64) + (uint64_t)((p >> 63) & 1);
+}
+#else
+static uint64_t mul_hi_rounded(uint64_t x, uint64_t y) {
+    const uint64_t M32 = 0xFFFFFFFFULL;
+    uint64_t a = x >> 32, b = x & M32, c = y >> 32, d = y & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t mid = (bd >> 32) + (ad & M32) + (bc & M32);
+    mid += 1ULL << 31;  /* round */
+    return ac + (ad >> 32) + (bc >> 32) + (mid >> 32);
+}
+#endif
+
+static diy_fp diy_fp_mul(diy_fp x, diy_fp y) {
+    return diy_fp_make(mul_hi_rounded(x.f, y.f), x.e + y.e + 64);
+}
+
+static diy_fp diy_fp_normalize(diy_fp x) {
+#if defined(__GNUC__)
+    int s = __builtin_clzll(x.f);
+#else
+    int s = 0;
+    while (!(x.f << s >> 63))
+        s++;
+#endif
+    return diy_fp_make(x.f << s, x.e - s);
+}
+
+static void grisu_round(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static void grisu_digits(diy_fp w, diy_fp mp, uint64_t delta, char *buf, int *len, int *k) {
+    static const uint64_t pow10[] = {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+        10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+        100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+        100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+        100000000000000000ULL, 1000000000000000000ULL,
+        10000000000000000000ULL
+    };
+    const diy_fp one = diy_fp_make(1ULL << -mp.e, mp.e);
+    const uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = 1;
+    uint32_t d = 0;
+    uint64_t rest = 0;
+
+    while (kappa < 10 && p1 >= pow10[kappa]) {
+        kappa++;
+    }
+    *len = 0;
+    while (kappa > 0) {
+        d = p1 / (uint32_t)pow10[kappa - 1];
+        p1 %= (uint32_t)pow10[kappa - 1];
+        if (d || *len) {
+            buf[(*len)++] = (char)('0' + d);
+        }
+        kappa--;
+        rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            grisu_round(buf, *len, delta, rest, pow10[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        d = (uint32_t)(p2 >> -one.e);
+        if (d || *len) {
+            buf[(*len)++] = (char)('0' + d);
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            grisu_round(buf, *len, delta, p2, one.f, wp_w * (-kappa < 20 ? pow10[-kappa] : 0));
+            return;
+        }
+    }
+}
+
+/* Round-trip digits of a positive finite v: v ~= digits * 10^k */
+static void grisu2(double v, char *buf, int *len, int *k) {
+    uint64_t bits = 0;
+    int biased_e = 0;
+    diy_fp w, plus, minus, c_mk;
+    double dk = 0;
+    int mk = 0;
+    unsigned index = 0;
+
+    memcpy(&bits, &v, sizeof(bits));
+    biased_e = (int)(bits >> 52);
+    if (biased_e != 0) {
+        w = diy_fp_make((bits & DP_SIGNIFICAND_MASK) + DP_HIDDEN_BIT, biased_e - DP_EXPONENT_BIAS);
+    } else {
+        w = diy_fp_make(bits & DP_SIGNIFICAND_MASK, 1 - DP_EXPONENT_BIAS);
+    }
+
+    /* Boundaries m- and m+ halfway to the neighbouring doubles */
+    plus = diy_fp_normalize(diy_fp_make((w.f << 1) + 1, w.e - 1));
+    if (w.f == DP_HIDDEN_BIT) {
+        minus = diy_fp_make((w.f << 2) - 1, w.e - 2);
+    } else {
+        minus = diy_fp_make((w.f << 1) - 1, w.e - 1);
+    }
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    /* Cached power bringing the exponent into [-60, -32] */
+    dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+    mk = (int)dk;
+    if (dk - mk > 0.0) {
+        mk++;
+    }
+    index = (unsigned)((mk >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    c_mk = diy_fp_make(cached_powers_f[index], cached_powers_e[index]);
+
+    w = diy_fp_mul(diy_fp_normalize(w), c_mk);
+    plus = diy_fp_mul(plus, c_mk);
+    minus = diy_fp_mul(minus, c_mk);
+    minus.f++;
+    plus.f--;
+    grisu_digits(w, plus, plus.f - minus.f, buf, len, k);
+}
+
+static int write_uint(char *buf, uint64_t u) {
+    char tmp[20];
+    int n = 0, i = 0;
+    do {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    for (i = 0; i < n; i++) {
+        buf[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+/* Writes num like "%g" would with just enough digits, plus a NUL; returns
+ * the length. num must be finite. */
+static int serialize_number(double num, char *buf) {
+    char *p = buf;
+    char digits[24];
+    int len = 0, k = 0, kk = 0, i = 0;
+
+    if (signbit(num)) {
+        *p++ = '-';
+        num = -num;
+    }
+    if (num == 0.0 || (num < EXACT_INT_LIMIT && num == floor(num))) {
+        p += write_uint(p, (uint64_t)num);
+        *p = '\0';
+        return (int)(p - buf);
+    }
+
+    grisu2(num, digits, &len, &k);
+    kk = len + k;   /* position of the decimal point */
+    if (len <= kk && kk <= 21) {
+        /* 1234e7 -> 12340000000 */
+        memcpy(p, digits, len);
+        for (i = len; i < kk; i++) {
+            p[i] = '0';
+        }
+        p += kk;
+    } else if (0 < kk && kk <= 21) {
+        /* 1234e-2 -> 12.34 */
+        memcpy(p, digits, kk);
+        p[kk] = '.';
+        memcpy(p + kk + 1, digits + kk, len - kk);
+        p += len + 1;
+    } else if (-6 < kk && kk <= 0) {
+        /* 1234e-6 -> 0.001234 */
+        *p++ = '0';
+        *p++ = '.';
+        for (i = kk; i < 0; i++) {
+            *p++ = '0';
+        }
+        memcpy(p, digits, len);
+        p += len;
+    } else {
+        /* 1234e30 -> 1.234e+33 */
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        *p++ = 'e';
+        *p++ = kk - 1 < 0 ? '-' : '+';
+        p += write_uint(p, (uint64_t)(kk - 1 < 0 ? 1 - kk : kk - 1));
+    }
+    *p = '\0';
+    return (int)(p - buf);
+}
+
+/* strtod() in the "C" locale, whatever the process locale is */
+static double strtod_c_locale(const char *string, char **end) {
+    static locale_t c_locale = (locale_t)0;
+    locale_t old = (locale_t)0;
+    double number = 0;
+
+    locale_t loc = __atomic_load_n(&c_locale, __ATOMIC_ACQUIRE);
+
+    if (loc == (locale_t)0) {
+        /* Parsers may run on several threads: first one to publish wins */
+        locale_t expected = (locale_t)0;
+        loc = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+        if (loc != (locale_t)0 &&
+            !__atomic_compare_exchange_n(&c_locale, &expected, loc, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            freelocale(loc);
+            loc = expected;
+        }
+    }
+    if (loc == (locale_t)0) {
+        return strtod(string, end);
+    }
+    old = uselocale(loc);
+    number = strtod(string, end);
+    uselocale(old);
+    return number;
+}
+
+/* Parses the JSON number at string; *end is set past it (to string if
+ * there is none). Returns 0, or -1 on overflow. */
+static int parse_number(const char *string, double *out, const char **end) {
+    static const double exact_pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char *p = string;
+    uint64_t mantissa = 0;
+    int digits = 0, exp10 = 0, exp_part = 0, exp_neg = 0;
+    parson_bool_t neg = PARSON_FALSE;
+    char *strtod_end = NULL;
     double number = 0;
+
+    *end = string;
+    if (*p == '-') {
+        neg = PARSON_TRUE;
+        p++;
+    }
+    if (!isdigit((unsigned char)*p)) {
+        return 0;
+    }
+    for (; isdigit((unsigned char)*p); p++) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exp10++;
+            digits++;
+        }
+    }
+    if (*p == '.') {
+        p++;
+        if (!isdigit((unsigned char)*p)) {
+            return 0;
+        }
+        for (; isdigit((unsigned char)*p); p++) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits += mantissa != 0;
+                exp10--;
+            } else {
+                digits++;
+            }
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') {
+            exp_neg = *p == '-';
+            p++;
+        }
+        if (!isdigit((unsigned char)*p)) {
+            return 0;
+        }
+        for (; isdigit((unsigned char)*p); p++) {
+            if (exp_part < 100000) {
+                exp_part = exp_part * 10 + (*p - '0');
+            }
+        }
+        exp10 += exp_neg ? -exp_part : exp_part;
+    }
+    *end = p;
+
+    if (digits <= 19 && mantissa <= (1ULL << 53)) {
+        number = (double)mantissa;
+        if (exp10 == 0 || mantissa == 0) {
+            *out = neg ? -number : number;
+            return 0;
+        }
+        if (exp10 > 0 && exp10 <= 22) {
+            *out = neg ? -(number * exact_pow10[exp10]) : number * exact_pow10[exp10];
+            return 0;
+        }
+        if (exp10 < 0 && exp10 >= -22) {
+            *out = neg ? -(number / exact_pow10[-exp10]) : number / exact_pow10[-exp10];
+            return 0;
+        }
+    }
+
     errno = 0;
-    number = strtod(*string, &end);
+    number = strtod_c_locale(string, &strtod_end);
     if (errno == ERANGE && (number <= -HUGE_VAL || number >= HUGE_VAL)) {
+        return -1;
+    }
+    *out = number;
+    return 0;
+}
+
+static JSON_Value * parse_number_value(const char **string) {
+    const char *end = NULL;
+    double number = 0;
+    if (parse_number(*string, &number, &end) < 0) {
         return NULL;
     }
-    if ((errno && errno != ERANGE) || !is_decimal(*string, end - *string)) {
+    if (end == *string || !is_decimal(*string, end - *string)) {
         return NULL;
     }
     *string = end;
@@ -1265,9 +1663,14 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
             }
             if (parson_number_serialization_function) {
                 written = parson_number_serialization_function(num, num_buf);
+            } else if (parson_float_format) {
+                written = parson_sprintf(num_buf, parson_float_format, num);
             } else {
-                const char *float_format = parson_float_format ? parson_float_format : PARSON_DEFAULT_FLOAT_FORMAT;
-                written = parson_sprintf(num_buf, float_format, num);
+#ifdef PARSON_DEFAULT_FLOAT_FORMAT
+                written = parson_sprintf(num_buf, PARSON_DEFAULT_FLOAT_FORMAT, num);
+#else
+                written = serialize_number(num, num_buf);
+#endif
             }
             if (written < 0) {
                 return -1;
@@ -1438,6 +1841,61 @@ int json_object_get_boolean(const JSON_Object *object, const char *name) {
     return json_value_get_boolean(json_object_get_value(object, name));
 }
 
+void json_key_init(JSON_Key *key, const char *name) {
+    key->name = name;
+    key->len = strlen(name);
+    key->hash = hash_string(name, key->len);
+    key->hint = 0;
+    key->prepared = 1;
+}
+
+JSON_Value * json_object_keyget_value(const JSON_Object *object, JSON_Key *key) {
+    parson_bool_t found = PARSON_FALSE;
+    size_t cell_ix = 0;
+    size_t item_ix = 0;
+    const char *name = NULL;
+
+    if (object == NULL || key == NULL || key->name == NULL) {
+        return NULL;
+    }
+    if (!key->prepared) {
+        json_key_init(key, key->name);
+    }
+
+    /* Shape cache: same position as in the previous object */
+    item_ix = key->hint;
+    if (item_ix < object->count && object->hashes[item_ix] == key->hash) {
+        name = object->names[item_ix];
+        if (strncmp(name, key->name, key->len) == 0 && name[key->len] == '\0') {
+            return object->values[item_ix];
+        }
+    }
+
+    cell_ix = json_object_get_cell_ix(object, key->name, key->len, key->hash, &found);
+    if (!found) {
+        return NULL;
+    }
+    item_ix = object->cells[cell_ix];
+    key->hint = item_ix;
+    return object->values[item_ix];
+}
+
+const char * json_object_keyget_string(const JSON_Object *object, JSON_Key *key) {
+    return json_value_get_string(json_object_keyget_value(object, key));
+}
+
+JSON_Object * json_object_keyget_object(const JSON_Object *object, JSON_Key *key) {
+    return json_value_get_object(json_object_keyget_value(object, key));
+}
+
+JSON_Array * json_object_keyget_array(const JSON_Object *object, JSON_Key *key) {
+    return json_value_get_array(json_object_keyget_value(object, key));
+}
+
+double json_object_keyget_number(const JSON_Object *object, JSON_Key *key) {
+    return json_value_get_number(json_object_keyget_value(object, key));
+}
+
 JSON_Value * json_object_dotget_value(const JSON_Object *object, const char *name) {
     const char *dot_position = strchr(name, '.');
     if (!dot_position) {
@@ -2484,3 +2942,11 @@ void json_set_float_serialization_format(const char *format) {
 void json_set_number_serialization_function(JSON_Number_Serialization_Function func) {
     parson_number_serialization_function = func;
 }
+
+int json_serialize_number(double num, char *buf) {
+    if (IS_NUMBER_INVALID(num)) {
+        memcpy(buf, "null", 5);
+        return 4;
+    }
+    return serialize_number(num, buf);
+}
@@ -47,6 +47,21 @@ typedef struct json_object_t JSON_Object;
 typedef struct json_array_t  JSON_Array;
 typedef struct json_value_t  JSON_Value;
 
+/* Prepared object key: the name's length and hash are computed once (on first
+   use) instead of on every lookup. 'hint' is a shape cache: the position at
+   which the key was last found, tried first on the next object, so iterating
+   objects with the same key layout needs no hashing or probing at all.
+   Lookups update the hint, so a key must not be shared between threads. */
+typedef struct json_key_t {
+    const char    *name;
+    size_t         len;
+    unsigned long  hash;
+    size_t         hint;
+    int            prepared;
+} JSON_Key;
+
+#define JSON_KEY_INIT(name) { (name), 0, 0, 0, 0 }
+
 enum json_value_type {
     JSONError   = -1,
     JSONNull    = 1,
@@ -90,6 +105,10 @@ void json_set_float_serialization_format(const char *format);
    If function is null then the default serialization function is used. */
 void json_set_number_serialization_function(JSON_Number_Serialization_Function fun);
 
+/* Writes num in the default form (Grisu2 round-trip, "null" if not finite)
+   followed by a NUL; buf must hold at least 32 bytes. Returns the length. */
+int json_serialize_number(double num, char *buf);
+
 /* Parses first JSON value in a file, returns NULL in case of error */
 JSON_Value * json_parse_file(const char *filename);
 
@@ -144,6 +163,14 @@ JSON_Array  * json_object_get_array  (const JSON_Object *object, const char *nam
 double        json_object_get_number (const JSON_Object *object, const char *name); /* returns 0 on fail */
 int           json_object_get_boolean(const JSON_Object *object, const char *name); /* returns -1 on fail */
 
+/* Same as the functions above, with a prepared key (see JSON_Key) */
+void          json_key_init(JSON_Key *key, const char *name);
+JSON_Value  * json_object_keyget_value  (const JSON_Object *object, JSON_Key *key);
+const char  * json_object_keyget_string (const JSON_Object *object, JSON_Key *key);
+JSON_Object * json_object_keyget_object (const JSON_Object *object, JSON_Key *key);
+JSON_Array  * json_object_keyget_array  (const JSON_Object *object, JSON_Key *key);
+double        json_object_keyget_number (const JSON_Object *object, JSON_Key *key); /* returns 0 on fail */
+
 /* dotget functions enable addressing values with dot notation in nested objects,
  just like in structs or c++/java/c# objects (e.g. objectA.objectB.value).
  Because valid names in JSON can contain dots, some values may be inaccessible
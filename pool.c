@@ -0,0 +1,233 @@
+// 324CC Stefan CALMAC
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TASK_NONE  SIZE_MAX         /* deque empty */
+#define TASK_ABORT (SIZE_MAX - 1)   /* lost a race, try again */
+
+/*
+ * Chase-Lev deque (in the C11 formulation of Lê et al., "Correct and
+ * Efficient Work-Stealing for Weak Memory Models"). The owner pushes and
+ * takes at the bottom, thieves steal at the top. All pushes happen before
+ * the workers are started, so the buffer never has to grow.
+ */
+struct deque {
+    _Alignas(64) _Atomic int64_t top;
+    _Alignas(64) _Atomic int64_t bottom;
+    _Atomic size_t *buf;
+    int64_t         mask;
+};
+
+struct pool_ctx {
+    struct deque   *dq;
+    int             nworkers;
+    pool_task_fn    run;
+    void           *arg;
+    atomic_uchar   *finished;   /* per task, only with a done callback */
+    atomic_size_t   want;       /* task the merger sleeps on, or SIZE_MAX */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+};
+
+struct pool_worker {
+    struct pool_ctx *ctx;
+    int              id;
+};
+
+/* Owner only, before the workers start */
+static void dq_push(struct deque *q, size_t task) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    atomic_store_explicit(&q->buf[b & q->mask], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+}
+
+/* Owner only: newest task pushed, i.e. the lowest task number left */
+static size_t dq_take(struct deque *q) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        return TASK_NONE;
+    }
+    size_t task = atomic_load_explicit(&q->buf[b & q->mask],
+                                       memory_order_relaxed);
+    if (t == b) {
+        /* Last one: race the thieves for it */
+        if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                memory_order_seq_cst, memory_order_relaxed))
+            task = TASK_NONE;
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/* Any thread: oldest task pushed, i.e. the highest task number left */
+static size_t dq_steal(struct deque *q) {
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    if (t >= b)
+        return TASK_NONE;
+
+    size_t task = atomic_load_explicit(&q->buf[t & q->mask],
+                                       memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+        return TASK_ABORT;
+    return task;
+}
+
+/**
+ * Steal from the other workers, starting with the next one. No task is
+ * added after the start, so one pass that finds every deque empty (and
+ * lost no race) means the batch is fully claimed.
+ */
+static size_t steal_any(struct pool_ctx *ctx, int self) {
+    for (;;) {
+        bool contended = false;
+        for (int k = 1; k < ctx->nworkers; k++) {
+            size_t task = dq_steal(&ctx->dq[(self + k) % ctx->nworkers]);
+            if (task == TASK_ABORT)
+                contended = true;
+            else if (task != TASK_NONE)
+                return task;
+        }
+        if (!contended)
+            return TASK_NONE;
+    }
+}
+
+static void mark_finished(struct pool_ctx *ctx, size_t task) {
+    if (!ctx->finished)
+        return;
+    atomic_store(&ctx->finished[task], 1);
+    /* The merger publishes want before checking finished, so either it
+     * sees the flag or we see it waiting and wake it up */
+    if (atomic_load(&ctx->want) == task) {
+        pthread_mutex_lock(&ctx->lock);
+        pthread_cond_signal(&ctx->cond);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+}
+
+static void *pool_worker(void *arg) {
+    struct pool_worker *w = arg;
+    struct pool_ctx *ctx = w->ctx;
+
+    for (;;) {
+        size_t task = dq_take(&ctx->dq[w->id]);
+        if (task == TASK_NONE)
+            task = steal_any(ctx, w->id);
+        if (task == TASK_NONE)
+            break;
+        ctx->run(task, w->id, ctx->arg);
+        mark_finished(ctx, task);
+    }
+    return NULL;
+}
+
+/* Hand each finished task to done, in task order */
+static void merge_ordered(struct pool_ctx *ctx, size_t ntasks,
+                          pool_done_fn done) {
+    for (size_t i = 0; i < ntasks; i++) {
+        if (!atomic_load(&ctx->finished[i])) {
+            pthread_mutex_lock(&ctx->lock);
+            atomic_store(&ctx->want, i);
+            while (!atomic_load(&ctx->finished[i]))
+                pthread_cond_wait(&ctx->cond, &ctx->lock);
+            atomic_store(&ctx->want, SIZE_MAX);
+            pthread_mutex_unlock(&ctx->lock);
+        }
+        done(i, ctx->arg);
+    }
+}
+
+int pool_run(size_t ntasks, int nworkers, pool_task_fn run, pool_done_fn done,
+             void *arg) {
+    if (nworkers > POOL_MAX_WORKERS)
+        nworkers = POOL_MAX_WORKERS;
+    if (nworkers < 1)
+        nworkers = 1;
+    if ((size_t)nworkers > ntasks)
+        nworkers = ntasks ? (int)ntasks : 1;
+
+    /* Each deque gets ceil(ntasks / nworkers) tasks at most */
+    size_t per = (ntasks + nworkers - 1) / nworkers;
+    size_t cap = 1;
+    while (cap < per)
+        cap <<= 1;
+
+    struct pool_ctx ctx = {
+        .nworkers = nworkers,
+        .run      = run,
+        .arg      = arg,
+    };
+    atomic_init(&ctx.want, SIZE_MAX);
+    struct pool_worker *workers = calloc(nworkers, sizeof(*workers));
+    pthread_t *tids = calloc(nworkers, sizeof(*tids));
+    _Atomic size_t *bufs = calloc((size_t)nworkers * cap, sizeof(*bufs));
+    ctx.dq = aligned_alloc(_Alignof(struct deque),
+                           nworkers * sizeof(struct deque));
+    if (done)
+        ctx.finished = calloc(ntasks ? ntasks : 1, sizeof(*ctx.finished));
+    if (!workers || !tids || !bufs || !ctx.dq || (done && !ctx.finished)) {
+        perror("pool");
+        free(workers);
+        free(tids);
+        free(bufs);
+        free(ctx.dq);
+        free(ctx.finished);
+        return -1;
+    }
+
+    for (int w = 0; w < nworkers; w++) {
+        struct deque *q = &ctx.dq[w];
+        atomic_init(&q->top, 0);
+        atomic_init(&q->bottom, 0);
+        q->buf  = bufs + (size_t)w * cap;
+        q->mask = (int64_t)cap - 1;
+        workers[w] = (struct pool_worker){ &ctx, w };
+    }
+    /* Highest first, so the owner's end holds its lowest task */
+    for (size_t i = ntasks; i-- > 0; )
+        dq_push(&ctx.dq[i % nworkers], i);
+
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.cond, NULL);
+
+    int started = 0;
+    for (; started < nworkers; started++) {
+        if (pthread_create(&tids[started], NULL, pool_worker,
+                           &workers[started]) != 0)
+            break;
+    }
+    /* Workers that did not start leave their tasks to be stolen; with no
+     * thread at all, the calling thread does the work */
+    if (started == 0)
+        pool_worker(&workers[0]);
+
+    if (done)
+        merge_ordered(&ctx, ntasks, done);
+
+    for (int w = 0; w < started; w++)
+        pthread_join(tids[w], NULL);
+
+    pthread_cond_destroy(&ctx.cond);
+    pthread_mutex_destroy(&ctx.lock);
+    free(ctx.finished);
+    free(ctx.dq);
+    free(bufs);
+    free(tids);
+    free(workers);
+    return started ? started : 1;
+}
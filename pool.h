@@ -0,0 +1,58 @@
+#ifndef POOL_H
+#define POOL_H
+// 324CC Stefan CALMAC
+
+#include <stddef.h>
+
+/**
+ * @file pool.h
+ * @brief Work-stealing thread pool for one batch of independent tasks.
+ *
+ * Every worker has its own Chase-Lev deque. The tasks are dealt out before
+ * the workers start (task i goes to worker i % nworkers), so each deque
+ * holds increasing task numbers with the lowest at the owner's end. A worker
+ * takes from its own end and, once that is empty, steals the highest
+ * pending task of another worker. Early tasks therefore finish first, which
+ * keeps the ordered merge (the done callback) streaming instead of waiting
+ * for the whole batch, while a worker stuck on a slow task is relieved by
+ * the others.
+ */
+
+#define POOL_MAX_WORKERS 64
+
+/**
+ * Task body, called on a worker thread.
+ *
+ * @param task    Task number, 0 <= task < ntasks.
+ * @param worker  Index of the worker running it, 0 <= worker < nworkers;
+ *                state indexed by it is never used by two threads at once.
+ * @param arg     Argument given to pool_run().
+ */
+typedef void (*pool_task_fn)(size_t task, int worker, void *arg);
+
+/**
+ * Ordered completion, called on the thread that called pool_run().
+ *
+ * @param task  Task number; called for 0, 1, 2... in order, each as soon as
+ *              that task and all the ones before it have finished.
+ * @param arg   Argument given to pool_run().
+ */
+typedef void (*pool_done_fn)(size_t task, void *arg);
+
+/**
+ * Run tasks 0..ntasks-1 on up to nworkers threads and wait for all of them.
+ * If no thread can be started, the tasks run on the calling thread.
+ *
+ * @param ntasks    Number of tasks.
+ * @param nworkers  Number of worker threads (capped at POOL_MAX_WORKERS
+ *                  and at ntasks).
+ * @param run       Task body.
+ * @param done      Ordered completion callback, or NULL.
+ * @param arg       Passed to run and done.
+ * @return          Number of workers used (>= 1), or -1 on allocation failure
+ *                  (nothing was run).
+ */
+int pool_run(size_t ntasks, int nworkers, pool_task_fn run, pool_done_fn done,
+             void *arg);
+
+#endif // POOL_H
@@ -1,13 +1,747 @@
 // 324CC Stefan CALMAC
+#define _GNU_SOURCE
 #include "requests.h"
 #include "helper.h"
+#include "trace.h"
+#include "retry.h"
+#include "timeout.h"
+#include "compress.h"
+#include "stats.h"
+#include "tcpopt.h"
+#include "shmcache.h"
+#include "uring.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/uio.h>
+
+#define RESP_INIT_SZ 8192   /* initial response buffer, grown as needed */
+#define REQ_MAX_IOV  4      /* segments per request (headers + body) */
+
+/* Framing information parsed from the response headers */
+struct resp_info {
+    size_t hdr_len;      /* bytes up to and including "\r\n\r\n" */
+    long   content_len;  /* Content-Length, or -1 if absent */
+    bool   chunked;      /* Transfer-Encoding: chunked */
+    bool   keep_alive;   /* connection may be reused after this response */
+    bool   no_body;      /* 1xx/204/304 responses never carry a body */
+    int    encoding;     /* ENCODING_* from Content-Encoding */
+    size_t wire_len;     /* bytes read off the socket */
+    size_t encoded_len;  /* body bytes before decoding (coded bodies only) */
+};
+
+/* Streaming decoder for a content-coded body */
+struct body_decoder {
+    struct inflater inf;
+    struct dbuf     out;   /* decoded body */
+    size_t          fed;   /* encoded body bytes consumed so far */
+};
+
+/**
+ * Parse the status line and the framing-related headers.
+ *
+ * @param buf      Response bytes; headers are complete up to hdr_len
+ * @param hdr_len  Length of the header block including the blank line
+ * @param info     Filled with framing information
+ */
+static void parse_resp_headers(const char *buf, size_t hdr_len,
+                               struct resp_info *info)
+{
+    info->hdr_len     = hdr_len;
+    info->content_len = -1;
+    info->chunked     = false;
+    info->encoding    = ENCODING_IDENTITY;
+    info->keep_alive  = strncmp(buf, "HTTP/1.1", 8) == 0;
+
+    int status = atoi(buf + 9);
+    info->no_body = status / 100 == 1 || status == 204 || status == 304;
+
+    const char *end = buf + hdr_len;
+    const char *line = strstr(buf, "\r\n");
+    while (line && line + 2 < end) {
+        line += 2;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            info->content_len = strtol(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            const char *v = line + 18;
+            while (*v == ' ') v++;
+            if (strncasecmp(v, "chunked", 7) == 0)
+                info->chunked = true;
+        } else if (strncasecmp(line, "Content-Encoding:", 17) == 0) {
+            info->encoding = compress_parse_encoding(line + 17);
+            if (info->encoding < 0) {
+                fprintf(stderr, "Warning: unsupported Content-Encoding\n");
+                info->encoding = ENCODING_IDENTITY;
+            }
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            const char *v = line + 11;
+            while (*v == ' ') v++;
+            if (strncasecmp(v, "close", 5) == 0)
+                info->keep_alive = false;
+            else if (strncasecmp(v, "keep-alive", 10) == 0)
+                info->keep_alive = true;
+        }
+        line = strstr(line, "\r\n");
+    }
+}
+
+/**
+ * Walk the chunked body framing that has arrived so far. When a decoder
+ * is given, the payload of every complete chunk is fed to it right away.
+ *
+ * @param body   Start of the (still encoded) body
+ * @param avail  Number of body bytes received
+ * @param scan   In/out cursor to the next unparsed chunk header
+ * @param dec    Content decoder, or NULL for identity bodies
+ * @return       1 once the terminating chunk and trailers are complete,
+ *               0 if more data is needed, -1 on malformed framing or
+ *               undecodable content
+ */
+static int chunked_scan(const char *body, size_t avail, size_t *scan,
+                        struct body_decoder *dec)
+{
+    for (;;) {
+        const char *p = body + *scan;
+        const char *eol = memmem(p, avail - *scan, "\r\n", 2);
+        if (!eol)
+            return 0;
+
+        char *hex_end;
+        unsigned long sz = strtoul(p, &hex_end, 16);
+        if (hex_end == p)
+            return -1;
+
+        size_t line_len = (size_t)(eol - p) + 2;
+        if (sz == 0) {
+            /* Last chunk: optional trailers end with an empty line */
+            const char *rest = eol + 2;
+            size_t left = avail - (size_t)(rest - body);
+            if (left >= 2 && rest[0] == '\r' && rest[1] == '\n')
+                return 1;
+            return memmem(rest, left, "\r\n\r\n", 4) ? 1 : 0;
+        }
+
+        if (avail - *scan < line_len + sz + 2)
+            return 0;
+        if (dec) {
+            if (inflater_feed(&dec->inf, p + line_len, sz, &dec->out) < 0)
+                return -1;
+            dec->fed += sz;
+        }
+        *scan += line_len + sz + 2;
+    }
+}
+
+/**
+ * Decode a complete chunked body in place.
+ *
+ * @param body  Start of the encoded body (validated by chunked_scan)
+ * @return      Length of the decoded body
+ */
+static size_t chunked_decode(char *body)
+{
+    char *src = body, *dst = body;
+    for (;;) {
+        char *eol = strstr(src, "\r\n");
+        unsigned long sz = strtoul(src, NULL, 16);
+        if (!eol || sz == 0)
+            break;
+        memmove(dst, eol + 2, sz);
+        dst += sz;
+        src = eol + 2 + sz + 2;
+    }
+    return (size_t)(dst - body);
+}
+
+int http_frame_scan(const char *buf, size_t len, struct http_frame *f,
+                    bool eof)
+{
+    if (f->hdr_len == 0) {
+        const char *sep = strstr(buf, "\r\n\r\n");
+        if (!sep)
+            return eof ? -1 : 0;
+        struct resp_info info;
+        parse_resp_headers(buf, (size_t)(sep - buf) + 4, &info);
+        if (info.encoding != ENCODING_IDENTITY)
+            return -1;
+        f->hdr_len     = info.hdr_len;
+        f->content_len = info.no_body ? 0 : info.content_len;
+        f->chunked     = info.chunked && !info.no_body;
+        f->keep_alive  = info.keep_alive &&
+                         (f->chunked || f->content_len >= 0);
+        f->scan        = 0;
+    }
+
+    size_t body = len - f->hdr_len;
+    if (f->chunked) {
+        int r = chunked_scan(buf + f->hdr_len, body, &f->scan, NULL);
+        if (r != 0) {
+            f->total = len;
+            return r;
+        }
+        return eof ? -1 : 0;
+    }
+    if (f->content_len >= 0) {
+        if (body >= (size_t)f->content_len) {
+            f->total = f->hdr_len + (size_t)f->content_len;
+            return 1;
+        }
+        return eof ? -1 : 0;
+    }
+    /* Close-delimited body */
+    f->total = len;
+    return eof ? 1 : 0;
+}
+
+size_t http_frame_finish(char *buf, const struct http_frame *f)
+{
+    size_t len = f->total;
+    if (f->chunked)
+        len = f->hdr_len + chunked_decode(buf + f->hdr_len);
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * Read one complete HTTP response from the socket.
+ *
+ * Reads the headers, then the body as framed by Content-Length, chunked
+ * transfer encoding or, failing both, connection close. gzip/deflate
+ * bodies are inflated incrementally as each piece arrives and chunked
+ * bodies are de-chunked, so callers always see "headers + plain body".
+ *
+ * With io_uring, the request is passed in and sent in the same linked
+ * submission as the first read.
+ *
+ * @param sockfd   Connected socket descriptor
+ * @param req      Request still to be sent (io_uring only), or NULL
+ * @param reqcnt   Number of segments in req
+ * @param info     Out: framing, reuse and size information
+ * @param len      Out: total length of the returned buffer
+ * @param t_first  Out: timestamp of the first byte (only when tracing)
+ * @return         Malloc’d, NUL-terminated response, or NULL on error
+ */
+static char *read_response(int sockfd, const struct iovec *req, int reqcnt,
+                           struct resp_info *info, size_t *len,
+                           uint64_t *t_first)
+{
+    size_t cap = RESP_INIT_SZ, got = 0, scan = 0;
+    char *buf = malloc(cap);
+    if (!buf) {
+        perror("malloc");
+        return NULL;
+    }
+
+    struct body_decoder dec;
+    bool decoding = false;
+    bool have_hdr = false;
+    int err = 0;
+    memset(info, 0, sizeof(*info));
+
+    for (;;) {
+        if (have_hdr) {
+            size_t body = got - info->hdr_len;
+            if (info->no_body)
+                break;
+            if (info->chunked) {
+                int r = chunked_scan(buf + info->hdr_len, body, &scan,
+                                     decoding ? &dec : NULL);
+                if (r < 0) {
+                    fprintf(stderr, "Error: malformed chunked response\n");
+                    err = EPROTO;
+                    goto fail;
+                }
+                if (r == 1)
+                    break;
+            } else {
+                if (info->content_len >= 0 &&
+                    body > (size_t)info->content_len)
+                    body = (size_t)info->content_len;
+                if (decoding && body > dec.fed) {
+                    if (inflater_feed(&dec.inf, buf + info->hdr_len + dec.fed,
+                                      body - dec.fed, &dec.out) < 0) {
+                        fprintf(stderr, "Error: corrupt compressed body\n");
+                        err = EPROTO;
+                        goto fail;
+                    }
+                    dec.fed = body;
+                }
+                if (info->content_len >= 0 &&
+                    body >= (size_t)info->content_len)
+                    break;
+            }
+        }
+
+        if (cap - got < 2048) {
+            char *tmp = realloc(buf, cap * 2);
+            if (!tmp) {
+                perror("realloc");
+                err = ENOMEM;
+                goto fail;
+            }
+            buf = tmp;
+            cap *= 2;
+        }
+
+        ssize_t n = -1;
+        if (req) {
+            bool send_failed;
+            n = uring_send_read(sockfd, req, reqcnt, buf, cap - 1,
+                                timeout_policy.io_ms, &send_failed);
+            req = NULL;
+            if (n < 0 && send_failed) {
+                err = errno;
+                perror("write");
+                goto fail;
+            }
+        } else if (uring_active()) {
+            n = uring_read(sockfd, buf + got, cap - got - 1,
+                           timeout_policy.io_ms);
+        } else if (wait_fd(sockfd, POLLIN, timeout_policy.io_ms) == 0) {
+            n = read(sockfd, buf + got, cap - got - 1);
+        }
+        if (n < 0) {
+            err = errno;
+            perror("read");
+            goto fail;
+        }
+        if (n == 0) {
+            /* Peer closed: fine for close-delimited bodies only */
+            if (have_hdr && !info->chunked && info->content_len < 0)
+                break;
+            if (got == 0)
+                fprintf(stderr, "read: connection closed by server\n");
+            else
+                fprintf(stderr, "read: truncated response\n");
+            err = ECONNRESET;
+            goto fail;
+        }
+        tcp_after_read(sockfd);
+        if (got == 0 && trace_active)
+            *t_first = trace_now_ns();
+        got += (size_t)n;
+        buf[got] = '\0';
+
+        if (!have_hdr) {
+            char *sep = strstr(buf, "\r\n\r\n");
+            if (sep) {
+                parse_resp_headers(buf, (size_t)(sep - buf) + 4, info);
+                have_hdr = true;
+                if (info->encoding != ENCODING_IDENTITY && !info->no_body) {
+                    memset(&dec, 0, sizeof(dec));
+                    if (inflater_init(&dec.inf, info->encoding) < 0) {
+                        fprintf(stderr, "Error: unable to init zlib\n");
+                        err = ENOMEM;
+                        goto fail;
+                    }
+                    decoding = true;
+                }
+            }
+        }
+    }
+    info->wire_len = got;
+
+    if (decoding) {
+        /* Replace the encoded body with the decoded one */
+        info->encoded_len = dec.fed;
+        char *tmp = realloc(buf, info->hdr_len + dec.out.len + 1);
+        if (!tmp) {
+            perror("realloc");
+            err = ENOMEM;
+            goto fail;
+        }
+        buf = tmp;
+        if (dec.out.len)
+            memcpy(buf + info->hdr_len, dec.out.data, dec.out.len);
+        got = info->hdr_len + dec.out.len;
+        buf[got] = '\0';
+        inflater_end(&dec.inf);
+        free(dec.out.data);
+    } else if (info->chunked) {
+        got = info->hdr_len + chunked_decode(buf + info->hdr_len);
+        buf[got] = '\0';
+    } else if (info->content_len >= 0 &&
+               got > info->hdr_len + (size_t)info->content_len) {
+        /* Never hand out bytes belonging to a following response */
+        got = info->hdr_len + (size_t)info->content_len;
+        buf[got] = '\0';
+    }
+
+    info->keep_alive = info->keep_alive &&
+                       (info->chunked || info->content_len >= 0 ||
+                        info->no_body);
+    *len = got;
+    return buf;
+
+fail:
+    if (decoding) {
+        inflater_end(&dec.inf);
+        free(dec.out.data);
+    }
+    free(buf);
+    errno = err;
+    return NULL;
+}
+
+/**
+ * Write all iovec segments, waiting at most the I/O timeout (clipped by the
+ * command deadline) for the socket to accept more data.
+ * MSG_NOSIGNAL turns a closed peer into EPIPE instead of SIGPIPE.
+ *
+ * @param sockfd  Connected socket descriptor
+ * @param iov     Segments to send (headers, then an optional body)
+ * @param iovcnt  Number of segments (at most REQ_MAX_IOV)
+ * @return        0 on success, -1 with errno set on failure/timeout
+ */
+static int send_iov(int sockfd, const struct iovec *iov, int iovcnt)
+{
+    struct iovec vec[REQ_MAX_IOV];
+    memcpy(vec, iov, iovcnt * sizeof(*iov));
+    struct msghdr msg = { .msg_iov = vec, .msg_iovlen = iovcnt };
+
+    bool uring = uring_active();
+    while (msg.msg_iovlen > 0) {
+        ssize_t n;
+        if (uring) {
+            n = uring_sendmsg(sockfd, &msg, timeout_policy.io_ms);
+        } else {
+            if (wait_fd(sockfd, POLLOUT, timeout_policy.io_ms) < 0)
+                return -1;
+            n = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+        }
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        /* Drop fully sent segments, advance inside a partial one */
+        while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len) {
+            n -= (ssize_t)msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Total number of bytes described by an iovec array.
+ */
+static size_t iov_total(const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+        total += iov[i].iov_len;
+    return total;
+}
+
+/**
+ * Send a fully built request and read the response.
+ *
+ * Shared tail of every request_* function: writes the request, reads the
+ * reply into a malloc’d buffer and, when tracing is on, records a span
+ * with the phase timings and byte counts.
+ *
+ * @param method    HTTP method (used for tracing only)
+ * @param path      Request path (used for tracing only)
+ * @param sockfd    Connected socket descriptor
+ * @param iov       Serialized request: headers, then an optional body
+ * @param iovcnt    Number of segments in iov
+ * @param reused    Whether sockfd already carried an earlier request
+ * @param keep      Out (optional): whether the connection may be reused
+ * @return          Malloc’d response buffer (headers+body), or NULL on error
+ */
+static char *exchange(const char *method, const char *path, int sockfd,
+                      const struct iovec *iov, int iovcnt,
+                      bool reused, bool *keep)
+{
+    uint64_t t_start = trace_active ? trace_now_ns() : 0;
+    size_t req_len = iov_total(iov, iovcnt);
+
+    /* Send the request; io_uring sends it together with the first read,
+     * so there the write time is counted as waiting */
+    bool linked = uring_active() && iovcnt <= URING_MAX_IOV;
+    if (!linked && send_iov(sockfd, iov, iovcnt) < 0) {
+        int err = errno;
+        perror("write");
+        errno = err;
+        return NULL;
+    }
+    uint64_t t_sent = trace_active && !linked ? trace_now_ns() : t_start;
+
+    size_t len = 0;
+    struct resp_info info;
+    uint64_t t_first = t_sent;
+    char *buf = read_response(sockfd, linked ? iov : NULL, iovcnt,
+                              &info, &len, &t_first);
+
+    /* Once the server has seen a mutation (even if its answer got lost),
+     * nothing cached across processes may be served any more */
+    if (shm_cache_active && strcmp(method, "GET") != 0)
+        shm_cache_invalidate(path);
+
+    if (!buf)
+        return NULL;
+    if (keep)
+        *keep = info.keep_alive;
+    if (!reused)
+        tcp_first_response(sockfd);
+
+    STATS_ADD(requests, 1);
+    STATS_ADD(bytes_out, req_len);
+    STATS_ADD(bytes_in, info.wire_len);
+    if (info.encoding != ENCODING_IDENTITY && !info.no_body) {
+        STATS_ADD(encoded_responses, 1);
+        STATS_ADD(encoded_bytes, info.encoded_len);
+        STATS_ADD(decoded_bytes, len - info.hdr_len);
+    }
+
+    if (trace_active) {
+        uint64_t t_done = trace_now_ns();
+        struct trace_span sp;
+        memset(&sp, 0, sizeof(sp));
+        sp.kind      = TRACE_KIND_REQ;
+        sp.start_ns  = t_start;
+        sp.dur_ns    = t_done - t_start;
+        sp.status    = get_status(buf);
+        sp.bytes_out = req_len;
+        sp.bytes_in  = info.wire_len;
+        sp.write_ns  = t_sent - t_start;
+        sp.wait_ns   = t_first - t_sent;
+        sp.read_ns   = t_done - t_first;
+        sp.reused    = reused;
+        snprintf(sp.name, sizeof(sp.name), "%s", method);
+        snprintf(sp.route, sizeof(sp.route), "%s", path);
+        trace_record(&sp);
+    }
+
+    return buf;
+}
+
+/**
+ * Run an idempotent request, retrying transient failures.
+ *
+ * The first attempt uses the caller's socket. If it fails with a retryable
+ * socket error or a 502/503/504 status, the request is replayed on a fresh
+ * connection after an exponential, jittered backoff, as long as the retry
+ * policy and the batch budget allow it. Never use this for POST.
+ *
+ * @param method    HTTP method (GET, PUT or DELETE)
+ * @param path      Request path
+ * @param sockfd    Connected socket descriptor for the first attempt
+ * @param iov       Serialized request: headers, then an optional body
+ * @param iovcnt    Number of segments in iov
+ * @return          Malloc’d response buffer of the last attempt that got an
+ *                  answer, or NULL if none did
+ */
+static char *exchange_retry(const char *method, const char *path, int sockfd,
+                            const struct iovec *iov, int iovcnt)
+{
+    char *resp = exchange(method, path, sockfd, iov, iovcnt, false, NULL);
+
+    for (int attempt = 1; attempt <= retry_policy.retries; attempt++) {
+        int err = errno;
+        int status = resp ? get_status(resp) : 0;
+        if (resp ? !retry_status_retryable(status)
+                 : !retry_errno_retryable(err))
+            break;
+        if (!retry_budget_take() || !retry_backoff(attempt))
+            break;
+
+        if (resp)
+            fprintf(stderr, "retry: %s %s (HTTP %d), attempt %d\n",
+                    method, path, status, attempt + 1);
+        else
+            fprintf(stderr, "retry: %s %s (%s), attempt %d\n",
+                    method, path, strerror(err), attempt + 1);
+
+        int fd = setup_conn();
+        if (fd < 0)
+            break;
+        char *next = exchange(method, path, fd, iov, iovcnt, false, NULL);
+        err = errno;
+        close(fd);
+        errno = err;
+
+        /* Keep the most informative answer: a 5xx beats no response */
+        if (next) {
+            free(resp);
+            resp = next;
+        } else if (resp) {
+            errno = 0;
+        }
+    }
+
+    return resp;
+}
+
+/**
+ * Send one request carrying a body, as-is or gzip-compressed.
+ *
+ * The headers are formatted into a stack buffer and the body is sent as a
+ * second iovec segment, so it is never copied into the request buffer.
+ * POSTs are sent once; other methods go through the retry policy.
+ *
+ * @param method     "POST" or "PUT"
+ * @param path       Full request path
+ * @param body       Body bytes (JSON text or its gzip encoding)
+ * @param body_len   Number of body bytes
+ * @param gzipped    Whether body is gzip-compressed
+ * @param payload    MIME type of the payload (e.g. "application/json")
+ * @param sockfd     Connected socket descriptor
+ * @param extra_hdr  Optional extra header string, or NULL
+ * @return           Malloc’d response buffer (headers+body), or NULL on error
+ */
+static char *send_body_once(const char *method, const char *path,
+                            const char *body, size_t body_len, bool gzipped,
+                            const char *payload, int sockfd,
+                            const char *extra_hdr)
+{
+    char request[4096];
+    int req_len = snprintf(request, sizeof(request),
+                           "%s %s HTTP/1.1\r\n"
+                           "Host: %s\r\n"
+                           "Content-Type: %s\r\n"
+                           "Content-Length: %zu\r\n"
+                           "%s"
+                           "%s"
+                           "%s"
+                           "Connection: close\r\n"
+                           "\r\n",
+                           method, path, HOST, payload, body_len,
+                           gzipped ? "Content-Encoding: gzip\r\n" : "",
+                           compress_accept_hdr(),
+                           extra_hdr ? extra_hdr : "");
+    if (req_len < 0 || req_len >= (int)sizeof(request)) {
+        fprintf(stderr, "request: header buffer overflow\n");
+        return NULL;
+    }
+
+    struct iovec iov[2] = {
+        { .iov_base = request,      .iov_len = (size_t)req_len },
+        { .iov_base = (char *)body, .iov_len = body_len },
+    };
+
+    if (strcmp(method, "POST") == 0)
+        return exchange(method, path, sockfd, iov, 2, false, NULL);
+    return exchange_retry(method, path, sockfd, iov, 2);
+}
+
+/**
+ * Send a request with a JSON body, compressing the body with gzip when it
+ * is above the configured threshold and the server has not refused
+ * compressed bodies. A 415 answer to a compressed body disables request
+ * compression for the rest of the session and the request is re-sent
+ * uncompressed on a fresh connection.
+ *
+ * @param method     "POST" or "PUT"
+ * @param path       Full request path
+ * @param json_body  NUL-terminated JSON body
+ * @param payload    MIME type of the payload
+ * @param sockfd     Connected socket descriptor
+ * @param extra_hdr  Optional extra header string, or NULL
+ * @return           Malloc’d response buffer (headers+body), or NULL on error
+ */
+static char *send_with_body(const char *method, const char *path,
+                            const char *json_body, const char *payload,
+                            int sockfd, const char *extra_hdr)
+{
+    size_t body_len = strlen(json_body);
+    struct dbuf gz = { 0 };
+    bool gzipped = compress_should_gzip(body_len) &&
+                   gzip_compress(json_body, body_len, &gz) == 0;
+
+    char *resp;
+    if (gzipped) {
+        STATS_ADD(gzip_requests, 1);
+        STATS_ADD(gzip_raw_bytes, body_len);
+        STATS_ADD(gzip_sent_bytes, gz.len);
+        resp = send_body_once(method, path, gz.data, gz.len, true,
+                              payload, sockfd, extra_hdr);
+    } else {
+        resp = send_body_once(method, path, json_body, body_len, false,
+                              payload, sockfd, extra_hdr);
+    }
+
+    if (gzipped && resp && get_status(resp) == 415) {
+        fprintf(stderr, "Server refused gzip request bodies, "
+                        "sending them uncompressed\n");
+        compress_gzip_refused();
+        free(resp);
+        resp = NULL;
+
+        int fd = setup_conn();
+        if (fd >= 0) {
+            resp = send_body_once(method, path, json_body, body_len, false,
+                                  payload, fd, extra_hdr);
+            close(fd);
+        }
+    }
+
+    free(gz.data);
+    return resp;
+}
+
+/**
+ * Perform a body-less HTTP request (GET or DELETE) on a persistent connection.
+ *
+ * Unlike the other request_* functions this asks the server to keep the
+ * connection open, so a caller can issue many requests over one socket.
+ *
+ * @param method      "GET" or "DELETE"
+ * @param route       Base route (e.g. "/api/movies")
+ * @param id          Optional path segment to append to route, or NULL
+ * @param sockfd      Connected socket descriptor
+ * @param extra_hdr   Optional extra header string (must include trailing "\r\n"), or NULL
+ * @param reused      Whether sockfd already carried an earlier request
+ * @param keep        Out: whether the connection may be used again
+ * @return            Malloc’d response buffer (headers+body), or NULL on error
+ */
+char *request_keepalive(const char *method,
+                        const char *route,
+                        const char *id,
+                        int sockfd,
+                        const char *extra_hdr,
+                        bool reused,
+                        bool *keep)
+{
+    char path[512];
+    if (id)
+        snprintf(path, sizeof(path), "%s/%s", route, id);
+    else
+        snprintf(path, sizeof(path), "%s", route);
+
+    char request[4096];
+    int req_len = snprintf(request, sizeof(request),
+                           "%s %s HTTP/1.1\r\n"
+                           "Host: %s\r\n"
+                           "%s"
+                           "%s"
+                           "Connection: keep-alive\r\n"
+                           "\r\n",
+                           method, path, HOST, compress_accept_hdr(),
+                           extra_hdr ? extra_hdr : "");
+    if (req_len < 0 || req_len >= (int)sizeof(request)) {
+        fprintf(stderr, "request_keepalive: request buffer overflow\n");
+        return NULL;
+    }
+
+    struct iovec iov = { .iov_base = request, .iov_len = (size_t)req_len };
+    return exchange(method, path, sockfd, &iov, 1, reused, keep);
+}
 
 /**
  * Perform an HTTP GET request.
  *
  * Constructs and sends a GET request to the specified route,
  * optionally appending an extra path segment and extra headers.
- * Reads the response into a malloc’d buffer and returns it.
+ * Reads the response into a malloc’d buffer and returns it. With the
+ * shared cache enabled, library reads may be answered without a request.
  *
  * @param route         Base route (e.g. "/api/movies")
  * @param sockfd        Connected socket descriptor
@@ -24,38 +758,37 @@ char *request_get(const char *route,
     snprintf(path, sizeof(path), "%s/%s", route, extra_path);
 
     char request[4096];
-    snprintf(request, sizeof(request),
+    int req_len = snprintf(request, sizeof(request),
              "GET %s HTTP/1.1\r\n"
              "Host: %s\r\n"
              "%s"
+             "%s"
              "Connection: close\r\n"
              "\r\n",
              extra_path ? path : route,
              HOST,
+             compress_accept_hdr(),
              extra_hdr ? extra_hdr : "");
 
-    /* Send the GET request */
-    if (write(sockfd, request, strlen(request)) < 0) {
-        perror("write");
-        return NULL;
-    }
-
-    /* Allocate buffer and read the response */
-    char *buf = malloc(8192);
-    if (!buf) {
-        perror("malloc");
+    if (req_len < 0 || req_len >= (int)sizeof(request)) {
+        fprintf(stderr, "request_get: request buffer overflow\n");
         return NULL;
     }
 
-    ssize_t n = read(sockfd, buf, 8191);
-    if (n < 0) {
-        perror("read");
-        free(buf);
-        return NULL;
+    /* Serve repeated library reads from the shared cache when enabled */
+    const char *target = extra_path ? path : route;
+    uint64_t gen = 0;
+    if (shm_cache_active) {
+        char *hit = shm_cache_get(target, extra_hdr, &gen);
+        if (hit)
+            return hit;
     }
-    buf[n] = '\0';
 
-    return buf;
+    struct iovec iov = { .iov_base = request, .iov_len = (size_t)req_len };
+    char *resp = exchange_retry("GET", target, sockfd, &iov, 1);
+    if (shm_cache_active && resp && get_status(resp) == 200)
+        shm_cache_put(target, extra_hdr, gen, resp, strlen(resp));
+    return resp;
 }
 
 /**
@@ -78,42 +811,8 @@ char *request_post(const char *route,
                    int sockfd,
                    const char *extra_hdr)
 {
-    char request[4096];
-    snprintf(request, sizeof(request),
-             "POST %s HTTP/1.1\r\n"
-             "Host: %s\r\n"
-             "Content-Type: %s\r\n"
-             "Content-Length: %zu\r\n"
-             "%s"
-             "Connection: close\r\n"
-             "\r\n"
-             "%s",
-             route, HOST, payload, strlen(json_body),
-             extra_hdr ? extra_hdr : "",
-             json_body);
-
-    /* Send the POST request */
-    if (write(sockfd, request, strlen(request)) < 0) {
-        perror("write");
-        return NULL;
-    }
-
-    /* Allocate buffer and read the response */
-    char *buf = malloc(8192);
-    if (!buf) {
-        perror("malloc");
-        return NULL;
-    }
-
-    ssize_t n = read(sockfd, buf, 8191);
-    if (n <= 0) {
-        perror("read");
-        free(buf);
-        return NULL;
-    }
-    buf[n] = '\0';
-
-    return buf;
+    return send_with_body("POST", route, json_body, payload,
+                          sockfd, extra_hdr);
 }
 
 /**
@@ -142,47 +841,8 @@ char *request_put(const char *route_base,
     char path[512];
     snprintf(path, sizeof(path), "%s/%s", route_base, movie_id);
 
-    size_t body_len = strlen(json_body);
-    char request[4096];
-    int req_len = snprintf(request, sizeof(request),
-        "PUT %s HTTP/1.1\r\n"
-        "Host: %s\r\n"
-        "Content-Type: %s\r\n"
-        "Content-Length: %zu\r\n"
-        "%s"
-        "Connection: close\r\n"
-        "\r\n"
-        "%s",
-        path, HOST, payload, body_len,
-        extra_hdr ? extra_hdr : "",
-        json_body);
-
-    if (req_len < 0 || req_len >= (int)sizeof(request)) {
-        fprintf(stderr, "request_put: request buffer overflow\n");
-        return NULL;
-    }
-
-    /* Send the PUT request */
-    if (write(sockfd, request, req_len) < 0) {
-        perror("write");
-        return NULL;
-    }
-
-    /* Allocate buffer and read the response */
-    char *buf = malloc(8192);
-    if (!buf) {
-        perror("malloc");
-        return NULL;
-    }
-    ssize_t n = read(sockfd, buf, 8191);
-    if (n < 0) {
-        perror("read");
-        free(buf);
-        return NULL;
-    }
-    buf[n] = '\0';
-
-    return buf;
+    return send_with_body("PUT", path, json_body, payload,
+                          sockfd, extra_hdr);
 }
 
 /**
@@ -211,31 +871,17 @@ char *request_delete(const char *route_base,
                            "DELETE %s HTTP/1.1\r\n"
                            "Host: %s\r\n"
                            "%s"
+                           "%s"
                            "Content-Length: 0\r\n"
                            "Connection: close\r\n"
                            "\r\n",
-                           path, HOST,
+                           path, HOST, compress_accept_hdr(),
                            extra_hdr ? extra_hdr : "");
-
-    /* Send the DELETE request */
-    if (write(sockfd, request, req_len) < 0) {
-        perror("write");
-        return NULL;
-    }
-
-    /* Allocate buffer and read the response */
-    char *buf = malloc(8192);
-    if (!buf) {
-        perror("malloc");
-        return NULL;
-    }
-    ssize_t n = read(sockfd, buf, 8191);
-    if (n < 0) {
-        perror("read");
-        free(buf);
+    if (req_len < 0 || req_len >= (int)sizeof(request)) {
+        fprintf(stderr, "request_delete: request buffer overflow\n");
         return NULL;
     }
-    buf[n] = '\0';
 
-    return buf;
+    struct iovec iov = { .iov_base = request, .iov_len = (size_t)req_len };
+    return exchange_retry("DELETE", path, sockfd, &iov, 1);
 }
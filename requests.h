@@ -3,6 +3,7 @@
 // 324CC Stefan CALMAC
 
 #include <stddef.h>
+#include <stdbool.h>
 
 /**
  * @file requests.h
@@ -87,4 +88,63 @@ char *request_delete(const char *route_base,
                      int sockfd,
                      const char *extra_hdr);
 
+/**
+ * Perform a body-less HTTP request (GET or DELETE) on a persistent connection.
+ *
+ * Sends "Connection: keep-alive" and reads exactly one response, so the
+ * same socket can be reused for the next request when *keep is true.
+ *
+ * @param method     "GET" or "DELETE".
+ * @param route      Base route (e.g. "/movies").
+ * @param id         Optional path segment to append to route (e.g. "123"), or NULL.
+ * @param sockfd     Connected socket descriptor.
+ * @param extra_hdr  Optional extra header string (must include trailing "\r\n"), or NULL.
+ * @param reused     Whether sockfd already carried an earlier request.
+ * @param keep       Out: true if the server left the connection open.
+ * @return           Malloc’d buffer containing the full HTTP response
+ *                   (headers + body), or NULL on error.
+ */
+char *request_keepalive(const char *method,
+                        const char *route,
+                        const char *id,
+                        int sockfd,
+                        const char *extra_hdr,
+                        bool reused,
+                        bool *keep);
+
+/** Framing of a response received without blocking (see http_frame_scan()). */
+struct http_frame {
+    size_t hdr_len;      /**< Header block length, 0 until it is complete */
+    long   content_len;  /**< Content-Length, or -1 if absent */
+    bool   chunked;      /**< Transfer-Encoding: chunked */
+    bool   keep_alive;   /**< Connection may carry another request */
+    size_t scan;         /**< Chunk parser cursor */
+    size_t total;        /**< Length of the complete response */
+};
+
+/**
+ * Check whether buf holds a complete response, for callers that read
+ * without blocking. Call again with the same frame as more bytes arrive.
+ * Responses must not be content-coded (send no Accept-Encoding).
+ *
+ * @param buf  Bytes received so far (NUL-terminated).
+ * @param len  Number of bytes.
+ * @param f    Zeroed before the first call; f->total is set on completion.
+ * @param eof  Whether the peer has closed the connection.
+ * @return     1 when complete, 0 if more bytes are needed, -1 if the
+ *             response is malformed or cut short.
+ */
+int http_frame_scan(const char *buf, size_t len, struct http_frame *f,
+                    bool eof);
+
+/**
+ * Turn a complete response into "headers + plain body" (de-chunked, cut
+ * at its end) in place, as the request_* functions return it.
+ *
+ * @param buf  Response buffer (NUL-terminated).
+ * @param f    Frame completed by http_frame_scan().
+ * @return     New length; buf is NUL-terminated there.
+ */
+size_t http_frame_finish(char *buf, const struct http_frame *f);
+
 #endif // REQUESTS_H
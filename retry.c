@@ -0,0 +1,96 @@
+// 324CC Stefan CALMAC
+#define _GNU_SOURCE
+#include "retry.h"
+#include "timeout.h"
+#include "coro.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+struct retry_policy retry_policy = {
+    .retries = RETRY_DEFAULT_RETRIES,
+    .budget  = RETRY_DEFAULT_BUDGET,
+    .base_ms = RETRY_BASE_MS,
+    .cap_ms  = RETRY_CAP_MS,
+};
+
+static atomic_int budget_left = RETRY_DEFAULT_BUDGET;
+static __thread unsigned jitter_seed = 0;
+
+/**
+ * Refill the retry budget at the start of a batch.
+ */
+void retry_budget_reset(void) {
+    atomic_store(&budget_left, retry_policy.budget);
+}
+
+/**
+ * Take one retry from the batch budget; false once it is exhausted.
+ */
+bool retry_budget_take(void) {
+    int left = atomic_load(&budget_left);
+    while (left > 0) {
+        if (atomic_compare_exchange_weak(&budget_left, &left, left - 1))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Classify socket errors: only those caused by the network or by the
+ * server being briefly unavailable are retried.
+ */
+bool retry_errno_retryable(int err) {
+    switch (err) {
+    case ECONNREFUSED:
+    case ECONNRESET:
+    case ECONNABORTED:
+    case EPIPE:
+    case ETIMEDOUT:
+    case ENETDOWN:
+    case ENETUNREACH:
+    case EHOSTUNREACH:
+    case EAGAIN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Bad gateway, service unavailable and gateway timeout are transient.
+ */
+bool retry_status_retryable(int status) {
+    return status == 502 || status == 503 || status == 504;
+}
+
+/**
+ * Sleep a random duration in [0, min(cap, base * 2^(attempt-1))] ms,
+ * unless the command deadline would pass in the meantime.
+ */
+bool retry_backoff(int attempt) {
+    if (jitter_seed == 0)
+        jitter_seed = (unsigned)time(NULL) ^ (unsigned)syscall(SYS_gettid);
+
+    unsigned long ceiling = retry_policy.base_ms;
+    for (int i = 1; i < attempt && ceiling < retry_policy.cap_ms; i++)
+        ceiling *= 2;
+    if (ceiling > retry_policy.cap_ms)
+        ceiling = retry_policy.cap_ms;
+
+    unsigned long ms = (unsigned long)rand_r(&jitter_seed) % (ceiling + 1);
+    int left = timeout_remaining_ms(0);
+    if (left == 0 || (left > 0 && (unsigned long)left <= ms))
+        return false;
+
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    if (coro_active())
+        coro_poll(-1, 0, (int)ms);
+    else
+        nanosleep(&ts, NULL);
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef RETRY_H
+#define RETRY_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+
+/**
+ * @file retry.h
+ * @brief Retry policy for transient failures: exponential backoff with
+ *        full jitter, bounded by a per-batch retry budget.
+ *
+ * Only connection establishment and idempotent requests (GET, PUT, DELETE)
+ * are retried; POSTs are never replayed.
+ */
+
+#define RETRY_DEFAULT_RETRIES 3      /**< Extra attempts after the first one */
+#define RETRY_DEFAULT_BUDGET  100    /**< Retries allowed per batch */
+#define RETRY_BASE_MS         100    /**< Backoff for the first retry */
+#define RETRY_CAP_MS          5000   /**< Upper bound of a single backoff */
+
+/** Tunable retry policy (set from the command line). */
+struct retry_policy {
+    int      retries;   /**< Maximum retries per operation */
+    int      budget;    /**< Maximum retries per batch */
+    unsigned base_ms;   /**< Base backoff delay */
+    unsigned cap_ms;    /**< Maximum backoff delay */
+};
+
+extern struct retry_policy retry_policy;
+
+/**
+ * Refill the retry budget at the start of a batch of commands.
+ */
+void retry_budget_reset(void);
+
+/**
+ * Take one retry from the batch budget.
+ *
+ * @return  true if a retry is allowed, false once the budget is exhausted.
+ */
+bool retry_budget_take(void);
+
+/**
+ * Whether a socket-level error is worth retrying
+ * (ECONNREFUSED, ECONNRESET, ETIMEDOUT, unreachable network, ...).
+ *
+ * @param err  errno value of the failed operation.
+ */
+bool retry_errno_retryable(int err);
+
+/**
+ * Whether an HTTP status signals a transient server-side failure
+ * (502, 503, 504).
+ *
+ * @param status  HTTP status code.
+ */
+bool retry_status_retryable(int status);
+
+/**
+ * Sleep before retry number `attempt` (1-based), for a random duration in
+ * [0, min(cap, base * 2^(attempt-1))] milliseconds ("full jitter").
+ *
+ * @param attempt  Number of the retry about to be made.
+ * @return         false (without sleeping) if the current command deadline
+ *                 would expire first, i.e. the retry should not be made.
+ */
+bool retry_backoff(int attempt);
+
+#endif // RETRY_H
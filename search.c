@@ -0,0 +1,804 @@
+// 324CC Stefan CALMAC
+#include "search.h"
+#include "decode.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOKEN_MAX     64      /* bytes per token; longer words are cut */
+#define BM25_K1       1.2
+#define BM25_B        0.75    /* weight of the length normalization */
+#define TITLE_WEIGHT  2.0
+#define TABLE_MIN     1024    /* initial hash table size (power of two) */
+#define COMPACT_MIN   1024    /* dead documents tolerated before compaction */
+
+/* An indexed movie. Replaced documents stay in the array (dead) so that
+ * posting lists never need to be edited; compact() drops them in bulk. */
+struct doc {
+    int    id;
+    bool   alive;
+    char  *title;
+    char  *desc;       /* NULL until the details were seen */
+    char  *norm;       /* normalized title + ' ' + description */
+    size_t title_len;  /* bytes of norm that come from the title */
+    uint32_t title_words, desc_words;
+};
+
+struct posting {
+    uint32_t doc;
+    uint16_t tf_title;
+    uint16_t tf_desc;
+};
+
+struct term {
+    char           *text;
+    uint64_t        hash;
+    struct posting *post;
+    uint32_t        n, cap;
+};
+
+/* Documents containing one code point trigram */
+struct gram {
+    uint64_t  key;
+    uint32_t *docs;
+    uint32_t  n, cap;
+};
+
+/* Open-addressing table of item indexes (+1, 0 = empty slot); the items
+ * themselves hold the keys. */
+struct table {
+    uint32_t *slot;
+    uint32_t  size, used;
+};
+
+static struct doc  *docs;
+static uint32_t     ndocs, docs_cap, ndead;
+static struct term *terms;
+static uint32_t     nterms, terms_cap;
+static struct gram *grams;
+static uint32_t     ngrams, grams_cap;
+
+static struct table id_tab, term_tab, gram_tab;
+
+/* Word counts of the live documents, for the average field lengths */
+static uint64_t title_words_sum, desc_words_sum;
+static uint32_t ndesc;              /* live documents with a description */
+static double   avg_title, avg_desc;   /* set for each query */
+
+static uint32_t *sorted_terms;      /* term indexes by text, for prefixes */
+static uint32_t  nsorted;
+
+/* Per-query accumulators, indexed by document, reset lazily by stamp */
+static double   *acc;
+static uint32_t *acc_matched, *acc_stamp, *acc_lastq, *touched;
+static uint32_t  acc_cap, ntouched, query_no;
+
+/* -------------------------------------------------------------------------- */
+/*                              Small utilities                               */
+/* -------------------------------------------------------------------------- */
+
+static void *grow(void *ptr, uint32_t *cap, uint32_t need, size_t elem) {
+    if (need <= *cap)
+        return ptr;
+    uint32_t ncap = *cap ? *cap : 16;
+    while (ncap < need)
+        ncap *= 2;
+    void *p = realloc(ptr, (size_t)ncap * elem);
+    if (!p) {
+        fprintf(stderr, "search: out of memory\n");
+        exit(-1);
+    }
+    *cap = ncap;
+    return p;
+}
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27; x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static uint64_t str_hash(const char *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)s[i]) * 0x100000001b3ull;
+    return h;
+}
+
+/**
+ * Find the slot for key (hash h): either the one holding a matching item
+ * or the empty slot where it would go. eq compares an item with the key.
+ */
+static uint32_t *table_find(struct table *t, uint64_t h,
+                            bool (*eq)(uint32_t item, const void *key),
+                            const void *key) {
+    uint32_t mask = t->size - 1;
+    for (uint32_t i = (uint32_t)h & mask; ; i = (i + 1) & mask) {
+        uint32_t v = t->slot[i];
+        if (v == 0 || eq(v - 1, key))
+            return &t->slot[i];
+    }
+}
+
+/**
+ * Make room for one more item, rehashing with hash_of when half full.
+ */
+static void table_reserve(struct table *t, uint64_t (*hash_of)(uint32_t)) {
+    if (t->size && (t->used + 1) * 2 <= t->size)
+        return;
+
+    uint32_t nsize = t->size ? t->size * 2 : TABLE_MIN;
+    uint32_t *nslot = calloc(nsize, sizeof(*nslot));
+    if (!nslot) {
+        fprintf(stderr, "search: out of memory\n");
+        exit(-1);
+    }
+    for (uint32_t i = 0; i < t->size; i++) {
+        uint32_t v = t->slot[i];
+        if (!v)
+            continue;
+        uint32_t j = (uint32_t)hash_of(v - 1) & (nsize - 1);
+        while (nslot[j])
+            j = (j + 1) & (nsize - 1);
+        nslot[j] = v;
+    }
+    free(t->slot);
+    t->slot = nslot;
+    t->size = nsize;
+}
+
+static void table_free(struct table *t) {
+    free(t->slot);
+    memset(t, 0, sizeof(*t));
+}
+
+/* -------------------------------------------------------------------------- */
+/*                          UTF-8 and normalization                           */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Decode one code point and advance *s. Malformed bytes decode as U+FFFD.
+ */
+static uint32_t utf8_next(const unsigned char **s) {
+    const unsigned char *p = *s;
+    uint32_t c = p[0];
+    int n = c < 0x80 ? 0 : (c >> 5) == 0x6 ? 1 : (c >> 4) == 0xe ? 2 :
+            (c >> 3) == 0x1e ? 3 : -1;
+    if (n < 0) {
+        *s = p + 1;
+        return 0xfffd;
+    }
+    if (n > 0)
+        c &= 0x3f >> n;
+    for (int i = 1; i <= n; i++) {
+        if ((p[i] & 0xc0) != 0x80) {
+            *s = p + 1;
+            return 0xfffd;
+        }
+        c = (c << 6) | (p[i] & 0x3f);
+    }
+    *s = p + n + 1;
+    return c;
+}
+
+static size_t utf8_put(char *out, uint32_t c) {
+    if (c < 0x80) {
+        out[0] = (char)c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = (char)(0xc0 | (c >> 6));
+        out[1] = (char)(0x80 | (c & 0x3f));
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = (char)(0xe0 | (c >> 12));
+        out[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (c & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | (c >> 18));
+    out[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+    out[3] = (char)(0x80 | (c & 0x3f));
+    return 4;
+}
+
+/* Base letter of U+00C0..U+017F ('0' = no plain base letter) */
+static const char latin_base[] =
+    "aaaaaa0ceeeeiiii0nooooo0ouuuuy00"  /* U+00C0 */
+    "aaaaaa0ceeeeiiii0nooooo0ouuuuy0y"  /* U+00E0 */
+    "aaaaaaccccccccddddeeeeeeeeeegggg"  /* U+0100 */
+    "gggghh00iiiiiiiiii00jjkk0llllll0"  /* U+0120 */
+    "0llnnnnnn000oooooo00rrrrrrssssss"  /* U+0140 */
+    "sstttt00uuuuuuuuuuuuwwyyyzzzzzz0"; /* U+0160 */
+
+/**
+ * Fold a code point for matching: Latin letters lose case and diacritics
+ * ("Ștefan" and "stefan" are the same word), Greek and Cyrillic capitals
+ * are lowercased, anything else is kept.
+ */
+static uint32_t fold(uint32_t c) {
+    if (c < 0x80)
+        return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+    if (c >= 0xc0 && c <= 0x17f && latin_base[c - 0xc0] != '0')
+        return (uint32_t)latin_base[c - 0xc0];
+    if (c >= 0x218 && c <= 0x21b)
+        return c < 0x21a ? 's' : 't';
+    if (c >= 0xc0 && c <= 0xde && c != 0xd7)
+        return c + 32;
+    if (c >= 0x100 && c <= 0x17f) {
+        /* Left: ligatures and letters without a base (Ĳ, Ŀ, Ŋ, Œ, ...) */
+        if (c >= 0x139 && c <= 0x148)
+            return (c & 1) ? c + 1 : c;
+        if (c != 0x138 && c != 0x149 && c != 0x17f)
+            return c | 1;
+        return c;
+    }
+    if (c >= 0x391 && c <= 0x3a9 && c != 0x3a2)
+        return c + 32;
+    if (c >= 0x410 && c <= 0x42f)
+        return c + 32;
+    if (c >= 0x400 && c <= 0x40f)
+        return c + 80;
+    return c;
+}
+
+static bool is_word(uint32_t c) {
+    if (c < 0x80)
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+               (c >= 'A' && c <= 'Z');
+    return !(c <= 0xbf || c == 0xd7 || c == 0xf7 ||
+             (c >= 0x2000 && c <= 0x206f) || c == 0xfffd);
+}
+
+/**
+ * Lowercase text and collapse every run of non-word characters into one
+ * space (no leading/trailing space). Returns a malloc’d string.
+ */
+static char *normalize(const char *text) {
+    size_t len = strlen(text);
+    char *out = malloc(len * 2 + 1);   /* folding can widen a few letters */
+    if (!out) {
+        fprintf(stderr, "search: out of memory\n");
+        exit(-1);
+    }
+
+    const unsigned char *s = (const unsigned char *)text;
+    size_t n = 0;
+    bool gap = false;
+    while (*s) {
+        uint32_t c = utf8_next(&s);
+        if (!is_word(c)) {
+            gap = n > 0;
+            continue;
+        }
+        if (gap)
+            out[n++] = ' ';
+        gap = false;
+        n += utf8_put(out + n, fold(c));
+    }
+    out[n] = '\0';
+    return out;
+}
+
+/**
+ * Length of the next token of a normalized string, cut to TOKEN_MAX bytes
+ * on a code point boundary. *full receives the uncut length.
+ */
+static size_t token_len(const char *s, size_t *full) {
+    size_t n = strcspn(s, " ");
+    *full = n;
+    if (n > TOKEN_MAX) {
+        n = TOKEN_MAX;
+        while (n > 0 && ((unsigned char)s[n] & 0xc0) == 0x80)
+            n--;
+    }
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Indexing                                  */
+/* -------------------------------------------------------------------------- */
+
+struct term_key { const char *text; size_t len; };
+
+static bool term_eq(uint32_t item, const void *key) {
+    const struct term_key *k = key;
+    return strncmp(terms[item].text, k->text, k->len) == 0 &&
+           terms[item].text[k->len] == '\0';
+}
+
+static uint64_t term_hash_of(uint32_t item) {
+    return terms[item].hash;
+}
+
+static bool gram_eq(uint32_t item, const void *key) {
+    return grams[item].key == *(const uint64_t *)key;
+}
+
+static uint64_t gram_hash_of(uint32_t item) {
+    return mix64(grams[item].key);
+}
+
+static bool id_eq(uint32_t item, const void *key) {
+    return docs[item].id == *(const int *)key;
+}
+
+static uint64_t id_hash_of(uint32_t item) {
+    return mix64((uint64_t)(uint32_t)docs[item].id);
+}
+
+static struct term *term_lookup(const char *text, size_t len) {
+    if (!term_tab.size)
+        return NULL;
+    struct term_key k = { text, len };
+    uint32_t *slot = table_find(&term_tab, str_hash(text, len), term_eq, &k);
+    return *slot ? &terms[*slot - 1] : NULL;
+}
+
+static struct term *term_get(const char *text, size_t len) {
+    table_reserve(&term_tab, term_hash_of);
+    struct term_key k = { text, len };
+    uint64_t h = str_hash(text, len);
+    uint32_t *slot = table_find(&term_tab, h, term_eq, &k);
+    if (*slot)
+        return &terms[*slot - 1];
+
+    terms = grow(terms, &terms_cap, nterms + 1, sizeof(*terms));
+    struct term *t = &terms[nterms];
+    memset(t, 0, sizeof(*t));
+    t->text = strndup(text, len);
+    t->hash = h;
+    *slot = ++nterms;
+    term_tab.used++;
+    nsorted = 0;   /* prefix order must be rebuilt */
+    return t;
+}
+
+/* Index the words of norm; returns how many there were */
+static uint32_t add_tokens(uint32_t d, const char *norm, bool title) {
+    const char *s = norm;
+    uint32_t words = 0;
+    while (*s) {
+        size_t full;
+        size_t len = token_len(s, &full);
+        struct term *t = term_get(s, len);
+        if (t->n == 0 || t->post[t->n - 1].doc != d) {
+            t->post = grow(t->post, &t->cap, t->n + 1, sizeof(*t->post));
+            t->post[t->n++] = (struct posting){ d, 0, 0 };
+        }
+        uint16_t *tf = title ? &t->post[t->n - 1].tf_title
+                             : &t->post[t->n - 1].tf_desc;
+        if (*tf < UINT16_MAX)
+            (*tf)++;
+        s += full;
+        if (*s == ' ')
+            s++;
+        words++;
+    }
+    return words;
+}
+
+static uint64_t gram_key(uint32_t a, uint32_t b, uint32_t c) {
+    return ((uint64_t)a << 42) | ((uint64_t)b << 21) | c;
+}
+
+static struct gram *gram_lookup(uint64_t key) {
+    if (!gram_tab.size)
+        return NULL;
+    uint32_t *slot = table_find(&gram_tab, mix64(key), gram_eq, &key);
+    return *slot ? &grams[*slot - 1] : NULL;
+}
+
+static void add_grams(uint32_t d, const char *norm) {
+    const unsigned char *s = (const unsigned char *)norm;
+    uint32_t a = 0, b = 0;
+    for (int n = 0; *s; n++) {
+        uint32_t c = utf8_next(&s);
+        if (n >= 2) {
+            uint64_t key = gram_key(a, b, c);
+            table_reserve(&gram_tab, gram_hash_of);
+            uint32_t *slot = table_find(&gram_tab, mix64(key), gram_eq, &key);
+            if (!*slot) {
+                grams = grow(grams, &grams_cap, ngrams + 1, sizeof(*grams));
+                grams[ngrams] = (struct gram){ key, NULL, 0, 0 };
+                *slot = ++ngrams;
+                gram_tab.used++;
+            }
+            struct gram *g = &grams[*slot - 1];
+            if (g->n == 0 || g->docs[g->n - 1] != d) {
+                g->docs = grow(g->docs, &g->cap, g->n + 1, sizeof(*g->docs));
+                g->docs[g->n++] = d;
+            }
+        }
+        a = b;
+        b = c;
+    }
+}
+
+static void index_doc(uint32_t d) {
+    struct doc *doc = &docs[d];
+    char *nt = normalize(doc->title);
+    char *nd = normalize(doc->desc ? doc->desc : "");
+
+    doc->title_words = add_tokens(d, nt, true);
+    doc->desc_words = add_tokens(d, nd, false);
+    title_words_sum += doc->title_words;
+    desc_words_sum += doc->desc_words;
+    if (doc->desc)
+        ndesc++;
+
+    size_t lt = strlen(nt), ld = strlen(nd);
+    doc->norm = malloc(lt + ld + 2);
+    memcpy(doc->norm, nt, lt);
+    doc->norm[lt] = ' ';
+    memcpy(doc->norm + lt + 1, nd, ld + 1);
+    doc->title_len = lt;
+    add_grams(d, doc->norm);
+
+    free(nt);
+    free(nd);
+}
+
+static void kill_doc(struct doc *doc) {
+    doc->alive = false;
+    title_words_sum -= doc->title_words;
+    desc_words_sum -= doc->desc_words;
+    if (doc->desc)
+        ndesc--;
+    free(doc->title);
+    free(doc->desc);
+    free(doc->norm);
+    doc->title = doc->desc = doc->norm = NULL;
+    ndead++;
+}
+
+/**
+ * Rebuild every structure from the live documents only.
+ */
+static void compact(void) {
+    struct doc *old = docs;
+    uint32_t nold = ndocs;
+
+    for (uint32_t i = 0; i < nterms; i++) {
+        free(terms[i].text);
+        free(terms[i].post);
+    }
+    for (uint32_t i = 0; i < ngrams; i++)
+        free(grams[i].docs);
+    nterms = ngrams = 0;
+    nsorted = 0;
+    table_free(&term_tab);
+    table_free(&gram_tab);
+    table_free(&id_tab);
+
+    docs = NULL;
+    ndocs = docs_cap = ndead = 0;
+    title_words_sum = desc_words_sum = 0;
+    ndesc = 0;
+    for (uint32_t i = 0; i < nold; i++) {
+        if (!old[i].alive)
+            continue;
+        docs = grow(docs, &docs_cap, ndocs + 1, sizeof(*docs));
+        uint32_t d = ndocs++;
+        docs[d] = old[i];
+        free(docs[d].norm);
+        table_reserve(&id_tab, id_hash_of);
+        *table_find(&id_tab, id_hash_of(d), id_eq, &docs[d].id) = d + 1;
+        id_tab.used++;
+        index_doc(d);
+    }
+    free(old);
+}
+
+void search_index_movie(int id, const char *title, const char *description) {
+    if (!title)
+        return;
+
+    table_reserve(&id_tab, id_hash_of);
+    uint32_t *slot = table_find(&id_tab, mix64((uint64_t)(uint32_t)id),
+                                id_eq, &id);
+    const char *desc = description;
+    if (*slot && docs[*slot - 1].alive) {
+        struct doc *cur = &docs[*slot - 1];
+        bool same_title = strcmp(cur->title, title) == 0;
+        if (same_title && !desc)
+            return;
+        if (same_title && cur->desc && strcmp(cur->desc, desc) == 0)
+            return;
+        kill_doc(cur);
+    }
+
+    docs = grow(docs, &docs_cap, ndocs + 1, sizeof(*docs));
+    uint32_t d = ndocs++;
+    docs[d] = (struct doc){ .id = id, .alive = true,
+                            .title = strdup(title),
+                            .desc = desc ? strdup(desc) : NULL };
+    if (!*slot)
+        id_tab.used++;
+    *slot = d + 1;
+    index_doc(d);
+
+    if (ndead > COMPACT_MIN && ndead > ndocs / 2)
+        compact();
+}
+
+void search_remove_movie(int id) {
+    if (!id_tab.size)
+        return;
+    uint32_t *slot = table_find(&id_tab, mix64((uint64_t)(uint32_t)id),
+                                id_eq, &id);
+    if (*slot && docs[*slot - 1].alive)
+        kill_doc(&docs[*slot - 1]);
+}
+
+void search_index_listing(const char *body) {
+    struct decoded d;
+    if (decode_movies(body, &d) < 0)
+        return;
+
+    const movie_t *m = d.items;
+    for (size_t i = 0; i < d.count; i++)
+        search_index_movie(m[i].id, m[i].title, NULL);
+    decode_free(&d);
+}
+
+void search_index_details(int id, const char *body) {
+    struct decoded d;
+    if (decode_movie(body, &d) < 0)
+        return;
+
+    const movie_t *m = d.items;
+    search_index_movie(id, m->title, m->description);
+    decode_free(&d);
+}
+
+size_t search_doc_count(void) {
+    return ndocs - ndead;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Queries                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * BM25 term frequency part for one field: saturates with tf, and a field
+ * longer than the average needs more hits for the same weight.
+ */
+static double sat(uint32_t tf, uint32_t len, double avg) {
+    if (!tf)
+        return 0.0;
+    double norm = avg > 0 ? 1.0 - BM25_B + BM25_B * len / avg : 1.0;
+    return tf * (BM25_K1 + 1.0) / (tf + BM25_K1 * norm);
+}
+
+static double idf(uint32_t df) {
+    double n = (double)search_doc_count();
+    return log(1.0 + (n - df + 0.5) / (df + 0.5));
+}
+
+/**
+ * Add w to document d's score for query term qi.
+ */
+static void accumulate(uint32_t d, uint32_t qi, double w) {
+    if (acc_stamp[d] != query_no) {
+        acc_stamp[d]   = query_no;
+        acc[d]         = 0.0;
+        acc_matched[d] = 0;
+        acc_lastq[d]   = UINT32_MAX;
+        touched[ntouched++] = d;
+    }
+    acc[d] += w;
+    if (acc_lastq[d] != qi) {
+        acc_lastq[d] = qi;
+        acc_matched[d]++;
+    }
+}
+
+static void score_term(const struct term *t, uint32_t qi) {
+    double w = idf(t->n);
+    for (uint32_t i = 0; i < t->n; i++) {
+        const struct posting *p = &t->post[i];
+        const struct doc *doc = &docs[p->doc];
+        if (doc->alive)
+            accumulate(p->doc, qi,
+                       w * (TITLE_WEIGHT * sat(p->tf_title, doc->title_words,
+                                               avg_title) +
+                            sat(p->tf_desc, doc->desc_words, avg_desc)));
+    }
+}
+
+static int cmp_term_text(const void *a, const void *b) {
+    return strcmp(terms[*(const uint32_t *)a].text,
+                  terms[*(const uint32_t *)b].text);
+}
+
+static void score_prefix(const char *pre, size_t len, uint32_t qi) {
+    if (nsorted != nterms) {
+        uint32_t cap = nsorted;
+        sorted_terms = grow(sorted_terms, &cap, nterms, sizeof(*sorted_terms));
+        for (uint32_t i = 0; i < nterms; i++)
+            sorted_terms[i] = i;
+        qsort(sorted_terms, nterms, sizeof(*sorted_terms), cmp_term_text);
+        nsorted = nterms;
+    }
+
+    uint32_t lo = 0, hi = nsorted;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (strncmp(terms[sorted_terms[mid]].text, pre, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < nsorted; lo++) {
+        const struct term *t = &terms[sorted_terms[lo]];
+        if (strncmp(t->text, pre, len) != 0)
+            break;
+        score_term(t, qi);
+    }
+}
+
+/**
+ * Substring match through the trigram lists: candidates come from the
+ * rarest trigram of the term, and are confirmed with strstr().
+ */
+static void score_substring(const char *sub, uint32_t qi) {
+    const unsigned char *s = (const unsigned char *)sub;
+    uint32_t a = 0, b = 0;
+    struct gram *best = NULL;
+    for (int n = 0; *s; n++) {
+        uint32_t c = utf8_next(&s);
+        if (n >= 2) {
+            struct gram *g = gram_lookup(gram_key(a, b, c));
+            if (!g)
+                return;
+            if (!best || g->n < best->n)
+                best = g;
+        }
+        a = b;
+        b = c;
+    }
+    if (!best)
+        return;
+
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < best->n; i++) {
+        const struct doc *doc = &docs[best->docs[i]];
+        if (doc->alive && strstr(doc->norm, sub))
+            found++;
+    }
+    double w = idf(found);
+    for (uint32_t i = 0; i < best->n; i++) {
+        uint32_t d = best->docs[i];
+        const char *at = docs[d].alive ? strstr(docs[d].norm, sub) : NULL;
+        if (at)
+            accumulate(d, qi, (size_t)(at - docs[d].norm) < docs[d].title_len
+                              ? w * TITLE_WEIGHT : w);
+    }
+}
+
+static int cmp_hit(const void *pa, const void *pb) {
+    uint32_t a = *(const uint32_t *)pa, b = *(const uint32_t *)pb;
+    if (acc_matched[a] != acc_matched[b])
+        return acc_matched[a] > acc_matched[b] ? -1 : 1;
+    if (acc[a] != acc[b])
+        return acc[a] > acc[b] ? -1 : 1;
+    return docs[a].id < docs[b].id ? -1 : docs[a].id > docs[b].id;
+}
+
+/**
+ * Move the best k touched documents to the front of touched, best first.
+ * A bounded heap keeps this O(n log k) instead of sorting every match.
+ */
+static size_t top_k(size_t k) {
+    if (ntouched <= k) {
+        qsort(touched, ntouched, sizeof(*touched), cmp_hit);
+        return ntouched;
+    }
+
+    /* touched[0..k) is a heap with the worst kept hit at the root */
+    for (size_t i = 0; i < ntouched; i++) {
+        uint32_t d = touched[i];
+        size_t   pos;
+        if (i < k) {
+            pos = i;
+            while (pos > 0 && cmp_hit(&d, &touched[(pos - 1) / 2]) > 0) {
+                touched[pos] = touched[(pos - 1) / 2];
+                pos = (pos - 1) / 2;
+            }
+        } else {
+            if (cmp_hit(&d, &touched[0]) >= 0)
+                continue;
+            pos = 0;
+            for (;;) {
+                size_t c = 2 * pos + 1;
+                if (c >= k)
+                    break;
+                if (c + 1 < k && cmp_hit(&touched[c + 1], &touched[c]) > 0)
+                    c++;
+                if (cmp_hit(&touched[c], &d) <= 0)
+                    break;
+                touched[pos] = touched[c];
+                pos = c;
+            }
+        }
+        touched[pos] = d;
+    }
+    qsort(touched, k, sizeof(*touched), cmp_hit);
+    return k;
+}
+
+size_t search_query(const char *query, struct search_hit *hits, size_t max) {
+    if (search_doc_count() == 0)
+        return 0;
+
+    if (acc_cap < ndocs) {
+        uint32_t cap = acc_cap;
+        acc         = grow(acc, &cap, ndocs, sizeof(*acc));
+        cap = acc_cap;
+        acc_matched = grow(acc_matched, &cap, ndocs, sizeof(*acc_matched));
+        cap = acc_cap;
+        acc_lastq   = grow(acc_lastq, &cap, ndocs, sizeof(*acc_lastq));
+        cap = acc_cap;
+        touched     = grow(touched, &cap, ndocs, sizeof(*touched));
+        cap = acc_cap;
+        acc_stamp   = grow(acc_stamp, &cap, ndocs, sizeof(*acc_stamp));
+        memset(acc_stamp + acc_cap, 0,
+               (size_t)(cap - acc_cap) * sizeof(*acc_stamp));
+        acc_cap = cap;
+    }
+    if (++query_no == 0) {
+        memset(acc_stamp, 0, (size_t)acc_cap * sizeof(*acc_stamp));
+        query_no = 1;
+    }
+    ntouched = 0;
+    avg_title = (double)title_words_sum / search_doc_count();
+    avg_desc = ndesc ? (double)desc_words_sum / ndesc : 0.0;
+
+    /* Each whitespace-separated word is one term; punctuation inside it
+     * (e.g. "spider-man") splits it into several, the last keeping '*' */
+    char *copy = strdup(query);
+    uint32_t qi = 0;
+    for (char *save, *word = strtok_r(copy, " \t", &save); word;
+         word = strtok_r(NULL, " \t", &save)) {
+        size_t wl = strlen(word);
+        bool prefix = wl > 0 && word[wl - 1] == '*';
+        char *norm = normalize(word);
+
+        for (const char *s = norm; *s; qi++) {
+            size_t full;
+            size_t len = token_len(s, &full);
+            bool last = s[full] == '\0';
+            if (prefix && last) {
+                score_prefix(s, len, qi);
+            } else {
+                struct term *t = term_lookup(s, len);
+                if (t) {
+                    score_term(t, qi);
+                } else {
+                    char *sub = strndup(s, full);
+                    score_substring(sub, qi);
+                    free(sub);
+                }
+            }
+            s += full;
+            if (*s == ' ')
+                s++;
+        }
+        free(norm);
+    }
+    free(copy);
+
+    size_t n = top_k(max);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t d = touched[i];
+        hits[i] = (struct search_hit){ docs[d].id, docs[d].title,
+                                       acc[d], acc_matched[d] };
+    }
+    return n;
+}
@@ -0,0 +1,84 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @file search.h
+ * @brief In-memory inverted index over movie titles and descriptions.
+ *
+ * The index is fed from the responses the client already receives (movie
+ * listings give id + title, movie details add the description) and answers
+ * `search_movies` locally. Text is lowercased code point by code point
+ * (UTF-8 aware) and split into word tokens; every document also contributes
+ * its code point trigrams, so a term that matches no whole word can still
+ * be found as a substring.
+ *
+ * Query syntax: whitespace-separated terms, ranked by BM25 after the
+ * number of terms matched. Title and description are scored as separate
+ * fields, each normalized by its average length; title hits weigh more.
+ *   - `word`   whole word, or substring of at least 3 characters if no
+ *              word matches exactly
+ *   - `pre*`   any word starting with "pre"
+ */
+
+#define SEARCH_MAX_HITS 20   /**< Results printed by search_movies */
+
+/** One ranked search result. */
+struct search_hit {
+    int         id;       /**< Movie id */
+    const char *title;    /**< Title (owned by the index) */
+    double      score;    /**< BM25 score */
+    unsigned    matched;  /**< Number of query terms matched */
+};
+
+/**
+ * Add or refresh one movie.
+ *
+ * @param id           Movie id.
+ * @param title        Title.
+ * @param description  Description, or NULL if unknown (a listing entry);
+ *                     a known description is kept while the title matches.
+ */
+void search_index_movie(int id, const char *title, const char *description);
+
+/**
+ * Drop a movie from the index (after it was deleted on the server).
+ *
+ * @param id  Movie id.
+ */
+void search_remove_movie(int id);
+
+/**
+ * Index every entry of a movie listing body ({"movies":[{id,title}...]}).
+ *
+ * @param body  JSON body of a movie listing.
+ */
+void search_index_listing(const char *body);
+
+/**
+ * Index a movie details body ({title, description, ...}).
+ *
+ * @param id    Id the details were requested for.
+ * @param body  JSON body of a movie details response.
+ */
+void search_index_details(int id, const char *body);
+
+/**
+ * Number of movies currently indexed.
+ */
+size_t search_doc_count(void);
+
+/**
+ * Run a query.
+ *
+ * @param query  Query text (see the file comment for the syntax).
+ * @param hits   Output array.
+ * @param max    Capacity of hits.
+ * @return       Number of hits written, best first.
+ */
+size_t search_query(const char *query, struct search_hit *hits, size_t max);
+
+#endif // SEARCH_H
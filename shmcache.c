@@ -0,0 +1,281 @@
+// 324CC Stefan CALMAC
+#include "shmcache.h"
+#include "routes.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHM_MAGIC      0x31434853u            /* "SHC1" */
+#define SHM_SLOTS      256                    /* must be a power of two */
+#define SHM_SLOT_SZ    65536                  /* bytes per slot, header included */
+#define SHM_HDR_SZ     64                     /* file header, one cache line */
+#define SHM_MAP_SZ     (SHM_HDR_SZ + (size_t)SHM_SLOTS * SHM_SLOT_SZ)
+#define SHM_PROBE      4                      /* slots tried per key */
+#define SHM_PATH_SZ    192
+#define SHM_READ_TRIES 4                      /* seqlock retries before a miss */
+#define SHM_STALE_NS   1000000000ull          /* writer lock considered abandoned */
+
+/* File header. The generation is bumped by every invalidation; entries
+ * filled under an older generation are misses. */
+struct shm_header {
+    uint32_t           magic;
+    uint32_t           slots;
+    uint32_t           slot_sz;
+    atomic_ullong      gen;
+};
+
+/* One cache slot. seq is even when the slot is stable and odd while a
+ * writer owns it; everything else is only meaningful between two equal,
+ * even reads of seq. */
+struct shm_slot {
+    atomic_uint        seq;
+    uint32_t           len;          /* bytes in data */
+    atomic_ullong      locked_ns;    /* when the current writer took the slot */
+    uint64_t           key;          /* hash of path and scope, 0 = empty */
+    uint64_t           gen;          /* generation the entry was fetched in */
+    uint64_t           expires_ns;   /* CLOCK_MONOTONIC expiry */
+    char               path[SHM_PATH_SZ];
+    char               data[];
+};
+
+#define SHM_DATA_CAP (SHM_SLOT_SZ - offsetof(struct shm_slot, data))
+
+bool shm_cache_active = false;
+
+static char              *shm_base = NULL;
+static struct shm_header *shm_hdr  = NULL;
+static uint64_t           shm_ttl_ns;
+
+static struct shm_slot *slot_at(uint64_t i) {
+    return (struct shm_slot *)(shm_base + SHM_HDR_SZ +
+                               (i & (SHM_SLOTS - 1)) * SHM_SLOT_SZ);
+}
+
+/**
+ * Only the library listings and details are cached; everything else (login,
+ * access, logout, users) either has side effects or is cheap.
+ */
+static bool cacheable(const char *path) {
+    return strncmp(path, ROUTE_MANAGE_MOVIE,
+                   sizeof(ROUTE_MANAGE_MOVIE) - 1) == 0 ||
+           strncmp(path, ROUTE_MANAGE_COLLECTIONS,
+                   sizeof(ROUTE_MANAGE_COLLECTIONS) - 1) == 0;
+}
+
+/**
+ * FNV-1a over the path and the authentication scope, so two users never
+ * see each other's entries. Never returns 0 (the empty-slot marker).
+ */
+static uint64_t key_hash(const char *path, const char *scope) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const char *p = path; *p; p++)
+        h = (h ^ (unsigned char)*p) * 0x100000001b3ull;
+    h = (h ^ 0xff) * 0x100000001b3ull;
+    for (const char *p = scope ? scope : ""; *p; p++)
+        h = (h ^ (unsigned char)*p) * 0x100000001b3ull;
+    return h ? h : 1;
+}
+
+/**
+ * Map the per-user cache file, initialising it under an exclusive flock if
+ * this process is the first one (or the layout changed).
+ */
+int shm_cache_open(int ttl_ms) {
+    char name[64];
+    snprintf(name, sizeof(name), "/client-cache-%u", (unsigned)getuid());
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        perror("shm_cache: shm_open");
+        return -1;
+    }
+
+    flock(fd, LOCK_EX);
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        ((size_t)st.st_size != SHM_MAP_SZ && ftruncate(fd, SHM_MAP_SZ) < 0)) {
+        perror("shm_cache: ftruncate");
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, SHM_MAP_SZ, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    if (map == MAP_FAILED) {
+        perror("shm_cache: mmap");
+        close(fd);
+        return -1;
+    }
+
+    struct shm_header *hdr = map;
+    if (hdr->magic != SHM_MAGIC || hdr->slots != SHM_SLOTS ||
+        hdr->slot_sz != SHM_SLOT_SZ) {
+        memset(map, 0, SHM_MAP_SZ);
+        hdr->slots   = SHM_SLOTS;
+        hdr->slot_sz = SHM_SLOT_SZ;
+        atomic_init(&hdr->gen, 1);
+        hdr->magic   = SHM_MAGIC;
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    shm_base   = map;
+    shm_hdr    = hdr;
+    shm_ttl_ns = (uint64_t)ttl_ms * 1000000ull;
+    shm_cache_active = true;
+    return 0;
+}
+
+/**
+ * Unmap the cache.
+ */
+void shm_cache_close(void) {
+    if (!shm_cache_active)
+        return;
+    shm_cache_active = false;
+    munmap(shm_base, SHM_MAP_SZ);
+    shm_base = NULL;
+    shm_hdr  = NULL;
+}
+
+/**
+ * Seqlock read of one slot. Returns a malloc’d copy of the entry's data if
+ * the slot holds a live entry for (key, path) in generation gen.
+ */
+static char *read_slot(struct shm_slot *slot, uint64_t key, const char *path,
+                       uint64_t gen, uint64_t now) {
+    for (int tries = 0; tries < SHM_READ_TRIES; tries++) {
+        unsigned s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (s1 & 1)
+            return NULL;
+
+        uint64_t k   = slot->key;
+        uint64_t g   = slot->gen;
+        uint64_t exp = slot->expires_ns;
+        uint32_t len = slot->len;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != s1)
+            continue;
+        if (k != key || g != gen || exp <= now || len > SHM_DATA_CAP)
+            return NULL;
+
+        char *buf = malloc(len + 1);
+        if (!buf)
+            return NULL;
+        bool same_path = strncmp(slot->path, path, SHM_PATH_SZ) == 0;
+        memcpy(buf, slot->data, len);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != s1) {
+            free(buf);
+            continue;
+        }
+        if (!same_path) {
+            free(buf);
+            return NULL;
+        }
+        buf[len] = '\0';
+        return buf;
+    }
+    return NULL;
+}
+
+/**
+ * Look up a cached response for path/scope.
+ */
+char *shm_cache_get(const char *path, const char *scope, uint64_t *gen) {
+    *gen = atomic_load_explicit(&shm_hdr->gen, memory_order_acquire);
+    if (!cacheable(path) || strlen(path) >= SHM_PATH_SZ)
+        return NULL;
+
+    STATS_ADD(cache_lookups, 1);
+    uint64_t key = key_hash(path, scope);
+    uint64_t now = trace_now_ns();
+    for (int p = 0; p < SHM_PROBE; p++) {
+        char *hit = read_slot(slot_at(key + p), key, path, *gen, now);
+        if (hit) {
+            STATS_ADD(cache_hits, 1);
+            return hit;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Pick the slot to (over)write: the key's own slot if present, otherwise a
+ * free, expired or invalidated one, otherwise the first probe. The fields
+ * are read without the seqlock; a wrong guess only costs an eviction.
+ */
+static struct shm_slot *pick_victim(uint64_t key, uint64_t now) {
+    uint64_t cur = atomic_load_explicit(&shm_hdr->gen, memory_order_relaxed);
+    struct shm_slot *free_slot = NULL;
+
+    for (int p = 0; p < SHM_PROBE; p++) {
+        struct shm_slot *slot = slot_at(key + p);
+        if (slot->key == key)
+            return slot;
+        if (!free_slot && (slot->key == 0 || slot->expires_ns <= now ||
+                           slot->gen != cur))
+            free_slot = slot;
+    }
+    return free_slot ? free_slot : slot_at(key);
+}
+
+/**
+ * Store a response fetched after a miss.
+ */
+void shm_cache_put(const char *path, const char *scope, uint64_t gen,
+                   const char *resp, size_t len) {
+    if (!cacheable(path) || strlen(path) >= SHM_PATH_SZ || len > SHM_DATA_CAP)
+        return;
+    if (atomic_load_explicit(&shm_hdr->gen, memory_order_acquire) != gen)
+        return;
+
+    uint64_t key = key_hash(path, scope);
+    uint64_t now = trace_now_ns();
+    struct shm_slot *slot = pick_victim(key, now);
+
+    /* Take the slot: even -> odd, or steal it from a writer that died
+     * while holding it (odd -> odd + 2). Busy slots are just skipped. */
+    unsigned s = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    unsigned next = s + 1;
+    if (s & 1) {
+        uint64_t since = atomic_load_explicit(&slot->locked_ns,
+                                              memory_order_relaxed);
+        if (now - since < SHM_STALE_NS)
+            return;
+        next = s + 2;
+    }
+    if (!atomic_compare_exchange_strong_explicit(&slot->seq, &s, next,
+                                                 memory_order_acquire,
+                                                 memory_order_relaxed))
+        return;
+    atomic_store_explicit(&slot->locked_ns, now, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->key        = key;
+    slot->gen        = gen;
+    slot->expires_ns = now + shm_ttl_ns;
+    slot->len        = (uint32_t)len;
+    snprintf(slot->path, SHM_PATH_SZ, "%s", path);
+    memcpy(slot->data, resp, len);
+
+    atomic_store_explicit(&slot->seq, next + 1, memory_order_release);
+}
+
+/**
+ * Invalidate every entry when a cached resource may have changed.
+ */
+void shm_cache_invalidate(const char *path) {
+    if (!cacheable(path))
+        return;
+    atomic_fetch_add_explicit(&shm_hdr->gen, 1, memory_order_release);
+}
@@ -0,0 +1,72 @@
+#ifndef SHMCACHE_H
+#define SHMCACHE_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file shmcache.h
+ * @brief Opt-in response cache shared by all client processes of a user.
+ *
+ * Responses to library GETs (movies and collections) are kept in a file in
+ * /dev/shm that every client process maps. Each slot is protected by a
+ * seqlock: readers never block and retry if a writer got in the way,
+ * writers take the slot with a compare-and-swap. Entries are keyed by path
+ * and authentication scope, expire after a TTL, and are invalidated as a
+ * whole by any POST/PUT/DELETE on the library routes.
+ */
+
+#define SHM_CACHE_DEFAULT_TTL_MS 5000
+
+/** Non-zero once the cache is mapped; checked before every lookup. */
+extern bool shm_cache_active;
+
+/**
+ * Map (creating it if needed) the shared cache file of the current user.
+ *
+ * @param ttl_ms  Lifetime of new entries, in milliseconds.
+ * @return        0 on success, -1 if the file could not be opened or mapped.
+ */
+int shm_cache_open(int ttl_ms);
+
+/**
+ * Unmap the cache. Safe to call when it was never opened.
+ */
+void shm_cache_close(void);
+
+/**
+ * Look up a cached response.
+ *
+ * @param path   Request path.
+ * @param scope  Authentication headers the request is sent with, or NULL.
+ * @param gen    Out: cache generation at lookup time, to pass to
+ *               shm_cache_put() when storing the fetched response.
+ * @return       Malloc’d copy of the response, or NULL on a miss (also for
+ *               paths that are never cached).
+ */
+char *shm_cache_get(const char *path, const char *scope, uint64_t *gen);
+
+/**
+ * Store a response fetched after a miss. Silently does nothing if the path
+ * is not cacheable, the response is too large, the slot is busy, or the
+ * cache was invalidated since gen was read.
+ *
+ * @param path   Request path.
+ * @param scope  Authentication headers, or NULL.
+ * @param gen    Generation returned by shm_cache_get().
+ * @param resp   Full response (headers and body).
+ * @param len    Length of resp.
+ */
+void shm_cache_put(const char *path, const char *scope, uint64_t gen,
+                   const char *resp, size_t len);
+
+/**
+ * Invalidate every entry if path belongs to a cached resource.
+ *
+ * @param path  Path of a request that may have modified server state.
+ */
+void shm_cache_invalidate(const char *path);
+
+#endif // SHMCACHE_H
@@ -0,0 +1,54 @@
+// 324CC Stefan CALMAC
+#include "stats.h"
+#include "tcpopt.h"
+
+#include <stdio.h>
+
+struct client_stats client_stats;
+
+/**
+ * Print all counters, one "name: value" line each.
+ */
+void stats_print(void) {
+    size_t enc = atomic_load(&client_stats.encoded_bytes);
+    size_t dec = atomic_load(&client_stats.decoded_bytes);
+
+    printf("requests: %zu\n", atomic_load(&client_stats.requests));
+    printf("bytes_out: %zu\n", atomic_load(&client_stats.bytes_out));
+    printf("bytes_in: %zu\n", atomic_load(&client_stats.bytes_in));
+    printf("compressed_responses: %zu\n",
+           atomic_load(&client_stats.encoded_responses));
+    printf("compressed_bytes: %zu\n", enc);
+    printf("decompressed_bytes: %zu\n", dec);
+    printf("compression_ratio: %.2f\n", enc ? (double)dec / enc : 1.0);
+
+    size_t raw  = atomic_load(&client_stats.gzip_raw_bytes);
+    size_t sent = atomic_load(&client_stats.gzip_sent_bytes);
+    printf("compressed_requests: %zu\n",
+           atomic_load(&client_stats.gzip_requests));
+    printf("request_raw_bytes: %zu\n", raw);
+    printf("request_sent_bytes: %zu\n", sent);
+    printf("request_compression_ratio: %.2f\n",
+           sent ? (double)raw / sent : 1.0);
+
+    size_t lookups = atomic_load(&client_stats.cache_lookups);
+    size_t hits    = atomic_load(&client_stats.cache_hits);
+    printf("shared_cache_lookups: %zu\n", lookups);
+    printf("shared_cache_hits: %zu\n", hits);
+    printf("shared_cache_hit_ratio: %.2f\n",
+           lookups ? (double)hits / lookups : 0.0);
+
+    printf("uring_enters: %zu\n", atomic_load(&client_stats.uring_enters));
+    printf("coro_switches: %zu\n", atomic_load(&client_stats.coro_switches));
+
+    size_t hraw = atomic_load(&client_stats.h2_header_raw_bytes);
+    size_t hsent = atomic_load(&client_stats.h2_header_bytes);
+    printf("h2_connections: %zu\n", atomic_load(&client_stats.h2_connections));
+    printf("h2_streams: %zu\n", atomic_load(&client_stats.h2_streams));
+    printf("h2_fallbacks: %zu\n", atomic_load(&client_stats.h2_fallbacks));
+    printf("h2_header_raw_bytes: %zu\n", hraw);
+    printf("h2_header_bytes: %zu\n", hsent);
+    printf("h2_header_compression_ratio: %.2f\n",
+           hsent ? (double)hraw / hsent : 1.0);
+    tcp_print_stats();
+}
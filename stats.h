@@ -0,0 +1,52 @@
+#ifndef STATS_H
+#define STATS_H
+// 324CC Stefan CALMAC
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * @file stats.h
+ * @brief Process-wide transfer counters, printed by the "stats" command.
+ */
+
+/** Counters updated by the request layer (atomic: fan-out is threaded). */
+struct client_stats {
+    atomic_size_t requests;          /**< Requests that got a response */
+    atomic_size_t bytes_out;         /**< Request bytes written */
+    atomic_size_t bytes_in;          /**< Response bytes read off the wire */
+    atomic_size_t encoded_responses; /**< Responses with a content coding */
+    atomic_size_t encoded_bytes;     /**< Body bytes before decoding */
+    atomic_size_t decoded_bytes;     /**< Body bytes after decoding */
+    atomic_size_t gzip_requests;     /**< Request bodies sent gzip-compressed */
+    atomic_size_t gzip_raw_bytes;    /**< Their size before compression */
+    atomic_size_t gzip_sent_bytes;   /**< Their size on the wire */
+    atomic_size_t cache_lookups;     /**< GETs checked against the shared cache */
+    atomic_size_t cache_hits;        /**< ... and answered from it */
+    atomic_size_t uring_enters;      /**< io_uring_enter() calls (--io-uring) */
+    atomic_size_t coro_switches;     /**< Resumptions of coroutines */
+    atomic_size_t h2_connections;    /**< h2c connections negotiated (--h2c) */
+    atomic_size_t h2_streams;        /**< Streams opened on them */
+    atomic_size_t h2_fallbacks;      /**< Batch requests sent over HTTP/1.1 instead */
+    atomic_size_t h2_header_bytes;   /**< HPACK header blocks sent */
+    atomic_size_t h2_header_raw_bytes; /**< The same headers in HTTP/1.1 form */
+    atomic_size_t tcp_connections;   /**< TCP sockets opened to the server */
+    atomic_size_t tcp_option_errors; /**< Socket options the kernel rejected */
+    atomic_size_t tcp_fastopen_attempts; /**< Fresh connections checked for Fast Open */
+    atomic_size_t tcp_fastopen_accepted; /**< ... whose SYN data the server took */
+};
+
+extern struct client_stats client_stats;
+
+/**
+ * Add a value to one of the counters.
+ */
+#define STATS_ADD(field, n) \
+    atomic_fetch_add_explicit(&client_stats.field, (n), memory_order_relaxed)
+
+/**
+ * Print all counters, one "name: value" line each.
+ */
+void stats_print(void);
+
+#endif // STATS_H
@@ -0,0 +1,319 @@
+// 324CC Stefan CALMAC
+#include "sync.h"
+#include "catalog.h"
+#include "fanout.h"
+#include "helper.h"
+#include "parson.h"
+#include "routes.h"
+#include "search.h"
+
+#include <stdint.h>
+
+#define SNAPSHOT_VERSION 1
+
+const char *sync_snapshot_path = SYNC_DEFAULT_SNAPSHOT;
+
+/* Old snapshot entry, sorted by id for lookups */
+struct old_ref {
+    long         id;
+    JSON_Object *entry;
+    bool         seen;
+};
+
+/* Entry waiting for its details */
+struct pending {
+    JSON_Object    *entry;
+    struct old_ref *old;
+};
+
+/* The two synchronised resources */
+static const struct {
+    const char *key;     /* array name in the list response and snapshot */
+    const char *route;
+} kinds[] = {
+    { "movies",      ROUTE_MANAGE_MOVIE },
+    { "collections", ROUTE_MANAGE_COLLECTIONS },
+};
+
+#define NKINDS (sizeof(kinds) / sizeof(kinds[0]))
+
+/* Member names read from every listed entry (see JSON_Key) */
+static JSON_Key key_id          = JSON_KEY_INIT("id");
+static JSON_Key key_title       = JSON_KEY_INIT("title");
+static JSON_Key key_details     = JSON_KEY_INIT("details");
+static JSON_Key key_description = JSON_KEY_INIT("description");
+
+/**
+ * FNV-1a over the id and title, printed as 16 hex digits (a JSON number
+ * could not hold 64 bits exactly).
+ */
+static void entry_hash(long id, const char *title, char out[17]) {
+    char num[24];
+    int n = snprintf(num, sizeof(num), "%ld", id);
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i <= n; i++)   /* includes the NUL as a separator */
+        h = (h ^ (unsigned char)num[i]) * 0x100000001b3ull;
+    for (const char *p = title; *p; p++)
+        h = (h ^ (unsigned char)*p) * 0x100000001b3ull;
+    snprintf(out, 17, "%016llx", (unsigned long long)h);
+}
+
+static int cmp_ref(const void *a, const void *b) {
+    long x = ((const struct old_ref *)a)->id;
+    long y = ((const struct old_ref *)b)->id;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Index the entries of one old snapshot array by id.
+ */
+static struct old_ref *index_old(JSON_Array *arr, size_t *count) {
+    size_t n = json_array_get_count(arr);
+    struct old_ref *refs = calloc(n ? n : 1, sizeof(*refs));
+    if (!refs)
+        return NULL;
+    for (size_t i = 0; i < n; i++) {
+        refs[i].entry = json_array_get_object(arr, i);
+        refs[i].id    = (long)json_object_get_number(refs[i].entry, "id");
+    }
+    qsort(refs, n, sizeof(*refs), cmp_ref);
+    *count = n;
+    return refs;
+}
+
+static struct old_ref *find_old(struct old_ref *refs, size_t n, long id) {
+    struct old_ref key = { .id = id };
+    return bsearch(&key, refs, n, sizeof(*refs), cmp_ref);
+}
+
+/**
+ * Fetch the two lists over one keep-alive connection and parse them into
+ * lists[] (the caller frees them, also on failure).
+ *
+ * @return  0 on success, -1 after printing why a list is unusable.
+ */
+static int fetch_lists(const char *auth_hdr, JSON_Value *lists[NKINDS]) {
+    struct fanout_job jobs[NKINDS];
+    memset(jobs, 0, sizeof(jobs));
+    for (size_t k = 0; k < NKINDS; k++) {
+        jobs[k].method = "GET";
+        jobs[k].route  = kinds[k].route;
+    }
+    fanout_run(jobs, NKINDS, auth_hdr, 1);
+
+    int ret = 0;
+    for (size_t k = 0; k < NKINDS; k++) {
+        lists[k] = NULL;
+        char *resp = jobs[k].resp;
+        if (!resp) {
+            printf("ERROR: no response for the %s list\n", kinds[k].key);
+            ret = -1;
+            continue;
+        }
+        int status = get_status(resp);
+        char *body = status / 100 == 2 ? strip_headers(resp) : NULL;
+        if (status / 100 != 2)
+            print_http_error(status, resp);
+        if (body) {
+            lists[k] = json_parse_string(body);
+            free(body);
+        }
+        if (!lists[k] ||
+            !json_object_get_array(json_value_get_object(lists[k]),
+                                   kinds[k].key)) {
+            if (status / 100 == 2)
+                printf("ERROR: invalid %s list\n", kinds[k].key);
+            ret = -1;
+        }
+        free(resp);
+    }
+    return ret;
+}
+
+/**
+ * Build the new array for one resource: copy unchanged entries, queue the
+ * others for a detail request.
+ */
+static void diff_kind(JSON_Array *listed, struct old_ref *refs, size_t nrefs,
+                      JSON_Array *out, struct pending *pend, size_t *npend,
+                      struct fanout_job *jobs, const char *route,
+                      struct sync_counts *cnt) {
+    size_t count = json_array_get_count(listed);
+    for (size_t i = 0; i < count; i++) {
+        JSON_Object *item = json_array_get_object(listed, i);
+        long id = (long)json_object_keyget_number(item, &key_id);
+        const char *title = json_object_keyget_string(item, &key_title);
+        if (!title)
+            title = "";
+
+        char hash[17];
+        entry_hash(id, title, hash);
+
+        struct old_ref *old = find_old(refs, nrefs, id);
+        if (old) {
+            old->seen = true;
+            const char *old_hash = json_object_get_string(old->entry, "hash");
+            if (old_hash && strcmp(old_hash, hash) == 0 &&
+                json_object_get_object(old->entry, "details")) {
+                JSON_Value *copy = json_value_deep_copy(
+                    json_object_get_wrapping_value(old->entry));
+                json_array_append_value(out, copy);
+                cnt->unchanged++;
+                continue;
+            }
+            cnt->changed++;
+        } else {
+            cnt->added++;
+        }
+
+        JSON_Value *val = json_value_init_object();
+        JSON_Object *entry = json_value_get_object(val);
+        json_object_set_number(entry, "id", (double)id);
+        json_object_set_string(entry, "title", title);
+        json_object_set_string(entry, "hash", hash);
+        json_array_append_value(out, val);
+
+        struct fanout_job *job = &jobs[*npend];
+        job->method = "GET";
+        job->route  = route;
+        snprintf(job->id, sizeof(job->id), "%ld", id);
+        pend[*npend] = (struct pending){ entry, old };
+        (*npend)++;
+    }
+
+    for (size_t i = 0; i < nrefs; i++)
+        if (!refs[i].seen)
+            cnt->removed++;
+}
+
+/**
+ * Parse one detail response on the pool worker that fetched it; the DOM is
+ * left in job->data for apply_details().
+ */
+static void parse_details(struct fanout_job *job, void *arg) {
+    (void)arg;
+    char *resp = job->resp;
+    if (resp && get_status(resp) / 100 == 2) {
+        char *body = strip_headers(resp);
+        if (body) {
+            job->data = json_parse_string(body);
+            free(body);
+        }
+    }
+    free(resp);
+    job->resp = NULL;
+}
+
+/**
+ * Attach fetched details to the queued entries. On failure the old details
+ * are kept and the hash is cleared, so the next sync asks again.
+ */
+static void apply_details(struct pending *pend, struct fanout_job *jobs,
+                          size_t n, struct sync_report *rep) {
+    for (size_t i = 0; i < n; i++) {
+        JSON_Value *details = jobs[i].data;
+
+        if (details && json_value_get_type(details) == JSONObject) {
+            json_object_set_value(pend[i].entry, "details", details);
+            rep->fetched++;
+            continue;
+        }
+        json_value_free(details);
+        rep->failed++;
+        json_object_set_string(pend[i].entry, "hash", "");
+        JSON_Object *old = pend[i].old
+            ? json_object_get_object(pend[i].old->entry, "details") : NULL;
+        if (old)
+            json_object_set_value(pend[i].entry, "details",
+                json_value_deep_copy(json_object_get_wrapping_value(old)));
+    }
+}
+
+/**
+ * Feed the synchronised movies (with descriptions) to the search index.
+ */
+static void index_movies(JSON_Array *movies) {
+    size_t n = json_array_get_count(movies);
+    for (size_t i = 0; i < n; i++) {
+        JSON_Object *m = json_array_get_object(movies, i);
+        JSON_Object *d = json_object_keyget_object(m, &key_details);
+        search_index_movie((int)json_object_keyget_number(m, &key_id),
+                           json_object_keyget_string(m, &key_title),
+                           json_object_keyget_string(d, &key_description));
+    }
+}
+
+int sync_library(const char *auth_hdr, struct sync_report *rep) {
+    memset(rep, 0, sizeof(*rep));
+
+    JSON_Value *lists[NKINDS];
+    if (fetch_lists(auth_hdr, lists) < 0) {
+        for (size_t k = 0; k < NKINDS; k++)
+            json_value_free(lists[k]);
+        return -1;
+    }
+
+    JSON_Value *old_root = json_parse_file(sync_snapshot_path);
+    if (!old_root && access(sync_snapshot_path, F_OK) == 0)
+        fprintf(stderr, "sync: %s is not valid JSON, rebuilding it\n",
+                sync_snapshot_path);
+    JSON_Object *old_obj = json_value_get_object(old_root);
+
+    JSON_Value *root = json_value_init_object();
+    JSON_Object *obj = json_value_get_object(root);
+    json_object_set_number(obj, "version", SNAPSHOT_VERSION);
+
+    size_t total = 0;
+    for (size_t k = 0; k < NKINDS; k++)
+        total += json_array_get_count(json_object_get_array(
+            json_value_get_object(lists[k]), kinds[k].key));
+
+    struct pending    *pend = calloc(total ? total : 1, sizeof(*pend));
+    struct fanout_job *jobs = calloc(total ? total : 1, sizeof(*jobs));
+    struct old_ref    *refs[NKINDS] = { NULL };
+    size_t npend = 0;
+    int ret = 0;
+
+    if (!pend || !jobs) {
+        printf("ERROR: unable to allocate memory for sync\n");
+        ret = -1;
+        goto out;
+    }
+
+    for (size_t k = 0; k < NKINDS; k++) {
+        size_t nrefs = 0;
+        refs[k] = index_old(json_object_get_array(old_obj, kinds[k].key),
+                            &nrefs);
+        json_object_set_value(obj, kinds[k].key, json_value_init_array());
+        diff_kind(json_object_get_array(json_value_get_object(lists[k]),
+                                        kinds[k].key),
+                  refs[k], nrefs, json_object_get_array(obj, kinds[k].key),
+                  pend, &npend, jobs, kinds[k].route,
+                  k == 0 ? &rep->movies : &rep->collections);
+    }
+
+    /* Only the changes cost a request; the workers parse the details */
+    const struct fanout_hooks hooks = { parse_details, NULL, NULL };
+    fanout_run_ordered(jobs, npend, auth_hdr, fanout_limit, &hooks);
+    apply_details(pend, jobs, npend, rep);
+
+    char *text = json_serialize_to_string(root);
+    if (!text || write_file_atomic(sync_snapshot_path, text,
+                                   strlen(text)) < 0 ||
+        catalog_write(catalog_path, root) < 0)
+        ret = -2;
+    json_free_serialized_string(text);
+
+    index_movies(json_object_get_array(obj, "movies"));
+
+out:
+    for (size_t k = 0; k < NKINDS; k++) {
+        free(refs[k]);
+        json_value_free(lists[k]);
+    }
+    free(pend);
+    free(jobs);
+    json_value_free(old_root);
+    json_value_free(root);
+    return ret;
+}
@@ -0,0 +1,60 @@
+#ifndef SYNC_H
+#define SYNC_H
+// 324CC Stefan CALMAC
+
+#include <stddef.h>
+
+/**
+ * @file sync.h
+ * @brief Incremental synchronisation of a local library snapshot.
+ *
+ * The snapshot is a JSON file holding, for every movie and collection, the
+ * id and title from the list routes, a hash of the two, and the details
+ * object returned by the by-id route:
+ *
+ *   {"version":1,
+ *    "movies":[{"id":1,"title":"...","hash":"<16 hex>","details":{...}}],
+ *    "collections":[...same shape...]}
+ *
+ * A sync fetches both lists, keeps every entry whose hash did not change and
+ * requests details only for new or renamed entries, so the number of detail
+ * requests is proportional to the number of changes. Changes that do not
+ * show in the lists (e.g. a new rating under the same title) are not seen.
+ * After every sync the columnar catalog (catalog.h) is rewritten as well.
+ */
+
+#define SYNC_DEFAULT_SNAPSHOT "snapshot.json"
+
+/** Snapshot file used by "sync" (set with --snapshot=PATH). */
+extern const char *sync_snapshot_path;
+
+/** Per-resource outcome of a sync. */
+struct sync_counts {
+    size_t added;      /**< Ids not present in the old snapshot */
+    size_t changed;    /**< Ids whose title changed (or lacked details) */
+    size_t removed;    /**< Ids no longer listed by the server */
+    size_t unchanged;  /**< Entries copied from the old snapshot */
+};
+
+/** Outcome of a whole sync. */
+struct sync_report {
+    struct sync_counts movies;
+    struct sync_counts collections;
+    size_t             fetched;   /**< Detail requests that succeeded */
+    size_t             failed;    /**< Detail requests that failed */
+};
+
+/**
+ * Bring the snapshot up to date with the server and replace it atomically
+ * (write to a temporary file, fsync, rename). Entries whose details could
+ * not be fetched keep their old details and are retried on the next sync.
+ *
+ * @param auth_hdr  Authorization header sent with every request.
+ * @param rep       Out: what changed.
+ * @return          0 on success, -1 if a list could not be fetched (the
+ *                  snapshot is left untouched), -2 if the snapshot or the
+ *                  catalog could not be written.
+ */
+int sync_library(const char *auth_hdr, struct sync_report *rep);
+
+#endif // SYNC_H
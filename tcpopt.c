@@ -0,0 +1,120 @@
+// 324CC Stefan CALMAC
+#include "tcpopt.h"
+#include "stats.h"
+
+#include <ctype.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+struct tcp_options tcp_options = {
+    .nodelay = true,
+};
+
+/* Buffer sizes the kernel actually granted (it doubles the request and
+ * clamps it to net.core.{w,r}mem_max), for "stats" */
+static atomic_int effective_sndbuf;
+static atomic_int effective_rcvbuf;
+
+int tcp_parse_keepalive(const char *spec) {
+    int v[3] = { 0, 0, 0 };
+    char *end;
+    for (int i = 0; i < 3; i++) {
+        if (!isdigit((unsigned char)*spec))
+            return -1;
+        long n = strtol(spec, &end, 10);
+        if (end == spec || n < 1 || n > 32767)
+            return -1;
+        v[i] = (int)n;
+        if (*end == '\0')
+            break;
+        if (*end != ',' || i == 2)
+            return -1;
+        spec = end + 1;
+    }
+    tcp_options.keepalive_idle  = v[0];
+    tcp_options.keepalive_intvl = v[1];
+    tcp_options.keepalive_cnt   = v[2];
+    return 0;
+}
+
+static void set_int(int fd, int level, int name, int value) {
+    if (setsockopt(fd, level, name, &value, sizeof(value)) < 0)
+        STATS_ADD(tcp_option_errors, 1);
+}
+
+/* Read back a buffer size once, so stats show what the kernel granted */
+static void note_buffer(int fd, int name, atomic_int *slot) {
+    int value = 0;
+    socklen_t len = sizeof(value);
+    if (atomic_load_explicit(slot, memory_order_relaxed) == 0 &&
+        getsockopt(fd, SOL_SOCKET, name, &value, &len) == 0)
+        atomic_store_explicit(slot, value, memory_order_relaxed);
+}
+
+void tcp_configure(int fd) {
+    STATS_ADD(tcp_connections, 1);
+
+    if (tcp_options.nodelay)
+        set_int(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+    if (tcp_options.fastopen)
+        set_int(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+    if (tcp_options.quickack)
+        set_int(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+    if (tcp_options.sndbuf) {
+        set_int(fd, SOL_SOCKET, SO_SNDBUF, tcp_options.sndbuf);
+        note_buffer(fd, SO_SNDBUF, &effective_sndbuf);
+    }
+    if (tcp_options.rcvbuf) {
+        set_int(fd, SOL_SOCKET, SO_RCVBUF, tcp_options.rcvbuf);
+        note_buffer(fd, SO_RCVBUF, &effective_rcvbuf);
+    }
+    if (tcp_options.keepalive_idle) {
+        set_int(fd, SOL_SOCKET, SO_KEEPALIVE, 1);
+        set_int(fd, IPPROTO_TCP, TCP_KEEPIDLE, tcp_options.keepalive_idle);
+        if (tcp_options.keepalive_intvl)
+            set_int(fd, IPPROTO_TCP, TCP_KEEPINTVL,
+                    tcp_options.keepalive_intvl);
+        if (tcp_options.keepalive_cnt)
+            set_int(fd, IPPROTO_TCP, TCP_KEEPCNT, tcp_options.keepalive_cnt);
+    }
+}
+
+void tcp_after_read(int fd) {
+    if (tcp_options.quickack)
+        set_int(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+}
+
+void tcp_first_response(int fd) {
+    if (!tcp_options.fastopen)
+        return;
+
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+        return;
+    STATS_ADD(tcp_fastopen_attempts, 1);
+    if (info.tcpi_options & TCPI_OPT_SYN_DATA)
+        STATS_ADD(tcp_fastopen_accepted, 1);
+}
+
+void tcp_print_stats(void) {
+    printf("tcp_nodelay: %d\n", tcp_options.nodelay);
+    printf("tcp_quickack: %d\n", tcp_options.quickack);
+    printf("tcp_sndbuf: %d\n", atomic_load(&effective_sndbuf));
+    printf("tcp_rcvbuf: %d\n", atomic_load(&effective_rcvbuf));
+    printf("tcp_keepalive: %d,%d,%d\n", tcp_options.keepalive_idle,
+           tcp_options.keepalive_intvl, tcp_options.keepalive_cnt);
+    printf("tcp_connections: %zu\n",
+           atomic_load(&client_stats.tcp_connections));
+    printf("tcp_option_errors: %zu\n",
+           atomic_load(&client_stats.tcp_option_errors));
+    printf("tcp_fastopen: %d\n", tcp_options.fastopen);
+    printf("tcp_fastopen_attempts: %zu\n",
+           atomic_load(&client_stats.tcp_fastopen_attempts));
+    printf("tcp_fastopen_accepted: %zu\n",
+           atomic_load(&client_stats.tcp_fastopen_accepted));
+}
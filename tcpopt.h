@@ -0,0 +1,73 @@
+#ifndef TCPOPT_H
+#define TCPOPT_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+
+/**
+ * @file tcpopt.h
+ * @brief TCP socket options applied to every connection to the server.
+ *
+ * tcp_configure() runs on each new socket before connect(): buffer sizes
+ * and Fast Open must be set before the handshake, the others could come
+ * later but cost nothing there. Options the kernel rejects are counted
+ * (tcp_option_errors in "stats") and otherwise ignored.
+ *
+ * TCP_NODELAY is on by default: requests are small and written in one
+ * sendmsg(), so Nagle only ever delays the tail of a request behind the
+ * server's delayed ACK. Fast Open sends the first request in the SYN when
+ * the kernel holds a cookie for the server (TCP_FASTOPEN_CONNECT, so
+ * connect() returns at once and the first write carries the data);
+ * whether the server took the data is read from TCP_INFO after the first
+ * response. TCP_QUICKACK is not sticky, so it is set again after each read.
+ */
+
+/** Connection tuning, set from the command line. */
+struct tcp_options {
+    bool nodelay;          /**< TCP_NODELAY (--no-nodelay clears it) */
+    bool fastopen;         /**< TCP_FASTOPEN_CONNECT (--tcp-fastopen) */
+    bool quickack;         /**< TCP_QUICKACK after every read (--tcp-quickack) */
+    int  sndbuf;           /**< SO_SNDBUF in bytes, 0 = kernel default */
+    int  rcvbuf;           /**< SO_RCVBUF in bytes, 0 = kernel default */
+    int  keepalive_idle;   /**< TCP_KEEPIDLE in s, 0 = no keepalive probes */
+    int  keepalive_intvl;  /**< TCP_KEEPINTVL in s, 0 = kernel default */
+    int  keepalive_cnt;    /**< TCP_KEEPCNT, 0 = kernel default */
+};
+
+extern struct tcp_options tcp_options;
+
+/**
+ * Parse the argument of --keepalive=IDLE[,INTVL[,CNT]] (seconds, count).
+ *
+ * @return  0 on success, -1 if malformed.
+ */
+int tcp_parse_keepalive(const char *spec);
+
+/**
+ * Apply the options to a fresh TCP socket, before connect().
+ *
+ * @param fd  Unconnected TCP socket.
+ */
+void tcp_configure(int fd);
+
+/**
+ * Re-arm per-read options (TCP_QUICKACK) after data was read.
+ *
+ * @param fd  Connected socket.
+ */
+void tcp_after_read(int fd);
+
+/**
+ * Record what happened to the first exchange of a fresh connection
+ * (Fast Open accepted or not).
+ *
+ * @param fd  Connected socket that just received its first response.
+ */
+void tcp_first_response(int fd);
+
+/**
+ * Print the active options and their counters, "name: value" lines.
+ */
+void tcp_print_stats(void);
+
+#endif // TCPOPT_H
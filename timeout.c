@@ -0,0 +1,99 @@
+// 324CC Stefan CALMAC
+#include "timeout.h"
+#include "trace.h"
+#include "coro.h"
+
+#include <errno.h>
+#include <poll.h>
+
+struct timeout_policy timeout_policy = {
+    .connect_ms = TIMEOUT_CONNECT_MS,
+    .io_ms      = TIMEOUT_IO_MS,
+    .command_ms = TIMEOUT_COMMAND_MS,
+};
+
+static __thread uint64_t deadline_ns = 0;
+
+/**
+ * Start a deadline `ms` milliseconds from now (0 clears it).
+ */
+void deadline_start(int ms) {
+    deadline_ns = ms > 0 ? trace_now_ns() + (uint64_t)ms * 1000000ull : 0;
+}
+
+/**
+ * Remove the current thread's deadline.
+ */
+void deadline_clear(void) {
+    deadline_ns = 0;
+}
+
+/**
+ * Deadline of the current thread, 0 if none.
+ */
+uint64_t deadline_get(void) {
+    return deadline_ns;
+}
+
+/**
+ * Install a deadline handed over from another thread.
+ */
+void deadline_set(uint64_t ns) {
+    deadline_ns = ns;
+}
+
+/**
+ * Push the current deadline back by `ns` nanoseconds.
+ */
+void deadline_extend(uint64_t ns) {
+    if (deadline_ns)
+        deadline_ns += ns;
+}
+
+/**
+ * Whether the current thread's deadline has passed.
+ */
+bool deadline_expired(void) {
+    return deadline_ns && trace_now_ns() >= deadline_ns;
+}
+
+/**
+ * Milliseconds left for an operation, clipped by the deadline.
+ */
+int timeout_remaining_ms(int op_ms) {
+    int ms = op_ms > 0 ? op_ms : -1;
+    if (deadline_ns) {
+        uint64_t now = trace_now_ns();
+        if (now >= deadline_ns)
+            return 0;
+        uint64_t left = (deadline_ns - now + 999999) / 1000000;
+        if (ms < 0 || left < (uint64_t)ms)
+            ms = (int)left;
+    }
+    return ms;
+}
+
+/**
+ * poll() a single descriptor within the operation timeout and deadline.
+ * Inside a coroutine the wait yields to the scheduler instead.
+ */
+int wait_fd(int fd, short events, int op_ms) {
+    struct pollfd pfd = { .fd = fd, .events = events };
+    for (;;) {
+        int ms = timeout_remaining_ms(op_ms);
+        if (ms == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        int r = coro_active() ? coro_poll(fd, events, ms)
+                              : poll(&pfd, 1, ms);
+        if (r > 0)
+            return 0;
+        if (r == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (errno != EINTR)
+            return -1;
+    }
+}
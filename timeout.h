@@ -0,0 +1,91 @@
+#ifndef TIMEOUT_H
+#define TIMEOUT_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file timeout.h
+ * @brief Per-operation timeouts and per-command deadlines.
+ *
+ * Every socket operation waits with poll() for at most its own timeout
+ * (connect or I/O), further clipped by the deadline of the command being
+ * executed. The deadline is thread-local, so all sub-requests issued by a
+ * command share it; worker threads inherit it explicitly.
+ */
+
+#define TIMEOUT_CONNECT_MS  5000    /**< Default connect timeout */
+#define TIMEOUT_IO_MS       15000   /**< Default read/write inactivity timeout */
+#define TIMEOUT_COMMAND_MS  60000   /**< Default whole-command deadline */
+
+/** Tunable timeouts in milliseconds (0 disables the limit). */
+struct timeout_policy {
+    int connect_ms;
+    int io_ms;
+    int command_ms;
+};
+
+extern struct timeout_policy timeout_policy;
+
+/**
+ * Start the deadline of the current thread's command, command_ms from now.
+ * A zero command_ms clears the deadline.
+ *
+ * @param ms  Milliseconds until the deadline.
+ */
+void deadline_start(int ms);
+
+/**
+ * Remove the current thread's deadline.
+ */
+void deadline_clear(void);
+
+/**
+ * Deadline of the current thread (CLOCK_MONOTONIC ns), 0 if none.
+ * Used to hand the deadline over to worker threads.
+ */
+uint64_t deadline_get(void);
+
+/**
+ * Install a deadline obtained from deadline_get() in the current thread.
+ *
+ * @param deadline_ns  Absolute deadline, or 0 for none.
+ */
+void deadline_set(uint64_t deadline_ns);
+
+/**
+ * Push the current deadline back, e.g. by the time spent waiting for
+ * user input, which should not count against the command.
+ *
+ * @param ns  Nanoseconds to add (ignored when no deadline is set).
+ */
+void deadline_extend(uint64_t ns);
+
+/**
+ * Whether the current thread's deadline has passed.
+ */
+bool deadline_expired(void);
+
+/**
+ * Milliseconds left for an operation limited to op_ms, clipped by the
+ * current deadline.
+ *
+ * @param op_ms  Operation timeout (0 = unlimited).
+ * @return       Remaining milliseconds, 0 if already expired,
+ *               -1 if neither limit applies.
+ */
+int timeout_remaining_ms(int op_ms);
+
+/**
+ * Wait until fd is ready for the given poll events, within op_ms and the
+ * current deadline.
+ *
+ * @param fd      File descriptor.
+ * @param events  POLLIN and/or POLLOUT.
+ * @param op_ms   Operation timeout (0 = unlimited).
+ * @return        0 when ready, -1 with errno set (ETIMEDOUT on timeout).
+ */
+int wait_fd(int fd, short events, int op_ms);
+
+#endif // TIMEOUT_H
@@ -0,0 +1,272 @@
+// 324CC Stefan CALMAC
+#define _GNU_SOURCE
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define TRACE_RING_SZ   4096                 /* must be a power of two */
+#define TRACE_RING_MASK (TRACE_RING_SZ - 1)
+#define TRACE_IDLE_NS   2000000L             /* flusher sleep when ring is empty */
+
+/* One ring slot: the sequence number tells producers and the consumer
+ * whose turn it is (bounded MPMC queue, Vyukov style). */
+struct trace_slot {
+    atomic_size_t     seq;
+    struct trace_span span;
+};
+
+volatile int trace_active = 0;
+
+static struct trace_slot ring[TRACE_RING_SZ];
+static atomic_size_t     enq_pos;
+static atomic_size_t     deq_pos;
+static atomic_size_t     dropped;
+
+static FILE      *trace_out    = NULL;
+static int        trace_format = TRACE_FMT_CHROME;
+static int        trace_first  = 1;
+static uint64_t   trace_base   = 0;
+static pthread_t  flusher;
+static atomic_int flusher_run;
+
+static __thread uint32_t cached_tid = 0;
+
+/**
+ * Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Write a JSON string literal (with quotes) to the trace file.
+ */
+static void put_json_str(const char *s) {
+    fputc('"', trace_out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', trace_out);
+            fputc(c, trace_out);
+        } else if (c < 0x20) {
+            fprintf(trace_out, "\\u%04x", c);
+        } else {
+            fputc(c, trace_out);
+        }
+    }
+    fputc('"', trace_out);
+}
+
+/**
+ * Format one span in the configured output format.
+ */
+static void write_span(const struct trace_span *sp) {
+    double ts  = (double)(sp->start_ns - trace_base) / 1000.0;
+    double dur = (double)sp->dur_ns / 1000.0;
+    bool   req = sp->kind == TRACE_KIND_REQ;
+
+    if (trace_format == TRACE_FMT_CHROME) {
+        if (!trace_first)
+            fputs(",\n", trace_out);
+        trace_first = 0;
+
+        char name[TRACE_NAME_SZ + TRACE_ROUTE_SZ + 2];
+        if (req)
+            snprintf(name, sizeof(name), "%s %s", sp->name, sp->route);
+        else
+            snprintf(name, sizeof(name), "%s", sp->name);
+
+        fputs("{\"name\":", trace_out);
+        put_json_str(name);
+        fprintf(trace_out,
+                ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":%d,\"tid\":%u,\"args\":{",
+                req ? "request" : "command", ts, dur, (int)getpid(), sp->tid);
+    } else {
+        fprintf(trace_out, "{\"kind\":\"%s\",\"name\":",
+                req ? "request" : "command");
+        put_json_str(sp->name);
+        if (req) {
+            fputs(",\"route\":", trace_out);
+            put_json_str(sp->route);
+        }
+        fprintf(trace_out, ",\"tid\":%u,\"start_us\":%.3f,\"dur_us\":%.3f,",
+                sp->tid, ts, dur);
+    }
+
+    if (req) {
+        fprintf(trace_out,
+                "\"status\":%d,\"bytes_out\":%zu,\"bytes_in\":%zu,"
+                "\"write_us\":%.3f,\"wait_us\":%.3f,\"read_us\":%.3f,"
+                "\"reused\":%s",
+                sp->status, sp->bytes_out, sp->bytes_in,
+                sp->write_ns / 1000.0, sp->wait_ns / 1000.0,
+                sp->read_ns / 1000.0, sp->reused ? "true" : "false");
+    } else {
+        fprintf(trace_out, "\"ret\":%d", sp->status);
+    }
+
+    fputs(trace_format == TRACE_FMT_CHROME ? "}}" : "}\n", trace_out);
+}
+
+/**
+ * Pop one span from the ring (single consumer).
+ *
+ * @return  1 if a span was copied into *out, 0 if the ring is empty.
+ */
+static int ring_pop(struct trace_span *out) {
+    size_t pos = atomic_load_explicit(&deq_pos, memory_order_relaxed);
+    struct trace_slot *slot = &ring[pos & TRACE_RING_MASK];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq != pos + 1)
+        return 0;
+
+    *out = slot->span;
+    atomic_store_explicit(&deq_pos, pos + 1, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, pos + TRACE_RING_SZ,
+                          memory_order_release);
+    return 1;
+}
+
+/**
+ * Write out everything currently queued. Returns the number of spans.
+ */
+static size_t drain(void) {
+    struct trace_span sp;
+    size_t n = 0;
+    while (ring_pop(&sp)) {
+        write_span(&sp);
+        n++;
+    }
+    if (n)
+        fflush(trace_out);
+    return n;
+}
+
+/**
+ * Background flusher: drains the ring, sleeping briefly when it is empty.
+ */
+static void *flusher_main(void *arg) {
+    (void)arg;
+    struct timespec idle = { 0, TRACE_IDLE_NS };
+    while (atomic_load(&flusher_run)) {
+        if (drain() == 0)
+            nanosleep(&idle, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * Open the trace output file and start the background flusher thread.
+ */
+int trace_init(const char *path, int format) {
+    trace_out = fopen(path, "w");
+    if (!trace_out) {
+        perror("trace: fopen");
+        return -1;
+    }
+
+    for (size_t i = 0; i < TRACE_RING_SZ; i++)
+        atomic_init(&ring[i].seq, i);
+    atomic_init(&enq_pos, 0);
+    atomic_init(&deq_pos, 0);
+    atomic_init(&dropped, 0);
+
+    trace_format = format;
+    trace_first  = 1;
+    trace_base   = trace_now_ns();
+    if (trace_format == TRACE_FMT_CHROME)
+        fputs("{\"traceEvents\":[\n", trace_out);
+
+    atomic_store(&flusher_run, 1);
+    if (pthread_create(&flusher, NULL, flusher_main, NULL) != 0) {
+        fprintf(stderr, "trace: unable to start flusher thread\n");
+        fclose(trace_out);
+        trace_out = NULL;
+        return -1;
+    }
+
+    trace_active = 1;
+    return 0;
+}
+
+/**
+ * Stop the flusher, drain pending spans and close the output file.
+ */
+void trace_shutdown(void) {
+    if (!trace_active)
+        return;
+    trace_active = 0;
+
+    atomic_store(&flusher_run, 0);
+    pthread_join(flusher, NULL);
+    drain();
+
+    if (trace_format == TRACE_FMT_CHROME)
+        fputs("\n]}\n", trace_out);
+    fclose(trace_out);
+    trace_out = NULL;
+
+    size_t lost = atomic_load(&dropped);
+    if (lost)
+        fprintf(stderr, "trace: %zu spans dropped (ring full)\n", lost);
+}
+
+/**
+ * Record a span without blocking; drops it if the ring is full.
+ */
+void trace_record(struct trace_span *span) {
+    if (!trace_active)
+        return;
+
+    if (cached_tid == 0)
+        cached_tid = (uint32_t)syscall(SYS_gettid);
+    span->tid = cached_tid;
+
+    size_t pos = atomic_load_explicit(&enq_pos, memory_order_relaxed);
+    struct trace_slot *slot;
+    for (;;) {
+        slot = &ring[pos & TRACE_RING_MASK];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enq_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&enq_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->span = *span;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+/**
+ * Record a span covering one dispatched command.
+ */
+void trace_command(const char *cmd, uint64_t start_ns, int ret) {
+    if (!trace_active)
+        return;
+
+    struct trace_span sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.kind     = TRACE_KIND_CMD;
+    sp.start_ns = start_ns;
+    sp.dur_ns   = trace_now_ns() - start_ns;
+    sp.status   = ret;
+    snprintf(sp.name, sizeof(sp.name), "%s", cmd);
+    trace_record(&sp);
+}
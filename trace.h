@@ -0,0 +1,84 @@
+#ifndef TRACE_H
+#define TRACE_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file trace.h
+ * @brief Opt-in span tracer for commands and HTTP requests.
+ *
+ * Spans are pushed into a fixed-size lock-free ring buffer on the hot path
+ * and written out by a background thread, either as Chrome trace-event JSON
+ * (loadable in chrome://tracing / Perfetto) or as one JSON object per line.
+ */
+
+#define TRACE_FMT_CHROME 0   /**< {"traceEvents":[...]} document */
+#define TRACE_FMT_JSONL  1   /**< One span object per line */
+
+#define TRACE_KIND_CMD   0   /**< Span covering a whole dispatched command */
+#define TRACE_KIND_REQ   1   /**< Span covering one HTTP request/response */
+
+#define TRACE_NAME_SZ    32
+#define TRACE_ROUTE_SZ   128
+
+/** A single recorded span. Fixed size so recording never allocates. */
+struct trace_span {
+    int      kind;                     /**< TRACE_KIND_CMD or TRACE_KIND_REQ */
+    char     name[TRACE_NAME_SZ];      /**< Command name or HTTP method */
+    char     route[TRACE_ROUTE_SZ];    /**< Request path (requests only) */
+    uint32_t tid;                      /**< Recording thread id */
+    uint64_t start_ns;                 /**< Monotonic start timestamp */
+    uint64_t dur_ns;                   /**< Total duration */
+    int      status;                   /**< HTTP status or handler return code */
+    size_t   bytes_out;                /**< Bytes written to the socket */
+    size_t   bytes_in;                 /**< Bytes read from the socket */
+    uint64_t write_ns;                 /**< Time spent sending the request */
+    uint64_t wait_ns;                  /**< Time to first response byte */
+    uint64_t read_ns;                  /**< Time spent reading the rest */
+    bool     reused;                   /**< Whether the connection was reused */
+};
+
+/** Non-zero while a trace sink is active; checked inline on the hot path. */
+extern volatile int trace_active;
+
+/**
+ * Open the trace output file and start the background flusher thread.
+ *
+ * @param path    Output file path.
+ * @param format  TRACE_FMT_CHROME or TRACE_FMT_JSONL.
+ * @return        0 on success, -1 if the file or thread could not be created.
+ */
+int trace_init(const char *path, int format);
+
+/**
+ * Stop the flusher, drain any pending spans and close the output file.
+ * Safe to call when tracing was never enabled.
+ */
+void trace_shutdown(void);
+
+/**
+ * Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t trace_now_ns(void);
+
+/**
+ * Record a span. The span is copied into the ring buffer; if the buffer is
+ * full the span is dropped and counted rather than blocking the caller.
+ *
+ * @param span  Filled-in span (tid is set by the tracer).
+ */
+void trace_record(struct trace_span *span);
+
+/**
+ * Convenience wrapper recording a command span.
+ *
+ * @param cmd       Command name.
+ * @param start_ns  Start timestamp from trace_now_ns().
+ * @param ret       Handler return code.
+ */
+void trace_command(const char *cmd, uint64_t start_ns, int ret);
+
+#endif // TRACE_H
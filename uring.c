@@ -0,0 +1,431 @@
+// 324CC Stefan CALMAC
+#define _GNU_SOURCE
+#include "uring.h"
+#include "stats.h"
+#include "timeout.h"
+#include "coro.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+bool uring_enabled = false;
+
+/* 0 = not tried yet, 1 = works, -1 = unsupported (use poll) */
+static atomic_int uring_state;
+
+/* One ring per thread, mapped from the kernel's ring fd */
+struct ring {
+    int                  fd;
+    unsigned            *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned            *cq_head, *cq_tail, *cq_mask;
+    unsigned             sq_entries;
+    unsigned             tail;      /* local SQ tail, published on submit */
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void                *sq_map, *cq_map;
+    size_t               sq_map_sz, cq_map_sz, sqes_sz;
+    char                *recv_buf;  /* registered buffer, NULL if not registered */
+};
+
+static __thread struct ring *tls_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/* Operations a request needs; all must be supported */
+static const uint8_t needed_ops[] = {
+    IORING_OP_CONNECT, IORING_OP_SENDMSG, IORING_OP_RECV,
+    IORING_OP_READ_FIXED, IORING_OP_LINK_TIMEOUT,
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+static void ring_close(struct ring *r) {
+    if (r->sqes)
+        munmap(r->sqes, r->sqes_sz);
+    if (r->cq_map && r->cq_map != r->sq_map)
+        munmap(r->cq_map, r->cq_map_sz);
+    if (r->sq_map)
+        munmap(r->sq_map, r->sq_map_sz);
+    if (r->fd >= 0)
+        close(r->fd);
+    free(r->recv_buf);
+    free(r);
+}
+
+static void ring_destroy(void *arg) {
+    ring_close(arg);
+}
+
+static void ring_key_create(void) {
+    pthread_key_create(&ring_key, ring_destroy);
+}
+
+/**
+ * Check that the kernel implements every operation we submit.
+ */
+static int probe_ops(int fd) {
+    size_t sz = sizeof(struct io_uring_probe) +
+                256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, sz);
+    if (!probe)
+        return -1;
+    int r = sys_register(fd, IORING_REGISTER_PROBE, probe, 256);
+    if (r == 0) {
+        for (size_t i = 0; i < sizeof(needed_ops); i++) {
+            uint8_t op = needed_ops[i];
+            if (op > probe->last_op ||
+                !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                errno = EOPNOTSUPP;
+                r = -1;
+                break;
+            }
+        }
+    }
+    free(probe);
+    return r;
+}
+
+/**
+ * Create the ring, map its queues and register the receive buffer.
+ *
+ * @return  The ring, or NULL with errno set.
+ */
+static struct ring *ring_open(void) {
+    struct ring *r = calloc(1, sizeof(*r));
+    if (!r)
+        return NULL;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = sys_setup(URING_ENTRIES, &p);
+    if (r->fd < 0 || probe_ops(r->fd) < 0)
+        goto fail;
+
+    r->sq_map_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_sz > r->sq_map_sz)
+            r->sq_map_sz = r->cq_map_sz;
+        r->cq_map_sz = r->sq_map_sz;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_sz, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        r->sq_map = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_map = r->sq_map;
+    } else {
+        r->cq_map = mmap(NULL, r->cq_map_sz, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) {
+            r->cq_map = NULL;
+            goto fail;
+        }
+    }
+    r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        goto fail;
+    }
+
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_head    = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail    = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask    = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array   = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head    = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail    = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask    = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes       = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sq_entries = p.sq_entries;
+    r->tail       = *r->sq_tail;
+
+    /* A registered buffer is pinned once instead of on every read; if
+     * RLIMIT_MEMLOCK refuses it, reads go to the caller's buffer instead */
+    if (posix_memalign((void **)&r->recv_buf, 4096, URING_RECV_SZ) == 0) {
+        struct iovec iov = { r->recv_buf, URING_RECV_SZ };
+        if (sys_register(r->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+            free(r->recv_buf);
+            r->recv_buf = NULL;
+        }
+    } else {
+        r->recv_buf = NULL;
+    }
+    return r;
+
+fail:;
+    int err = errno;
+    ring_close(r);
+    errno = err;
+    return NULL;
+}
+
+bool uring_active(void) {
+    /* A submission blocks the whole thread, which coroutines share */
+    if (!uring_enabled || coro_active())
+        return false;
+    if (tls_ring)
+        return true;
+    if (atomic_load(&uring_state) < 0)
+        return false;
+
+    struct ring *r = ring_open();
+    if (!r) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&uring_state, &expected, -1))
+            fprintf(stderr, "io_uring unavailable (%s), using poll\n",
+                    strerror(errno));
+        atomic_store(&uring_state, -1);
+        return false;
+    }
+    atomic_store(&uring_state, 1);
+    pthread_once(&ring_key_once, ring_key_create);
+    pthread_setspecific(ring_key, r);
+    tls_ring = r;
+    return true;
+}
+
+/* Next free SQE, zeroed; tagged with its position in the chain */
+static struct io_uring_sqe *ring_sqe(struct ring *r, unsigned n, int op,
+                                     int fd) {
+    unsigned idx = r->tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = (uint8_t)op;
+    sqe->fd        = fd;
+    sqe->user_data = n;
+    r->sq_array[idx] = idx;
+    r->tail++;
+    return sqe;
+}
+
+/* Link a timeout of ms to the previous SQE (ts must outlive the submit) */
+static void ring_link_timeout(struct ring *r, unsigned n,
+                              struct io_uring_sqe *prev,
+                              struct __kernel_timespec *ts, int ms) {
+    ts->tv_sec  = ms / 1000;
+    ts->tv_nsec = (long long)(ms % 1000) * 1000000;
+    prev->flags |= IOSQE_IO_LINK;
+    struct io_uring_sqe *sqe = ring_sqe(r, n, IORING_OP_LINK_TIMEOUT, -1);
+    sqe->addr = (uintptr_t)ts;
+    sqe->len  = 1;
+}
+
+/**
+ * Submit the n queued SQEs and wait for their n completions.
+ *
+ * @param res  Out: result of SQE i (user_data i) in res[i].
+ * @return     0, or -1 with errno set if the ring itself failed.
+ */
+static int ring_run(struct ring *r, unsigned n, int *res) {
+    __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+
+    unsigned submit = n, got = 0;
+    while (got < n) {
+        int ret = sys_enter(r->fd, submit, n - got, IORING_ENTER_GETEVENTS);
+        STATS_ADD(uring_enters, 1);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            return -1;
+        }
+        submit -= (unsigned)ret < submit ? (unsigned)ret : submit;
+
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            if (cqe->user_data < n)
+                res[cqe->user_data] = cqe->res;
+            got++;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/* Result of an operation that may have been cut by its linked timeout */
+static int op_result(int res, int timeout_res) {
+    if (res >= 0)
+        return res;
+    errno = (res == -ECANCELED && timeout_res == -ETIME) ? ETIMEDOUT : -res;
+    return -1;
+}
+
+int uring_connect(int fd, const struct sockaddr *addr, socklen_t len,
+                  int op_ms) {
+    struct ring *r = tls_ring;
+    int ms = timeout_remaining_ms(op_ms);
+    if (ms == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    struct __kernel_timespec ts;
+    int res[2] = { 0, 0 };
+    struct io_uring_sqe *sqe = ring_sqe(r, 0, IORING_OP_CONNECT, fd);
+    sqe->addr = (uintptr_t)addr;
+    sqe->off  = len;
+    if (ms > 0)
+        ring_link_timeout(r, 1, sqe, &ts, ms);
+    if (ring_run(r, ms > 0 ? 2 : 1, res) < 0)
+        return -1;
+    return op_result(res[0], res[1]) < 0 ? -1 : 0;
+}
+
+ssize_t uring_sendmsg(int fd, const struct msghdr *msg, int op_ms) {
+    struct ring *r = tls_ring;
+    int ms = timeout_remaining_ms(op_ms);
+    if (ms == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    struct __kernel_timespec ts;
+    int res[2] = { 0, 0 };
+    struct io_uring_sqe *sqe = ring_sqe(r, 0, IORING_OP_SENDMSG, fd);
+    sqe->addr      = (uintptr_t)msg;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    if (ms > 0)
+        ring_link_timeout(r, 1, sqe, &ts, ms);
+    if (ring_run(r, ms > 0 ? 2 : 1, res) < 0)
+        return -1;
+    return op_result(res[0], res[1]);
+}
+
+/* Queue a read of at most len bytes: into the registered buffer if any */
+static struct io_uring_sqe *queue_read(struct ring *r, unsigned n, int fd,
+                                       void *buf, size_t *len) {
+    struct io_uring_sqe *sqe;
+    if (r->recv_buf) {
+        if (*len > URING_RECV_SZ)
+            *len = URING_RECV_SZ;
+        sqe = ring_sqe(r, n, IORING_OP_READ_FIXED, fd);
+        sqe->addr      = (uintptr_t)r->recv_buf;
+        sqe->buf_index = 0;
+    } else {
+        sqe = ring_sqe(r, n, IORING_OP_RECV, fd);
+        sqe->addr = (uintptr_t)buf;
+    }
+    sqe->len = (uint32_t)*len;
+    return sqe;
+}
+
+/* Move what a read left in the registered buffer to the caller */
+static void finish_read(struct ring *r, void *buf, int n) {
+    if (r->recv_buf && n > 0)
+        memcpy(buf, r->recv_buf, (size_t)n);
+}
+
+ssize_t uring_read(int fd, void *buf, size_t len, int op_ms) {
+    struct ring *r = tls_ring;
+    int ms = timeout_remaining_ms(op_ms);
+    if (ms == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    struct __kernel_timespec ts;
+    int res[2] = { 0, 0 };
+    struct io_uring_sqe *sqe = queue_read(r, 0, fd, buf, &len);
+    if (ms > 0)
+        ring_link_timeout(r, 1, sqe, &ts, ms);
+    if (ring_run(r, ms > 0 ? 2 : 1, res) < 0)
+        return -1;
+    int n = op_result(res[0], res[1]);
+    finish_read(r, buf, n);
+    return n;
+}
+
+ssize_t uring_send_read(int fd, const struct iovec *iov, int iovcnt,
+                        void *buf, size_t len, int op_ms, bool *send_failed) {
+    struct ring *r = tls_ring;
+    *send_failed = false;
+    int ms = timeout_remaining_ms(op_ms);
+    if (ms == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    struct iovec vec[URING_MAX_IOV];
+    memcpy(vec, iov, iovcnt * sizeof(*iov));
+    struct msghdr msg = { .msg_iov = vec, .msg_iovlen = iovcnt };
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+        total += iov[i].iov_len;
+
+    /* The send must not block, or the read and its timeout would never
+     * start. MSG_WAITALL makes a short send fail the link, so the read is
+     * cancelled instead of waiting for a response to a partial request */
+    struct __kernel_timespec ts;
+    int res[3] = { 0, 0, 0 };
+    struct io_uring_sqe *sqe = ring_sqe(r, 0, IORING_OP_SENDMSG, fd);
+    sqe->addr      = (uintptr_t)&msg;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT | MSG_WAITALL;
+    sqe->flags     = IOSQE_IO_LINK;
+    size_t rlen = len;
+    sqe = queue_read(r, 1, fd, buf, &rlen);
+    if (ms > 0)
+        ring_link_timeout(r, 2, sqe, &ts, ms);
+    if (ring_run(r, ms > 0 ? 3 : 2, res) < 0)
+        return -1;
+
+    if (res[0] < 0 && res[0] != -EAGAIN) {
+        *send_failed = true;
+        errno = -res[0];
+        return -1;
+    }
+    size_t sent = res[0] > 0 ? (size_t)res[0] : 0;
+    if (sent == total) {
+        int n = op_result(res[1], res[2]);
+        finish_read(r, buf, n);
+        return n;
+    }
+
+    /* Short send: the read was cancelled; finish sending, then read */
+    while (sent < total) {
+        size_t skip = sent;
+        msg.msg_iov = vec;
+        msg.msg_iovlen = iovcnt;
+        memcpy(vec, iov, iovcnt * sizeof(*iov));
+        while (skip >= msg.msg_iov->iov_len) {
+            skip -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + skip;
+        msg.msg_iov->iov_len -= skip;
+
+        ssize_t n = uring_sendmsg(fd, &msg, op_ms);
+        if (n < 0) {
+            *send_failed = true;
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    return uring_read(fd, buf, len, op_ms);
+}
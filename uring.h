@@ -0,0 +1,83 @@
+#ifndef URING_H
+#define URING_H
+// 324CC Stefan CALMAC
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * @file uring.h
+ * @brief Optional io_uring transport for connect, send and receive.
+ *
+ * Enabled with --io-uring. Each thread that does network I/O gets its own
+ * small ring, set up with the raw io_uring syscalls (no liburing) the first
+ * time it is needed, plus one registered receive buffer. Every operation is
+ * a single io_uring_enter() that submits the operation, linked to a
+ * timeout taken from the usual per-operation timeout and command deadline,
+ * and waits for it: no poll() before each read or write, and no fcntl()
+ * around connect. A request and the first read of its response go in one
+ * linked chain (send, then receive), so a small request/response exchange
+ * costs one syscall until the response outgrows the first read.
+ *
+ * If the kernel lacks io_uring or one of the operations (or it is blocked,
+ * e.g. by seccomp), a note is printed once and every caller keeps using
+ * the poll() + read()/write() path.
+ */
+
+#define URING_ENTRIES  8             /**< Submission queue size per thread */
+#define URING_RECV_SZ  (64 * 1024)   /**< Registered receive buffer per thread */
+#define URING_MAX_IOV  4             /**< Segments accepted by uring_send_read() */
+
+/** Set by --io-uring. */
+extern bool uring_enabled;
+
+/**
+ * Whether the calling thread can use io_uring (sets up its ring on the
+ * first call).
+ *
+ * @return  false when disabled or unsupported: use the poll() path.
+ */
+bool uring_active(void);
+
+/**
+ * Connect a socket within the connect timeout and the command deadline.
+ *
+ * @return  0 on success, -1 with errno set (ETIMEDOUT on timeout).
+ */
+int uring_connect(int fd, const struct sockaddr *addr, socklen_t len,
+                  int op_ms);
+
+/**
+ * Send part of a message (MSG_NOSIGNAL) within the I/O timeout.
+ *
+ * @return  Bytes sent, or -1 with errno set.
+ */
+ssize_t uring_sendmsg(int fd, const struct msghdr *msg, int op_ms);
+
+/**
+ * Read at most len bytes within the I/O timeout.
+ *
+ * @return  Bytes read (0 at end of stream), or -1 with errno set.
+ */
+ssize_t uring_read(int fd, void *buf, size_t len, int op_ms);
+
+/**
+ * Send a whole request and read the start of the response, as one linked
+ * chain when the request fits in the socket buffer.
+ *
+ * @param fd           Connected socket.
+ * @param iov          Request segments.
+ * @param iovcnt       Number of segments (at most URING_MAX_IOV).
+ * @param buf          Receive buffer.
+ * @param len          Its size.
+ * @param op_ms        I/O timeout.
+ * @param send_failed  Out: set when the error happened while sending.
+ * @return             Bytes read, or -1 with errno set.
+ */
+ssize_t uring_send_read(int fd, const struct iovec *iov, int iovcnt,
+                        void *buf, size_t len, int op_ms, bool *send_failed);
+
+#endif // URING_H